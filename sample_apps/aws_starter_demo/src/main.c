@@ -28,9 +28,13 @@
 #include <wmsdk.h>
 #include <led_indicator.h>
 #include <board.h>
+#include <flash.h>
 #include <push_button.h>
 #include <aws_iot_mqtt_interface.h>
+#include <aws_iot_mqtt_io_task.h>
 #include <aws_iot_shadow_interface.h>
+#include <aws_iot_shadow_reported.h>
+#include <aws_iot_shadow_snapshot.h>
 #include <aws_utils.h>
 /* configuration parameters */
 #include <aws_iot_config.h>
@@ -65,11 +69,8 @@ enum state {
 
 /* These hold each pushbutton's count, updated in the callback ISR */
 static volatile uint32_t pushbutton_a_count;
-static volatile uint32_t pushbutton_a_count_prev = -1;
 static volatile uint32_t pushbutton_b_count;
-static volatile uint32_t pushbutton_b_count_prev = -1;
 static volatile uint32_t led_1_state;
-static volatile uint32_t led_1_state_prev = -1;
 
 static output_gpio_cfg_t led_1;
 static MQTTClient_t mqtt_client;
@@ -94,6 +95,24 @@ static char url[128];
 #define VAR_BUTTON_B_PROPERTY   "pb_lambda"
 #define RESET_TO_FACTORY_TIMEOUT 5000
 #define BUFSIZE                  512
+/* pushbuttons and led, plus one for each sensor event */
+#define MAX_REPORTED_FIELDS      16
+/* a sensor reading is reported at most once in this interval */
+#define SENSOR_REPORT_INTERVAL_MS 5000
+
+/* Define to the flash address of a sector set aside for the shadow snapshot,
+ * the LED then takes its last state at boot without waiting for the cloud */
+/* #define SHADOW_SNAPSHOT_FLASH_START 0x1ff000 */
+#define SHADOW_SNAPSHOT_SECTOR_SIZE 4096
+
+#ifdef SHADOW_SNAPSHOT_FLASH_START
+static ShadowSnapshotStore_t snapshot_store;
+#endif /* SHADOW_SNAPSHOT_FLASH_START */
+
+/* last state accepted by the shadow, only changes to it are published */
+static ShadowReportedField_t reported_fields[MAX_REPORTED_FIELDS];
+static ShadowReportedCache_t reported_cache;
+static char reported_buf[BUFSIZE];
 
 /* callback function invoked on reset to factory */
 static void device_reset_to_factory_cb()
@@ -121,15 +140,13 @@ static void configure_reset_to_factory()
 /* callback function invoked when pushbutton_a is pressed */
 static void pushbutton_a_cb()
 {
-	if (pushbutton_a_count_prev == pushbutton_a_count)
-		pushbutton_a_count++;
+	pushbutton_a_count++;
 }
 
 /* callback function invoked when pushbutton_b is pressed */
 static void pushbutton_b_cb()
 {
-	if (pushbutton_b_count_prev == pushbutton_b_count)
-		pushbutton_b_count++;
+	pushbutton_b_count++;
 }
 
 /* Configure led and pushbuttons with callback functions */
@@ -226,11 +243,11 @@ void shadow_update_status_cb(const char *pThingName, ShadowActions_t action,
 	}
 }
 
-/* shadow yield thread which periodically checks for data */
+/* shadow yield thread which periodically expires pending shadow actions,
+ * incoming data is handled by the MQTT I/O task as soon as it arrives */
 static void aws_shadow_yield(os_thread_arg_t data)
 {
 	while (1) {
-		/* periodically check if any data is received on socket */
 		aws_iot_shadow_yield(&mqtt_client, 500);
 	}
 }
@@ -276,59 +293,85 @@ void led_indicator_cb(const char *p_json_string,
 	}
 }
 
-/* Publish thing state to shadow */
-int aws_publish_property_state(ShadowParameters_t *sp)
+static void add_reported_field(int *count, const char *key,
+			       JsonPrimitiveType type, void *data,
+			       uint32_t min_interval_ms)
 {
-	char buf_out[BUFSIZE];
-	char state[BUFSIZE];
-	char *ptr = state;
-	int ret = WM_SUCCESS;
+	ShadowReportedField_t *field;
+
+	if (*count >= MAX_REPORTED_FIELDS) {
+		wmprintf("No room to report %s\r\n", key);
+		return;
+	}
+	field = &reported_fields[(*count)++];
+	field->pKey = key;
+	field->pData = data;
+	field->type = type;
+	field->deadband = 0;
+	field->minIntervalMs = min_interval_ms;
+}
 
-	memset(state, 0, BUFSIZE);
+/* Register the properties of the thing with the reported state cache */
+static int aws_reported_state_init()
+{
+	int count = 0;
+#ifdef SENSORS_SUPPORTED
+	struct sensor_info *sevent = NULL;
+#endif /* SENSORS_SUPPORTED */
 
+	add_reported_field(&count, VAR_BUTTON_A_PROPERTY, SHADOW_JSON_UINT32,
+			   (void *)&pushbutton_a_count, 0);
+	add_reported_field(&count, VAR_BUTTON_B_PROPERTY, SHADOW_JSON_UINT32,
+			   (void *)&pushbutton_b_count, 0);
+	add_reported_field(&count, VAR_LED_1_PROPERTY, SHADOW_JSON_UINT32,
+			   (void *)&led_1_state, 0);
 #ifdef SENSORS_SUPPORTED
-	/* Construct JSON object for sensor events */
-	sensor_msg_construct(state, buf_out, BUFSIZE);
+	/* sensor events hold their reading as JSON text */
+	while ((sevent = sensor_event_next(sevent)) != NULL)
+		add_reported_field(&count, sevent->property,
+				   SHADOW_JSON_OBJECT,
+				   sevent->event_curr_value,
+				   SENSOR_REPORT_INTERVAL_MS);
 #endif /* SENSORS_SUPPORTED */
-	if (pushbutton_a_count_prev != pushbutton_a_count) {
-		snprintf(buf_out, BUFSIZE, ",\"%s\":%d", VAR_BUTTON_A_PROPERTY,
-			 pushbutton_a_count);
-		strcat(state, buf_out);
-		pushbutton_a_count_prev = pushbutton_a_count;
-	}
-	if (pushbutton_b_count_prev != pushbutton_b_count) {
-		snprintf(buf_out, BUFSIZE, ",\"%s\":%d", VAR_BUTTON_B_PROPERTY,
-			 pushbutton_b_count);
-		strcat(state, buf_out);
-		pushbutton_b_count_prev = pushbutton_b_count;
-	}
-	/* On receiving led state change notification from cloud, change
-	 * the state of the led on the board in callback function and
-	 * publish updated state on configured topic.
-	 */
-	if (led_1_state_prev != led_1_state) {
-		snprintf(buf_out, BUFSIZE, ",\"%s\":%d", VAR_LED_1_PROPERTY,
-			 led_1_state);
-		strcat(state, buf_out);
-		led_1_state_prev = led_1_state;
-	}
 
-	if (*ptr == ',')
-		ptr++;
-	if (strlen(state)) {
-		snprintf(buf_out, BUFSIZE, "{\"state\": {\"reported\":{%s}}}",
-			 ptr);
-		wmprintf("Publishing '%s' to AWS\r\n", buf_out);
-
-		/* publish incremented value on pushbutton press on
-		 * configured thing */
-		ret = aws_iot_shadow_update(&mqtt_client,
-					    sp->pMyThingName,
-					    buf_out,
-					    shadow_update_status_cb,
-					    NULL,
-					    10, true);
-	}
+	return aws_iot_shadow_reported_init(&reported_cache, reported_fields,
+					    count);
+}
+
+#ifdef SHADOW_SNAPSHOT_FLASH_START
+/* Keep the last shadow state received in flash */
+static int aws_shadow_snapshot_init()
+{
+	mdev_t *fl_dev;
+
+	fl_dev = flash_drv_open(FL_INT);
+	if (fl_dev == NULL)
+		return -WM_FAIL;
+	if (aws_iot_shadow_snapshot_flash_init(&snapshot_store, fl_dev,
+					       SHADOW_SNAPSHOT_FLASH_START,
+					       SHADOW_SNAPSHOT_SECTOR_SIZE)
+	    != NONE_ERROR)
+		return -WM_FAIL;
+	aws_iot_shadow_set_snapshot_store(&snapshot_store);
+	return WM_SUCCESS;
+}
+#endif /* SHADOW_SNAPSHOT_FLASH_START */
+
+/* Publish the changed thing state to shadow */
+int aws_publish_property_state(ShadowParameters_t *sp)
+{
+	int ret;
+
+	ret = aws_iot_shadow_reported_update(&mqtt_client,
+					     sp->pMyThingName,
+					     &reported_cache,
+					     reported_buf, sizeof(reported_buf),
+					     shadow_update_status_cb,
+					     NULL,
+					     10);
+	/* the previous update is still waiting for its response */
+	if (ret == WAIT_FOR_PUBLISH)
+		return WM_SUCCESS;
 	return ret;
 }
 
@@ -339,7 +382,13 @@ static void aws_starter_demo(os_thread_arg_t data)
 	jsonStruct_t led_indicator;
 	ShadowParameters_t sp;
 
-	aws_iot_mqtt_init(&mqtt_client);
+	/* the MQTT client is used from this thread, the shadow yield thread
+	 * and the wlan event handlers, let a dedicated task own it */
+	ret = aws_iot_mqtt_io_init(&mqtt_client);
+	if (ret != WM_SUCCESS) {
+		wmprintf("aws mqtt io task start failed : %d\r\n", ret);
+		goto out;
+	}
 
 	ret = aws_starter_load_configuration(&sp);
 	if (ret != WM_SUCCESS) {
@@ -347,12 +396,30 @@ static void aws_starter_demo(os_thread_arg_t data)
 		goto out;
 	}
 
+#ifdef SHADOW_SNAPSHOT_FLASH_START
+	ret = aws_shadow_snapshot_init();
+	if (ret != WM_SUCCESS)
+		wmprintf("aws shadow snapshot not kept : %d\r\n", ret);
+#endif /* SHADOW_SNAPSHOT_FLASH_START */
+
 	ret = aws_iot_shadow_init(&mqtt_client);
 	if (ret != WM_SUCCESS) {
 		wmprintf("aws shadow init failed : %d\r\n", ret);
 		goto out;
 	}
 
+	/* configures property of a thing */
+	led_indicator.cb = led_indicator_cb;
+	led_indicator.pData = &led_state;
+	led_indicator.pKey = "led";
+	led_indicator.type = SHADOW_JSON_INT8;
+
+#ifdef SHADOW_SNAPSHOT_FLASH_START
+	/* the LED takes its last known state before connecting */
+	if (aws_iot_shadow_snapshot_apply(&led_indicator) == NONE_ERROR)
+		wmprintf("LED state restored from snapshot\r\n");
+#endif /* SHADOW_SNAPSHOT_FLASH_START */
+
 	ret = aws_iot_shadow_connect(&mqtt_client, &sp);
 	if (ret != WM_SUCCESS) {
 		wmprintf("aws shadow connect failed : %d\r\n", ret);
@@ -363,12 +430,6 @@ static void aws_starter_demo(os_thread_arg_t data)
 	led_on(board_led_2());
 	wmprintf("Cloud Started\r\n");
 
-	/* configures property of a thing */
-	led_indicator.cb = led_indicator_cb;
-	led_indicator.pData = &led_state;
-	led_indicator.pKey = "led";
-	led_indicator.type = SHADOW_JSON_INT8;
-
 	/* subscribes to delta topic of the configured thing */
 	ret = aws_iot_shadow_register_delta(&mqtt_client, &led_indicator);
 	if (ret != WM_SUCCESS) {
@@ -376,6 +437,21 @@ static void aws_starter_demo(os_thread_arg_t data)
 		goto out;
 	}
 
+#ifdef SHADOW_SNAPSHOT_FLASH_START
+	/* the desired state may have changed while the device was off, the
+	 * get/accepted is passed to the registered properties */
+	ret = aws_iot_shadow_get(&mqtt_client, sp.pMyThingName, NULL, NULL,
+				 10, false);
+	if (ret != WM_SUCCESS)
+		wmprintf("Failed to get shadow %d\r\n", ret);
+#endif /* SHADOW_SNAPSHOT_FLASH_START */
+
+	ret = aws_reported_state_init();
+	if (ret != WM_SUCCESS) {
+		wmprintf("Failed to set up reported state %d\r\n", ret);
+		goto out;
+	}
+
 	/* creates a thread which will wait for incoming messages, ensuring the
 	 * connection is kept alive with the AWS Service
 	 */
@@ -396,16 +472,16 @@ static void aws_starter_demo(os_thread_arg_t data)
 			}
 		}
 
+#ifdef SENSORS_SUPPORTED
+		/* Periodically scan the sensor inputs */
+		sensor_inputs_scan();
+#endif /* SENSORS_SUPPORTED */
+
 		ret = aws_publish_property_state(&sp);
 		if (ret != WM_SUCCESS)
 			wmprintf("Sending property failed\r\n");
 
 		os_thread_sleep(1000);
-
-#ifdef SENSORS_SUPPORTED
-		/* Periodically scan the sensor inputs */
-		sensor_inputs_scan();
-#endif /* SENSORS_SUPPORTED */
 	}
 
 	ret = aws_iot_shadow_disconnect(&mqtt_client);
@@ -34,17 +34,45 @@
 
 // MQTT PubSub
 #define AWS_IOT_MQTT_TX_BUF_LEN 512 ///< Any time a message is sent out through the MQTT layer. The message is copied into this buffer anytime a publish is done. This will also be used in the case of Thing Shadow
-#define AWS_IOT_MQTT_RX_BUF_LEN 512 ///< Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size the message will be dropped.
-#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters the MQTT client can handle at any given time. This should be increased appropriately when using Thing Shadow
+#define AWS_IOT_MQTT_RX_BUF_LEN 512 ///< Any message that comes into the device should be less than this buffer size. If a received message is bigger than this buffer size the message will be dropped unless AWS_IOT_MQTT_RX_CHUNK_LEN is set.
+#define AWS_IOT_MQTT_RX_CHUNK_LEN 256 ///< A received message bigger than the RX buffer is delivered to the subscribe callback in chunks of at most this size, see MQTTMessageParams::PayloadOffset. Set to 0 to drop such messages instead
+#define AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS 5 ///< Maximum number of topic filters the MQTT client can handle at any given time. This should be increased appropriately when using Thing Shadow. Must not exceed MAX_MESSAGE_HANDLERS the MQTT client is built with, topic lookup does not slow down as it grows
+#define AWS_IOT_MQTT_INFLIGHT_WINDOW 10 ///< Maximum number of QoS 1/2 publishes awaiting acknowledgement at any given time. Capped by MAX_INFLIGHT_PUBLISHES of the MQTT client
+#define AWS_IOT_MQTT_IO_QUEUE_LEN 8 ///< Commands that can wait for the MQTT I/O task, see aws_iot_mqtt_io_task.h
+#define AWS_IOT_MQTT_IO_POLL_MS 50 ///< Longest time a queued command waits while the MQTT I/O task yields to the client
+#define AWS_IOT_MQTT_IO_SYNC_TIMEOUT_MS 20000 ///< Longest time a blocking call waits to queue its command for the MQTT I/O task, and an asynchronous publish waits for room in the in-flight window. Once queued, a blocking call returns when the client completes or times the command out
+#define AWS_IOT_MQTT_IO_STACK_SIZE (8 * 1024) ///< Stack of the MQTT I/O task, it runs the TLS handshake and the subscribe callbacks
+#ifndef AWS_IOT_MQTT_TX_COALESCE_LEN
+#define AWS_IOT_MQTT_TX_COALESCE_LEN 0 ///< Set to gather outgoing packets in a buffer of this size and write them as a single TLS record, saving the TLS and TCP overhead of small publishes. 0 writes every packet on its own
+#endif
+#ifndef AWS_IOT_MQTT_TX_COALESCE_MS
+#define AWS_IOT_MQTT_TX_COALESCE_MS 20 ///< Longest time a packet waits for others to be written with when AWS_IOT_MQTT_TX_COALESCE_LEN is set. aws_iot_mqtt_yield() writes them out
+#endif
+#define AWS_IOT_MQTT_CLEAN_SESSION true ///< Clean session flag Thing Shadow connects with. Set to false to have the broker keep the subscriptions and undelivered messages across reconnects, see aws_iot_session_store.h to also keep unacknowledged publishes across a restart
+#define AWS_IOT_SESSION_STORE_RECORDS 4 ///< QoS 1/2 publishes the session store keeps until acknowledged. Further asynchronous publishes wait for a free record
+#define AWS_IOT_SESSION_STORE_TOPIC_LEN 128 ///< Longest topic of a publish kept in the session store, a publish on a longer topic is sent but not kept
+#define AWS_IOT_SESSION_STORE_PAYLOAD_LEN AWS_IOT_MQTT_TX_BUF_LEN ///< Largest payload of a publish kept in the session store, a bigger publish is sent but not kept
 
 // Thing Shadow specific configs
 #define SHADOW_MAX_SIZE_OF_RX_BUFFER AWS_IOT_MQTT_RX_BUF_LEN+1 ///< Maximum size of the SHADOW buffer to store the received Shadow message
 #define MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES 80  ///< Maximum size of the Unique Client Id. For More info on the Client Id refer \ref response "Acknowledgments"
 #define MAX_SIZE_CLIENT_ID_WITH_SEQUENCE MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES + 10 ///< This is size of the extra sequence number that will be appended to the Unique client Id
 #define MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE MAX_SIZE_CLIENT_ID_WITH_SEQUENCE + 20 ///< This is size of the the total clientToken key and value pair in the JSON
-#define MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME 10 ///< At Any given time we will wait for this many responses. This will correlate to the rate at which the shadow actions are requested
+#ifndef MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME
+#define MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME 10 ///< At Any given time we will wait for this many responses. This will correlate to the rate at which the shadow actions are requested. Up to 2048, responses are matched in constant time and timeouts handled in logarithmic time
+#endif
+#define SHADOW_MAX_VERSION_CONFLICT_RETRIES 3 ///< Times a versioned update of the reported state cache is retried after a version conflict, see aws_iot_shadow_reported.h
+#define SHADOW_REPORTED_TEXT_LEN 32 ///< Longest string or JSON text a field of the reported state cache keeps a copy of to compare with, longer ones are compared by their length and a hash of their text
+#define AWS_IOT_SHADOW_SNAPSHOT_LEN 256 ///< Bytes of keys and values the shadow snapshot keeps across a restart, see aws_iot_shadow_snapshot.h
+#ifndef AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS
+#define AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS 60000 ///< Least time between two saves of the shadow snapshot, each save to flash erases its sector
+#endif
 #define MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME 10 ///< We could perform shadow action on any thing Name and this is maximum Thing Names we can act on at any given time
 #define MAX_JSON_TOKEN_EXPECTED 120 ///< These are the max tokens that is expected to be in the Shadow JSON document. Include the metadata that gets published
+#define AWS_IOT_JSON_FAST_TOKENIZER 1 ///< Tokenize the shadow documents with aws_iot_json_tokenize(), which gives the same tokens as jsmn_parse() but scans strings a word at a time. Set to 0 to use jsmn_parse()
+#define AWS_IOT_JSON_STREAM_TOKEN_LEN 128 ///< Longest key or value the streaming JSON parser can gather when it is split across chunks of a document, see aws_iot_json_tokenizer.h
+#define AWS_IOT_JSON_FLOAT_DECIMALS 6 ///< Digits after the decimal point of the float and double values the shadow JSON builder writes, up to 9
+#define AWS_IOT_SHADOW_STREAM_WINDOW_LEN 256 ///< Window a document of aws_iot_shadow_update_stream() is written through, on the stack of the writing task. Each full window is one write to the MQTT client, or to its coalescing buffer when AWS_IOT_MQTT_TX_COALESCE_LEN is set
 #define MAX_SHADOW_TOPIC_LENGTH_WITHOUT_THINGNAME 60 ///< All shadow actions have to be published or subscribed to a topic which is of the format $aws/things/{thingName}/shadow/update/accepted. This refers to the size of the topic without the Thing Name
 #define MAX_SIZE_OF_THING_NAME 20 ///< The Thing Name should not be bigger than this value. Modify this if the Thing Name needs to be bigger
 #define MAX_SHADOW_TOPIC_LENGTH_BYTES MAX_SHADOW_TOPIC_LENGTH_WITHOUT_THINGNAME + MAX_SIZE_OF_THING_NAME ///< This size includes the length of topic with Thing Name
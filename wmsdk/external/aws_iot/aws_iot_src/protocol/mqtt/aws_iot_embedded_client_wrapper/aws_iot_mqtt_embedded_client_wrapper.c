@@ -13,16 +13,48 @@
  * permissions and limitations under the License.
  */
 
+#include <string.h>
 #include "aws_iot_mqtt_interface.h"
+#include "aws_iot_session_store.h"
 #include "MQTTClient.h"
 #include "aws_iot_config.h"
 
+#if AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS > MAX_MESSAGE_HANDLERS
+#error "AWS_IOT_MQTT_NUM_SUBSCRIBE_HANDLERS exceeds the MQTT client capacity, build libaws_iot with a larger -DMAX_MESSAGE_HANDLERS"
+#endif
+#if AWS_IOT_SESSION_STORE_RECORDS > MAX_INFLIGHT_PUBLISHES
+#error "AWS_IOT_SESSION_STORE_RECORDS exceeds the publishes the MQTT client keeps in flight"
+#endif
+
 static Network n;
 static Client c;
 static iot_disconnect_handler clientDisconnectHandler;
 
 static unsigned char writebuf[AWS_IOT_MQTT_TX_BUF_LEN];
 static unsigned char readbuf[AWS_IOT_MQTT_RX_BUF_LEN];
+#if AWS_IOT_MQTT_TX_COALESCE_LEN > 0
+static unsigned char coalescebuf[AWS_IOT_MQTT_TX_COALESCE_LEN];
+#endif
+
+typedef struct {
+	iot_publish_complete_handler handler;
+	void *pContext;
+	bool isFree;
+	int8_t sessionSlot;		// record of the publish in the session store, -1 if it is not kept
+} AsyncPublishRecord_t;
+
+static AsyncPublishRecord_t asyncPublishRecords[MAX_INFLIGHT_PUBLISHES];
+
+const SessionStore_t SessionStoreRamOnly = {
+		.load = NULL,
+		.save = NULL,
+		.erase = NULL,
+		.pContext = NULL
+};
+
+static const SessionStore_t *pSessionStore = NULL;
+static SessionRecord_t sessionRecords[AWS_IOT_SESSION_STORE_RECORDS];
+static uint8_t nextSessionRecord = 0;
 
 const MQTTConnectParams MQTTConnectParamsDefault = {
 		.pHostURL = AWS_IOT_MQTT_HOST,
@@ -46,17 +78,18 @@ const MQTTConnectParams MQTTConnectParamsDefault = {
 
 const MQTTPublishParams MQTTPublishParamsDefault={
 		.pTopic = NULL,
-		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0}
+		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0, .PayloadOffset = 0, .TotalPayloadLen = 0}
 };
 const MQTTSubscribeParams MQTTSubscribeParamsDefault={
 		.pTopic = NULL,
 		.qos = QOS_0,
-		.mHandler = NULL
+		.mHandler = NULL,
+		.grantedQos = QOS_0
 };
 const MQTTCallbackParams MQTTCallbackParamsDefault={
 		.pTopicName = NULL,
 		.TopicNameLen = 0,
-		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0}
+		.MessageParams = {.qos = QOS_0, .isRetained=false, .isDuplicate = false, .id = 0, .pPayload = NULL, .PayloadLen = 0, .PayloadOffset = 0, .TotalPayloadLen = 0}
 };
 const MQTTMessageParams MQTTMessageParamsDefault={
 		.qos = QOS_0,
@@ -64,7 +97,9 @@ const MQTTMessageParams MQTTMessageParamsDefault={
 		.isDuplicate = false,
 		.id = 0,
 		.pPayload = NULL,
-		.PayloadLen = 0
+		.PayloadLen = 0,
+		.PayloadOffset = 0,
+		.TotalPayloadLen = 0
 };
 const MQTTwillOptions MQTTwillOptionsDefault={
 		.pTopicName = NULL,
@@ -89,6 +124,8 @@ void pahoMessageCallback(MessageData* md) {
 	}
 	if (NULL != message) {
 		params.MessageParams.PayloadLen = message->payloadlen & GETLOWER4BYTES;
+		params.MessageParams.PayloadOffset = message->offset & GETLOWER4BYTES;
+		params.MessageParams.TotalPayloadLen = message->totallen & GETLOWER4BYTES;
 		params.MessageParams.pPayload = (char*) message->payload;
 		params.MessageParams.isDuplicate = message->dup;
 		params.MessageParams.qos = (QoSLevel)message->qos;
@@ -99,6 +136,58 @@ void pahoMessageCallback(MessageData* md) {
 	((iot_message_handler)(md->applicationHandler))(params);
 }
 
+// records are handed out in turn, so that a flash backend wears its sectors evenly
+static int8_t claimSessionRecord(void) {
+	uint8_t i, slot;
+
+	for (i = 0; i < AWS_IOT_SESSION_STORE_RECORDS; i++) {
+		slot = (uint8_t)((nextSessionRecord + i) % AWS_IOT_SESSION_STORE_RECORDS);
+		if (!sessionRecords[slot].isUsed) {
+			nextSessionRecord = (uint8_t)((slot + 1) % AWS_IOT_SESSION_STORE_RECORDS);
+			sessionRecords[slot].isUsed = true;
+			return (int8_t)slot;
+		}
+	}
+	return -1;
+}
+
+static void releaseSessionRecord(int8_t slot) {
+	if (slot < 0) {
+		return;
+	}
+	sessionRecords[slot].isUsed = false;
+	if (NULL != pSessionStore && NULL != pSessionStore->erase) {
+		pSessionStore->erase(pSessionStore, (uint8_t)slot);
+	}
+}
+
+static AsyncPublishRecord_t *claimAsyncPublishRecord(void) {
+	uint8_t i;
+
+	for (i = 0; i < MAX_INFLIGHT_PUBLISHES; i++) {
+		if (asyncPublishRecords[i].isFree) {
+			asyncPublishRecords[i].isFree = false;
+			asyncPublishRecords[i].sessionSlot = -1;
+			return &asyncPublishRecords[i];
+		}
+	}
+	return NULL;
+}
+
+void pahoPublishCompleteHandler(unsigned short id, int rc, void *context) {
+	AsyncPublishRecord_t *pRecord = (AsyncPublishRecord_t *)context;
+	iot_publish_complete_handler handler = pRecord->handler;
+	void *pContext = pRecord->pContext;
+
+	// acknowledged, or given up on by a clean session, either way the broker is not owed it any more
+	releaseSessionRecord(pRecord->sessionSlot);
+	pRecord->sessionSlot = -1;
+	pRecord->isFree = true;
+	if (handler != NULL) {
+		handler((uint16_t)id, (rc == MQTT_SUCCESS) ? NONE_ERROR : PUBLISH_ERROR, pContext);
+	}
+}
+
 void pahoDisconnectHandler(void) {
 	if (clientDisconnectHandler != NULL) {
 		clientDisconnectHandler();
@@ -117,6 +206,63 @@ static IoT_Error_t parseConnectParamsForError(MQTTConnectParams *pParams) {
 
 static bool isPowerCycle = true;
 
+// the restart lost the in-flight publishes of the client, put back the ones the session store kept
+static void resumeSession(void) {
+	AsyncPublishRecord_t *pRecord;
+	MQTTMessage Message;
+	uint8_t i;
+
+	for (i = 0; i < AWS_IOT_SESSION_STORE_RECORDS; i++) {
+		if (!sessionRecords[i].isUsed) {
+			continue;
+		}
+		if (NULL == (pRecord = claimAsyncPublishRecord())) {
+			break;
+		}
+		pRecord->handler = NULL;
+		pRecord->pContext = NULL;
+		pRecord->sessionSlot = (int8_t)i;
+
+		Message.dup = 1;
+		Message.id = sessionRecords[i].id;
+		Message.payload = sessionRecords[i].payload;
+		Message.payloadlen = sessionRecords[i].PayloadLen;
+		Message.offset = 0;
+		Message.totallen = Message.payloadlen;
+		Message.qos = (enum QoS)sessionRecords[i].qos;
+		Message.retained = sessionRecords[i].isRetained;
+		if (MQTT_SUCCESS != MQTTResumePublish(&c, sessionRecords[i].topic, &Message, pahoPublishCompleteHandler, pRecord)) {
+			pRecord->isFree = true;
+			releaseSessionRecord((int8_t)i);
+		}
+	}
+}
+
+static void discardSession(void) {
+	uint8_t i;
+
+	for (i = 0; i < AWS_IOT_SESSION_STORE_RECORDS; i++) {
+		if (sessionRecords[i].isUsed) {
+			releaseSessionRecord((int8_t)i);
+		}
+	}
+}
+
+IoT_Error_t aws_iot_mqtt_set_session_store(const SessionStore_t *pStore) {
+	IoT_Error_t rc = NONE_ERROR;
+	uint8_t i;
+
+	pSessionStore = pStore;
+	for (i = 0; i < AWS_IOT_SESSION_STORE_RECORDS; i++) {
+		sessionRecords[i].isUsed = false;
+		if (NULL != pStore && NULL != pStore->load && NONE_ERROR != pStore->load(pStore, i, &sessionRecords[i])) {
+			sessionRecords[i].isUsed = false;
+			rc = GENERIC_ERROR;
+		}
+	}
+	return rc;
+}
+
 IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 	IoT_Error_t rc = NONE_ERROR;
 
@@ -137,11 +283,31 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 		rc = iot_tls_connect(&n, TLSParams);
 
 		if (NONE_ERROR == rc) {
-			// This implementation assumes you are not going to switch between cleansession 1 to 0
 			// As we don't have a default subscription handler support in the MQTT client every time a device power cycles it has to re-subscribe to let the MQTT client to pass the message up to the application callback.
+			// Within a power cycle the client keeps its subscriptions and the publishes in flight for a session that is not clean.
 			// The default message handler will be implemented in the future revisions.
 			if(pParams->isCleansession || isPowerCycle){
+				if (isPowerCycle) {
+					uint8_t i;
+					for (i = 0; i < MAX_INFLIGHT_PUBLISHES; i++) {
+						asyncPublishRecords[i].isFree = true;
+						asyncPublishRecords[i].sessionSlot = -1;
+					}
+				} else {
+					// report the publishes a clean session is about to discard
+					MQTTAbortInflight(&c);
+				}
 				MQTTClient(&c, &n, (unsigned int)(pParams->mqttCommandTimeout_ms), writebuf, AWS_IOT_MQTT_TX_BUF_LEN, readbuf, AWS_IOT_MQTT_RX_BUF_LEN);
+				setInflightWindow(&c, AWS_IOT_MQTT_INFLIGHT_WINDOW);
+				setStreamChunkSize(&c, AWS_IOT_MQTT_RX_CHUNK_LEN);
+#if AWS_IOT_MQTT_TX_COALESCE_LEN > 0
+				setWriteCoalescing(&c, coalescebuf, AWS_IOT_MQTT_TX_COALESCE_LEN, AWS_IOT_MQTT_TX_COALESCE_MS);
+#endif
+				if (pParams->isCleansession) {
+					discardSession();
+				} else if (isPowerCycle) {
+					resumeSession();	// sent by MQTTConnect once the broker confirms the session
+				}
 				isPowerCycle = false;
 			}
 
@@ -183,10 +349,50 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams) {
 }
 
 IoT_Error_t aws_iot_mqtt_subscribe(MQTTSubscribeParams *pParams) {
+	return aws_iot_mqtt_subscribe_batch(pParams, 1);
+}
+
+IoT_Error_t aws_iot_mqtt_subscribe_batch(MQTTSubscribeParams *pParams, uint8_t count) {
 	IoT_Error_t rc = NONE_ERROR;
+	const char *topics[MAX_SUBSCRIBE_FILTERS];
+	enum QoS qoss[MAX_SUBSCRIBE_FILTERS];
+	messageHandler fps[MAX_SUBSCRIBE_FILTERS];
+	pApplicationHandler_t applicationHandlers[MAX_SUBSCRIBE_FILTERS];
+	int grantedQoSs[MAX_SUBSCRIBE_FILTERS];
+	uint8_t i;
+
+	if (NULL == pParams || 0 == count) {
+		return NULL_VALUE_ERROR;
+	}
+	if (count > MAX_SUBSCRIBE_FILTERS) {
+		return SUBSCRIBE_ERROR;
+	}
+
+	for (i = 0; i < count; i++) {
+		topics[i] = pParams[i].pTopic;
+		qoss[i] = (enum QoS)pParams[i].qos;
+		fps[i] = pahoMessageCallback;
+		applicationHandlers[i] = (void (*)(void))(pParams[i].mHandler);
+	}
 
-	if (0 != MQTTSubscribe(&c, pParams->pTopic, (enum QoS)pParams->qos, pahoMessageCallback, (void (*)(void))(pParams->mHandler))) {
+	if (0 != MQTTSubscribeMany(&c, count, topics, qoss, fps, applicationHandlers, grantedQoSs)) {
+		return SUBSCRIBE_ERROR;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (0x80 == grantedQoSs[i]) {
 			rc = SUBSCRIBE_ERROR;
+		} else {
+			pParams[i].grantedQos = (QoSLevel)grantedQoSs[i];
+		}
+	}
+	if (NONE_ERROR != rc) {
+		// keep the batch all or nothing, drop what the broker did grant
+		for (i = 0; i < count; i++) {
+			if (0x80 != grantedQoSs[i]) {
+				MQTTUnsubscribe(&c, topics[i]);
+			}
+		}
 	}
 	return rc;
 }
@@ -209,6 +415,111 @@ IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams) {
 	return rc;
 }
 
+IoT_Error_t aws_iot_mqtt_publish_async(MQTTPublishParams *pParams, iot_publish_complete_handler handler, void *pContext) {
+	IoT_Error_t rc = NONE_ERROR;
+	AsyncPublishRecord_t *pRecord = NULL;
+	SessionRecord_t *pSession = NULL;
+	const char *pTopic = pParams->pTopic;
+	int8_t sessionSlot = -1;
+	int pahoRc;
+
+	MQTTMessage Message;
+	Message.dup = pParams->MessageParams.isDuplicate;
+	Message.id = pParams->MessageParams.id;
+	Message.payload = pParams->MessageParams.pPayload;
+	Message.payloadlen = pParams->MessageParams.PayloadLen;
+	Message.qos = (enum QoS)pParams->MessageParams.qos;
+	Message.retained = pParams->MessageParams.isRetained;
+
+	// keep a copy for a resumed session, the client then sends it from the copy
+	if (NULL != pSessionStore && QOS_0 != pParams->MessageParams.qos &&
+			strlen(pTopic) < AWS_IOT_SESSION_STORE_TOPIC_LEN &&
+			pParams->MessageParams.PayloadLen <= AWS_IOT_SESSION_STORE_PAYLOAD_LEN) {
+		if ((sessionSlot = claimSessionRecord()) < 0) {
+			return WAIT_FOR_PUBLISH;
+		}
+		pSession = &sessionRecords[sessionSlot];
+		pSession->qos = pParams->MessageParams.qos;
+		pSession->isRetained = pParams->MessageParams.isRetained;
+		strcpy(pSession->topic, pTopic);
+		pSession->PayloadLen = pParams->MessageParams.PayloadLen;
+		memcpy(pSession->payload, pParams->MessageParams.pPayload, pSession->PayloadLen);
+		pTopic = pSession->topic;
+		Message.payload = pSession->payload;
+	}
+
+	if (NULL == (pRecord = claimAsyncPublishRecord())) {
+		if (NULL != pSession) {
+			pSession->isUsed = false;
+		}
+		return WAIT_FOR_PUBLISH;
+	}
+	pRecord->handler = handler;
+	pRecord->pContext = pContext;
+	pRecord->sessionSlot = sessionSlot;
+
+	pahoRc = MQTTPublishAsync(&c, pTopic, &Message, pahoPublishCompleteHandler, pRecord);
+	if (pahoRc != MQTT_SUCCESS) {
+		pRecord->isFree = true;
+		if (NULL != pSession) {
+			pSession->isUsed = false;	// never reached the backend
+		}
+		rc = (pahoRc == MQTT_INFLIGHT_WINDOW_FULL) ? WAIT_FOR_PUBLISH : PUBLISH_ERROR;
+	} else {
+		pParams->MessageParams.id = Message.id;
+		if (NULL != pSession) {
+			// the packet id is only known now, and the record has to carry it
+			pSession->id = Message.id;
+			if (NULL != pSessionStore->save) {
+				pSessionStore->save(pSessionStore, (uint8_t)sessionSlot, pSession);
+			}
+		}
+	}
+
+	return rc;
+}
+
+typedef struct {
+	iot_payload_writer writer;
+	void *pContext;
+	IoT_Error_t rc;		// outcome of the writer
+} StreamPublish_t;
+
+static IoT_Error_t writeStreamPayload(const void *pData, uint32_t length) {
+	if (MQTT_SUCCESS != MQTTPublishStreamWrite(&c, pData, length)) {
+		return PUBLISH_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static int pahoPayloadWriter(Client *pClient, void *context) {
+	StreamPublish_t *pStream = (StreamPublish_t *)context;
+
+	pStream->rc = pStream->writer(writeStreamPayload, pStream->pContext);
+	return (NONE_ERROR == pStream->rc) ? MQTT_SUCCESS : MQTT_FAILURE;
+}
+
+IoT_Error_t aws_iot_mqtt_publish_stream(MQTTPublishParams *pParams, iot_payload_writer writer, void *pContext) {
+	StreamPublish_t stream = {writer, pContext, NONE_ERROR};
+
+	if (NULL == pParams || NULL == writer) {
+		return NULL_VALUE_ERROR;
+	}
+
+	MQTTMessage Message;
+	Message.dup = false;
+	Message.id = 0;
+	Message.payload = NULL;
+	Message.payloadlen = pParams->MessageParams.PayloadLen;
+	Message.qos = (enum QoS)pParams->MessageParams.qos;
+	Message.retained = pParams->MessageParams.isRetained;
+
+	if (0 != MQTTPublishStream(&c, pParams->pTopic, &Message, pahoPayloadWriter, &stream)) {
+		return (NONE_ERROR != stream.rc) ? stream.rc : PUBLISH_ERROR;
+	}
+	return NONE_ERROR;
+}
+
 IoT_Error_t aws_iot_mqtt_unsubscribe(char *pTopic) {
 	IoT_Error_t rc = NONE_ERROR;
 
@@ -236,6 +547,14 @@ IoT_Error_t aws_iot_mqtt_yield(int timeout) {
 	return rc;
 }
 
+IoT_Error_t aws_iot_mqtt_flush(void) {
+	IoT_Error_t rc = NONE_ERROR;
+	if(0 != MQTTFlush(&c)){
+		rc = GENERIC_ERROR;
+	}
+	return rc;
+}
+
 bool aws_iot_is_mqtt_connected(void) {
 	return c.isconnected;
 }
@@ -245,7 +564,11 @@ void aws_iot_mqtt_init(MQTTClient_t *pClient){
 	pClient->disconnect = aws_iot_mqtt_disconnect;
 	pClient->isConnected = aws_iot_is_mqtt_connected;
 	pClient->publish = aws_iot_mqtt_publish;
+	pClient->publishAsync = aws_iot_mqtt_publish_async;
+	pClient->publishStream = aws_iot_mqtt_publish_stream;
 	pClient->subscribe = aws_iot_mqtt_subscribe;
+	pClient->subscribeBatch = aws_iot_mqtt_subscribe_batch;
 	pClient->unsubscribe = aws_iot_mqtt_unsubscribe;
 	pClient->yield = aws_iot_mqtt_yield;
+	pClient->flush = aws_iot_mqtt_flush;
 }
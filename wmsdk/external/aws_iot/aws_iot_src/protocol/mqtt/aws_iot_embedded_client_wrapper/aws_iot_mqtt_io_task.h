@@ -0,0 +1,70 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_mqtt_io_task.h
+ * @brief MQTT client shared between threads through a dedicated I/O task.
+ *
+ * The MQTT client handles one command at a time. Instead of every thread calling
+ * into it directly, a single I/O task owns the client and the network. Other threads
+ * hand their commands to it through a queue and get the results back either by
+ * blocking, through the MQTTClient_t functions, or through a completion callback.
+ * Messages on subscribed topics are delivered as soon as they arrive, the subscribe
+ * callbacks run on the I/O task.
+ */
+
+#ifndef AWS_IOT_SDK_SRC_IOT_MQTT_IO_TASK_H_
+#define AWS_IOT_SDK_SRC_IOT_MQTT_IO_TASK_H_
+
+#include "aws_iot_mqtt_interface.h"
+
+/**
+ * @brief Command Completion Callback Handler Type
+ *
+ * Defining a type for the completion callback of a command queued to the I/O task.
+ * The callback runs on the I/O task.
+ *
+ * @param rc		Outcome of the command
+ * @param pContext	Context given when the command was queued
+ */
+typedef void (*iot_io_complete_handler)(IoT_Error_t rc, void *pContext);
+
+/**
+ * @brief Start the MQTT I/O task
+ *
+ * Creates the I/O task and its command queue on the first call, and sets up the
+ * function pointers of pClient to route every call through the I/O task. It is used
+ * in place of aws_iot_mqtt_init(), the resulting client can be used from any thread,
+ * including from subscribe callbacks.
+ * The yield function of the client only waits, the I/O task yields on its own.
+ *
+ * @param pClient	Pointer to the MQTT client to set up
+ * @return An IoT Error Type defining successful/failed start of the I/O task
+ */
+IoT_Error_t aws_iot_mqtt_io_init(MQTTClient_t *pClient);
+
+/**
+ * @brief Queue a subscribe to the I/O task without waiting for the SUBACK
+ *
+ * @param pParams	Array of MQTT subscribe parameters, must stay valid until the handler runs
+ * @param count		Number of entries in pParams
+ * @param handler	Completion callback, could be set to NULL if the outcome is not important
+ * @param pContext	Passed back to the completion callback
+ * @return NONE_ERROR if the command was queued, WAIT_FOR_PUBLISH if the queue is full
+ */
+IoT_Error_t aws_iot_mqtt_io_subscribe_async(MQTTSubscribeParams *pParams, uint8_t count,
+		iot_io_complete_handler handler, void *pContext);
+
+#endif /* AWS_IOT_SDK_SRC_IOT_MQTT_IO_TASK_H_ */
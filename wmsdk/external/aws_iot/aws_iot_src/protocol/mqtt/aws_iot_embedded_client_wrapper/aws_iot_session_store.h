@@ -0,0 +1,107 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_session_store.h
+ * @brief Keeps unacknowledged QoS 1/2 publishes for a resumed MQTT session.
+ *
+ * With a persistent session (isCleansession false) the broker keeps the subscriptions
+ * and the messages it still owes the device, the device in turn has to send again every
+ * publish the broker did not acknowledge. Once a session store is set, every QoS 1/2
+ * publish made through aws_iot_mqtt_publish_async() is copied into one of
+ * #AWS_IOT_SESSION_STORE_RECORDS records until it is acknowledged. The records live in
+ * RAM and are handed to an optional backend, such as flash, so that they also survive
+ * a restart: the first connect after a power cycle with isCleansession false sends them
+ * again, with their original packet ids and the DUP flag. Connecting with a clean
+ * session discards them.
+ * Subscriptions are kept by the MQTT client, when the broker reports it has no session
+ * they are subscribed again as part of the connect.
+ */
+
+#ifndef AWS_IOT_SDK_SRC_IOT_SESSION_STORE_H_
+#define AWS_IOT_SDK_SRC_IOT_SESSION_STORE_H_
+
+#include <mdev.h>
+#include "aws_iot_mqtt_interface.h"
+#include "aws_iot_config.h"
+
+/**
+ * @brief Session Record Type
+ *
+ * An unacknowledged publish as kept by the session store.
+ */
+typedef struct {
+	bool isUsed;									///< False for an empty record
+	uint16_t id;									///< Packet id the publish was first sent with
+	QoSLevel qos;									///< QoS of the publish, 1 or 2
+	bool isRetained;								///< Retained flag of the publish
+	char topic[AWS_IOT_SESSION_STORE_TOPIC_LEN];	///< NULL terminated topic of the publish
+	uint32_t PayloadLen;							///< Number of bytes used in payload
+	char payload[AWS_IOT_SESSION_STORE_PAYLOAD_LEN];	///< Payload of the publish
+} SessionRecord_t;
+
+typedef struct SessionStore SessionStore_t;
+
+/**
+ * @brief Session Store Backend Type
+ *
+ * Keeps the records outside of RAM. Records are addressed by slot, from 0 to
+ * #AWS_IOT_SESSION_STORE_RECORDS - 1. Any of the functions can be NULL, a store with
+ * all of them NULL keeps the records in RAM only.
+ */
+struct SessionStore {
+	IoT_Error_t (*load)(const SessionStore_t *pStore, uint8_t slot, SessionRecord_t *pRecord);	///< Read a slot back, an empty slot is reported with isUsed false
+	IoT_Error_t (*save)(const SessionStore_t *pStore, uint8_t slot, const SessionRecord_t *pRecord);	///< Write a record to a slot
+	IoT_Error_t (*erase)(const SessionStore_t *pStore, uint8_t slot);	///< Empty a slot
+	void *pContext;		///< Backend specific
+};
+
+/**
+ * @brief Session store that keeps the records in RAM only
+ *
+ * The records survive reconnects but not a restart.
+ */
+extern const SessionStore_t SessionStoreRamOnly;
+
+/**
+ * @brief Set the session store of the MQTT client
+ *
+ * Reads back every record the backend holds. Call it before the first connect, the
+ * records read back are sent again by that connect unless it asks for a clean session.
+ * The store must stay valid while in use.
+ *
+ * @param pStore	Session store to use, NULL stops keeping publishes
+ * @return An IoT Error Type defining successful/failed setup of the store
+ */
+IoT_Error_t aws_iot_mqtt_set_session_store(const SessionStore_t *pStore);
+
+/**
+ * @brief Set up a session store backed by flash
+ *
+ * Every record takes a sector of its own, so pDev needs
+ * #AWS_IOT_SESSION_STORE_RECORDS * sectorSize bytes from start onward, reserved for
+ * the session store. A record is written to a freshly erased sector, emptying a slot
+ * only clears its header so it costs no erase.
+ *
+ * @param pStore		Session store to set up
+ * @param pDev			Flash device, as returned by flash_drv_open()
+ * @param start			Flash address of the first record, sector aligned
+ * @param sectorSize	Erase size of the flash, at least sizeof(SessionRecord_t) plus a small header
+ * @return An IoT Error Type defining successful/failed setup of the store
+ */
+IoT_Error_t aws_iot_session_store_flash_init(SessionStore_t *pStore, mdev_t *pDev, uint32_t start,
+		uint32_t sectorSize);
+
+#endif /* AWS_IOT_SDK_SRC_IOT_SESSION_STORE_H_ */
@@ -54,7 +54,10 @@ typedef struct{
  */
 struct Network{
 	int my_socket;	///< Integer holding the socket file descriptor
+	int rx_timeout_ms;	///< Receive timeout currently set on my_socket, so it is only changed when needed
 	int (*mqttread) (Network*, unsigned char*, int, int);	///< Function pointer pointing to the network function to read from the network
+	int (*mqttreadsome) (Network*, unsigned char*, int, int);	///< Function pointer pointing to the network function returning whatever the network has ready, at most len bytes. May be NULL
+	int (*mqttwait) (Network*, int);	///< Function pointer pointing to the network function waiting for bytes to read. May be NULL, the MQTT client then polls with read timeouts
 	int (*mqttwrite) (Network*, unsigned char*, int, int);	///< Function pointer pointing to the network function to write to the network
 	void (*disconnect) (Network*);		///< Function pointer pointing to the network function to disconnect from the network
 };
@@ -104,6 +107,33 @@ int iot_tls_write(Network*, unsigned char*, int, int);
  */
 int iot_tls_read(Network*, unsigned char*, int, int);
 
+/**
+ * @brief Read the bytes available on the network socket
+ *
+ * Unlike iot_tls_read this does not wait for the buffer to fill up. It returns
+ * as soon as at least one byte has been received.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param unsigned char pointer - pointer to buffer where read bytes should be copied
+ * @param integer - maximum number of bytes to read
+ * @param integer - read timeout value in milliseconds
+ * @return integer - number of bytes read or TLS error
+ */
+int iot_tls_read_some(Network*, unsigned char*, int, int);
+
+/**
+ * @brief Wait until bytes can be read from the network socket
+ *
+ * Sleeps in select() rather than in a read, so nothing is consumed and the
+ * caller can pick the read that suits it once bytes are there. Bytes the TLS
+ * layer has decrypted already count as ready, the socket does not show them.
+ *
+ * @param Network - Pointer to a Network struct defining the network interface.
+ * @param integer - longest time to wait in milliseconds, 0 only checks
+ * @return integer - positive if bytes can be read, 0 on timeout, negative on socket error
+ */
+int iot_tls_wait(Network*, int);
+
 /**
  * @brief Disconnect from network socket
  *
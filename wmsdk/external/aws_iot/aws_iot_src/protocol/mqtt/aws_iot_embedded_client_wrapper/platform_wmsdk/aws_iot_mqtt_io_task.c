@@ -0,0 +1,301 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_mqtt_io_task.c
+ * @brief WMSDK implementation of the MQTT I/O task.
+ */
+
+#include <wm_os.h>
+#include <wmerrno.h>
+#include <timer_interface.h>
+#include "aws_iot_mqtt_io_task.h"
+#include "aws_iot_config.h"
+
+typedef enum {
+	IO_CONNECT, IO_PUBLISH, IO_PUBLISH_ASYNC, IO_PUBLISH_STREAM, IO_SUBSCRIBE, IO_UNSUBSCRIBE, IO_DISCONNECT, IO_FLUSH
+} IoCommandType_t;
+
+typedef struct {
+	IoCommandType_t type;
+	union {
+		MQTTConnectParams *pConnect;
+		MQTTPublishParams publish;
+		struct {
+			MQTTPublishParams *pParams;
+			iot_payload_writer writer;
+			void *pWriterContext;
+		} publishStream;
+		struct {
+			MQTTSubscribeParams *pParams;
+			uint8_t count;
+		} subscribe;
+		char *pTopic;
+	} params;
+	iot_publish_complete_handler publishHandler;	///< Only for IO_PUBLISH_ASYNC
+	iot_io_complete_handler handler;				///< For all the other commands
+	void *pContext;
+} IoCommand_t;
+
+static os_thread_t ioThread;
+static os_thread_stack_define(ioStack, AWS_IOT_MQTT_IO_STACK_SIZE);
+static os_queue_t ioQueue;
+static os_queue_pool_define(ioQueuePool, sizeof(IoCommand_t) * AWS_IOT_MQTT_IO_QUEUE_LEN);
+static bool isIoStarted = false;
+static volatile IoT_Error_t lastYieldResult = YIELD_ERROR;
+
+// blocking calls take turns, each waits on syncDone for its own command to complete
+static os_mutex_t syncLock;
+static os_semaphore_t syncDone;
+
+static bool isIoThread(void) {
+	return isIoStarted && os_get_current_task_handle() == ioThread;
+}
+
+static IoT_Error_t runCommand(IoCommand_t *pCmd) {
+	IoT_Error_t rc = GENERIC_ERROR;
+
+	switch (pCmd->type) {
+	case IO_CONNECT:
+		rc = aws_iot_mqtt_connect(pCmd->params.pConnect);
+		break;
+	case IO_PUBLISH:
+		rc = aws_iot_mqtt_publish(&pCmd->params.publish);
+		break;
+	case IO_PUBLISH_STREAM:
+		rc = aws_iot_mqtt_publish_stream(pCmd->params.publishStream.pParams, pCmd->params.publishStream.writer,
+				pCmd->params.publishStream.pWriterContext);
+		break;
+	case IO_SUBSCRIBE:
+		rc = aws_iot_mqtt_subscribe_batch(pCmd->params.subscribe.pParams, pCmd->params.subscribe.count);
+		break;
+	case IO_UNSUBSCRIBE:
+		rc = aws_iot_mqtt_unsubscribe(pCmd->params.pTopic);
+		break;
+	case IO_DISCONNECT:
+		rc = aws_iot_mqtt_disconnect();
+		break;
+	case IO_FLUSH:
+		rc = aws_iot_mqtt_flush();
+		break;
+	}
+	return rc;
+}
+
+static void executeCommand(IoCommand_t *pCmd) {
+	IoT_Error_t rc;
+	Timer windowTimer;
+
+	if (IO_PUBLISH_ASYNC != pCmd->type) {
+		rc = runCommand(pCmd);
+		if (NULL != pCmd->handler) {
+			pCmd->handler(rc, pCmd->pContext);
+		}
+		return;
+	}
+
+	// the publish completes from a later yield, once acknowledged
+	InitTimer(&windowTimer);
+	countdown_ms(&windowTimer, AWS_IOT_MQTT_IO_SYNC_TIMEOUT_MS);
+	rc = aws_iot_mqtt_publish_async(&pCmd->params.publish, pCmd->publishHandler, pCmd->pContext);
+	while (WAIT_FOR_PUBLISH == rc && aws_iot_is_mqtt_connected() && !expired(&windowTimer)) {
+		// in-flight window full, let acknowledgements come in. Those of publishes still gathered
+		// for write coalescing cannot, until the publishes are written out
+		aws_iot_mqtt_flush();
+		lastYieldResult = aws_iot_mqtt_yield(AWS_IOT_MQTT_IO_POLL_MS);
+		rc = aws_iot_mqtt_publish_async(&pCmd->params.publish, pCmd->publishHandler, pCmd->pContext);
+	}
+	if (NONE_ERROR != rc && NULL != pCmd->publishHandler) {
+		pCmd->publishHandler(0, rc, pCmd->pContext);
+	}
+}
+
+static void ioTask(os_thread_arg_t arg) {
+	IoCommand_t cmd;
+
+	while (1) {
+		if (!aws_iot_is_mqtt_connected()) {
+			// nothing to read from the network, sleep until there is something to do
+			lastYieldResult = YIELD_ERROR;
+			if (WM_SUCCESS == os_queue_recv(&ioQueue, &cmd, OS_WAIT_FOREVER)) {
+				executeCommand(&cmd);
+			}
+			continue;
+		}
+		while (WM_SUCCESS == os_queue_recv(&ioQueue, &cmd, OS_NO_WAIT)) {
+			executeCommand(&cmd);
+		}
+		lastYieldResult = aws_iot_mqtt_yield(AWS_IOT_MQTT_IO_POLL_MS);
+	}
+}
+
+static void syncComplete(IoT_Error_t rc, void *pContext) {
+	*(IoT_Error_t *)pContext = rc;
+	os_semaphore_put(&syncDone);
+}
+
+/*
+ * Once queued, the command is waited for however long it takes. It is bounded by the
+ * command timeout of the client, and until it completes the I/O task may still use
+ * the parameters and the result slot the caller lent it.
+ */
+static IoT_Error_t runSync(IoCommand_t *pCmd) {
+	IoT_Error_t rc = GENERIC_ERROR;
+
+	if (!isIoStarted) {
+		return GENERIC_ERROR;
+	}
+	if (isIoThread()) {
+		// called from a subscribe callback, the client is ours already
+		return runCommand(pCmd);
+	}
+
+	os_mutex_get(&syncLock, OS_WAIT_FOREVER);
+	pCmd->handler = syncComplete;
+	pCmd->pContext = &rc;
+	if (WM_SUCCESS == os_queue_send(&ioQueue, pCmd, os_msec_to_ticks(AWS_IOT_MQTT_IO_SYNC_TIMEOUT_MS))) {
+		os_semaphore_get(&syncDone, OS_WAIT_FOREVER);
+	}
+	os_mutex_put(&syncLock);
+	return rc;
+}
+
+static IoT_Error_t ioConnect(MQTTConnectParams *pParams) {
+	IoCommand_t cmd = {.type = IO_CONNECT};
+	cmd.params.pConnect = pParams;
+	return runSync(&cmd);
+}
+
+// a blocking publish, its packet is out of the in-flight window by the time it returns
+static IoT_Error_t ioPublish(MQTTPublishParams *pParams) {
+	IoCommand_t cmd = {.type = IO_PUBLISH};
+	cmd.params.publish = *pParams;
+	return runSync(&cmd);
+}
+
+static IoT_Error_t ioPublishAsync(MQTTPublishParams *pParams, iot_publish_complete_handler handler, void *pContext) {
+	IoCommand_t cmd = {.type = IO_PUBLISH_ASYNC};
+
+	if (isIoThread()) {
+		return aws_iot_mqtt_publish_async(pParams, handler, pContext);
+	}
+	cmd.params.publish = *pParams;
+	cmd.publishHandler = handler;
+	cmd.pContext = pContext;
+	if (!isIoStarted || WM_SUCCESS != os_queue_send(&ioQueue, &cmd, OS_NO_WAIT)) {
+		return WAIT_FOR_PUBLISH;
+	}
+	return NONE_ERROR;
+}
+
+// the writer runs on the I/O task, the caller waits for it
+static IoT_Error_t ioPublishStream(MQTTPublishParams *pParams, iot_payload_writer writer, void *pContext) {
+	IoCommand_t cmd = {.type = IO_PUBLISH_STREAM};
+	cmd.params.publishStream.pParams = pParams;
+	cmd.params.publishStream.writer = writer;
+	cmd.params.publishStream.pWriterContext = pContext;
+	return runSync(&cmd);
+}
+
+static IoT_Error_t ioSubscribe(MQTTSubscribeParams *pParams) {
+	IoCommand_t cmd = {.type = IO_SUBSCRIBE};
+	cmd.params.subscribe.pParams = pParams;
+	cmd.params.subscribe.count = 1;
+	return runSync(&cmd);
+}
+
+static IoT_Error_t ioSubscribeBatch(MQTTSubscribeParams *pParams, uint8_t count) {
+	IoCommand_t cmd = {.type = IO_SUBSCRIBE};
+	cmd.params.subscribe.pParams = pParams;
+	cmd.params.subscribe.count = count;
+	return runSync(&cmd);
+}
+
+static IoT_Error_t ioUnsubscribe(char *pTopic) {
+	IoCommand_t cmd = {.type = IO_UNSUBSCRIBE};
+	cmd.params.pTopic = pTopic;
+	return runSync(&cmd);
+}
+
+static IoT_Error_t ioDisconnect(void) {
+	IoCommand_t cmd = {.type = IO_DISCONNECT};
+	return runSync(&cmd);
+}
+
+// the coalesced writes belong to the client, only the I/O task may write them out
+static IoT_Error_t ioFlush(void) {
+	IoCommand_t cmd = {.type = IO_FLUSH};
+	return runSync(&cmd);
+}
+
+static IoT_Error_t ioYield(int timeout) {
+	if (isIoThread()) {
+		return aws_iot_mqtt_yield(timeout);
+	}
+	os_thread_sleep(os_msec_to_ticks(timeout));
+	return lastYieldResult;
+}
+
+IoT_Error_t aws_iot_mqtt_io_subscribe_async(MQTTSubscribeParams *pParams, uint8_t count,
+		iot_io_complete_handler handler, void *pContext) {
+	IoCommand_t cmd = {.type = IO_SUBSCRIBE};
+
+	if (NULL == pParams || 0 == count) {
+		return NULL_VALUE_ERROR;
+	}
+	cmd.params.subscribe.pParams = pParams;
+	cmd.params.subscribe.count = count;
+	cmd.handler = handler;
+	cmd.pContext = pContext;
+	if (!isIoStarted || WM_SUCCESS != os_queue_send(&ioQueue, &cmd, OS_NO_WAIT)) {
+		return WAIT_FOR_PUBLISH;
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_mqtt_io_init(MQTTClient_t *pClient) {
+	if (NULL == pClient) {
+		return NULL_VALUE_ERROR;
+	}
+
+	if (!isIoStarted) {
+		if (WM_SUCCESS != os_queue_create(&ioQueue, "awsMqttIoQ", sizeof(IoCommand_t), &ioQueuePool)) {
+			return GENERIC_ERROR;
+		}
+		if (WM_SUCCESS != os_mutex_create(&syncLock, "awsMqttIoSync", OS_MUTEX_INHERIT)) {
+			return GENERIC_ERROR;
+		}
+		if (WM_SUCCESS != os_semaphore_create_counting(&syncDone, "awsMqttIoDone", 1, 0)) {
+			return GENERIC_ERROR;
+		}
+		if (WM_SUCCESS != os_thread_create(&ioThread, "awsMqttIo", ioTask, 0, &ioStack, OS_PRIO_3)) {
+			return GENERIC_ERROR;
+		}
+		isIoStarted = true;
+	}
+
+	pClient->connect = ioConnect;
+	pClient->disconnect = ioDisconnect;
+	pClient->isConnected = aws_iot_is_mqtt_connected;
+	pClient->publish = ioPublish;
+	pClient->publishAsync = ioPublishAsync;
+	pClient->publishStream = ioPublishStream;
+	pClient->subscribe = ioSubscribe;
+	pClient->subscribeBatch = ioSubscribeBatch;
+	pClient->unsubscribe = ioUnsubscribe;
+	pClient->yield = ioYield;
+	pClient->flush = ioFlush;
+	return NONE_ERROR;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_session_store_flash.c
+ * @brief WMSDK flash backend of the MQTT session store.
+ */
+
+#include <flash.h>
+#include "aws_iot_session_store.h"
+
+// marks a sector holding a record, erased flash reads as all ones and an emptied slot as all zeros
+#define SESSION_RECORD_MAGIC 0x53455331
+
+typedef struct {
+	mdev_t *pDev;
+	uint32_t start;
+	uint32_t sectorSize;
+} FlashStoreContext_t;
+
+static FlashStoreContext_t flashContext;
+
+static uint32_t slotAddress(const FlashStoreContext_t *pFlash, uint8_t slot) {
+	return pFlash->start + (uint32_t)slot * pFlash->sectorSize;
+}
+
+static IoT_Error_t flashLoad(const SessionStore_t *pStore, uint8_t slot, SessionRecord_t *pRecord) {
+	const FlashStoreContext_t *pFlash = (const FlashStoreContext_t *)pStore->pContext;
+	uint32_t address = slotAddress(pFlash, slot);
+	uint32_t magic = 0;
+
+	pRecord->isUsed = false;
+	if (0 != flash_drv_read(pFlash->pDev, (uint8_t *)&magic, sizeof(magic), address)) {
+		return GENERIC_ERROR;
+	}
+	if (SESSION_RECORD_MAGIC != magic) {
+		return NONE_ERROR;
+	}
+	if (0 != flash_drv_read(pFlash->pDev, (uint8_t *)pRecord, sizeof(SessionRecord_t), address + sizeof(magic))) {
+		pRecord->isUsed = false;
+		return GENERIC_ERROR;
+	}
+	if (pRecord->PayloadLen > AWS_IOT_SESSION_STORE_PAYLOAD_LEN) {
+		pRecord->isUsed = false;	// written by a build with other sizes
+	}
+	pRecord->topic[AWS_IOT_SESSION_STORE_TOPIC_LEN - 1] = '\0';
+	return NONE_ERROR;
+}
+
+static IoT_Error_t flashSave(const SessionStore_t *pStore, uint8_t slot, const SessionRecord_t *pRecord) {
+	const FlashStoreContext_t *pFlash = (const FlashStoreContext_t *)pStore->pContext;
+	uint32_t address = slotAddress(pFlash, slot);
+	uint32_t magic = SESSION_RECORD_MAGIC;
+	// the payload tail is not used, leave it erased
+	uint32_t recordLen = sizeof(SessionRecord_t) - AWS_IOT_SESSION_STORE_PAYLOAD_LEN + pRecord->PayloadLen;
+
+	if (0 != flash_drv_erase(pFlash->pDev, address, pFlash->sectorSize)) {
+		return GENERIC_ERROR;
+	}
+	// the record goes first, a power loss before the magic is written leaves the slot empty
+	if (0 != flash_drv_write(pFlash->pDev, (const uint8_t *)pRecord, recordLen, address + sizeof(magic))) {
+		return GENERIC_ERROR;
+	}
+	if (0 != flash_drv_write(pFlash->pDev, (const uint8_t *)&magic, sizeof(magic), address)) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static IoT_Error_t flashErase(const SessionStore_t *pStore, uint8_t slot) {
+	const FlashStoreContext_t *pFlash = (const FlashStoreContext_t *)pStore->pContext;
+	uint32_t address = slotAddress(pFlash, slot);
+	uint32_t magic = 0;
+
+	if (0 != flash_drv_read(pFlash->pDev, (uint8_t *)&magic, sizeof(magic), address)) {
+		return GENERIC_ERROR;
+	}
+	if (SESSION_RECORD_MAGIC != magic) {
+		return NONE_ERROR;
+	}
+	// clearing bits needs no erase, the next save erases the sector anyway
+	magic = 0;
+	if (0 != flash_drv_write(pFlash->pDev, (const uint8_t *)&magic, sizeof(magic), address)) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_session_store_flash_init(SessionStore_t *pStore, mdev_t *pDev, uint32_t start,
+		uint32_t sectorSize) {
+	if (NULL == pStore || NULL == pDev) {
+		return NULL_VALUE_ERROR;
+	}
+	if (sectorSize < sizeof(uint32_t) + sizeof(SessionRecord_t)) {
+		return GENERIC_ERROR;
+	}
+
+	flashContext.pDev = pDev;
+	flashContext.start = start;
+	flashContext.sectorSize = sectorSize;
+
+	pStore->load = flashLoad;
+	pStore->save = flashSave;
+	pStore->erase = flashErase;
+	pStore->pContext = &flashContext;
+	return NONE_ERROR;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_shadow_snapshot_flash.c
+ * @brief WMSDK flash backend of the shadow snapshot.
+ */
+
+#include <flash.h>
+#include "aws_iot_shadow_snapshot.h"
+
+// marks a sector holding a snapshot, erased flash reads as all ones
+#define SHADOW_SNAPSHOT_MAGIC 0x53484431
+
+typedef struct {
+	mdev_t *pDev;
+	uint32_t start;
+	uint32_t sectorSize;
+} FlashSnapshotContext_t;
+
+static FlashSnapshotContext_t flashSnapshotContext;
+
+static IoT_Error_t flashLoad(const ShadowSnapshotStore_t *pStore, ShadowSnapshot_t *pSnapshot) {
+	const FlashSnapshotContext_t *pFlash = (const FlashSnapshotContext_t *)pStore->pContext;
+	uint32_t magic = 0;
+
+	pSnapshot->length = 0;
+	if (0 != flash_drv_read(pFlash->pDev, (uint8_t *)&magic, sizeof(magic), pFlash->start)) {
+		return GENERIC_ERROR;
+	}
+	if (SHADOW_SNAPSHOT_MAGIC != magic) {
+		return NONE_ERROR;
+	}
+	if (0 != flash_drv_read(pFlash->pDev, (uint8_t *)pSnapshot, sizeof(ShadowSnapshot_t),
+			pFlash->start + sizeof(magic))) {
+		pSnapshot->length = 0;
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static IoT_Error_t flashSave(const ShadowSnapshotStore_t *pStore, const ShadowSnapshot_t *pSnapshot) {
+	const FlashSnapshotContext_t *pFlash = (const FlashSnapshotContext_t *)pStore->pContext;
+	uint32_t magic = SHADOW_SNAPSHOT_MAGIC;
+	// the unused tail of the values is left erased
+	uint32_t snapshotLen = sizeof(ShadowSnapshot_t) - AWS_IOT_SHADOW_SNAPSHOT_LEN + pSnapshot->length;
+
+	if (0 != flash_drv_erase(pFlash->pDev, pFlash->start, pFlash->sectorSize)) {
+		return GENERIC_ERROR;
+	}
+	// the snapshot goes first, a power loss before the magic is written leaves the sector empty
+	if (0 != flash_drv_write(pFlash->pDev, (const uint8_t *)pSnapshot, snapshotLen, pFlash->start + sizeof(magic))) {
+		return GENERIC_ERROR;
+	}
+	if (0 != flash_drv_write(pFlash->pDev, (const uint8_t *)&magic, sizeof(magic), pFlash->start)) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_snapshot_flash_init(ShadowSnapshotStore_t *pStore, mdev_t *pDev, uint32_t start,
+		uint32_t sectorSize) {
+	if (NULL == pStore || NULL == pDev) {
+		return NULL_VALUE_ERROR;
+	}
+	if (sectorSize < sizeof(uint32_t) + sizeof(ShadowSnapshot_t)) {
+		return GENERIC_ERROR;
+	}
+
+	flashSnapshotContext.pDev = pDev;
+	flashSnapshotContext.start = start;
+	flashSnapshotContext.sectorSize = sectorSize;
+
+	pStore->load = flashLoad;
+	pStore->save = flashSave;
+	pStore->pContext = &flashSnapshotContext;
+	return NONE_ERROR;
+}
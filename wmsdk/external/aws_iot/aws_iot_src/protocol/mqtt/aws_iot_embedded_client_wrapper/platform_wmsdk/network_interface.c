@@ -94,12 +94,17 @@ int tls_session_init(tls_handle_t *h, int sockfd,
 		     const tls_init_config_t *cfg);
 int tls_send(tls_handle_t h, const void *buf, int len);
 int tls_recv(tls_handle_t h, void *buf, int max_len);
+/* bytes of the last record decrypted but not returned by tls_recv() yet */
+int tls_pending(tls_handle_t h);
 void tls_close(tls_handle_t *h);
 
 int iot_tls_init(Network *pNetwork) 
 {
 	pNetwork->my_socket = 0;
+	pNetwork->rx_timeout_ms = -1;
 	pNetwork->mqttread = iot_tls_read;
+	pNetwork->mqttreadsome = iot_tls_read_some;
+	pNetwork->mqttwait = iot_tls_wait;
 	pNetwork->mqttwrite = iot_tls_write;
 	pNetwork->disconnect = iot_tls_disconnect;
 	tls_lib_init();
@@ -149,6 +154,7 @@ int iot_tls_connect(Network *pNetwork, TLSConnectParams params)
 	IoT_Error_t ret_val;
 
 	pNetwork->my_socket = Create_TCPSocket();
+	pNetwork->rx_timeout_ms = -1;
 	if (-1 == pNetwork->my_socket) {
 		ret_val = TCP_SETUP_ERROR;
 		return ret_val;
@@ -175,17 +181,24 @@ int iot_tls_connect(Network *pNetwork, TLSConnectParams params)
 	return ret_val;
 }
 
+static void setReceiveTimeout(Network *pNetwork, int timeout_ms)
+{
+	/* lwIP treats a zero SO_RCVTIMEO as no timeout at all */
+	if (timeout_ms < 1)
+		timeout_ms = 1;
+	if (timeout_ms == pNetwork->rx_timeout_ms)
+		return;
+	setsockopt(pNetwork->my_socket, SOL_SOCKET, SO_RCVTIMEO,
+		   (void *)&timeout_ms, sizeof(timeout_ms));
+	pNetwork->rx_timeout_ms = timeout_ms;
+}
+
 int iot_tls_read(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) 
 {
 	int val = 0;
 	int recv_len = 0;
-	fd_set fds;
-
-	FD_ZERO(&fds);
-	FD_SET(pNetwork->my_socket, &fds);
 
-	setsockopt(pNetwork->my_socket, SOL_SOCKET, SO_RCVTIMEO,
-		   (void *)&timeout_ms, sizeof(timeout_ms));
+	setReceiveTimeout(pNetwork, timeout_ms);
 
 	do {
 		val = tls_recv(tls_handle, pMsg + recv_len, len - recv_len);
@@ -194,7 +207,29 @@ int iot_tls_read(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms
 		recv_len += val;
 	} while (recv_len < len);
 
-	return val;
+	return (recv_len == len) ? recv_len : val;
+}
+
+int iot_tls_read_some(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms)
+{
+	setReceiveTimeout(pNetwork, timeout_ms);
+	return tls_recv(tls_handle, pMsg, len);
+}
+
+int iot_tls_wait(Network *pNetwork, int timeout_ms)
+{
+	fd_set readfds;
+	struct timeval tv;
+
+	/* select() only sees the socket, not what TLS has decrypted already */
+	if (tls_pending(tls_handle) > 0)
+		return 1;
+
+	FD_ZERO(&readfds);
+	FD_SET(pNetwork->my_socket, &readfds);
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+	return lwip_select(pNetwork->my_socket + 1, &readfds, NULL, NULL, &tv);
 }
 
 int iot_tls_write(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) 
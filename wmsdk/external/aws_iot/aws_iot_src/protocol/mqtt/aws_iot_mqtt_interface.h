@@ -113,6 +113,8 @@ typedef struct {
 	uint16_t id;			///< Message sequence identifier.  Handled automatically by the MQTT client.
 	void *pPayload;			///< Pointer to MQTT message payload (bytes).
 	uint32_t PayloadLen;	///< Length of MQTT payload.
+	uint32_t PayloadOffset;	///< Received messages only. Offset of this payload chunk when a message bigger than the RX buffer is streamed in chunks, otherwise 0.
+	uint32_t TotalPayloadLen;	///< Received messages only. Length of the whole message, equals PayloadLen unless the message is streamed in chunks.
 } MQTTMessageParams;
 extern const MQTTMessageParams MQTTMessageParamsDefault;
 /**
@@ -148,6 +150,7 @@ typedef struct {
 	char *pTopic;					///< Pointer to the string defining the desired subscription topic.
 	QoSLevel qos;					///< Quality of service of the subscription.
 	iot_message_handler mHandler;	///< Callback to be invoked upon receipt of a message on the subscribed topic.
+	QoSLevel grantedQos;			///< Set on success to the quality of service granted by the broker, which may be lower than qos.
 } MQTTSubscribeParams;
 extern const MQTTSubscribeParams MQTTSubscribeParamsDefault;
 
@@ -186,6 +189,77 @@ IoT_Error_t aws_iot_mqtt_connect(MQTTConnectParams *pParams);
  */
 IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams);
 
+/**
+ * @brief Publish Completion Callback Handler Type
+ *
+ * Defining a TYPE for definition of asynchronous publish completion callback function pointers.
+ * Invoked from the context of aws_iot_mqtt_yield() once the PUBACK (QoS 1) or PUBCOMP (QoS 2) is received,
+ * or with an error if the message is abandoned because the session was lost.
+ *
+ */
+typedef void (*iot_publish_complete_handler)(uint16_t id, IoT_Error_t rc, void *pContext);
+
+/**
+ * @brief Publish an MQTT message on a topic without waiting for the acknowledgement
+ *
+ * Called to publish an MQTT message on a topic.
+ * @note Call returns as soon as the message was passed to the TLS layer.  Up to
+ * #AWS_IOT_MQTT_INFLIGHT_WINDOW QoS 1 messages can be awaiting their PUBACK at the same time,
+ * the outcome of each is reported through the completion handler.  The topic string and the
+ * payload must stay valid until the handler has been called, as they are used again if the
+ * message has to be retransmitted after a reconnect.
+ *
+ * @param pParams	Pointer to MQTT publish parameters
+ * @param handler	Completion callback, could be set to NULL if the outcome is not important
+ * @param pContext	Passed back to the completion callback
+ * @return An IoT Error Type defining successful/failed send, WAIT_FOR_PUBLISH if the in-flight window is full
+ */
+IoT_Error_t aws_iot_mqtt_publish_async(MQTTPublishParams *pParams, iot_publish_complete_handler handler, void *pContext);
+
+/**
+ * @brief Payload Write Function Type
+ *
+ * Given to a payload writer, sends the next bytes of the payload of a streamed publish.
+ *
+ * @param pData		Next bytes of the payload
+ * @param length	Length of pData
+ * @return An IoT Error Type defining successful/failed write, PUBLISH_ERROR past the length of the payload
+ */
+typedef IoT_Error_t (*iot_payload_write)(const void *pData, uint32_t length);
+
+/**
+ * @brief Payload Writer Callback Type
+ *
+ * Writes the payload of a streamed publish through write, in pieces of any size. Called
+ * once, while the publish is being sent, on the thread that sends it: the MQTT I/O task
+ * when the client goes through it. It must not call the MQTT client.
+ *
+ * @param write		Sends the next bytes of the payload
+ * @param pContext	Context given along with the writer
+ * @return NONE_ERROR once the whole payload was written, else the error that stopped it
+ */
+typedef IoT_Error_t (*iot_payload_writer)(iot_payload_write write, void *pContext);
+
+/**
+ * @brief Publish an MQTT message whose payload is written as it is sent
+ *
+ * The PUBLISH header carries the length of the payload, which has to be known up front,
+ * but the payload itself never has to be in RAM as a whole: the writer passes it to the
+ * TLS layer a piece at a time, from buffers of its own. Only QoS 0 is supported, a QoS 1
+ * message would have to be sent again from a copy of the payload.
+ * @note Call is blocking.  The call returns after the whole message was passed to the TLS
+ * layer.  Each piece the writer passes has the command timeout to be written.  A writer
+ * that stops short of PayloadLen, or a write that fails, leaves a packet cut short that
+ * the broker would read the next packets into: the publish fails and the connection is
+ * closed, as a keepalive that gets no answer does, the disconnect handler is called.
+ *
+ * @param pParams	Pointer to MQTT publish parameters, PayloadLen is what the writer writes and pPayload is not used
+ * @param writer	Writes the payload
+ * @param pContext	Passed to the writer
+ * @return An IoT Error Type defining successful/failed send, the error of the writer if it failed
+ */
+IoT_Error_t aws_iot_mqtt_publish_stream(MQTTPublishParams *pParams, iot_payload_writer writer, void *pContext);
+
 /**
  * @brief Subscribe to an MQTT topic.
  *
@@ -198,6 +272,21 @@ IoT_Error_t aws_iot_mqtt_publish(MQTTPublishParams *pParams);
  */
 IoT_Error_t aws_iot_mqtt_subscribe(MQTTSubscribeParams *pParams);
 
+/**
+ * @brief Subscribe to several MQTT topics at once.
+ *
+ * Sends all the topics in a single subscribe message and waits for the one SUBACK
+ * that answers it, instead of one round trip per topic.
+ * Either all the subscriptions are made or none: if the broker refuses any of the
+ * topics, the ones it granted are unsubscribed again and no handler is registered.
+ * @note Call is blocking.  The call returns after the receipt of the SUBACK control packet.
+ *
+ * @param pParams	Array of MQTT subscribe parameters, grantedQos of each is set on success
+ * @param count		Number of entries in pParams, at most MAX_SUBSCRIBE_FILTERS of the MQTT client
+ * @return An IoT Error Type defining successful/failed subscription
+ */
+IoT_Error_t aws_iot_mqtt_subscribe_batch(MQTTSubscribeParams *pParams, uint8_t count);
+
 /**
  * @brief Unsubscribe to an MQTT topic.
  *
@@ -236,6 +325,20 @@ IoT_Error_t aws_iot_mqtt_disconnect(void);
  */
 IoT_Error_t aws_iot_mqtt_yield(int timeout);
 
+/**
+ * @brief Write out the packets held back by write coalescing
+ *
+ * With #AWS_IOT_MQTT_TX_COALESCE_LEN set, publishes, acknowledgements and PING requests are
+ * gathered and written to the TLS layer together, once #AWS_IOT_MQTT_TX_COALESCE_MS have passed
+ * or the buffer is full, from aws_iot_mqtt_yield(). This sends them right away instead, for
+ * instance before a long sleep. Requests waiting for an answer, such as a subscribe, never wait.
+ * When the client is shared through the MQTT I/O task, call the flush function of the
+ * MQTTClient_t instead, it runs on the I/O task.
+ *
+ * @return An IoT Error Type defining successful/failed write
+ */
+IoT_Error_t aws_iot_mqtt_flush(void);
+
 /**
  * @brief Is the MQTT client currently connected?
  *
@@ -248,10 +351,14 @@ bool aws_iot_is_mqtt_connected(void);
 
 typedef IoT_Error_t (*pConnectFunc_t)(MQTTConnectParams *pParams);
 typedef IoT_Error_t (*pPublishFunc_t)(MQTTPublishParams *pParams);
+typedef IoT_Error_t (*pPublishAsyncFunc_t)(MQTTPublishParams *pParams, iot_publish_complete_handler handler, void *pContext);
+typedef IoT_Error_t (*pPublishStreamFunc_t)(MQTTPublishParams *pParams, iot_payload_writer writer, void *pContext);
 typedef IoT_Error_t (*pSubscribeFunc_t)(MQTTSubscribeParams *pParams);
+typedef IoT_Error_t (*pSubscribeBatchFunc_t)(MQTTSubscribeParams *pParams, uint8_t count);
 typedef IoT_Error_t (*pUnsubscribeFunc_t)(char *pTopic);
 typedef IoT_Error_t (*pDisconnectFunc_t)(void);
 typedef IoT_Error_t (*pYieldFunc_t)(int timeout);
+typedef IoT_Error_t (*pFlushFunc_t)(void);
 typedef bool (*pIsConnectedFunc_t)(void);
 
 /**
@@ -265,10 +372,14 @@ typedef bool (*pIsConnectedFunc_t)(void);
 typedef struct{
 	pConnectFunc_t connect;				///< function implementing the iot_mqtt_connect function
 	pPublishFunc_t publish;				///< function implementing the iot_mqtt_publish function
+	pPublishAsyncFunc_t publishAsync;	///< function implementing the iot_mqtt_publish_async function
+	pPublishStreamFunc_t publishStream;	///< function implementing the iot_mqtt_publish_stream function
 	pSubscribeFunc_t subscribe;			///< function implementing the iot_mqtt_subscribe function
+	pSubscribeBatchFunc_t subscribeBatch;	///< function implementing the iot_mqtt_subscribe_batch function
 	pUnsubscribeFunc_t unsubscribe;		///< function implementing the iot_mqtt_unsubscribe function
 	pDisconnectFunc_t disconnect;		///< function implementing the iot_mqtt_disconnect function
 	pYieldFunc_t yield;					///< function implementing the iot_mqtt_yield function
+	pFlushFunc_t flush;					///< function implementing the iot_mqtt_flush function
 	pIsConnectedFunc_t isConnected;		///< function implementing the iot_is_mqtt_connected function
 }MQTTClient_t;
 
@@ -19,6 +19,7 @@
 #include "aws_iot_shadow_json.h"
 #include "aws_iot_shadow_key.h"
 #include "aws_iot_shadow_records.h"
+#include "aws_iot_shadow_snapshot.h"
 
 const ShadowParameters_t ShadowParametersDefault = {
 		.pMyThingName = AWS_IOT_MY_THING_NAME,
@@ -31,11 +32,11 @@ const ShadowParameters_t ShadowParametersDefault = {
 };
 
 void aws_iot_shadow_reset_last_received_version(void) {
-	shadowJsonVersionNum = 0;
+	defaultShadowContext.pThings[0].version = 0;
 }
 
 uint32_t aws_iot_shadow_get_last_received_version(void) {
-	return shadowJsonVersionNum;
+	return defaultShadowContext.pThings[0].version;
 }
 
 void aws_iot_shadow_enable_discard_old_delta_msgs(void) {
@@ -47,6 +48,7 @@ void aws_iot_shadow_disable_discard_old_delta_msgs(void) {
 }
 
 IoT_Error_t aws_iot_shadow_init(MQTTClient_t *pClient) {
+	uint32_t snapshotVersion = 0;
 
 	if (pClient == NULL) {
 		return NULL_VALUE_ERROR;
@@ -54,6 +56,9 @@ IoT_Error_t aws_iot_shadow_init(MQTTClient_t *pClient) {
 
 	resetClientTokenSequenceNum();
 	aws_iot_shadow_reset_last_received_version();
+	if (loadShadowSnapshot(&snapshotVersion)) {
+		defaultShadowContext.pThings[0].version = snapshotVersion;
+	}
 	initDeltaTokens();
 	return NONE_ERROR;
 }
@@ -73,7 +78,7 @@ IoT_Error_t aws_iot_shadow_connect(MQTTClient_t *pClient, ShadowParameters_t *pP
 	ConnectParams.MQTTVersion = MQTT_3_1_1;
 	ConnectParams.mqttCommandTimeout_ms = 2000;
 	ConnectParams.tlsHandshakeTimeout_ms = 10000;
-	ConnectParams.isCleansession = true;
+	ConnectParams.isCleansession = AWS_IOT_MQTT_CLEAN_SESSION;
 	ConnectParams.isSSLHostnameVerify = true;
 	ConnectParams.isWillMsgPresent = false;
 	ConnectParams.pClientID = pParams->pMqttClientId;
@@ -107,8 +112,19 @@ IoT_Error_t aws_iot_shadow_register_delta(MQTTClient_t *pClient, jsonStruct_t *p
 	return rc;
 }
 
+IoT_Error_t aws_iot_shadow_register_delta_schema(MQTTClient_t *pClient, const ShadowSchema_t *pSchema,
+		void *pState, fpShadowSchemaDeltaCallback_t callback, void *pContextData) {
+
+	if (!(pClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	return registerSchemaOnDelta(pSchema, pState, callback, pContextData);
+}
+
 IoT_Error_t aws_iot_shadow_yield(MQTTClient_t *pClient, int timeout) {
-	HandleExpiredResponseCallbacks();
+	HandleExpiredResponseCallbacks(&defaultShadowContext);
+	saveShadowSnapshot();
 	return pClient->yield(timeout);
 }
 
@@ -125,12 +141,24 @@ IoT_Error_t aws_iot_shadow_update(MQTTClient_t *pClient, const char *pThingName,
 		return CONNECTION_ERROR;
 	}
 
-	ret_val = iot_shadow_action(pClient, pThingName, SHADOW_UPDATE, pJsonString, callback, pContextData,
-			timeout_seconds, isPersistentSubscribe);
+	ret_val = iot_shadow_action(&defaultShadowContext, pThingName, SHADOW_UPDATE, pJsonString, callback,
+			pContextData, timeout_seconds, isPersistentSubscribe);
 
 	return ret_val;
 }
 
+IoT_Error_t aws_iot_shadow_update_stream(MQTTClient_t *pClient, const char *pThingName, fpShadowJsonWriter_t writer,
+		void *pWriterContext, fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds,
+		bool isPersistentSubscribe) {
+
+	if (!(pClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	return iot_shadow_action_stream(&defaultShadowContext, pThingName, SHADOW_UPDATE, writer, pWriterContext,
+			callback, pContextData, timeout_seconds, isPersistentSubscribe);
+}
+
 IoT_Error_t aws_iot_shadow_delete(MQTTClient_t *pClient, const char *pThingName, fpActionCallback_t callback,
 		void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe) {
 	IoT_Error_t ret_val = NONE_ERROR;
@@ -141,8 +169,8 @@ IoT_Error_t aws_iot_shadow_delete(MQTTClient_t *pClient, const char *pThingName,
 
 	char deleteRequestJsonBuf[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
 	iot_shadow_delete_request_json(deleteRequestJsonBuf);
-	ret_val = iot_shadow_action(pClient, pThingName, SHADOW_DELETE, deleteRequestJsonBuf, callback, pContextData,
-			timeout_seconds, isPersistentSubscribe);
+	ret_val = iot_shadow_action(&defaultShadowContext, pThingName, SHADOW_DELETE, deleteRequestJsonBuf, callback,
+			pContextData, timeout_seconds, isPersistentSubscribe);
 
 	return ret_val;
 }
@@ -160,8 +188,63 @@ IoT_Error_t aws_iot_shadow_get(MQTTClient_t *pClient, const char *pThingName, fp
 
 	iot_shadow_get_request_json(getRequestJsonBuf);
 
-	ret_val = iot_shadow_action(pClient, pThingName, SHADOW_GET, getRequestJsonBuf, callback, pContextData,
-			timeout_seconds, isPersistentSubscribe);
+	ret_val = iot_shadow_action(&defaultShadowContext, pThingName, SHADOW_GET, getRequestJsonBuf, callback,
+			pContextData, timeout_seconds, isPersistentSubscribe);
 
 	return ret_val;
 }
+
+IoT_Error_t aws_iot_shadow_context_yield(ShadowContext_t *pContext, int timeout) {
+	if (pContext == NULL || pContext->pMqttClient == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	HandleExpiredResponseCallbacks(pContext);
+	saveShadowSnapshot();
+	return pContext->pMqttClient->yield(timeout);
+}
+
+IoT_Error_t aws_iot_shadow_context_update(ShadowContext_t *pContext, const char *pThingName, char *pJsonString,
+		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds) {
+
+	if (pContext == NULL || pContext->pMqttClient == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (!(pContext->pMqttClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	return iot_shadow_action(pContext, pThingName, SHADOW_UPDATE, pJsonString, callback, pContextData,
+			timeout_seconds, true);
+}
+
+IoT_Error_t aws_iot_shadow_context_delete(ShadowContext_t *pContext, const char *pThingName,
+		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds) {
+	char deleteRequestJsonBuf[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+
+	if (pContext == NULL || pContext->pMqttClient == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (!(pContext->pMqttClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	iot_shadow_delete_request_json(deleteRequestJsonBuf);
+	return iot_shadow_action(pContext, pThingName, SHADOW_DELETE, deleteRequestJsonBuf, callback, pContextData,
+			timeout_seconds, true);
+}
+
+IoT_Error_t aws_iot_shadow_context_get(ShadowContext_t *pContext, const char *pThingName,
+		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds) {
+	char getRequestJsonBuf[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+
+	if (pContext == NULL || pContext->pMqttClient == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (!(pContext->pMqttClient->isConnected())) {
+		return CONNECTION_ERROR;
+	}
+
+	iot_shadow_get_request_json(getRequestJsonBuf);
+	return iot_shadow_action(pContext, pThingName, SHADOW_GET, getRequestJsonBuf, callback, pContextData,
+			timeout_seconds, true);
+}
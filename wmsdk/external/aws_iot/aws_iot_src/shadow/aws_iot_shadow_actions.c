@@ -20,46 +20,87 @@
 #include "aws_iot_shadow_records.h"
 #include "aws_iot_config.h"
 
-IoT_Error_t iot_shadow_action(MQTTClient_t *pClient, const char *pThingName, ShadowActions_t action,
-		const char *pJsonDocumentToBeSent, fpActionCallback_t callback, void *pCallbackContext,
-		uint32_t timeout_seconds, bool isSticky) {
+// the document of an action, a string or written by the writer as it is published
+typedef struct {
+	const char *pJsonDocument;
+	fpShadowJsonWriter_t writer;
+	void *pWriterContext;
+} ShadowActionDocument_t;
+
+static IoT_Error_t runShadowAction(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		const ShadowActionDocument_t *pDocument, bool isClientTokenPresent, uint32_t clientTokenKey,
+		fpActionCallback_t callback, void *pCallbackContext, uint32_t timeout_seconds, bool isSticky) {
 
 	IoT_Error_t ret_val = NONE_ERROR;
 	bool isCallbackPresent = false;
-	bool isClientTokenPresent = false;
 	bool isAckWaitListFree = false;
-	uint8_t indexAckWaitList;
 
-	if(pClient == NULL || pThingName == NULL || pJsonDocumentToBeSent == NULL){
-		return NULL_VALUE_ERROR;
+	if (!isThingOfContext(pContext, pThingName)) {
+		return GENERIC_ERROR;
 	}
 
-	if (getNextFreeIndexOfAckWaitList(&indexAckWaitList)) {
+	if (!isAckWaitListFull(pContext)) {
 		isAckWaitListFree = true;
 	}
 	if (callback != NULL) {
 		isCallbackPresent = true;
 	}
 
-	char extractedClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
-	isClientTokenPresent = extractClientToken(pJsonDocumentToBeSent, extractedClientToken);
-
 	if (isClientTokenPresent && isCallbackPresent && isAckWaitListFree) {
-		if (!isSubscriptionPresent(pThingName, action)) {
-			ret_val = subscribeToShadowActionAcks(pThingName, action, isSticky);
+		ret_val = subscribeToShadowActionAcks(pContext, pThingName, action, isSticky);
+	}
+
+	// the response can come in as soon as the action is published, wait for it before that.
+	// Other threads may have taken the last free entries while the topics were subscribed
+	if (isClientTokenPresent && isCallbackPresent && ret_val == NONE_ERROR && isAckWaitListFree) {
+		isAckWaitListFree = addToAckWaitList(pContext, pThingName, action, clientTokenKey, callback,
+				pCallbackContext, timeout_seconds);
+		if (!isAckWaitListFree) {
+			unsubscribeFromShadowActionAcks(pContext, pThingName, action);
+		}
+	}
+
+	if (ret_val == NONE_ERROR) {
+		if (pDocument->pJsonDocument != NULL) {
+			ret_val = publishToShadowAction(pContext, pThingName, action, pDocument->pJsonDocument);
 		} else {
-			incrementSubscriptionCnt(pThingName, action, isSticky);
+			// the key of a token of ours is its sequence number
+			ret_val = publishStreamToShadowAction(pContext, pThingName, action, pDocument->writer,
+					pDocument->pWriterContext, clientTokenKey);
+		}
+		if (ret_val != NONE_ERROR && isClientTokenPresent && isCallbackPresent && isAckWaitListFree) {
+			cancelAckWaitListEntry(pContext, clientTokenKey);
 		}
 	}
+	return ret_val;
+}
 
+IoT_Error_t iot_shadow_action(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		const char *pJsonDocumentToBeSent, fpActionCallback_t callback, void *pCallbackContext,
+		uint32_t timeout_seconds, bool isSticky) {
+	ShadowActionDocument_t document = {pJsonDocumentToBeSent, NULL, NULL};
+	bool isClientTokenPresent;
+	uint32_t clientTokenKey = 0;
 
-	if (ret_val == NONE_ERROR) {
-		ret_val = publishToShadowAction(pThingName, action, pJsonDocumentToBeSent);
+	if(pContext == NULL || pThingName == NULL || pJsonDocumentToBeSent == NULL){
+		return NULL_VALUE_ERROR;
 	}
+	// the parse shares its tokens with the responses being dispatched
+	lockShadowRecords();
+	isClientTokenPresent = extractClientTokenKey(pJsonDocumentToBeSent, &clientTokenKey);
+	unlockShadowRecords();
+	return runShadowAction(pContext, pThingName, action, &document, isClientTokenPresent, clientTokenKey, callback,
+			pCallbackContext, timeout_seconds, isSticky);
+}
 
-	if (isClientTokenPresent && isCallbackPresent && ret_val == NONE_ERROR && isAckWaitListFree) {
-		addToAckWaitList(indexAckWaitList, pThingName, action, extractedClientToken, callback, pCallbackContext,
-				timeout_seconds);
+IoT_Error_t iot_shadow_action_stream(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		fpShadowJsonWriter_t writer, void *pWriterContext, fpActionCallback_t callback, void *pCallbackContext,
+		uint32_t timeout_seconds, bool isSticky) {
+	ShadowActionDocument_t document = {NULL, writer, pWriterContext};
+
+	if (pContext == NULL || pThingName == NULL || writer == NULL) {
+		return NULL_VALUE_ERROR;
 	}
-	return ret_val;
+	return runShadowAction(pContext, pThingName, action, &document, true, takeClientTokenNum(), callback,
+			pCallbackContext, timeout_seconds, isSticky);
 }
@@ -17,9 +17,13 @@
 #define SRC_SHADOW_AWS_IOT_SHADOW_ACTIONS_H_
 
 #include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_context.h"
 
-IoT_Error_t iot_shadow_action(MQTTClient_t *pClient, const char *pThingName, ShadowActions_t action,
+IoT_Error_t iot_shadow_action(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
 		const char *pJsonDocumentToBeSent, fpActionCallback_t callback, void *pCallbackContext,
 		uint32_t timeout_seconds, bool isSticky);
+IoT_Error_t iot_shadow_action_stream(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		fpShadowJsonWriter_t writer, void *pWriterContext, fpActionCallback_t callback, void *pCallbackContext,
+		uint32_t timeout_seconds, bool isSticky);
 
 #endif /* SRC_SHADOW_AWS_IOT_SHADOW_ACTIONS_H_ */
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_shadow_context.h
+ * @brief Thing Shadows of many Things over one MQTT connection.
+ *
+ * A shadow context keeps the state of every Thing it serves: the last version
+ * received, its delta callback and the actions waiting for a response. Instead of
+ * subscribing to the accepted/rejected topics of each Thing and action, a context
+ * subscribes once to three wildcard topics and tells the Things apart by the Thing
+ * Name in the topic, so the number of Things does not depend on the number of
+ * subscriptions the MQTT client can hold. This is meant for a gateway acting for
+ * its child devices.
+ * The aws_iot_shadow_update(), aws_iot_shadow_get() and aws_iot_shadow_delete()
+ * functions keep working on a context of their own, with per Thing subscriptions.
+ * A Thing should be handled by one context only.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_CONTEXT_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_CONTEXT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "timer_interface.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_config.h"
+
+/**
+ * @brief Delta Callback Type of a Thing served by a shadow context
+ *
+ * Called from the context of the MQTT yield with the state object of every delta
+ * of the Thing that is newer than the last version received.
+ *
+ * @param pThingName	Thing Name the delta is for
+ * @param pState		The state object of the delta, not NULL terminated
+ * @param stateLength	Length of pState
+ * @param pContextData	The data given when the Thing was added
+ */
+typedef void (*fpShadowDeltaCallback_t)(const char *pThingName, const char *pState, uint32_t stateLength,
+		void *pContextData);
+
+/**
+ * @brief Thing served by a shadow context
+ */
+typedef struct {
+	char thingName[MAX_SIZE_OF_THING_NAME];	///< NULL terminated Thing Name
+	uint32_t nameHash;						///< Hash of thingName, checked before comparing names
+	uint32_t version;						///< Last version received for the Thing, from get/accepted and delta
+	fpShadowDeltaCallback_t deltaCallback;	///< Could be NULL if the deltas are not needed
+	void *pDeltaContext;					///< Passed back to deltaCallback
+	bool isUsed;							///< False for a free entry
+} ShadowThing_t;
+
+/**
+ * @brief Action waiting for its accepted/rejected response
+ */
+typedef struct {
+	uint32_t clientTokenKey;				///< Sequence number of the client token, a hash of it for a token of another format
+	char thingName[MAX_SIZE_OF_THING_NAME];
+	ShadowActions_t action;
+	fpActionCallback_t callback;
+	void *pCallbackContext;
+	uint16_t heapIndex;						///< Position in ackExpiryHeap
+	bool isFree;
+	Timer timer;
+} ToBeReceivedAckRecord_t;
+
+#if MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME <= 8
+#define SHADOW_ACK_WAIT_HASH_SLOTS 16
+#elif MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME <= 32
+#define SHADOW_ACK_WAIT_HASH_SLOTS 64
+#elif MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME <= 128
+#define SHADOW_ACK_WAIT_HASH_SLOTS 256
+#elif MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME <= 512
+#define SHADOW_ACK_WAIT_HASH_SLOTS 1024
+#elif MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME <= 2048
+#define SHADOW_ACK_WAIT_HASH_SLOTS 4096
+#else
+#error "MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME is larger than the ack wait list supports"
+#endif
+
+/**
+ * @brief Shadow Context Type
+ *
+ * Set up by aws_iot_shadow_context_init(), its members are internal.
+ */
+typedef struct {
+	MQTTClient_t *pMqttClient;					///< MQTT client the context works through
+	ShadowThing_t *pThings;						///< Things served, set aside by the application
+	uint8_t maxThings;							///< Number of entries in pThings
+	bool isWildcard;							///< Responses of every Thing come in on the wildcard subscriptions
+	ToBeReceivedAckRecord_t ackWaitList[MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME];	///< Actions waiting for a response
+	uint16_t ackWaitHash[SHADOW_ACK_WAIT_HASH_SLOTS];	///< Entries of ackWaitList by client token key, at most half full
+	uint16_t ackExpiryHeap[MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME];	///< Entries of ackWaitList, the first ackWaitCount ordered by timeout, the free ones after them
+	uint16_t ackWaitCount;						///< Actions waiting for a response
+} ShadowContext_t;
+
+/**
+ * @brief Set up a shadow context and subscribe to its wildcard topics
+ *
+ * The MQTT client has to be connected. The responses and deltas of every Thing come in
+ * on $aws/things/+/shadow/+/accepted, $aws/things/+/shadow/+/rejected and
+ * $aws/things/+/shadow/update/delta, which take three of the subscriptions of the
+ * MQTT client. One context can be set up at a time, setting up another one replaces it.
+ *
+ * @param pContext	Context to set up, must stay valid while in use
+ * @param pClient	MQTT Client used as the protocol layer
+ * @param pThings	Storage for the Things served, must stay valid while in use
+ * @param maxThings	Number of entries in pThings
+ * @return An IoT Error Type defining successful/failed setup of the context
+ */
+IoT_Error_t aws_iot_shadow_context_init(ShadowContext_t *pContext, MQTTClient_t *pClient, ShadowThing_t *pThings,
+		uint8_t maxThings);
+
+/**
+ * @brief Serve the shadow of a Thing through a context
+ *
+ * @param pContext		Shadow context
+ * @param pThingName	Thing Name, shorter than #MAX_SIZE_OF_THING_NAME
+ * @param deltaCallback	Called with the deltas of the Thing, could be NULL
+ * @param pContextData	Passed back to deltaCallback, could be NULL
+ * @return An IoT Error Type, GENERIC_ERROR if every Thing entry is used
+ */
+IoT_Error_t aws_iot_shadow_context_add_thing(ShadowContext_t *pContext, const char *pThingName,
+		fpShadowDeltaCallback_t deltaCallback, void *pContextData);
+
+/**
+ * @brief Stop serving the shadow of a Thing
+ *
+ * Actions of the Thing still waiting for a response are left to time out.
+ *
+ * @param pContext		Shadow context
+ * @param pThingName	Thing Name given to aws_iot_shadow_context_add_thing()
+ * @return An IoT Error Type, GENERIC_ERROR if the Thing is not served
+ */
+IoT_Error_t aws_iot_shadow_context_remove_thing(ShadowContext_t *pContext, const char *pThingName);
+
+/**
+ * @brief Last version received for a Thing
+ *
+ * @param pContext		Shadow context
+ * @param pThingName	Thing Name
+ * @return The version number, 0 if none was received or the Thing is not served
+ */
+uint32_t aws_iot_shadow_context_get_version(ShadowContext_t *pContext, const char *pThingName);
+
+/**
+ * @brief Update the shadow of a Thing served by a context
+ *
+ * Same as aws_iot_shadow_update(), without subscribing to the response topics of the Thing.
+ *
+ * @param pContext			Shadow context
+ * @param pThingName		Thing Name, served by the context
+ * @param pJsonString		The update action expects a JSON document to send
+ * @param callback			Called with the response, or on timeout. Could be NULL
+ * @param pContextData		Passed back to the callback, could be NULL
+ * @param timeout_seconds	Time to wait for the response
+ * @return An IoT Error Type defining successful/failed update action
+ */
+IoT_Error_t aws_iot_shadow_context_update(ShadowContext_t *pContext, const char *pThingName, char *pJsonString,
+		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds);
+
+/**
+ * @brief Get the shadow of a Thing served by a context
+ *
+ * @param pContext			Shadow context
+ * @param pThingName		Thing Name, served by the context
+ * @param callback			Called with the response, or on timeout. Could be NULL
+ * @param pContextData		Passed back to the callback, could be NULL
+ * @param timeout_seconds	Time to wait for the response
+ * @return An IoT Error Type defining successful/failed get action
+ */
+IoT_Error_t aws_iot_shadow_context_get(ShadowContext_t *pContext, const char *pThingName,
+		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds);
+
+/**
+ * @brief Delete the shadow of a Thing served by a context
+ *
+ * @param pContext			Shadow context
+ * @param pThingName		Thing Name, served by the context
+ * @param callback			Called with the response, or on timeout. Could be NULL
+ * @param pContextData		Passed back to the callback, could be NULL
+ * @param timeout_seconds	Time to wait for the response
+ * @return An IoT Error Type defining successful/failed delete action
+ */
+IoT_Error_t aws_iot_shadow_context_delete(ShadowContext_t *pContext, const char *pThingName,
+		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds);
+
+/**
+ * @brief Yield to the MQTT client and time out the actions of a context
+ *
+ * Same as aws_iot_shadow_yield() for the Things of the context.
+ *
+ * @param pContext	Shadow context
+ * @param timeout	Maximum time to yield to the MQTT client, in ms
+ * @return An IoT Error Type defining successful/failed yield
+ */
+IoT_Error_t aws_iot_shadow_context_yield(ShadowContext_t *pContext, int timeout);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_CONTEXT_H_ */
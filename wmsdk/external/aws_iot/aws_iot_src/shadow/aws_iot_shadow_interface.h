@@ -67,7 +67,9 @@ extern const ShadowParameters_t ShadowParametersDefault;
 /**
  * @brief Initialize the Thing Shadow before use
  *
- * This function takes care of initializing the internal book-keeping data structures
+ * This function takes care of initializing the internal book-keeping data structures.
+ * With a snapshot store set, it also reads back the snapshot of the shadow, see
+ * aws_iot_shadow_snapshot.h
  *
  * @param pClient	MQTT Client used as the protocol layer
  * @return An IoT Error Type defining successful/failed Initialization
@@ -167,6 +169,43 @@ typedef void (*fpActionCallback_t)(const char *pThingName, ShadowActions_t actio
 IoT_Error_t aws_iot_shadow_update(MQTTClient_t *pClient, const char *pThingName, char *pJsonString,
 		fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds, bool isPersistentSubscribe);
 
+/**
+ * @brief Update a Thing Name's Shadow with a document written as it is published
+ *
+ * Works as aws_iot_shadow_update() does, but the document is never held in RAM as a
+ * whole. The writer adds its members to the outermost object of a streamed builder,
+ * see aws_iot_shadow_builder_init_stream(), and the client token is added after them.
+ * The document goes through a window of #AWS_IOT_SHADOW_STREAM_WINDOW_LEN bytes
+ * straight into the MQTT client, so a report can be far bigger than the TX buffer.
+ *
+ * The MQTT header carries the length of the document, so the writer is called twice:
+ * once to count the bytes and once, from the thread sending the publish, to send them.
+ * Both calls must write the same document. The update is published at QoS 0.
+ *
+ * @code
+ * static IoT_Error_t writeReport(ShadowJsonBuilder_t *pBuilder, void *pContextData) {
+ *     aws_iot_shadow_builder_begin_object(pBuilder, "state");
+ *     aws_iot_shadow_builder_begin_object(pBuilder, "reported");
+ *     return aws_iot_shadow_schema_add(pBuilder, &deviceSchema, pContextData, SHADOW_SCHEMA_ALL_FIELDS);
+ * }
+ *
+ * rc = aws_iot_shadow_update_stream(&mqttClient, "myThing", writeReport, &device, callback, NULL, 4, true);
+ * @endcode
+ *
+ * @param pClient	MQTT Client used as the protocol layer, it must implement publishStream
+ * @param pThingName Thing Name of the shadow that needs to be Updated
+ * @param writer	Adds the members of the document, called twice
+ * @param pWriterContext Passed to the writer, could be NULL
+ * @param callback This is the callback that will be used to inform the caller of the response from the AWS IoT Shadow service.Callback could be set to NULL if response is not important
+ * @param pContextData This is an extra parameter that could be passed along with the callback. It should be set to NULL if not used
+ * @param timeout_seconds It is the time the SDK will wait for the response on either accepted/rejected before declaring timeout on the action
+ * @param isPersistentSubscribe As with aws_iot_shadow_update()
+ * @return An IoT Error Type defining successful/failed update action, or the error of the writer
+ */
+IoT_Error_t aws_iot_shadow_update_stream(MQTTClient_t *pClient, const char *pThingName, fpShadowJsonWriter_t writer,
+		void *pWriterContext, fpActionCallback_t callback, void *pContextData, uint8_t timeout_seconds,
+		bool isPersistentSubscribe);
+
 /**
  * @brief This function is the one used to perform an Get action to a Thing Name's Shadow.
  *
@@ -204,6 +243,8 @@ IoT_Error_t aws_iot_shadow_delete(MQTTClient_t *pClient, const char *pThingName,
  * @brief This function is used to listen on the delta topic of #AWS_IOT_MY_THING_NAME mentioned in the aws_iot_config.h file.
  *
  * Any time a delta is published the Json document will be delivered to the pStruct->cb. If you don't want the parsing done by the SDK then use the jsonStruct_t key set to "state". A good example of this is displayed in the sample_apps/shadow_console_echo.c
+ * The key is the path of the value from the state object, nested keys are joined with dots, for example "light.color" for {"state":{"light":{"color":"red"}}}
+ * A delta bigger than the RX buffer is parsed as its chunks arrive, see #AWS_IOT_MQTT_RX_CHUNK_LEN. Its values that are not objects are still delivered, but not the whole state to the key "state"
  *
  * @param pClient MQTT Client used as the protocol layer
  * @param pStruct The struct used to parse JSON value
@@ -17,27 +17,53 @@
 
 #include <string.h>
 #include <stdbool.h>
-#include <inttypes.h>
+#include <wm_os.h>
 #include <jsmn.h>
 #include "aws_iot_json_utils.h"
+#include "aws_iot_json_tokenizer.h"
+#include "aws_iot_json_index.h"
+#include "aws_iot_json_number.h"
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_key.h"
 #include "aws_iot_config.h"
 
-static uint32_t clientTokenNum = 0;
+#if AWS_IOT_JSON_FLOAT_DECIMALS > AWS_IOT_JSON_MAX_DECIMALS
+#error "AWS_IOT_JSON_FLOAT_DECIMALS is more than aws_iot_json_format_double() writes"
+#endif
+
+#define CLIENT_TOKEN_MAX_LEN (MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES + AWS_IOT_JSON_NUMBER_MAX_LEN)
 
-//helper functions
-static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
-		void *pData);
+static uint32_t clientTokenNum = 0;
 
 void resetClientTokenSequenceNum(void) {
 	clientTokenNum = 0;
 }
 
+// the documents of the actions may be written by several threads, each token is taken once
+uint32_t takeClientTokenNum(void) {
+	unsigned long state = os_enter_critical_section();
+	uint32_t tokenNum = clientTokenNum++;
+
+	os_exit_critical_section(state);
+	return tokenNum;
+}
+
+// the client id and the sequence number, NULL terminated. pToken has CLIENT_TOKEN_MAX_LEN bytes
+static size_t formatClientToken(char *pToken, uint32_t tokenNum) {
+	size_t length = strlen(AWS_IOT_MQTT_CLIENT_ID);
+
+	memcpy(pToken, AWS_IOT_MQTT_CLIENT_ID, length);
+	pToken[length++] = '-';
+	return length + aws_iot_json_format_uint32(pToken + length, tokenNum);
+}
+
 static void emptyJsonWithClientToken(char *pJsonDocument) {
-	sprintf(pJsonDocument, "{\"clientToken\":\"");
-	FillWithClientToken(pJsonDocument + strlen(pJsonDocument));
-	sprintf(pJsonDocument + strlen(pJsonDocument), "\"}");
+	static const char prefix[] = "{\"" SHADOW_CLIENT_TOKEN_STRING "\":\"";
+	size_t length = sizeof(prefix) - 1;
+
+	memcpy(pJsonDocument, prefix, length);
+	length += formatClientToken(pJsonDocument + length, takeClientTokenNum());
+	memcpy(pJsonDocument + length, "\"}", 3);
 }
 
 void iot_shadow_get_request_json(char *pJsonDocument) {
@@ -74,248 +100,465 @@ IoT_Error_t aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSiz
 
 }
 
-IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
-	IoT_Error_t ret_val = NONE_ERROR;
-	int32_t tempSize = 0;
-	int8_t i;
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	va_list pArgs;
-	va_start(pArgs, count);
-	jsonStruct_t *pTemporary;
+// the length snprintf() would give, the token is cut to the buffer
+static int32_t FillWithClientTokenSize(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument) {
+	char token[CLIENT_TOKEN_MAX_LEN];
+	size_t length = formatClientToken(token, takeClientTokenNum());
 
-	if (pJsonDocument == NULL) {
-		return NULL_VALUE_ERROR;
+	if (0 < maxSizeOfJsonDocument) {
+		memcpy(pBufferToBeUpdatedWithClientToken, token,
+				(length < maxSizeOfJsonDocument) ? length + 1 : maxSizeOfJsonDocument);
+		pBufferToBeUpdatedWithClientToken[maxSizeOfJsonDocument - 1] = '\0';
 	}
+	return (int32_t)length;
+}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-		if(tempSize <= 1){
-			return SHADOW_JSON_ERROR;
+// hands a piece of a streamed document to its flush callback
+static void builderPass(ShadowJsonBuilder_t *pBuilder, const char *pData, size_t length) {
+	if (0 < length) {
+		pBuilder->error = pBuilder->flush(pData, length, pBuilder->pFlushContext);
+		pBuilder->flushedLength += length;
+	}
+}
+
+static void builderAppend(ShadowJsonBuilder_t *pBuilder, const char *pData, size_t length) {
+	if (NONE_ERROR != pBuilder->error) {
+		return;
+	}
+	// one byte stays free for the NULL termination
+	if (length >= pBuilder->size - pBuilder->length) {
+		if (NULL == pBuilder->flush) {
+			pBuilder->error = SHADOW_JSON_BUFFER_TRUNCATED;
+			return;
 		}
-		remSizeOfJsonBuffer = tempSize;
+		builderPass(pBuilder, pBuilder->pBuffer, pBuilder->length);
+		pBuilder->length = 0;
+		pBuilder->pBuffer[0] = '\0';
+		if (NONE_ERROR != pBuilder->error) {
+			return;
+		}
+		if (length >= pBuilder->size) {
+			// bigger than the window, passed on as it is
+			builderPass(pBuilder, pData, length);
+			return;
+		}
+	}
+	memcpy(pBuilder->pBuffer + pBuilder->length, pData, length);
+	pBuilder->length += length;
+	pBuilder->pBuffer[pBuilder->length] = '\0';
+}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"desired\":{");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+static void builderAppendString(ShadowJsonBuilder_t *pBuilder, const char *pString) {
+	static const char hexDigits[] = "0123456789abcdef";
+	const char *pRun = pString;
+	char escape[6] = {'\\', 'u', '0', '0'};
 
-	if (ret_val != NONE_ERROR) {
-		return ret_val;
+	builderAppend(pBuilder, "\"", 1);
+	// characters are copied a run at a time, only the ones JSON does not allow raw are escaped
+	for (; '\0' != *pString; pString++) {
+		if ('"' != *pString && '\\' != *pString && (unsigned char)*pString >= 0x20) {
+			continue;
+		}
+		builderAppend(pBuilder, pRun, pString - pRun);
+		if ('"' == *pString || '\\' == *pString) {
+			escape[1] = *pString;
+			builderAppend(pBuilder, escape, 2);
+			escape[1] = 'u';
+		} else {
+			escape[4] = hexDigits[(unsigned char)*pString >> 4];
+			escape[5] = hexDigits[*pString & 0x0F];
+			builderAppend(pBuilder, escape, sizeof(escape));
+		}
+		pRun = pString + 1;
 	}
+	builderAppend(pBuilder, pRun, pString - pRun);
+	builderAppend(pBuilder, "\"", 1);
+}
 
-	for (i = 0; i < count; i++) {
-		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-			if(tempSize <= 1){
-				return SHADOW_JSON_ERROR;
-			}
-			remSizeOfJsonBuffer = tempSize;
-		pTemporary = va_arg (pArgs, jsonStruct_t *);
-		if (pTemporary != NULL) {
-			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
-					pTemporary->pKey);
-			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-			if (pTemporary->pKey != NULL && pTemporary->pData != NULL) {
-				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
-						pTemporary->type, pTemporary->pData);
-			} else {
-				return NULL_VALUE_ERROR;
-			}
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-		} else {
-			return NULL_VALUE_ERROR;
+static void builderBeginMember(ShadowJsonBuilder_t *pBuilder, const char *pKey) {
+	uint32_t depthBit = (uint32_t)1 << pBuilder->depth;
+
+	if (pBuilder->hasMembers & depthBit) {
+		builderAppend(pBuilder, ",", 1);
+	}
+	pBuilder->hasMembers |= depthBit;
+	// members of an object need a key, elements of an array must not have one
+	if ((NULL == pKey) != (0 != (pBuilder->isArray & depthBit))) {
+		if (NONE_ERROR == pBuilder->error) {
+			pBuilder->error = SHADOW_JSON_ERROR;
 		}
+		return;
+	}
+	if (NULL != pKey) {
+		builderAppendString(pBuilder, pKey);
+		builderAppend(pBuilder, ":", 1);
 	}
+}
 
-	va_end(pArgs);
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-	return ret_val;
+static IoT_Error_t builderBegin(ShadowJsonBuilder_t *pBuilder, const char *pKey, bool isArray) {
+	uint32_t depthBit;
+
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	if (pBuilder->depth + 1 >= SHADOW_JSON_BUILDER_MAX_DEPTH) {
+		if (NONE_ERROR == pBuilder->error) {
+			pBuilder->error = SHADOW_JSON_ERROR;
+		}
+		return pBuilder->error;
+	}
+	builderBeginMember(pBuilder, pKey);
+	builderAppend(pBuilder, isArray ? "[" : "{", 1);
+
+	pBuilder->depth++;
+	depthBit = (uint32_t)1 << pBuilder->depth;
+	pBuilder->hasMembers &= ~depthBit;
+	if (isArray) {
+		pBuilder->isArray |= depthBit;
+	} else {
+		pBuilder->isArray &= ~depthBit;
+	}
+	return pBuilder->error;
 }
 
-IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
-	IoT_Error_t ret_val = NONE_ERROR;
+static void builderAppendClientToken(ShadowJsonBuilder_t *pBuilder, uint32_t tokenNum) {
+	char token[CLIENT_TOKEN_MAX_LEN];
 
-	int8_t i;
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	int32_t tempSize = 0;
-	va_list pArgs;
-	va_start(pArgs, count);
-	jsonStruct_t *pTemporary;
+	builderAppend(pBuilder, "\"", 1);
+	builderAppend(pBuilder, token, formatClientToken(token, tokenNum));
+	builderAppend(pBuilder, "\"", 1);
+}
 
-	if (pJsonDocument == NULL) {
+IoT_Error_t aws_iot_shadow_builder_init(ShadowJsonBuilder_t *pBuilder, char *pBuffer, size_t size) {
+	return aws_iot_shadow_builder_init_stream(pBuilder, pBuffer, size, NULL, NULL);
+}
+
+IoT_Error_t aws_iot_shadow_builder_init_stream(ShadowJsonBuilder_t *pBuilder, char *pBuffer, size_t size,
+		fpShadowJsonFlush_t flush, void *pFlushContext) {
+	if (NULL == pBuilder) {
 		return NULL_VALUE_ERROR;
 	}
+	pBuilder->pBuffer = pBuffer;
+	pBuilder->size = size;
+	pBuilder->length = 0;
+	pBuilder->depth = 0;
+	pBuilder->hasMembers = 0;
+	pBuilder->isArray = 0;
+	pBuilder->error = NONE_ERROR;
+	pBuilder->flush = flush;
+	pBuilder->pFlushContext = pFlushContext;
+	pBuilder->flushedLength = 0;
+
+	if (NULL == pBuffer || 0 == size) {
+		pBuilder->size = 0;
+		pBuilder->error = NULL_VALUE_ERROR;
+		return pBuilder->error;
+	}
+	pBuffer[0] = '\0';
+	builderAppend(pBuilder, "{", 1);
+	return pBuilder->error;
+}
 
+IoT_Error_t aws_iot_shadow_builder_begin_object(ShadowJsonBuilder_t *pBuilder, const char *pKey) {
+	return builderBegin(pBuilder, pKey, false);
+}
 
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
-		return SHADOW_JSON_ERROR;
+IoT_Error_t aws_iot_shadow_builder_begin_array(ShadowJsonBuilder_t *pBuilder, const char *pKey) {
+	return builderBegin(pBuilder, pKey, true);
+}
+
+IoT_Error_t aws_iot_shadow_builder_end(ShadowJsonBuilder_t *pBuilder) {
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	if (0 == pBuilder->depth) {
+		// the outermost object is closed by aws_iot_shadow_builder_finalize()
+		if (NONE_ERROR == pBuilder->error) {
+			pBuilder->error = SHADOW_JSON_ERROR;
+		}
+		return pBuilder->error;
 	}
-	remSizeOfJsonBuffer = tempSize;
+	builderAppend(pBuilder, (pBuilder->isArray & ((uint32_t)1 << pBuilder->depth)) ? "]" : "}", 1);
+	pBuilder->depth--;
+	return pBuilder->error;
+}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"reported\":{");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+IoT_Error_t aws_iot_shadow_builder_add_int32(ShadowJsonBuilder_t *pBuilder, const char *pKey, int32_t value) {
+	char number[AWS_IOT_JSON_NUMBER_MAX_LEN];
 
-	if (ret_val != NONE_ERROR) {
-		return ret_val;
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
 	}
+	builderBeginMember(pBuilder, pKey);
+	builderAppend(pBuilder, number, aws_iot_json_format_int32(number, value));
+	return pBuilder->error;
+}
 
-	for (i = 0; i < count; i++) {
-		tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-		if(tempSize <= 1){
-			return SHADOW_JSON_ERROR;
-		}
-		remSizeOfJsonBuffer = tempSize;
-
-		pTemporary = va_arg (pArgs, jsonStruct_t *);
-		if (pTemporary != NULL) {
-			snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"%s\":",
-					pTemporary->pKey);
-			ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-			if (pTemporary->pKey != NULL && pTemporary->pData != NULL) {
-				ret_val = convertDataToString(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer,
-						pTemporary->type, pTemporary->pData);
-			} else {
-				return NULL_VALUE_ERROR;
-			}
-			if (ret_val != NONE_ERROR) {
-				return ret_val;
-			}
-		} else {
-			return NULL_VALUE_ERROR;
-		}
+IoT_Error_t aws_iot_shadow_builder_add_uint32(ShadowJsonBuilder_t *pBuilder, const char *pKey, uint32_t value) {
+	char number[AWS_IOT_JSON_NUMBER_MAX_LEN];
+
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
 	}
+	builderBeginMember(pBuilder, pKey);
+	builderAppend(pBuilder, number, aws_iot_json_format_uint32(number, value));
+	return pBuilder->error;
+}
 
-	va_end(pArgs);
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "},");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
-	return ret_val;
+IoT_Error_t aws_iot_shadow_builder_add_double(ShadowJsonBuilder_t *pBuilder, const char *pKey, double value) {
+	char number[AWS_IOT_JSON_NUMBER_MAX_LEN];
+
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	builderBeginMember(pBuilder, pKey);
+	builderAppend(pBuilder, number, aws_iot_json_format_double(number, value, AWS_IOT_JSON_FLOAT_DECIMALS));
+	return pBuilder->error;
 }
 
+IoT_Error_t aws_iot_shadow_builder_add_bool(ShadowJsonBuilder_t *pBuilder, const char *pKey, bool value) {
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	builderBeginMember(pBuilder, pKey);
+	if (value) {
+		builderAppend(pBuilder, "true", 4);
+	} else {
+		builderAppend(pBuilder, "false", 5);
+	}
+	return pBuilder->error;
+}
 
-int32_t FillWithClientTokenSize(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument) {
-	int32_t snPrintfReturn;
-	snPrintfReturn = snprintf(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument, "%s-%d", AWS_IOT_MQTT_CLIENT_ID,
-			clientTokenNum++);
+IoT_Error_t aws_iot_shadow_builder_add_value(ShadowJsonBuilder_t *pBuilder, const char *pKey, JsonPrimitiveType type,
+		const void *pData) {
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	if (NULL == pData) {
+		if (NONE_ERROR == pBuilder->error) {
+			pBuilder->error = NULL_VALUE_ERROR;
+		}
+		return pBuilder->error;
+	}
 
-	return snPrintfReturn;
+	switch (type) {
+	case SHADOW_JSON_INT32:
+		return aws_iot_shadow_builder_add_int32(pBuilder, pKey, *(const int32_t *)pData);
+	case SHADOW_JSON_INT16:
+		return aws_iot_shadow_builder_add_int32(pBuilder, pKey, *(const int16_t *)pData);
+	case SHADOW_JSON_INT8:
+		return aws_iot_shadow_builder_add_int32(pBuilder, pKey, *(const int8_t *)pData);
+	case SHADOW_JSON_UINT32:
+		return aws_iot_shadow_builder_add_uint32(pBuilder, pKey, *(const uint32_t *)pData);
+	case SHADOW_JSON_UINT16:
+		return aws_iot_shadow_builder_add_uint32(pBuilder, pKey, *(const uint16_t *)pData);
+	case SHADOW_JSON_UINT8:
+		return aws_iot_shadow_builder_add_uint32(pBuilder, pKey, *(const uint8_t *)pData);
+	case SHADOW_JSON_DOUBLE:
+		return aws_iot_shadow_builder_add_double(pBuilder, pKey, *(const double *)pData);
+	case SHADOW_JSON_FLOAT:
+		return aws_iot_shadow_builder_add_double(pBuilder, pKey, *(const float *)pData);
+	case SHADOW_JSON_BOOL:
+		return aws_iot_shadow_builder_add_bool(pBuilder, pKey, *(const bool *)pData);
+	case SHADOW_JSON_STRING:
+		builderBeginMember(pBuilder, pKey);
+		builderAppendString(pBuilder, (const char *)pData);
+		break;
+	case SHADOW_JSON_OBJECT:
+		builderBeginMember(pBuilder, pKey);
+		builderAppend(pBuilder, (const char *)pData, strlen((const char *)pData));
+		break;
+	}
+	return pBuilder->error;
 }
 
-IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument){
+IoT_Error_t aws_iot_shadow_builder_add(ShadowJsonBuilder_t *pBuilder, const jsonStruct_t *pStruct) {
+	if (NULL == pStruct) {
+		return NULL_VALUE_ERROR;
+	}
+	return aws_iot_shadow_builder_add_value(pBuilder, pStruct->pKey, pStruct->type, pStruct->pData);
+}
 
-	int32_t snPrintfRet = 0;
-	snPrintfRet = FillWithClientTokenSize(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument);
-	return checkReturnValueOfSnPrintf(snPrintfRet, maxSizeOfJsonDocument);
+static IoT_Error_t builderFinalize(ShadowJsonBuilder_t *pBuilder, uint32_t tokenNum) {
+	while (0 < pBuilder->depth) {
+		aws_iot_shadow_builder_end(pBuilder);
+	}
+	builderBeginMember(pBuilder, SHADOW_CLIENT_TOKEN_STRING);
+	builderAppendClientToken(pBuilder, tokenNum);
+	builderAppend(pBuilder, "}", 1);
+	if (NULL != pBuilder->flush && NONE_ERROR == pBuilder->error) {
+		builderPass(pBuilder, pBuilder->pBuffer, pBuilder->length);
+		pBuilder->length = 0;
+		pBuilder->pBuffer[0] = '\0';
+	}
+	return pBuilder->error;
+}
 
+IoT_Error_t aws_iot_shadow_builder_finalize(ShadowJsonBuilder_t *pBuilder) {
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	return builderFinalize(pBuilder, takeClientTokenNum());
 }
 
-IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
-	size_t remSizeOfJsonBuffer = maxSizeOfJsonDocument;
-	int32_t snPrintfReturn = 0;
-	int32_t tempSize = 0;
-	IoT_Error_t ret_val = NONE_ERROR;
+IoT_Error_t writeShadowJsonStream(fpShadowJsonWriter_t writer, void *pWriterContext, uint32_t tokenNum,
+		fpShadowJsonFlush_t flush, void *pFlushContext, size_t *pLength) {
+	// a window per call, documents streamed from several threads share nothing
+	char window[AWS_IOT_SHADOW_STREAM_WINDOW_LEN];
+	ShadowJsonBuilder_t builder;
+	IoT_Error_t ret_val;
+
+	aws_iot_shadow_builder_init_stream(&builder, window, sizeof(window), flush, pFlushContext);
+	ret_val = writer(&builder, pWriterContext);
+	if (NONE_ERROR == ret_val) {
+		ret_val = builderFinalize(&builder, tokenNum);
+	}
+	*pLength = builder.flushedLength;
+	return ret_val;
+}
 
+// picks up a document of the varargs API where the previous call left it, without the builder state of its objects
+static IoT_Error_t resumeJsonDocument(ShadowJsonBuilder_t *pBuilder, char *pJsonDocument,
+		size_t maxSizeOfJsonDocument) {
 	if (pJsonDocument == NULL) {
 		return NULL_VALUE_ERROR;
 	}
-
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
+	pBuilder->pBuffer = pJsonDocument;
+	pBuilder->size = maxSizeOfJsonDocument;
+	pBuilder->length = strlen(pJsonDocument);
+	pBuilder->depth = 0;
+	pBuilder->hasMembers = 0;
+	pBuilder->isArray = 0;
+	pBuilder->error = NONE_ERROR;
+	pBuilder->flush = NULL;
+	pBuilder->pFlushContext = NULL;
+	pBuilder->flushedLength = 0;
+	if (maxSizeOfJsonDocument <= pBuilder->length + 1) {
 		return SHADOW_JSON_ERROR;
 	}
-	remSizeOfJsonBuffer = tempSize;
+	return NONE_ERROR;
+}
 
-	// strlen(ShadowTxBuffer) - 1 is to ensure we remove the last ,(comma) that was added
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument) - 1, remSizeOfJsonBuffer, "}, \"%s\":\"",
-			SHADOW_CLIENT_TOKEN_STRING);
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+static IoT_Error_t addSection(char *pJsonDocument, size_t maxSizeOfJsonDocument, const char *pSectionKey, uint8_t count,
+		va_list pArgs) {
+	ShadowJsonBuilder_t builder;
+	IoT_Error_t ret_val;
+	jsonStruct_t *pTemporary;
+	va_list pCheckArgs;
+	size_t startLength;
+	uint8_t i;
 
+	ret_val = resumeJsonDocument(&builder, pJsonDocument, maxSizeOfJsonDocument);
 	if (ret_val != NONE_ERROR) {
 		return ret_val;
 	}
-	// refactor this XXX repeated code
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
-		return SHADOW_JSON_ERROR;
-	}
-	remSizeOfJsonBuffer = tempSize;
-
-
-	snPrintfReturn = FillWithClientTokenSize(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer);
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
 
+	// every entry is checked before anything is written, a failed call leaves the document as it was
+	va_copy(pCheckArgs, pArgs);
+	for (i = 0; i < count; i++) {
+		pTemporary = va_arg(pCheckArgs, jsonStruct_t *);
+		if (pTemporary == NULL || pTemporary->pKey == NULL || pTemporary->pData == NULL) {
+			ret_val = NULL_VALUE_ERROR;
+			break;
+		}
+	}
+	va_end(pCheckArgs);
 	if (ret_val != NONE_ERROR) {
 		return ret_val;
 	}
-	tempSize = maxSizeOfJsonDocument - strlen(pJsonDocument);
-	if(tempSize <= 1){
-		return SHADOW_JSON_ERROR;
+
+	startLength = builder.length;
+	aws_iot_shadow_builder_begin_object(&builder, pSectionKey);
+	for (i = 0; i < count; i++) {
+		aws_iot_shadow_builder_add(&builder, va_arg(pArgs, jsonStruct_t *));
 	}
-	remSizeOfJsonBuffer = tempSize;
+	aws_iot_shadow_builder_end(&builder);
+	// the comma is taken back by the next section or by aws_iot_finalize_json_document()
+	builderAppend(&builder, ",", 1);
+	if (builder.error != NONE_ERROR) {
+		pJsonDocument[startLength] = '\0';
+	}
+	return builder.error;
+}
+
+IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
 
+	va_start(pArgs, count);
+	ret_val = addSection(pJsonDocument, maxSizeOfJsonDocument, SHADOW_DESIRED_STRING, count, pArgs);
+	va_end(pArgs);
+	return ret_val;
+}
 
-	snPrintfReturn = snprintf(pJsonDocument + strlen(pJsonDocument), remSizeOfJsonBuffer, "\"}");
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, remSizeOfJsonBuffer);
+IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...) {
+	IoT_Error_t ret_val;
+	va_list pArgs;
 
+	va_start(pArgs, count);
+	ret_val = addSection(pJsonDocument, maxSizeOfJsonDocument, SHADOW_REPORTED_STRING, count, pArgs);
+	va_end(pArgs);
 	return ret_val;
 }
 
-void FillWithClientToken(char *pBufferToBeUpdatedWithClientToken) {
-	sprintf(pBufferToBeUpdatedWithClientToken, "%s-%d", AWS_IOT_MQTT_CLIENT_ID, clientTokenNum++);
+IoT_Error_t aws_iot_fill_with_client_token(char *pBufferToBeUpdatedWithClientToken, size_t maxSizeOfJsonDocument){
+
+	int32_t snPrintfRet = 0;
+	snPrintfRet = FillWithClientTokenSize(pBufferToBeUpdatedWithClientToken, maxSizeOfJsonDocument);
+	return checkReturnValueOfSnPrintf(snPrintfRet, maxSizeOfJsonDocument);
+
 }
 
-static IoT_Error_t convertDataToString(char *pStringBuffer, size_t maxSizoStringBuffer, JsonPrimitiveType type,
-		void *pData) {
-	int32_t snPrintfReturn = 0;
-	IoT_Error_t ret_val = NONE_ERROR;
+IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument) {
+	ShadowJsonBuilder_t builder;
+	IoT_Error_t ret_val;
 
-	if (maxSizoStringBuffer == 0) {
-		return SHADOW_JSON_ERROR;
+	ret_val = resumeJsonDocument(&builder, pJsonDocument, maxSizeOfJsonDocument);
+	if (ret_val != NONE_ERROR) {
+		return ret_val;
 	}
 
-	if (type == SHADOW_JSON_INT32) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIi32",", *(int32_t * )(pData));
-	} else if (type == SHADOW_JSON_INT16) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIi16",", *(int16_t * )(pData));
-	} else if (type == SHADOW_JSON_INT8) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIi8",", *(int8_t * )(pData));
-	} else if (type == SHADOW_JSON_UINT32) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIu32",", *(uint32_t * )(pData));
-	} else if (type == SHADOW_JSON_UINT16) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIu16",", *(uint16_t * )(pData));
-	} else if (type == SHADOW_JSON_UINT8) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%"PRIu8",", *(uint8_t * )(pData));
-	} else if (type == SHADOW_JSON_DOUBLE) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(double * )(pData));
-	} else if (type == SHADOW_JSON_FLOAT) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%f,", *(float * )(pData));
-	} else if (type == SHADOW_JSON_BOOL) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "%s,", *(bool *)(pData)?"true":"false");
-	} else if (type == SHADOW_JSON_STRING) {
-		snPrintfReturn = snprintf(pStringBuffer, maxSizoStringBuffer, "\"%s\",", (char * )(pData));
-	}
-
-	ret_val = checkReturnValueOfSnPrintf(snPrintfReturn, maxSizoStringBuffer);
+	// remove the last ,(comma) that was added by the sections
+	if (0 < builder.length && ',' == pJsonDocument[builder.length - 1]) {
+		builder.length--;
+	}
+	builderAppend(&builder, "}, \"" SHADOW_CLIENT_TOKEN_STRING "\":", sizeof(SHADOW_CLIENT_TOKEN_STRING) + 5);
+	builderAppendClientToken(&builder, takeClientTokenNum());
+	builderAppend(&builder, "}", 1);
+	return builder.error;
+}
 
-	return ret_val;
+void FillWithClientToken(char *pBufferToBeUpdatedWithClientToken) {
+	formatClientToken(pBufferToBeUpdatedWithClientToken, takeClientTokenNum());
 }
+
 static jsmn_parser shadowJsonParser;
 static jsmntok_t jsonTokenStruct[MAX_JSON_TOKEN_EXPECTED];
+static int16_t jsonTokenNext[MAX_JSON_TOKEN_EXPECTED];
+
+// index of the first token after the value at index value and everything nested in it
+static int32_t skipJsonValue(const jsmntok_t *pTokens, int32_t tokenCount, int32_t value) {
+	int32_t i = value + 1;
 
-bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount) {
+	while (i < tokenCount && pTokens[i].start < pTokens[value].end) {
+		i++;
+	}
+	return i;
+}
+
+bool parseShadowJson(const char *pJsonDocument, ShadowJsonView_t *pView) {
 	int32_t tokenCount;
+	int32_t i;
 
 	jsmn_init(&shadowJsonParser);
 
+#if AWS_IOT_JSON_FAST_TOKENIZER
+	tokenCount = aws_iot_json_tokenize(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
+			sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+#else
 	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
 			sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+#endif
 
 	if (tokenCount < 0) {
 		WARN("Failed to parse JSON: %d\n", tokenCount);
@@ -328,8 +571,30 @@ bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t
 		return false;
 	}
 
-	pJsonHandler = (void *) jsonTokenStruct;
-	*pTokenCount = tokenCount;
+	pView->pJsonDocument = pJsonDocument;
+	pView->pTokens = jsonTokenStruct;
+	pView->pNext = jsonTokenNext;
+	pView->tokenCount = tokenCount;
+	pView->version = -1;
+	pView->clientToken = -1;
+	pView->state = -1;
+	pView->metadata = -1;
+	aws_iot_json_index_siblings(jsonTokenStruct, tokenCount, jsonTokenNext);
+
+	// one walk over the members of the top level object, their values are stepped over whole
+	i = 1;
+	while (i + 1 < tokenCount) {
+		if (jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_VERSION_STRING) == 0) {
+			pView->version = i + 1;
+		} else if (jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_CLIENT_TOKEN_STRING) == 0) {
+			pView->clientToken = i + 1;
+		} else if (jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_STATE_STRING) == 0) {
+			pView->state = i + 1;
+		} else if (jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_METADATA_STRING) == 0) {
+			pView->metadata = i + 1;
+		}
+		i = jsonTokenNext[i];
+	}
 
 	return true;
 }
@@ -359,88 +624,101 @@ static IoT_Error_t UpdateValueIfNoObject(const char *pJsonString, jsonStruct_t *
 	return ret_val;
 }
 
-bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
-		jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition) {
+int32_t skipShadowJsonValue(const ShadowJsonView_t *pView, int32_t valueToken) {
+	if (pView->pNext != NULL) {
+		return pView->pNext[valueToken];
+	}
+	return skipJsonValue(pView->pTokens, pView->tokenCount, valueToken);
+}
+
+int32_t findShadowJsonMember(const ShadowJsonView_t *pView, int32_t objectToken, const char *pKey) {
+	int32_t objectEnd;
 	int32_t i;
 
-	for (i = 1; i < tokenCount; i++) {
-		if (jsoneq(pJsonDocument, &(jsonTokenStruct[i]), pDataStruct->pKey) == 0) {
-			jsmntok_t dataToken = jsonTokenStruct[i + 1];
-			uint32_t dataLength = dataToken.end - dataToken.start;
-			UpdateValueIfNoObject(pJsonDocument, pDataStruct, dataToken);
-			*pDataPosition = dataToken.start;
-			*pDataLength = dataLength;
-			return true;
+	if (objectToken < 0 || pView->pTokens[objectToken].type != JSMN_OBJECT) {
+		return -1;
+	}
+	objectEnd = pView->pTokens[objectToken].end;
+	i = objectToken + 1;
+	while (i + 1 < pView->tokenCount && pView->pTokens[i].start < objectEnd) {
+		if (jsoneq(pView->pJsonDocument, &pView->pTokens[i], pKey) == 0) {
+			return i + 1;
 		}
+		i = skipShadowJsonValue(pView, i + 1);
 	}
-	return false;
+	return -1;
 }
 
-bool isReceivedJsonValid(const char *pJsonDocument) {
-	int32_t tokenCount;
-
-	jsmn_init(&shadowJsonParser);
-
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-					sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+bool getShadowJsonErrorCode(const ShadowJsonView_t *pView, uint32_t *pCode) {
+	int32_t code = findShadowJsonMember(pView, 0, SHADOW_CODE_STRING);
 
-	if (tokenCount < 0) {
-		WARN("Failed to parse JSON: %d\n", tokenCount);
+	if (code < 0) {
 		return false;
 	}
+	return parseUnsignedInteger32Value(pCode, pView->pJsonDocument, &pView->pTokens[code]) == NONE_ERROR;
+}
 
-	/* Assume the top-level element is an object */
-	if (tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
-		return false;
-	}
+void updateJsonStructFromToken(const ShadowJsonView_t *pView, int32_t valueToken, jsonStruct_t *pDataStruct) {
+	UpdateValueIfNoObject(pView->pJsonDocument, pDataStruct, pView->pTokens[valueToken]);
+}
 
-	return true;
+bool isReceivedJsonValid(const char *pJsonDocument) {
+	ShadowJsonView_t view;
+
+	return parseShadowJson(pJsonDocument, &view);
 }
 
-bool extractClientToken(const char *pJsonDocument, char *pExtractedClientToken) {
-	jsmn_init(&shadowJsonParser);
-	int32_t tokenCount, i;
-	jsmntok_t ClientJsonToken;
+// a token of ours is the client id and a sequence number, which is the key. Any other token is keyed by a hash
+static uint32_t clientTokenKey(const char *pToken, size_t length) {
+	size_t prefixLength = strlen(AWS_IOT_MQTT_CLIENT_ID);
+	uint32_t key = 0;
+	size_t i;
 
-	tokenCount = jsmn_parse(&shadowJsonParser, pJsonDocument, strlen(pJsonDocument), jsonTokenStruct,
-					sizeof(jsonTokenStruct) / sizeof(jsonTokenStruct[0]));
+	if (length > prefixLength + 1 && length <= prefixLength + 10 && pToken[prefixLength] == '-'
+			&& strncmp(pToken, AWS_IOT_MQTT_CLIENT_ID, prefixLength) == 0) {
+		for (i = prefixLength + 1; i < length && pToken[i] >= '0' && pToken[i] <= '9'; i++) {
+			key = key * 10 + (pToken[i] - '0');
+		}
+		if (i == length) {
+			return key;
+		}
+	}
 
-	if (tokenCount < 0) {
-		WARN("Failed to parse JSON: %d\n", tokenCount);
-		return false;
+	key = 2166136261u;
+	for (i = 0; i < length; i++) {
+		key = (key ^ (uint8_t)pToken[i]) * 16777619u;
 	}
+	return key;
+}
 
-	/* Assume the top-level element is an object */
-	if (tokenCount < 1 || jsonTokenStruct[0].type != JSMN_OBJECT) {
+bool getShadowJsonClientTokenKey(const ShadowJsonView_t *pView, uint32_t *pKey) {
+	jsmntok_t *pToken;
+
+	if (pView->clientToken < 0) {
 		return false;
 	}
 
-	for (i = 1; i < tokenCount; i++) {
-		if (jsoneq(pJsonDocument, &jsonTokenStruct[i], SHADOW_CLIENT_TOKEN_STRING) == 0) {
-			ClientJsonToken = jsonTokenStruct[i + 1];
-			uint8_t length = ClientJsonToken.end - ClientJsonToken.start;
-			strncpy(pExtractedClientToken, pJsonDocument + ClientJsonToken.start, length);
-			pExtractedClientToken[length] = '\0';
-			return true;
-		}
+	pToken = &pView->pTokens[pView->clientToken];
+	if (pToken->type != JSMN_STRING) {
+		return false;
 	}
-
-	return false;
+	*pKey = clientTokenKey(pView->pJsonDocument + pToken->start, pToken->end - pToken->start);
+	return true;
 }
 
-bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber) {
-	int32_t i;
-	IoT_Error_t ret_val = NONE_ERROR;
+bool extractClientTokenKey(const char *pJsonDocument, uint32_t *pKey) {
+	ShadowJsonView_t view;
 
-	for (i = 1; i < tokenCount; i++) {
-		if (jsoneq(pJsonDocument, &(jsonTokenStruct[i]), SHADOW_VERSION_STRING) == 0) {
-			jsmntok_t dataToken = jsonTokenStruct[i + 1];
-			ret_val = parseUnsignedInteger32Value(pVersionNumber, pJsonDocument, &dataToken);
-			if (ret_val == NONE_ERROR) {
-				return true;
-			}
-		}
+	if (!parseShadowJson(pJsonDocument, &view)) {
+		return false;
 	}
-	return false;
+	return getShadowJsonClientTokenKey(&view, pKey);
 }
 
+bool getShadowJsonVersion(const ShadowJsonView_t *pView, uint32_t *pVersionNumber) {
+	if (pView->version < 0) {
+		return false;
+	}
+	return parseUnsignedInteger32Value(pVersionNumber, pView->pJsonDocument, &pView->pTokens[pView->version])
+			== NONE_ERROR;
+}
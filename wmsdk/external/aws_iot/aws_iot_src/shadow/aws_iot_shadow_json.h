@@ -18,22 +18,48 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <jsmn.h>
 
 #include "aws_iot_error.h"
 #include "aws_iot_shadow_json_data.h"
 
+/**
+ * @brief Parsed view of a received shadow document
+ *
+ * Filled by a single parse of the document, the top level members used by the shadow
+ * layer are located in the same pass. Member indexes point at the value token and are
+ * -1 when the member is absent. The tokens are shared by every parse, a view is only
+ * valid until the next one.
+ */
+typedef struct {
+	const char *pJsonDocument;	///< Document the tokens point into
+	jsmntok_t *pTokens;			///< Tokens of the whole document
+	const int16_t *pNext;		///< Next sibling of every token, see aws_iot_json_index.h. NULL to walk the tokens instead
+	int32_t tokenCount;			///< Number of tokens in pTokens
+	int32_t version;			///< Token of the "version" value
+	int32_t clientToken;		///< Token of the "clientToken" value
+	int32_t state;				///< Token of the "state" object
+	int32_t metadata;			///< Token of the "metadata" object
+} ShadowJsonView_t;
 
-bool isJsonValidAndParse(const char *pJsonDocument, void *pJsonHandler, int32_t *pTokenCount);
-bool isJsonKeyMatchingAndUpdateValue(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount,
-		jsonStruct_t *pDataStruct, uint32_t *pDataLength, int32_t *pDataPosition);
+bool parseShadowJson(const char *pJsonDocument, ShadowJsonView_t *pView);
+int32_t skipShadowJsonValue(const ShadowJsonView_t *pView, int32_t valueToken);
+int32_t findShadowJsonMember(const ShadowJsonView_t *pView, int32_t objectToken, const char *pKey);
+bool getShadowJsonErrorCode(const ShadowJsonView_t *pView, uint32_t *pCode);
+void updateJsonStructFromToken(const ShadowJsonView_t *pView, int32_t valueToken, jsonStruct_t *pDataStruct);
+bool getShadowJsonVersion(const ShadowJsonView_t *pView, uint32_t *pVersionNumber);
+bool getShadowJsonClientTokenKey(const ShadowJsonView_t *pView, uint32_t *pKey);
 
 void iot_shadow_get_request_json(char *pJsonDocument);
 void iot_shadow_delete_request_json(char *pJsonDocument);
 void resetClientTokenSequenceNum(void);
+uint32_t takeClientTokenNum(void);
+IoT_Error_t writeShadowJsonStream(fpShadowJsonWriter_t writer, void *pWriterContext, uint32_t tokenNum,
+		fpShadowJsonFlush_t flush, void *pFlushContext, size_t *pLength);
 
 
 bool isReceivedJsonValid(const char *pJsonDocument);
 void FillWithClientToken(char *pStringToUpdateClientToken);
-bool extractClientToken(const char *pJsonDocumentToBeSent, char *pExtractedClientToken);
-bool extractVersionNumber(const char *pJsonDocument, void *pJsonHandler, int32_t tokenCount, uint32_t *pVersionNumber);
+bool extractClientTokenKey(const char *pJsonDocumentToBeSent, uint32_t *pKey);
 #endif // AWS_IOT_SDK_SRC_IOT_SHADOW_JSON_H_
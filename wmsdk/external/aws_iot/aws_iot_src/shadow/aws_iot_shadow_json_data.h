@@ -92,7 +92,8 @@ IoT_Error_t aws_iot_shadow_init_json_document(char *pJsonDocument, size_t maxSiz
  * @param pJsonDocument The JSON Document filled in this char buffer
  * @param maxSizeOfJsonDocument maximum size of the pJsonDocument that can be used to fill the JSON document
  * @param count total number of arguments(jsonStruct_t object) passed in the arguments
- * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up. A failed call
+ * leaves the document as it was, so another section can still be added
  */
 IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...);
 
@@ -108,7 +109,8 @@ IoT_Error_t aws_iot_shadow_add_reported(char *pJsonDocument, size_t maxSizeOfJso
  * @param pJsonDocument The JSON Document filled in this char buffer
  * @param maxSizeOfJsonDocument maximum size of the pJsonDocument that can be used to fill the JSON document
  * @param count total number of arguments(jsonStruct_t object) passed in the arguments
- * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up
+ * @return An IoT Error Type defining if the buffer was null or the entire string was not filled up. A failed call
+ * leaves the document as it was, so another section can still be added
  */
 IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJsonDocument, uint8_t count, ...);
 
@@ -126,6 +128,189 @@ IoT_Error_t aws_iot_shadow_add_desired(char *pJsonDocument, size_t maxSizeOfJson
  */
 IoT_Error_t aws_iot_finalize_json_document(char *pJsonDocument, size_t maxSizeOfJsonDocument);
 
+/**
+ * @brief Maximum nesting of a document written by the builder, the outermost object included
+ */
+#define SHADOW_JSON_BUILDER_MAX_DEPTH 32
+
+/**
+ * @brief Output Callback Type of a streamed document
+ *
+ * Gets the document a piece at a time, in order, as the window of the builder fills up.
+ *
+ * @param pData			Next piece of the document, not NULL terminated
+ * @param length		Length of pData
+ * @param pContext		The context given to aws_iot_shadow_builder_init_stream()
+ * @return NONE_ERROR, any other error stops the document and is kept by the builder
+ */
+typedef IoT_Error_t (*fpShadowJsonFlush_t)(const char *pData, size_t length, void *pContext);
+
+/**
+ * @brief JSON Document Builder Type
+ *
+ * Writes a JSON document into a buffer set aside by the caller, keeping track of where
+ * the document ends so that nothing already written is scanned again. The document is
+ * NULL terminated after every call. The first error hit is kept and makes every later
+ * call do nothing, so a whole document can be written and the error checked once at
+ * the end. For a shadow update:
+ *
+ *     aws_iot_shadow_builder_init(&builder, buffer, sizeof(buffer));
+ *     aws_iot_shadow_builder_begin_object(&builder, "state");
+ *     aws_iot_shadow_builder_begin_object(&builder, "reported");
+ *     aws_iot_shadow_builder_add(&builder, &temperature);
+ *     rc = aws_iot_shadow_builder_finalize(&builder);
+ *
+ * Numbers are written without the printf family, see aws_iot_json_number.h. Float and
+ * double values get #AWS_IOT_JSON_FLOAT_DECIMALS decimals.
+ *
+ * Set up by aws_iot_shadow_builder_init() or aws_iot_shadow_builder_init_stream(), its
+ * members are internal.
+ */
+typedef struct {
+	char *pBuffer;			///< Buffer the document is written to, the window of a streamed document
+	size_t size;			///< Size of pBuffer
+	size_t length;			///< Length of the document written so far, the part still in the window when streamed
+	uint8_t depth;			///< Objects and arrays open inside the outermost object
+	uint32_t hasMembers;	///< Bit per depth, set once the object or array has a member
+	uint32_t isArray;		///< Bit per depth, set for an array
+	IoT_Error_t error;		///< First error hit
+	fpShadowJsonFlush_t flush;	///< Takes the window once it is full, NULL when the whole document stays in pBuffer
+	void *pFlushContext;	///< Passed back to flush
+	size_t flushedLength;	///< Length of the document already passed to flush
+} ShadowJsonBuilder_t;
+
+/**
+ * @brief Document Writer Callback Type
+ *
+ * Adds the members of a document to the outermost object of a builder. Used where the
+ * SDK runs the builder itself, see aws_iot_shadow_update_stream().
+ *
+ * @param pBuilder		Builder of the document, with its outermost object open
+ * @param pContextData	The data given along with the writer
+ * @return The error of the builder, or any other error that stops the document
+ */
+typedef IoT_Error_t (*fpShadowJsonWriter_t)(ShadowJsonBuilder_t *pBuilder, void *pContextData);
+
+/**
+ * @brief Start a JSON document, with its outermost object open
+ *
+ * @param pBuilder	Builder to set up
+ * @param pBuffer	Buffer the document is written to, must stay valid while in use
+ * @param size		Size of pBuffer
+ * @return An IoT Error Type defining if the buffer was null or too small
+ */
+IoT_Error_t aws_iot_shadow_builder_init(ShadowJsonBuilder_t *pBuilder, char *pBuffer, size_t size);
+
+/**
+ * @brief Start a JSON document that is passed on as it is written
+ *
+ * The buffer is only a window: whenever the next piece does not fit, what the window
+ * holds goes to flush and the window starts over, a piece bigger than the window goes
+ * to flush straight away. A document of any size is written in as little RAM as the
+ * window, straight into the MQTT client with aws_iot_shadow_update_stream(). The
+ * window is NULL terminated like a whole document is, and the rest of it is flushed by
+ * aws_iot_shadow_builder_finalize().
+ *
+ * @param pBuilder		Builder to set up
+ * @param pBuffer		Window of the document, must stay valid while in use
+ * @param size			Size of pBuffer, flush gets at most size - 1 bytes at a time from it
+ * @param flush			Gets the document a piece at a time, NULL keeps it all in pBuffer as aws_iot_shadow_builder_init() does
+ * @param pFlushContext	Passed back to flush, could be NULL
+ * @return An IoT Error Type defining if the buffer was null or too small
+ */
+IoT_Error_t aws_iot_shadow_builder_init_stream(ShadowJsonBuilder_t *pBuilder, char *pBuffer, size_t size,
+		fpShadowJsonFlush_t flush, void *pFlushContext);
+
+/**
+ * @brief Open an object
+ *
+ * @param pBuilder	Builder of the document
+ * @param pKey		Key of the object, NULL for an element of an array
+ * @return The error hit so far, SHADOW_JSON_ERROR if nested deeper than #SHADOW_JSON_BUILDER_MAX_DEPTH
+ */
+IoT_Error_t aws_iot_shadow_builder_begin_object(ShadowJsonBuilder_t *pBuilder, const char *pKey);
+
+/**
+ * @brief Open an array
+ *
+ * @param pBuilder	Builder of the document
+ * @param pKey		Key of the array, NULL for an element of an array
+ * @return The error hit so far, SHADOW_JSON_ERROR if nested deeper than #SHADOW_JSON_BUILDER_MAX_DEPTH
+ */
+IoT_Error_t aws_iot_shadow_builder_begin_array(ShadowJsonBuilder_t *pBuilder, const char *pKey);
+
+/**
+ * @brief Close the object or array opened last
+ *
+ * @param pBuilder	Builder of the document
+ * @return The error hit so far, SHADOW_JSON_ERROR if only the outermost object is open
+ */
+IoT_Error_t aws_iot_shadow_builder_end(ShadowJsonBuilder_t *pBuilder);
+
+/**
+ * @brief Add a value to the object or array opened last
+ *
+ * Strings are escaped as needed. A SHADOW_JSON_OBJECT value is JSON text that is copied as it is.
+ *
+ * @param pBuilder	Builder of the document
+ * @param pKey		Key of the value, NULL in an array
+ * @param type		Type of the value pointed to by pData
+ * @param pData		The value
+ * @return The error hit so far
+ */
+IoT_Error_t aws_iot_shadow_builder_add_value(ShadowJsonBuilder_t *pBuilder, const char *pKey, JsonPrimitiveType type,
+		const void *pData);
+
+/**
+ * @brief Add a signed integer to the object or array opened last
+ *
+ * Typed forms of aws_iot_shadow_builder_add_value(), for values whose type is known
+ * at build time. The smaller integers go through the 32-bit ones, a float through the
+ * double one.
+ *
+ * @param pBuilder	Builder of the document
+ * @param pKey		Key of the value, NULL in an array
+ * @param value		The value
+ * @return The error hit so far
+ */
+IoT_Error_t aws_iot_shadow_builder_add_int32(ShadowJsonBuilder_t *pBuilder, const char *pKey, int32_t value);
+
+/**
+ * @brief Add an unsigned integer to the object or array opened last, see aws_iot_shadow_builder_add_int32()
+ */
+IoT_Error_t aws_iot_shadow_builder_add_uint32(ShadowJsonBuilder_t *pBuilder, const char *pKey, uint32_t value);
+
+/**
+ * @brief Add a number with #AWS_IOT_JSON_FLOAT_DECIMALS decimals to the object or array opened last, see
+ * aws_iot_shadow_builder_add_int32()
+ */
+IoT_Error_t aws_iot_shadow_builder_add_double(ShadowJsonBuilder_t *pBuilder, const char *pKey, double value);
+
+/**
+ * @brief Add true or false to the object or array opened last, see aws_iot_shadow_builder_add_int32()
+ */
+IoT_Error_t aws_iot_shadow_builder_add_bool(ShadowJsonBuilder_t *pBuilder, const char *pKey, bool value);
+
+/**
+ * @brief Add the key and value of a jsonStruct_t to the object opened last
+ *
+ * @param pBuilder	Builder of the document
+ * @param pStruct	Key and value to add
+ * @return The error hit so far
+ */
+IoT_Error_t aws_iot_shadow_builder_add(ShadowJsonBuilder_t *pBuilder, const jsonStruct_t *pStruct);
+
+/**
+ * @brief Close every object and array still open and add the client token
+ *
+ * The client token is written straight into the document, the sequence number is
+ * incremented as with aws_iot_finalize_json_document().
+ *
+ * @param pBuilder	Builder of the document
+ * @return NONE_ERROR if the whole document fit in the buffer, or was all flushed, else the first error hit
+ */
+IoT_Error_t aws_iot_shadow_builder_finalize(ShadowJsonBuilder_t *pBuilder);
+
 /**
  * @brief Fill the given buffer with client token for tracking the Repsonse.
  *
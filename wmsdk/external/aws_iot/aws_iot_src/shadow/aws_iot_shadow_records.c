@@ -17,80 +17,178 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <wm_os.h>
 #include <aws_utils.h>
 
 #include "timer_interface.h"
 #include "aws_iot_json_utils.h"
+#include "aws_iot_json_tokenizer.h"
 #include "aws_iot_log.h"
 #include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_key.h"
+#include "aws_iot_shadow_schema.h"
+#include "aws_iot_shadow_snapshot.h"
 #include "aws_iot_config.h"
 
-typedef struct {
-	char clientTokenID[MAX_SIZE_CLIENT_ID_WITH_SEQUENCE];
-	char thingName[MAX_SIZE_OF_THING_NAME];
-	ShadowActions_t action;
-	fpActionCallback_t callback;
-	void *pCallbackContext;
-	bool isFree;
-	Timer timer;
-} ToBeReceivedAckRecord_t;
-
 typedef struct {
 	const char *pKey;
 	void *pStruct;
 	jsonStructCallback_t callback;
+	uint32_t pathHash;
 	bool isFree;
 } JsonTokenTable_t;
 
 typedef struct {
 	char Topic[MAX_SHADOW_TOPIC_LENGTH_BYTES];
 	uint8_t count;
+	uint8_t calls;				// subscribes and unsubscribes of the topic in progress
+	uint8_t unsubscribeCalls;	// unsubscribes started so far, a subscribe older than the last one may be undone
 	bool isFree;
 	bool isSticky;
+	bool isSubscribed;
 } SubscriptionRecord_t;
 
 typedef enum {
 	SHADOW_ACCEPTED, SHADOW_REJECTED, SHADOW_ACTION
 } ShadowAckTopicTypes_t;
 
-ToBeReceivedAckRecord_t AckWaitList[MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME];
+// the context of aws_iot_shadow_update() and the like, it subscribes to the topics of each Thing
+static ShadowThing_t defaultShadowThing;
+ShadowContext_t defaultShadowContext = {
+		.pThings = &defaultShadowThing,
+		.maxThings = 1,
+		.isWildcard = false
+};
 
-MQTTClient_t *pMqttClient;
+// the context set up by aws_iot_shadow_context_init(), the wildcard subscriptions deliver to it
+static ShadowContext_t *pWildcardContext = NULL;
+
+#define SHADOW_TOPIC_PREFIX "$aws/things/"
+#define SHADOW_WILDCARD_ACCEPTED_TOPIC SHADOW_TOPIC_PREFIX "+/shadow/+/accepted"
+#define SHADOW_WILDCARD_REJECTED_TOPIC SHADOW_TOPIC_PREFIX "+/shadow/+/rejected"
+#define SHADOW_WILDCARD_DELTA_TOPIC SHADOW_TOPIC_PREFIX "+/shadow/update/delta"
 
 #define SHADOW_DELTA_TOPIC_WITH_THING_NAME "$aws/things/" AWS_IOT_MY_THING_NAME "/shadow/update/delta"
 
 #define MAX_TOPICS_AT_ANY_GIVEN_TIME 2*MAX_THINGNAME_HANDLED_AT_ANY_GIVEN_TIME
 SubscriptionRecord_t SubscriptionList[MAX_TOPICS_AT_ANY_GIVEN_TIME];
 
-#define SUBSCRIBE_SETTLING_TIME 2
 char shadowRxBuf[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+static uint32_t shadowRxLen = 0;	// bytes of the message in shadowRxBuf, gathered from its chunks
 char shadow_dela_topic_with_thing_name[156];
 
 static JsonTokenTable_t tokenTable[MAX_JSON_TOKEN_EXPECTED];
 static uint32_t tokenTableIndex = 0;
+
+// open addressed index of tokenTable by key path, at most half full
+#define DELTA_KEY_HASH_SLOTS 256
+#define DELTA_KEY_HASH_EMPTY 0xFF
+#define DELTA_KEY_MAX_DEPTH 8
+#if MAX_JSON_TOKEN_EXPECTED * 2 > DELTA_KEY_HASH_SLOTS
+#error "DELTA_KEY_HASH_SLOTS is too small for MAX_JSON_TOKEN_EXPECTED"
+#endif
+static uint8_t deltaKeyHash[DELTA_KEY_HASH_SLOTS];
+
+// the schema the top level keys of the deltas are also looked up in
+static const ShadowSchema_t *pDeltaSchema = NULL;
+static void *pDeltaSchemaState = NULL;
+static fpShadowSchemaDeltaCallback_t deltaSchemaCallback = NULL;
+static void *pDeltaSchemaContext = NULL;
+
+// a delta bigger than shadowRxBuf is dispatched as its chunks arrive
+#define DELTA_STREAM_PATH_INVALID 0xFFFF
+typedef enum {
+	DELTA_STREAM_OTHER, DELTA_STREAM_VERSION, DELTA_STREAM_STATE
+} DeltaStreamMember_t;
+
+typedef struct {
+	JsonStreamParser_t parser;
+	char path[AWS_IOT_JSON_STREAM_TOKEN_LEN];	// keys from the state object down to the current one, joined with dots
+	uint16_t pathLength[DELTA_KEY_MAX_DEPTH];	// length of path down to each depth of the state
+	uint32_t isArray;							// bit n set if the values at depth n are in an array
+	uint32_t schemaFields;
+	DeltaStreamMember_t member;					// top level member being read
+	bool isInState;
+	bool isDiscarded;
+	bool isActive;
+} DeltaStream_t;
+static DeltaStream_t deltaStream;
+
+#define ACK_WAIT_HASH_EMPTY 0xFFFF
 static bool deltaTopicSubscribedFlag = false;
-uint32_t shadowJsonVersionNum = 0;
 bool shadowDiscardOldDeltaFlag = true;
 
+/*
+ * The records are used by the threads starting the actions, by the MQTT I/O task that
+ * runs the subscribe callbacks and by the one calling the yield for the timeouts. The
+ * lock is never held while an MQTT call of another thread waits for the I/O task, so
+ * the tables are only looked at and updated under it, the calls come after. It stays
+ * held over the delta callbacks, which run on the I/O task and may start an action.
+ * It also guards the tokens parseShadowJson fills, a view is used under it only.
+ */
+static os_mutex_t recordsLock;
+static bool isRecordsLockCreated = false;
+
+static void createRecordsLock(void) {
+	if (!isRecordsLockCreated && os_recursive_mutex_create(&recordsLock, "awsShadowRecords") == WM_SUCCESS) {
+		isRecordsLockCreated = true;
+	}
+}
+
+void lockShadowRecords(void) {
+	os_recursive_mutex_get(&recordsLock, OS_WAIT_FOREVER);
+}
+
+void unlockShadowRecords(void) {
+	os_recursive_mutex_put(&recordsLock);
+}
+
 // local helper functions
 static int AckStatusCallback(MQTTCallbackParams params);
 static int shadow_delta_callback(MQTTCallbackParams params);
 static void topicNameFromThingAndAction(char *pTopic, const char *pThingName, ShadowActions_t action,
 		ShadowAckTopicTypes_t ackType);
 static int16_t getNextFreeIndexOfSubscriptionList(void);
-static void unsubscribeFromAcceptedAndRejected(uint8_t index);
+static void removeFromAckWaitList(ShadowContext_t *pContext, uint16_t index);
+static void dispatchDeltaState(const ShadowJsonView_t *pView);
 
 void initDeltaTokens(void) {
 	uint32_t i;
+
+	createRecordsLock();
+	lockShadowRecords();
 	for (i = 0; i < MAX_JSON_TOKEN_EXPECTED; i++) {
 		tokenTable[i].isFree = true;
 	}
+	memset(deltaKeyHash, DELTA_KEY_HASH_EMPTY, sizeof(deltaKeyHash));
 	tokenTableIndex = 0;
+	pDeltaSchema = NULL;
+	deltaStream.isActive = false;
 	deltaTopicSubscribedFlag = false;
+	unlockShadowRecords();
+}
+
+// FNV-1a, a path hashes the same whether it is hashed whole or segment by segment
+#define HASH_KEY_PATH_SEED 2166136261u
+static uint32_t hashKeyPath(uint32_t hash, const char *pPath, size_t length) {
+	size_t i;
+	for (i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)pPath[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static void insertDeltaKeyHash(uint8_t index) {
+	uint32_t slot = tokenTable[index].pathHash & (DELTA_KEY_HASH_SLOTS - 1);
+
+	while (deltaKeyHash[slot] != DELTA_KEY_HASH_EMPTY) {
+		slot = (slot + 1) & (DELTA_KEY_HASH_SLOTS - 1);
+	}
+	deltaKeyHash[slot] = index;
 }
 
 #define THING_LEN 126
-IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
+static IoT_Error_t subscribeToDeltaTopic(void) {
 
 	IoT_Error_t rc = NONE_ERROR;
 
@@ -111,28 +209,62 @@ IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
 			wmprintf("delta topic %s\r\n", SHADOW_DELTA_TOPIC_WITH_THING_NAME);
 		}
 		subParams.qos = QOS_0;
-		rc = pMqttClient->subscribe(&subParams);
+		rc = defaultShadowContext.pMqttClient->subscribe(&subParams);
 		deltaTopicSubscribedFlag = true;
 	}
+	return rc;
+}
+
+IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct) {
+
+	IoT_Error_t rc = subscribeToDeltaTopic();
 
-	if (tokenTableIndex >= MAX_JSON_TOKEN_EXPECTED) {
+	lockShadowRecords();
+	if (tokenTableIndex >= MAX_JSON_TOKEN_EXPECTED || pStruct->pKey == NULL) {
+		unlockShadowRecords();
 		return GENERIC_ERROR;
 	}
 
 	tokenTable[tokenTableIndex].pKey = pStruct->pKey;
 	tokenTable[tokenTableIndex].callback = pStruct->cb;
 	tokenTable[tokenTableIndex].pStruct = pStruct;
+	tokenTable[tokenTableIndex].pathHash = hashKeyPath(HASH_KEY_PATH_SEED, pStruct->pKey, strlen(pStruct->pKey));
 	tokenTable[tokenTableIndex].isFree = false;
+	insertDeltaKeyHash(tokenTableIndex);
 	tokenTableIndex++;
+	unlockShadowRecords();
 
 	return rc;
 }
 
+IoT_Error_t registerSchemaOnDelta(const ShadowSchema_t *pSchema, void *pState,
+		fpShadowSchemaDeltaCallback_t callback, void *pContextData) {
+	IoT_Error_t rc = aws_iot_shadow_schema_check(pSchema);
+
+	if (rc != NONE_ERROR) {
+		return rc;
+	}
+	if (pState == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+
+	lockShadowRecords();
+	pDeltaSchema = pSchema;
+	pDeltaSchemaState = pState;
+	deltaSchemaCallback = callback;
+	pDeltaSchemaContext = pContextData;
+	unlockShadowRecords();
+	return subscribeToDeltaTopic();
+}
+
 static int16_t getNextFreeIndexOfSubscriptionList(void) {
 	uint8_t i;
 	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
 		if (SubscriptionList[i].isFree) {
 			SubscriptionList[i].isFree = false;
+			SubscriptionList[i].count = 0;
+			SubscriptionList[i].calls = 0;
+			SubscriptionList[i].isSubscribed = false;
 			return i;
 		}
 	}
@@ -166,65 +298,256 @@ static void topicNameFromThingAndAction(char *pTopic, const char *pThingName, Sh
 	}
 }
 
-static bool isAckForMyThingName(const char *pTopicName) {
-	if (strstr(pTopicName, AWS_IOT_MY_THING_NAME) != NULL && ((strstr(pTopicName, "get/accepted") != NULL) || (strstr(pTopicName, "delta") != NULL))) {
-		return true;
+static bool isTopicEndingWith(const char *pTopic, uint16_t topicLen, const char *pSuffix) {
+	size_t suffixLen = strlen(pSuffix);
+	return topicLen >= suffixLen && strncmp(pTopic + topicLen - suffixLen, pSuffix, suffixLen) == 0;
+}
+
+static ShadowThing_t *findThing(ShadowContext_t *pContext, const char *pName, size_t nameLen) {
+	uint32_t hash;
+	uint8_t i;
+
+	if (nameLen >= MAX_SIZE_OF_THING_NAME) {
+		return NULL;
+	}
+	hash = hashKeyPath(HASH_KEY_PATH_SEED, pName, nameLen);
+	for (i = 0; i < pContext->maxThings; i++) {
+		ShadowThing_t *pThing = &pContext->pThings[i];
+		if (pThing->isUsed && pThing->nameHash == hash && strncmp(pThing->thingName, pName, nameLen) == 0
+				&& pThing->thingName[nameLen] == '\0') {
+			return pThing;
+		}
 	}
-	return false;
+	return NULL;
 }
 
-static int AckStatusCallback(MQTTCallbackParams params) {
-	int32_t tokenCount;
-	int32_t i;
-	void *pJsonHandler = NULL;
-	char temporaryClientToken[MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE];
+// the topic name is not NULL terminated, it is followed by the rest of the packet
+static ShadowThing_t *findThingOfTopic(ShadowContext_t *pContext, const char *pTopic, uint16_t topicLen) {
+	size_t prefixLen = strlen(SHADOW_TOPIC_PREFIX);
+	const char *pName = pTopic + prefixLen;
+	const char *pNameEnd;
 
-	if (params.MessageParams.PayloadLen > SHADOW_MAX_SIZE_OF_RX_BUFFER) {
-		return GENERIC_ERROR;
+	if (topicLen <= prefixLen || strncmp(pTopic, SHADOW_TOPIC_PREFIX, prefixLen) != 0) {
+		return NULL;
+	}
+	pNameEnd = memchr(pName, '/', topicLen - prefixLen);
+	if (pNameEnd == NULL) {
+		return NULL;
 	}
+	return findThing(pContext, pName, pNameEnd - pName);
+}
 
-	memcpy(shadowRxBuf, params.MessageParams.pPayload, params.MessageParams.PayloadLen);
-	shadowRxBuf[params.MessageParams.PayloadLen] = '\0';	// jsmn_parse relies on a string
+static bool setThingName(ShadowThing_t *pThing, const char *pThingName) {
+	size_t nameLen = strlen(pThingName);
+
+	if (nameLen >= MAX_SIZE_OF_THING_NAME) {
+		return false;
+	}
+	memcpy(pThing->thingName, pThingName, nameLen + 1);
+	pThing->nameHash = hashKeyPath(HASH_KEY_PATH_SEED, pThingName, nameLen);
+	return true;
+}
+
+// timeouts of the actions waiting, soonest first. left_ms() keeps its order as time goes on
+static bool isAckExpiringBefore(ShadowContext_t *pContext, uint16_t a, uint16_t b) {
+	return left_ms(&pContext->ackWaitList[a].timer) < left_ms(&pContext->ackWaitList[b].timer);
+}
+
+static void placeInAckExpiryHeap(ShadowContext_t *pContext, uint16_t position, uint16_t index) {
+	pContext->ackExpiryHeap[position] = index;
+	pContext->ackWaitList[index].heapIndex = position;
+}
+
+static void siftAckExpiryHeap(ShadowContext_t *pContext, uint16_t position) {
+	uint16_t *pHeap = pContext->ackExpiryHeap;
+	uint16_t index = pHeap[position];
+	uint16_t child;
+
+	while (position > 0 && isAckExpiringBefore(pContext, index, pHeap[(position - 1) / 2])) {
+		placeInAckExpiryHeap(pContext, position, pHeap[(position - 1) / 2]);
+		position = (position - 1) / 2;
+	}
+	while ((child = 2 * position + 1) < pContext->ackWaitCount) {
+		if (child + 1 < pContext->ackWaitCount && isAckExpiringBefore(pContext, pHeap[child + 1], pHeap[child])) {
+			child++;
+		}
+		if (!isAckExpiringBefore(pContext, pHeap[child], index)) {
+			break;
+		}
+		placeInAckExpiryHeap(pContext, position, pHeap[child]);
+		position = child;
+	}
+	placeInAckExpiryHeap(pContext, position, index);
+}
+
+static int32_t findInAckWaitList(ShadowContext_t *pContext, uint32_t clientTokenKey) {
+	uint32_t slot = clientTokenKey & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+	uint16_t index;
+
+	while ((index = pContext->ackWaitHash[slot]) != ACK_WAIT_HASH_EMPTY) {
+		if (pContext->ackWaitList[index].clientTokenKey == clientTokenKey) {
+			return index;
+		}
+		slot = (slot + 1) & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+	}
+	return -1;
+}
+
+static void removeFromAckWaitHash(ShadowContext_t *pContext, uint16_t index) {
+	uint16_t *pHash = pContext->ackWaitHash;
+	uint32_t slot = pContext->ackWaitList[index].clientTokenKey & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+	uint32_t next;
+	uint32_t home;
+
+	while (pHash[slot] != index) {
+		slot = (slot + 1) & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+	}
+	// the entries after the hole that would no longer be found move back into it
+	next = slot;
+	while (1) {
+		next = (next + 1) & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+		if (pHash[next] == ACK_WAIT_HASH_EMPTY) {
+			break;
+		}
+		home = pContext->ackWaitList[pHash[next]].clientTokenKey & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+		if (((next - home) & (SHADOW_ACK_WAIT_HASH_SLOTS - 1)) >= ((next - slot) & (SHADOW_ACK_WAIT_HASH_SLOTS - 1))) {
+			pHash[slot] = pHash[next];
+			slot = next;
+		}
+	}
+	pHash[slot] = ACK_WAIT_HASH_EMPTY;
+}
 
-	if (!isJsonValidAndParse(shadowRxBuf, pJsonHandler, &tokenCount)) {
+static void removeFromAckWaitList(ShadowContext_t *pContext, uint16_t index) {
+	uint16_t position = pContext->ackWaitList[index].heapIndex;
+	uint16_t last;
+
+	if (pContext->ackWaitList[index].isFree) {
+		return;
+	}
+	removeFromAckWaitHash(pContext, index);
+	pContext->ackWaitList[index].isFree = true;
+
+	// the last entry of the heap takes its place, the freed entry goes first of the free ones
+	pContext->ackWaitCount--;
+	last = pContext->ackExpiryHeap[pContext->ackWaitCount];
+	placeInAckExpiryHeap(pContext, pContext->ackWaitCount, index);
+	if (position < pContext->ackWaitCount) {
+		placeInAckExpiryHeap(pContext, position, last);
+		siftAckExpiryHeap(pContext, position);
+	}
+}
+
+/*
+ * A message bigger than the RX buffer of the MQTT client comes in chunks, although it
+ * may still fit shadowRxBuf. The chunks are put back together there, returns true once
+ * the whole message is in, followed by the string terminator the JSON parser relies on.
+ * Every subscription matching the topic is handed the same chunk in turn, a chunk
+ * already gathered is copied again.
+ */
+static bool gatherShadowRxBuf(const MQTTMessageParams *pMessage) {
+	uint32_t end = pMessage->PayloadOffset + pMessage->PayloadLen;
+
+	if (pMessage->TotalPayloadLen >= SHADOW_MAX_SIZE_OF_RX_BUFFER || end > pMessage->TotalPayloadLen) {
+		return false;
+	}
+	if (pMessage->PayloadOffset == 0) {
+		shadowRxLen = 0;
+	} else if (pMessage->PayloadOffset > shadowRxLen) {
+		return false;	// a chunk was missed, the message it belongs to is lost
+	}
+
+	memcpy(shadowRxBuf + pMessage->PayloadOffset, pMessage->pPayload, pMessage->PayloadLen);
+	if (end > shadowRxLen) {
+		shadowRxLen = end;
+	}
+	if (end < pMessage->TotalPayloadLen) {
+		return false;
+	}
+	shadowRxBuf[end] = '\0';
+	return true;
+}
+
+static bool isLastChunk(const MQTTMessageParams *pMessage) {
+	return pMessage->PayloadOffset + pMessage->PayloadLen >= pMessage->TotalPayloadLen;
+}
+
+static int handleShadowAck(ShadowContext_t *pContext, MQTTCallbackParams params) {
+	ShadowJsonView_t view;
+	ShadowThing_t *pThing;
+	ToBeReceivedAckRecord_t ack;
+	Shadow_Ack_Status_t status;
+	uint32_t clientTokenKey;
+	int32_t index;
+
+	// the JSON parser needs the whole document, one too big for shadowRxBuf cannot be handled here
+	if (!gatherShadowRxBuf(&params.MessageParams)) {
+		return isLastChunk(&params.MessageParams) ? GENERIC_ERROR : NONE_ERROR;
+	}
+
+	if (isTopicEndingWith(params.pTopicName, params.TopicNameLen, "/accepted")) {
+		status = SHADOW_ACK_ACCEPTED;
+	} else if (isTopicEndingWith(params.pTopicName, params.TopicNameLen, "/rejected")) {
+		status = SHADOW_ACK_REJECTED;
+	} else {
+		return GENERIC_ERROR;
+	}
+
+	lockShadowRecords();
+	if (!parseShadowJson(shadowRxBuf, &view)) {
+		unlockShadowRecords();
 		WARN("Received JSON is not valid");
 		return GENERIC_ERROR;
 	}
 
-	if (isAckForMyThingName(params.pTopicName)) {
+	pThing = findThingOfTopic(pContext, params.pTopicName, params.TopicNameLen);
+	if (pThing != NULL && isTopicEndingWith(params.pTopicName, params.TopicNameLen, "/get/accepted")) {
 		uint32_t tempVersionNumber = 0;
-		if (extractVersionNumber(shadowRxBuf, pJsonHandler, tokenCount, &tempVersionNumber)) {
-			if (tempVersionNumber > shadowJsonVersionNum) {
-				shadowJsonVersionNum = tempVersionNumber;
+		if (getShadowJsonVersion(&view, &tempVersionNumber)) {
+			if (tempVersionNumber > pThing->version) {
+				pThing->version = tempVersionNumber;
 			}
 		}
-	}
-
-	if (extractClientToken(shadowRxBuf, temporaryClientToken)) {
-		for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-			if (!AckWaitList[i].isFree) {
-				if (strcmp(AckWaitList[i].clientTokenID, temporaryClientToken) == 0) {
-					Shadow_Ack_Status_t status = SHADOW_ACK_ACCEPTED;
-					if (strstr(params.pTopicName, "accepted") != NULL) {
-						status = SHADOW_ACK_ACCEPTED;
-					} else if (strstr(params.pTopicName, "rejected") != NULL) {
-						status = SHADOW_ACK_REJECTED;
-					}
-					if (status == SHADOW_ACK_ACCEPTED || status == SHADOW_ACK_REJECTED) {
-						if (AckWaitList[i].callback != NULL) {
-							AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, status,
-									shadowRxBuf, AckWaitList[i].pCallbackContext);
-						}
-						unsubscribeFromAcceptedAndRejected(i);
-						AckWaitList[i].isFree = true;
-						return NONE_ERROR;
-					}
-				}
+		// the device may have started from a snapshot older than the desired state
+		if (pThing == &defaultShadowThing && isShadowSnapshotSet()) {
+			ShadowJsonView_t desiredView = view;
+			desiredView.state = findShadowJsonMember(&view, view.state, SHADOW_DESIRED_STRING);
+			if (desiredView.state >= 0) {
+				dispatchDeltaState(&desiredView);
+				setShadowSnapshotVersion(pThing->version);
 			}
 		}
 	}
 
-	return GENERIC_ERROR;
+	index = -1;
+	if (getShadowJsonClientTokenKey(&view, &clientTokenKey)) {
+		index = findInAckWaitList(pContext, clientTokenKey);
+	}
+	if (index < 0) {
+		unlockShadowRecords();
+		return GENERIC_ERROR;
+	}
+	// the entry is free before the callback runs, the callback may start another action
+	ack = pContext->ackWaitList[index];
+	removeFromAckWaitList(pContext, index);
+	unlockShadowRecords();
+
+	unsubscribeFromShadowActionAcks(pContext, ack.thingName, ack.action);
+	if (ack.callback != NULL) {
+		ack.callback(ack.thingName, ack.action, status, shadowRxBuf, ack.pCallbackContext);
+	}
+	return NONE_ERROR;
+}
+
+static int AckStatusCallback(MQTTCallbackParams params) {
+	return handleShadowAck(&defaultShadowContext, params);
+}
+
+static int wildcardAckCallback(MQTTCallbackParams params) {
+	if (pWildcardContext == NULL) {
+		return GENERIC_ERROR;
+	}
+	return handleShadowAck(pWildcardContext, params);
 }
 
 static int16_t findIndexOfSubscriptionList(const char *pTopic) {
@@ -239,257 +562,879 @@ static int16_t findIndexOfSubscriptionList(const char *pTopic) {
 	return -1;
 }
 
-static void unsubscribeFromAcceptedAndRejected(uint8_t index) {
+/*
+ * A topic has a single record, whatever the threads subscribing and unsubscribing it
+ * at the same time. Once the last of their calls returns, the topic is subscribed or
+ * unsubscribed again until it matches the count of the actions waiting on it. A
+ * subscribe only counts as done if no unsubscribe started since, as the unsubscribe
+ * may have reached the broker after it. Called and returns with the lock held.
+ */
+static void settleSubscription(ShadowContext_t *pContext, uint8_t indexSubList) {
+	SubscriptionRecord_t *pRecord = &SubscriptionList[indexSubList];
+	MQTTSubscribeParams subParams = MQTTSubscribeParamsDefault;
+	uint8_t unsubscribeCalls;
+	IoT_Error_t ret_val;
+
+	while (pRecord->calls == 0) {
+		if (pRecord->count == 0 && !pRecord->isSticky && pRecord->isSubscribed) {
+			pRecord->isSubscribed = false;
+			pRecord->calls++;
+			pRecord->unsubscribeCalls++;
+			unlockShadowRecords();
+			ret_val = pContext->pMqttClient->unsubscribe(pRecord->Topic);
+			lockShadowRecords();
+			pRecord->calls--;
+			if (ret_val != NONE_ERROR) {
+				pRecord->isSubscribed = true;	// kept, as it may still be
+				break;
+			}
+		} else if (pRecord->count > 0 && !pRecord->isSubscribed) {
+			subParams.mHandler = AckStatusCallback;
+			subParams.qos = QOS_0;
+			subParams.pTopic = pRecord->Topic;
+			unsubscribeCalls = pRecord->unsubscribeCalls;
+			pRecord->calls++;
+			unlockShadowRecords();
+			ret_val = pContext->pMqttClient->subscribe(&subParams);
+			lockShadowRecords();
+			pRecord->calls--;
+			if (ret_val != NONE_ERROR) {
+				break;	// the actions waiting on it time out
+			}
+			pRecord->isSubscribed = (unsubscribeCalls == pRecord->unsubscribeCalls);
+		} else {
+			break;
+		}
+	}
+	if (pRecord->calls == 0 && pRecord->count == 0 && !pRecord->isSubscribed) {
+		pRecord->isFree = true;
+	}
+}
 
-	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	IoT_Error_t ret_val = NONE_ERROR;
+static void releaseSubscription(ShadowContext_t *pContext, const char *pTopic) {
+	int16_t indexSubList;
 
-	topicNameFromThingAndAction(TemporaryTopicNameAccepted, AckWaitList[index].thingName, AckWaitList[index].action,
-			SHADOW_ACCEPTED);
-	topicNameFromThingAndAction(TemporaryTopicNameRejected, AckWaitList[index].thingName, AckWaitList[index].action,
-			SHADOW_REJECTED);
+	lockShadowRecords();
+	indexSubList = findIndexOfSubscriptionList(pTopic);
+	if (indexSubList >= 0 && SubscriptionList[indexSubList].count > 0) {
+		SubscriptionList[indexSubList].count--;
+		settleSubscription(pContext, indexSubList);
+	}
+	unlockShadowRecords();
+}
 
-	int16_t indexSubList;
+void unsubscribeFromShadowActionAcks(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action) {
 
-	indexSubList = findIndexOfSubscriptionList(TemporaryTopicNameAccepted);
-	if ((indexSubList >= 0)) {
-		if (!SubscriptionList[indexSubList].isSticky && (SubscriptionList[indexSubList].count == 1)) {
-			ret_val = pMqttClient->unsubscribe(TemporaryTopicNameAccepted);
-			if (ret_val == NONE_ERROR) {
-				SubscriptionList[indexSubList].isFree = true;
-			}
-		} else if (SubscriptionList[indexSubList].count > 1) {
-			SubscriptionList[indexSubList].count--;
-		}
+	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+
+	if (pContext->isWildcard) {
+		return;
 	}
 
-	indexSubList = findIndexOfSubscriptionList(TemporaryTopicNameRejected);
-	if ((indexSubList >= 0)) {
-		if (!SubscriptionList[indexSubList].isSticky && (SubscriptionList[indexSubList].count == 1)) {
-			ret_val = pMqttClient->unsubscribe(TemporaryTopicNameRejected);
-			if (ret_val == NONE_ERROR) {
-				SubscriptionList[indexSubList].isFree = true;
-			}
-		} else if (SubscriptionList[indexSubList].count > 1) {
-			SubscriptionList[indexSubList].count--;
-		}
+	topicNameFromThingAndAction(TemporaryTopicNameAccepted, pThingName, action, SHADOW_ACCEPTED);
+	topicNameFromThingAndAction(TemporaryTopicNameRejected, pThingName, action, SHADOW_REJECTED);
+	releaseSubscription(pContext, TemporaryTopicNameAccepted);
+	releaseSubscription(pContext, TemporaryTopicNameRejected);
+}
+
+static void initializeAckWaitList(ShadowContext_t *pContext) {
+	uint16_t i;
+	for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
+		pContext->ackWaitList[i].isFree = true;
+		placeInAckExpiryHeap(pContext, i, i);
 	}
+	memset(pContext->ackWaitHash, 0xFF, sizeof(pContext->ackWaitHash));
+	pContext->ackWaitCount = 0;
 }
 
 void initializeRecords(MQTTClient_t *pClient) {
 	uint8_t i;
-	for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-		AckWaitList[i].isFree = true;
-	}
+	char thingName[THING_LEN];
+
+	createRecordsLock();
+	lockShadowRecords();
+	initializeAckWaitList(&defaultShadowContext);
 	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
 		SubscriptionList[i].isFree = true;
 		SubscriptionList[i].count = 0;
 		SubscriptionList[i].isSticky = false;
+		SubscriptionList[i].isSubscribed = false;
+		SubscriptionList[i].calls = 0;
+		SubscriptionList[i].unsubscribeCalls = 0;
+	}
+	defaultShadowContext.pMqttClient = pClient;
+
+	// the version of the Thing of this device is kept across connects
+	memset(thingName, 0, sizeof(thingName));
+	if (read_aws_thing(thingName, THING_LEN) != WM_SUCCESS) {
+		strcpy(thingName, AWS_IOT_MY_THING_NAME);
+	}
+	defaultShadowThing.isUsed = setThingName(&defaultShadowThing, thingName);
+	unlockShadowRecords();
+	if (!defaultShadowThing.isUsed) {
+		WARN("Thing Name %s is too long to track its version", thingName);
 	}
-	pMqttClient = pClient;
 }
 
-bool isSubscriptionPresent(const char *pThingName, ShadowActions_t action) {
+// the record of pTopic, counting one more action
+static int16_t takeSubscription(const char *pTopic, bool isSticky) {
+	int16_t indexSubList = findIndexOfSubscriptionList(pTopic);
 
-	uint8_t i = 0;
-	bool isAcceptedPresent = false;
-	bool isRejectedPresent = false;
+	if (indexSubList < 0) {
+		indexSubList = getNextFreeIndexOfSubscriptionList();
+		if (indexSubList < 0) {
+			return -1;
+		}
+		strcpy(SubscriptionList[indexSubList].Topic, pTopic);
+	}
+	SubscriptionList[indexSubList].count++;
+	SubscriptionList[indexSubList].isSticky = isSticky;
+	return indexSubList;
+}
+
+IoT_Error_t subscribeToShadowActionAcks(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		bool isSticky) {
+	IoT_Error_t ret_val = SUBSCRIBE_ERROR;
+	MQTTSubscribeParams subParams[2] = {MQTTSubscribeParamsDefault, MQTTSubscribeParamsDefault};
 	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
 	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+	uint8_t unsubscribeCalls[2];
+	int16_t indexSubList[2];
+	uint8_t i;
 
+	if (pContext->isWildcard) {
+		return NONE_ERROR;
+	}
 	topicNameFromThingAndAction(TemporaryTopicNameAccepted, pThingName, action, SHADOW_ACCEPTED);
 	topicNameFromThingAndAction(TemporaryTopicNameRejected, pThingName, action, SHADOW_REJECTED);
 
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		if (!SubscriptionList[i].isFree) {
-			if ((strcmp(TemporaryTopicNameAccepted, SubscriptionList[i].Topic) == 0)) {
-				isAcceptedPresent = true;
-			} else if ((strcmp(TemporaryTopicNameRejected, SubscriptionList[i].Topic) == 0)) {
-				isRejectedPresent = true;
+	lockShadowRecords();
+	indexSubList[0] = takeSubscription(TemporaryTopicNameAccepted, isSticky);
+	indexSubList[1] = takeSubscription(TemporaryTopicNameRejected, isSticky);
+	if (indexSubList[0] >= 0 && indexSubList[1] >= 0) {
+		if (SubscriptionList[indexSubList[0]].isSubscribed && SubscriptionList[indexSubList[1]].isSubscribed) {
+			unlockShadowRecords();
+			return NONE_ERROR;
+		}
+		for (i = 0; i < 2; i++) {
+			subParams[i].mHandler = AckStatusCallback;
+			subParams[i].qos = QOS_0;
+			subParams[i].pTopic = SubscriptionList[indexSubList[i]].Topic;
+			unsubscribeCalls[i] = SubscriptionList[indexSubList[i]].unsubscribeCalls;
+			SubscriptionList[indexSubList[i]].calls++;
+		}
+		unlockShadowRecords();
+
+		// both topics go out in one SUBSCRIBE, and either both or none of them are subscribed.
+		// It returns once the SUBACK grants them, so the action can be published right away
+		ret_val = pContext->pMqttClient->subscribeBatch(subParams, 2);
+
+		lockShadowRecords();
+		for (i = 0; i < 2; i++) {
+			SubscriptionList[indexSubList[i]].calls--;
+			if (ret_val == NONE_ERROR && unsubscribeCalls[i] == SubscriptionList[indexSubList[i]].unsubscribeCalls) {
+				SubscriptionList[indexSubList[i]].isSubscribed = true;
 			}
 		}
 	}
 
-	if (isRejectedPresent && isAcceptedPresent) {
-		return true;
+	for (i = 0; i < 2; i++) {
+		if (indexSubList[i] >= 0) {
+			if (ret_val != NONE_ERROR) {
+				SubscriptionList[indexSubList[i]].count--;
+			}
+			settleSubscription(pContext, indexSubList[i]);
+		}
 	}
+	unlockShadowRecords();
 
-	return false;
+	return ret_val;
 }
 
-IoT_Error_t subscribeToShadowActionAcks(const char *pThingName, ShadowActions_t action, bool isSticky) {
+IoT_Error_t publishToShadowAction(ShadowContext_t *pContext, const char * pThingName, ShadowActions_t action,
+		const char *pJsonDocumentToBeSent) {
 	IoT_Error_t ret_val = NONE_ERROR;
-	MQTTSubscribeParams subParams = MQTTSubscribeParamsDefault;
+	char TemporaryTopicName[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+	topicNameFromThingAndAction(TemporaryTopicName, pThingName, action, SHADOW_ACTION);
 
-	bool clearBothEntriesFromList = true;
-	int16_t indexAcceptedSubList = 0;
-	int16_t indexRejectedSubList = 0;
-	indexAcceptedSubList = getNextFreeIndexOfSubscriptionList();
-	indexRejectedSubList = getNextFreeIndexOfSubscriptionList();
+	MQTTPublishParams pubParams = MQTTPublishParamsDefault;
+	pubParams.pTopic = TemporaryTopicName;
+	MQTTMessageParams msgParams = MQTTMessageParamsDefault;
+	msgParams.qos = QOS_0;
+	msgParams.PayloadLen = strlen(pJsonDocumentToBeSent) + 1;
+	msgParams.pPayload = (char *) pJsonDocumentToBeSent;
+	pubParams.MessageParams = msgParams;
+	ret_val = pContext->pMqttClient->publish(&pubParams);
 
-	if (indexAcceptedSubList >= 0 && indexRejectedSubList >= 0) {
-		topicNameFromThingAndAction(SubscriptionList[indexAcceptedSubList].Topic, pThingName, action, SHADOW_ACCEPTED);
-		subParams.mHandler = AckStatusCallback;
-		subParams.qos = QOS_0;
-		subParams.pTopic = SubscriptionList[indexAcceptedSubList].Topic;
-		ret_val = pMqttClient->subscribe(&subParams);
-		if (ret_val == NONE_ERROR) {
-			SubscriptionList[indexAcceptedSubList].count = 1;
-			SubscriptionList[indexAcceptedSubList].isSticky = isSticky;
-			topicNameFromThingAndAction(SubscriptionList[indexRejectedSubList].Topic, pThingName, action,
-					SHADOW_REJECTED);
-			subParams.pTopic = SubscriptionList[indexRejectedSubList].Topic;
-			ret_val = pMqttClient->subscribe(&subParams);
-			if (ret_val == NONE_ERROR) {
-				SubscriptionList[indexRejectedSubList].count = 1;
-				SubscriptionList[indexRejectedSubList].isSticky = isSticky;
-				clearBothEntriesFromList = false;
-
-				// wait for SUBSCRIBE_SETTLING_TIME seconds to let the subscription take effect
-				Timer subSettlingtimer;
-				InitTimer(&subSettlingtimer);
-				countdown(&subSettlingtimer, SUBSCRIBE_SETTLING_TIME);
-				while(!expired(&subSettlingtimer));
+	return ret_val;
+}
 
-			}
+// a document written as it is published, with the client token fixed so that both passes give the same bytes
+typedef struct {
+	fpShadowJsonWriter_t writer;
+	void *pWriterContext;
+	uint32_t clientTokenNum;
+	iot_payload_write write;
+} ShadowStreamDocument_t;
+
+static IoT_Error_t countShadowStream(const char *pData, size_t length, void *pContext) {
+	return NONE_ERROR;
+}
+
+static IoT_Error_t flushShadowStream(const char *pData, size_t length, void *pContext) {
+	return ((ShadowStreamDocument_t *)pContext)->write(pData, length);
+}
+
+static IoT_Error_t writeShadowStreamPayload(iot_payload_write write, void *pContext) {
+	ShadowStreamDocument_t *pDocument = (ShadowStreamDocument_t *)pContext;
+	size_t length;
+
+	pDocument->write = write;
+	return writeShadowJsonStream(pDocument->writer, pDocument->pWriterContext, pDocument->clientTokenNum,
+			flushShadowStream, pDocument, &length);
+}
+
+IoT_Error_t publishStreamToShadowAction(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		fpShadowJsonWriter_t writer, void *pWriterContext, uint32_t clientTokenNum) {
+	ShadowStreamDocument_t document = {writer, pWriterContext, clientTokenNum, NULL};
+	char TemporaryTopicName[MAX_SHADOW_TOPIC_LENGTH_BYTES];
+	MQTTPublishParams pubParams = MQTTPublishParamsDefault;
+	IoT_Error_t ret_val;
+	size_t length;
+
+	if (NULL == pContext->pMqttClient->publishStream) {
+		return GENERIC_ERROR;
+	}
+	// the MQTT header goes out first with the length in it, a first pass only counts the bytes
+	ret_val = writeShadowJsonStream(writer, pWriterContext, clientTokenNum, countShadowStream, NULL, &length);
+	if (ret_val != NONE_ERROR) {
+		return ret_val;
+	}
+
+	topicNameFromThingAndAction(TemporaryTopicName, pThingName, action, SHADOW_ACTION);
+	pubParams.pTopic = TemporaryTopicName;
+	pubParams.MessageParams.qos = QOS_0;
+	pubParams.MessageParams.PayloadLen = length;
+	return pContext->pMqttClient->publishStream(&pubParams, writeShadowStreamPayload, &document);
+}
+
+bool isAckWaitListFull(ShadowContext_t *pContext) {
+	bool isFull;
+
+	lockShadowRecords();
+	isFull = pContext->ackWaitCount >= MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME;
+	unlockShadowRecords();
+	return isFull;
+}
+
+bool addToAckWaitList(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		uint32_t clientTokenKey, fpActionCallback_t callback, void *pCallbackContext, uint32_t timeout_seconds) {
+	ToBeReceivedAckRecord_t *pAck;
+	uint32_t slot = clientTokenKey & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+	uint16_t indexAckWaitList;
+
+	lockShadowRecords();
+	if (pContext->ackWaitCount >= MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME) {
+		unlockShadowRecords();
+		return false;
+	}
+	// the first of the free entries, it is last of the heap once added
+	indexAckWaitList = pContext->ackExpiryHeap[pContext->ackWaitCount];
+	pAck = &pContext->ackWaitList[indexAckWaitList];
+
+	pAck->callback = callback;
+	pAck->clientTokenKey = clientTokenKey;
+	strncpy(pAck->thingName, pThingName, MAX_SIZE_OF_THING_NAME - 1);
+	pAck->thingName[MAX_SIZE_OF_THING_NAME - 1] = '\0';
+	pAck->pCallbackContext = pCallbackContext;
+	pAck->action = action;
+	InitTimer(&(pAck->timer));
+	countdown(&(pAck->timer), timeout_seconds);
+	pAck->isFree = false;
+
+	while (pContext->ackWaitHash[slot] != ACK_WAIT_HASH_EMPTY) {
+		slot = (slot + 1) & (SHADOW_ACK_WAIT_HASH_SLOTS - 1);
+	}
+	pContext->ackWaitHash[slot] = indexAckWaitList;
+
+	pContext->ackWaitCount++;
+	siftAckExpiryHeap(pContext, pContext->ackWaitCount - 1);
+	unlockShadowRecords();
+	return true;
+}
+
+// the entry may be gone already, answered or timed out while the action was published
+void cancelAckWaitListEntry(ShadowContext_t *pContext, uint32_t clientTokenKey) {
+	ToBeReceivedAckRecord_t ack;
+	int32_t index;
+
+	lockShadowRecords();
+	index = findInAckWaitList(pContext, clientTokenKey);
+	if (index < 0) {
+		unlockShadowRecords();
+		return;
+	}
+	ack = pContext->ackWaitList[index];
+	removeFromAckWaitList(pContext, index);
+	unlockShadowRecords();
+	unsubscribeFromShadowActionAcks(pContext, ack.thingName, ack.action);
+}
+
+void HandleExpiredResponseCallbacks(ShadowContext_t *pContext) {
+	ToBeReceivedAckRecord_t ack;
+	uint16_t index;
+
+	// only the actions that timed out are looked at, soonest first
+	while (1) {
+		lockShadowRecords();
+		index = pContext->ackExpiryHeap[0];
+		if (pContext->ackWaitCount == 0 || !expired(&pContext->ackWaitList[index].timer)) {
+			unlockShadowRecords();
+			break;
+		}
+		ack = pContext->ackWaitList[index];
+		removeFromAckWaitList(pContext, index);
+		unlockShadowRecords();
+
+		unsubscribeFromShadowActionAcks(pContext, ack.thingName, ack.action);
+		if (ack.callback != NULL) {
+			// there is no document, shadowRxBuf belongs to the task receiving the responses
+			ack.callback(ack.thingName, ack.action, SHADOW_ACK_TIMEOUT, "", ack.pCallbackContext);
 		}
 	}
+}
 
-	if (clearBothEntriesFromList) {
-		if (indexAcceptedSubList >= 0) {
-			SubscriptionList[indexAcceptedSubList].isFree = true;
-		} else if (indexRejectedSubList >= 0) {
-			SubscriptionList[indexRejectedSubList].isFree = true;
+// true if pKey spells out the keys at pPath[0] to pPath[depth], separated by dots
+static bool isKeyPathMatching(const ShadowJsonView_t *pView, const char *pKey, const int32_t *pPath, uint8_t depth) {
+	uint8_t d;
+	for (d = 0; d <= depth; d++) {
+		jsmntok_t *pToken = &pView->pTokens[pPath[d]];
+		size_t length = pToken->end - pToken->start;
+		if (strncmp(pKey, pView->pJsonDocument + pToken->start, length) != 0) {
+			return false;
 		}
-		if (SubscriptionList[indexAcceptedSubList].count == 1) {
-			ret_val = pMqttClient->unsubscribe(SubscriptionList[indexAcceptedSubList].Topic);
+		pKey += length;
+		if (*pKey != (d == depth ? '\0' : '.')) {
+			return false;
 		}
+		pKey++;
 	}
+	return true;
+}
 
-	return ret_val;
+static void dispatchDeltaValue(const ShadowJsonView_t *pView, uint8_t index, int32_t valueToken) {
+	jsmntok_t *pValue = &pView->pTokens[valueToken];
+
+	updateJsonStructFromToken(pView, valueToken, tokenTable[index].pStruct);
+	rememberShadowSnapshotValue(tokenTable[index].pKey, pValue->type, pView->pJsonDocument + pValue->start,
+			pValue->end - pValue->start);
+	if (tokenTable[index].callback != NULL) {
+		tokenTable[index].callback(pView->pJsonDocument + pValue->start, pValue->end - pValue->start,
+				tokenTable[index].pStruct);
+	}
 }
 
-void incrementSubscriptionCnt(const char *pThingName, ShadowActions_t action, bool isSticky) {
-	char TemporaryTopicNameAccepted[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	char TemporaryTopicNameRejected[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	uint8_t i;
-	topicNameFromThingAndAction(TemporaryTopicNameAccepted, pThingName, action, SHADOW_ACCEPTED);
-	topicNameFromThingAndAction(TemporaryTopicNameRejected, pThingName, action, SHADOW_REJECTED);
+// a top level key of the schema goes straight to the parser of its type, returns the bit of the key
+static uint32_t dispatchDeltaSchemaValue(const char *pKey, size_t keyLength, const char *pJsonDocument,
+		jsmntok_t *pValue) {
+	const ShadowSchemaField_t *pField;
+	int32_t index;
 
-	for (i = 0; i < MAX_TOPICS_AT_ANY_GIVEN_TIME; i++) {
-		if (!SubscriptionList[i].isFree) {
-			if ((strcmp(TemporaryTopicNameAccepted, SubscriptionList[i].Topic) == 0)
-					|| (strcmp(TemporaryTopicNameRejected, SubscriptionList[i].Topic) == 0)) {
-				SubscriptionList[i].count++;
-				SubscriptionList[i].isSticky = isSticky;
-			}
+	index = findShadowSchemaField(pDeltaSchema, pKey, keyLength);
+	if (index < 0) {
+		return 0;
+	}
+	pField = &pDeltaSchema->pFields[index];
+	if (pField->parse((uint8_t *)pDeltaSchemaState + pField->offset, pJsonDocument, pValue) != NONE_ERROR) {
+		return 0;
+	}
+	rememberShadowSnapshotValue(pField->pKey, pValue->type, pJsonDocument + pValue->start,
+			pValue->end - pValue->start);
+	return (uint32_t)1 << index;
+}
+
+static uint32_t dispatchDeltaSchemaKey(const ShadowJsonView_t *pView, int32_t keyToken) {
+	jsmntok_t *pKey = &pView->pTokens[keyToken];
+
+	return dispatchDeltaSchemaValue(pView->pJsonDocument + pKey->start, pKey->end - pKey->start,
+			pView->pJsonDocument, &pView->pTokens[keyToken + 1]);
+}
+
+static void dispatchDeltaKey(const ShadowJsonView_t *pView, uint32_t hash, const int32_t *pPath, uint8_t depth) {
+	uint32_t slot = hash & (DELTA_KEY_HASH_SLOTS - 1);
+	uint8_t index;
+
+	// every entry registered on this path is called, in the order of registration
+	while ((index = deltaKeyHash[slot]) != DELTA_KEY_HASH_EMPTY) {
+		if (!tokenTable[index].isFree && tokenTable[index].pathHash == hash
+				&& isKeyPathMatching(pView, tokenTable[index].pKey, pPath, depth)) {
+			dispatchDeltaValue(pView, index, pPath[depth] + 1);
 		}
+		slot = (slot + 1) & (DELTA_KEY_HASH_SLOTS - 1);
 	}
 }
 
-IoT_Error_t publishToShadowAction(const char * pThingName, ShadowActions_t action, const char *pJsonDocumentToBeSent) {
-	IoT_Error_t ret_val = NONE_ERROR;
-	char TemporaryTopicName[MAX_SHADOW_TOPIC_LENGTH_BYTES];
-	topicNameFromThingAndAction(TemporaryTopicName, pThingName, action, SHADOW_ACTION);
+/*
+ * Registered keys are paths from the state object, nested keys joined with dots such
+ * as "light.color". One walk over the keys of the state hashes the path of every key
+ * as it goes and looks it up, whatever the number of registered keys.
+ */
+static void dispatchDeltaState(const ShadowJsonView_t *pView) {
+	int32_t path[DELTA_KEY_MAX_DEPTH];
+	uint32_t prefixHash[DELTA_KEY_MAX_DEPTH];
+	int16_t objectEnd[DELTA_KEY_MAX_DEPTH];
+	uint8_t depth = 0;
+	uint32_t hash;
+	int32_t i;
+	uint8_t index;
+	uint32_t slot;
+	uint32_t schemaFields = 0;
+
+	// the whole state goes to the entries registered as "state"
+	hash = hashKeyPath(HASH_KEY_PATH_SEED, SHADOW_STATE_STRING, strlen(SHADOW_STATE_STRING));
+	for (slot = hash & (DELTA_KEY_HASH_SLOTS - 1); (index = deltaKeyHash[slot]) != DELTA_KEY_HASH_EMPTY;
+			slot = (slot + 1) & (DELTA_KEY_HASH_SLOTS - 1)) {
+		if (!tokenTable[index].isFree && strcmp(tokenTable[index].pKey, SHADOW_STATE_STRING) == 0) {
+			dispatchDeltaValue(pView, index, pView->state);
+		}
+	}
 
-	MQTTPublishParams pubParams = MQTTPublishParamsDefault;
-	pubParams.pTopic = TemporaryTopicName;
-	MQTTMessageParams msgParams = MQTTMessageParamsDefault;
-	msgParams.qos = QOS_0;
-	msgParams.PayloadLen = strlen(pJsonDocumentToBeSent) + 1;
-	msgParams.pPayload = (char *) pJsonDocumentToBeSent;
-	pubParams.MessageParams = msgParams;
-	ret_val = pMqttClient->publish(&pubParams);
+	if (pView->pTokens[pView->state].type != JSMN_OBJECT) {
+		return;
+	}
 
-	return ret_val;
+	prefixHash[0] = HASH_KEY_PATH_SEED;
+	objectEnd[0] = pView->pTokens[pView->state].end;
+	i = pView->state + 1;
+	while (i + 1 < pView->tokenCount && pView->pTokens[i].start < objectEnd[0]) {
+		while (pView->pTokens[i].start >= objectEnd[depth]) {
+			depth--;
+		}
+		path[depth] = i;
+		hash = hashKeyPath(prefixHash[depth], pView->pJsonDocument + pView->pTokens[i].start,
+				pView->pTokens[i].end - pView->pTokens[i].start);
+		// "state" as a top level key of the state object stands for the whole state
+		if (depth > 0 || jsoneq(pView->pJsonDocument, &pView->pTokens[i], SHADOW_STATE_STRING) != 0) {
+			dispatchDeltaKey(pView, hash, path, depth);
+		}
+		if (depth == 0 && pDeltaSchema != NULL) {
+			schemaFields |= dispatchDeltaSchemaKey(pView, i);
+		}
+
+		if (pView->pTokens[i + 1].type == JSMN_OBJECT && depth + 1 < DELTA_KEY_MAX_DEPTH) {
+			depth++;
+			prefixHash[depth] = hashKeyPath(hash, ".", 1);
+			objectEnd[depth] = pView->pTokens[i + 1].end;
+			i += 2;
+		} else {
+			i = skipShadowJsonValue(pView, i + 1);
+		}
+	}
+	if (schemaFields != 0 && deltaSchemaCallback != NULL) {
+		deltaSchemaCallback(pDeltaSchemaState, schemaFields, pDeltaSchemaContext);
+	}
 }
 
-bool getNextFreeIndexOfAckWaitList(uint8_t *pIndex) {
-	uint8_t i;
-	if (pIndex != NULL) {
-		for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-			if (AckWaitList[i].isFree) {
-				*pIndex = i;
-				return true;
-			}
+static void dispatchDeltaStreamValue(JsonStreamEvent_t event, const char *pText, size_t length, uint8_t level) {
+	uint16_t pathLength = deltaStream.pathLength[level];
+	ShadowJsonView_t view;
+	jsmntok_t value;
+	uint32_t hash;
+	uint32_t slot;
+	uint8_t index;
+
+	if (pathLength == DELTA_STREAM_PATH_INVALID) {
+		return;
+	}
+	// "state" as a top level key of the state object stands for the whole state, which is never streamed
+	if (level == 0 && pathLength == strlen(SHADOW_STATE_STRING)
+			&& strncmp(deltaStream.path, SHADOW_STATE_STRING, pathLength) == 0) {
+		return;
+	}
+
+	// the value alone, as a view of a single token
+	value.type = (event == JSON_STREAM_STRING) ? JSMN_STRING : JSMN_PRIMITIVE;
+	value.start = 0;
+	value.end = length;
+	value.size = 0;
+	value.parent = -1;
+	memset(&view, 0, sizeof(view));
+	view.pJsonDocument = pText;
+	view.pTokens = &value;
+	view.tokenCount = 1;
+
+	hash = hashKeyPath(HASH_KEY_PATH_SEED, deltaStream.path, pathLength);
+	for (slot = hash & (DELTA_KEY_HASH_SLOTS - 1); (index = deltaKeyHash[slot]) != DELTA_KEY_HASH_EMPTY;
+			slot = (slot + 1) & (DELTA_KEY_HASH_SLOTS - 1)) {
+		if (!tokenTable[index].isFree && tokenTable[index].pathHash == hash
+				&& strncmp(tokenTable[index].pKey, deltaStream.path, pathLength) == 0
+				&& tokenTable[index].pKey[pathLength] == '\0') {
+			dispatchDeltaValue(&view, index, 0);
 		}
 	}
-	return false;
+	if (level == 0 && pDeltaSchema != NULL) {
+		deltaStream.schemaFields |= dispatchDeltaSchemaValue(deltaStream.path, pathLength, pText, &value);
+	}
 }
 
-void addToAckWaitList(uint8_t indexAckWaitList, const char *pThingName, ShadowActions_t action,
-		const char *pExtractedClientToken, fpActionCallback_t callback, void *pCallbackContext,
-		uint32_t timeout_seconds) {
-	AckWaitList[indexAckWaitList].callback = callback;
-	strncpy(AckWaitList[indexAckWaitList].clientTokenID, pExtractedClientToken, MAX_SIZE_CLIENT_TOKEN_CLIENT_SEQUENCE);
-	strncpy(AckWaitList[indexAckWaitList].thingName, pThingName, MAX_SIZE_OF_THING_NAME);
-	AckWaitList[indexAckWaitList].pCallbackContext = pCallbackContext;
-	AckWaitList[indexAckWaitList].action = action;
-	InitTimer(&(AckWaitList[indexAckWaitList].timer));
-	countdown(&(AckWaitList[indexAckWaitList].timer), timeout_seconds);
-	AckWaitList[indexAckWaitList].isFree = false;
+static void setDeltaStreamKey(const char *pKey, size_t length, uint8_t level) {
+	size_t start = 0;
+
+	if (level > 0) {
+		if (deltaStream.pathLength[level - 1] == DELTA_STREAM_PATH_INVALID) {
+			deltaStream.pathLength[level] = DELTA_STREAM_PATH_INVALID;
+			return;
+		}
+		start = deltaStream.pathLength[level - 1];
+		if (start < sizeof(deltaStream.path)) {
+			deltaStream.path[start] = '.';
+		}
+		start++;
+	}
+	if (start + length > sizeof(deltaStream.path)) {
+		deltaStream.pathLength[level] = DELTA_STREAM_PATH_INVALID;
+		return;
+	}
+	memcpy(deltaStream.path + start, pKey, length);
+	deltaStream.pathLength[level] = start + length;
 }
 
-void HandleExpiredResponseCallbacks(void) {
-	uint8_t i;
-	for (i = 0; i < MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
-		if (!AckWaitList[i].isFree) {
-			if (expired(&(AckWaitList[i].timer))) {
-				if (AckWaitList[i].callback != NULL) {
-					AckWaitList[i].callback(AckWaitList[i].thingName, AckWaitList[i].action, SHADOW_ACK_TIMEOUT,
-							shadowRxBuf, AckWaitList[i].pCallbackContext);
-				}
-				AckWaitList[i].isFree = true;
-				unsubscribeFromAcceptedAndRejected(i);
+/*
+ * Same dispatch as dispatchDeltaState(), from the events of the streaming parser. The
+ * keys of the state are at depth 2 of the document. Only the values that are not
+ * objects reach the registered keys, and the version is only checked before the state
+ * if it comes first, as it does in the deltas of the AWS IoT service.
+ */
+static void deltaStreamCallback(JsonStreamEvent_t event, const char *pText, size_t length, uint8_t depth,
+		void *pContextData) {
+	uint32_t version = 0;
+	jsmntok_t value;
+
+	(void)pContextData;
+
+	switch (event) {
+	case JSON_STREAM_KEY:
+		if (depth == 1) {
+			if (length == strlen(SHADOW_STATE_STRING) && strncmp(pText, SHADOW_STATE_STRING, length) == 0) {
+				deltaStream.member = DELTA_STREAM_STATE;
+			} else if (length == strlen(SHADOW_VERSION_STRING)
+					&& strncmp(pText, SHADOW_VERSION_STRING, length) == 0) {
+				deltaStream.member = DELTA_STREAM_VERSION;
+			} else {
+				deltaStream.member = DELTA_STREAM_OTHER;
+			}
+		} else if (deltaStream.isInState && depth - 2 < DELTA_KEY_MAX_DEPTH) {
+			setDeltaStreamKey(pText, length, depth - 2);
+		}
+		break;
+	case JSON_STREAM_OBJECT_BEGIN:
+	case JSON_STREAM_ARRAY_BEGIN:
+		if (depth == 1 && deltaStream.member == DELTA_STREAM_STATE) {
+			deltaStream.isInState = (event == JSON_STREAM_OBJECT_BEGIN);
+		}
+		if (depth + 1 < 32) {
+			if (event == JSON_STREAM_ARRAY_BEGIN) {
+				deltaStream.isArray |= (uint32_t)1 << (depth + 1);
+			} else {
+				deltaStream.isArray &= ~((uint32_t)1 << (depth + 1));
+			}
+		}
+		break;
+	case JSON_STREAM_OBJECT_END:
+	case JSON_STREAM_ARRAY_END:
+		if (depth == 1) {
+			deltaStream.isInState = false;
+		}
+		break;
+	case JSON_STREAM_STRING:
+	case JSON_STREAM_PRIMITIVE:
+		if (depth == 1 && deltaStream.member == DELTA_STREAM_VERSION && shadowDiscardOldDeltaFlag) {
+			value.type = JSMN_PRIMITIVE;
+			value.start = 0;
+			value.end = length;
+			if (parseUnsignedInteger32Value(&version, pText, &value) != NONE_ERROR) {
+				break;
+			}
+			if (version > defaultShadowThing.version) {
+				defaultShadowThing.version = version;
+				DEBUG("New Version number: %d", defaultShadowThing.version);
+			} else if (!deltaStream.isDiscarded) {
+				WARN("Old Delta Message received - Ignoring rx: %d local: %d", version, defaultShadowThing.version);
+				deltaStream.isDiscarded = true;
 			}
+		} else if (deltaStream.isInState && !deltaStream.isDiscarded && depth >= 2 && depth - 2 < DELTA_KEY_MAX_DEPTH
+				&& (deltaStream.isArray & ((uint32_t)1 << depth)) == 0) {
+			dispatchDeltaStreamValue(event, pText, length, depth - 2);
 		}
+		break;
 	}
 }
 
-static int shadow_delta_callback(MQTTCallbackParams params) {
-
-	int32_t tokenCount;
-	uint32_t i = 0;
-	void *pJsonHandler = NULL;
-	int32_t DataPosition;
-	uint32_t dataLength;
+static int handleDeltaChunk(MQTTMessageParams *pMessage) {
+	int rc;
+
+	if (pMessage->PayloadOffset == 0) {
+		aws_iot_json_stream_init(&deltaStream.parser, deltaStreamCallback, NULL);
+		deltaStream.isArray = 0;
+		deltaStream.schemaFields = 0;
+		deltaStream.member = DELTA_STREAM_OTHER;
+		deltaStream.isInState = false;
+		deltaStream.isDiscarded = false;
+		deltaStream.isActive = true;
+	} else if (!deltaStream.isActive) {
+		return GENERIC_ERROR;
+	}
 
-	if (params.MessageParams.PayloadLen > SHADOW_MAX_SIZE_OF_RX_BUFFER) {
+	rc = aws_iot_json_stream_feed(&deltaStream.parser, pMessage->pPayload, pMessage->PayloadLen);
+	if (rc == 0 && pMessage->PayloadOffset + pMessage->PayloadLen >= pMessage->TotalPayloadLen) {
+		deltaStream.isActive = false;
+		rc = aws_iot_json_stream_finish(&deltaStream.parser);
+	} else if (rc == 0) {
+		return NONE_ERROR;
+	}
+	if (rc != 0) {
+		// the values of the chunks already parsed have been dispatched
+		WARN("Received JSON is not valid: %d", rc);
+		deltaStream.isActive = false;
+		return GENERIC_ERROR;
+	}
+	if (deltaStream.isDiscarded) {
 		return GENERIC_ERROR;
 	}
 
+	if (deltaStream.schemaFields != 0 && deltaSchemaCallback != NULL) {
+		deltaSchemaCallback(pDeltaSchemaState, deltaStream.schemaFields, pDeltaSchemaContext);
+	}
+	setShadowSnapshotVersion(defaultShadowThing.version);
+	return NONE_ERROR;
+}
+
+static int handleDelta(MQTTCallbackParams params) {
+
+	ShadowJsonView_t view;
+
+	// a document delivered in chunks, whatever its size, is parsed as it streams in
+	if (params.MessageParams.PayloadLen != params.MessageParams.TotalPayloadLen) {
+		return handleDeltaChunk(&params.MessageParams);
+	}
+
 	memcpy(shadowRxBuf, params.MessageParams.pPayload, params.MessageParams.PayloadLen);
 	shadowRxBuf[params.MessageParams.PayloadLen] = '\0';	// jsmn_parse relies on a string
 
-	if (!isJsonValidAndParse(shadowRxBuf, pJsonHandler, &tokenCount)) {
+	if (!parseShadowJson(shadowRxBuf, &view)) {
 		WARN("Received JSON is not valid");
 		return GENERIC_ERROR;
 	}
 
 	if (shadowDiscardOldDeltaFlag) {
 		uint32_t tempVersionNumber = 0;
-		if (extractVersionNumber(shadowRxBuf, pJsonHandler, tokenCount, &tempVersionNumber)) {
-			if (tempVersionNumber > shadowJsonVersionNum) {
-				shadowJsonVersionNum = tempVersionNumber;
-				DEBUG("New Version number: %d", shadowJsonVersionNum);
+		if (getShadowJsonVersion(&view, &tempVersionNumber)) {
+			if (tempVersionNumber > defaultShadowThing.version) {
+				defaultShadowThing.version = tempVersionNumber;
+				DEBUG("New Version number: %d", defaultShadowThing.version);
 			} else {
-				WARN("Old Delta Message received - Ignoring rx: %d local: %d", tempVersionNumber, shadowJsonVersionNum);
+				WARN("Old Delta Message received - Ignoring rx: %d local: %d", tempVersionNumber,
+						defaultShadowThing.version);
 				return GENERIC_ERROR;
 			}
 		}
 	}
 
-	for (i = 0; i < tokenTableIndex; i++) {
-		if (!tokenTable[i].isFree) {
-			if (isJsonKeyMatchingAndUpdateValue(shadowRxBuf, pJsonHandler, tokenCount, tokenTable[i].pStruct,
-					&dataLength, &DataPosition)) {
-				if (tokenTable[i].callback != NULL) {
-					tokenTable[i].callback(shadowRxBuf + DataPosition, dataLength, tokenTable[i].pStruct);
-				}
+	if (view.state < 0) {
+		WARN("Delta without a state");
+		return GENERIC_ERROR;
+	}
+	dispatchDeltaState(&view);
+	setShadowSnapshotVersion(defaultShadowThing.version);
+
+	return NONE_ERROR;
+}
+
+static int shadow_delta_callback(MQTTCallbackParams params) {
+	int rc;
+
+	lockShadowRecords();
+	rc = handleDelta(params);
+	unlockShadowRecords();
+	return rc;
+}
+
+static int wildcardDeltaCallback(MQTTCallbackParams params) {
+	ShadowJsonView_t view;
+	ShadowThing_t *pThing;
+	ShadowThing_t thing;
+	jsmntok_t *pState;
+
+	if (pWildcardContext == NULL) {
+		return GENERIC_ERROR;
+	}
+	lockShadowRecords();
+	pThing = findThingOfTopic(pWildcardContext, params.pTopicName, params.TopicNameLen);
+	unlockShadowRecords();
+	if (pThing == NULL) {
+		return GENERIC_ERROR;
+	}
+
+	// the JSON parser needs the whole document, one too big for shadowRxBuf cannot be handled here
+	if (!gatherShadowRxBuf(&params.MessageParams)) {
+		return isLastChunk(&params.MessageParams) ? GENERIC_ERROR : NONE_ERROR;
+	}
+
+	// the Thing may have been removed meanwhile, it is looked up again
+	lockShadowRecords();
+	pThing = findThingOfTopic(pWildcardContext, params.pTopicName, params.TopicNameLen);
+	if (pThing == NULL) {
+		unlockShadowRecords();
+		return GENERIC_ERROR;
+	}
+	if (!parseShadowJson(shadowRxBuf, &view) || view.state < 0) {
+		unlockShadowRecords();
+		WARN("Received JSON is not valid");
+		return GENERIC_ERROR;
+	}
+	if (shadowDiscardOldDeltaFlag) {
+		uint32_t tempVersionNumber = 0;
+		if (getShadowJsonVersion(&view, &tempVersionNumber)) {
+			if (tempVersionNumber > pThing->version) {
+				pThing->version = tempVersionNumber;
+			} else {
+				WARN("Old Delta Message received for %s - Ignoring rx: %d local: %d", pThing->thingName,
+						tempVersionNumber, pThing->version);
+				unlockShadowRecords();
+				return GENERIC_ERROR;
 			}
 		}
 	}
+	thing = *pThing;
+
+	// held over the callback as for the deltas of the default Thing, the view stays valid
+	if (thing.deltaCallback != NULL) {
+		pState = &view.pTokens[view.state];
+		thing.deltaCallback(thing.thingName, shadowRxBuf + pState->start, pState->end - pState->start,
+				thing.pDeltaContext);
+	}
+	unlockShadowRecords();
 
 	return NONE_ERROR;
 }
+
+IoT_Error_t aws_iot_shadow_context_init(ShadowContext_t *pContext, MQTTClient_t *pClient, ShadowThing_t *pThings,
+		uint8_t maxThings) {
+	IoT_Error_t rc;
+	uint8_t i;
+	MQTTSubscribeParams subParams[3] = {MQTTSubscribeParamsDefault, MQTTSubscribeParamsDefault,
+			MQTTSubscribeParamsDefault};
+
+	if (pContext == NULL || pClient == NULL || pThings == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	if (!pClient->isConnected()) {
+		return CONNECTION_ERROR;
+	}
+
+	createRecordsLock();
+	lockShadowRecords();
+	pContext->pMqttClient = pClient;
+	pContext->pThings = pThings;
+	pContext->maxThings = maxThings;
+	pContext->isWildcard = true;
+	for (i = 0; i < maxThings; i++) {
+		pThings[i].isUsed = false;
+	}
+	initializeAckWaitList(pContext);
+	unlockShadowRecords();
+
+	subParams[0].mHandler = wildcardAckCallback;
+	subParams[0].qos = QOS_0;
+	subParams[0].pTopic = SHADOW_WILDCARD_ACCEPTED_TOPIC;
+	subParams[1] = subParams[0];
+	subParams[1].pTopic = SHADOW_WILDCARD_REJECTED_TOPIC;
+	subParams[2] = subParams[0];
+	subParams[2].mHandler = wildcardDeltaCallback;
+	subParams[2].pTopic = SHADOW_WILDCARD_DELTA_TOPIC;
+
+	// the handlers look the context up, set it first so no response is lost
+	pWildcardContext = pContext;
+	rc = pClient->subscribeBatch(subParams, 3);
+	if (rc != NONE_ERROR) {
+		pWildcardContext = NULL;
+	}
+	return rc;
+}
+
+IoT_Error_t aws_iot_shadow_context_add_thing(ShadowContext_t *pContext, const char *pThingName,
+		fpShadowDeltaCallback_t deltaCallback, void *pContextData) {
+	ShadowThing_t *pThing;
+	uint8_t i;
+
+	IoT_Error_t rc = GENERIC_ERROR;
+
+	if (pContext == NULL || pThingName == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	lockShadowRecords();
+	if (findThing(pContext, pThingName, strlen(pThingName)) != NULL) {
+		unlockShadowRecords();
+		return GENERIC_ERROR;
+	}
+
+	for (i = 0; i < pContext->maxThings; i++) {
+		pThing = &pContext->pThings[i];
+		if (!pThing->isUsed) {
+			if (setThingName(pThing, pThingName)) {
+				pThing->version = 0;
+				pThing->deltaCallback = deltaCallback;
+				pThing->pDeltaContext = pContextData;
+				pThing->isUsed = true;
+				rc = NONE_ERROR;
+			}
+			break;
+		}
+	}
+	unlockShadowRecords();
+	return rc;
+}
+
+IoT_Error_t aws_iot_shadow_context_remove_thing(ShadowContext_t *pContext, const char *pThingName) {
+	ShadowThing_t *pThing;
+
+	if (pContext == NULL || pThingName == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	lockShadowRecords();
+	pThing = findThing(pContext, pThingName, strlen(pThingName));
+	if (pThing != NULL) {
+		pThing->isUsed = false;
+	}
+	unlockShadowRecords();
+	return pThing != NULL ? NONE_ERROR : GENERIC_ERROR;
+}
+
+uint32_t aws_iot_shadow_context_get_version(ShadowContext_t *pContext, const char *pThingName) {
+	ShadowThing_t *pThing;
+	uint32_t version = 0;
+
+	if (pContext == NULL || pThingName == NULL) {
+		return 0;
+	}
+	lockShadowRecords();
+	pThing = findThing(pContext, pThingName, strlen(pThingName));
+	if (pThing != NULL) {
+		version = pThing->version;
+	}
+	unlockShadowRecords();
+	return version;
+}
+
+bool isThingOfContext(ShadowContext_t *pContext, const char *pThingName) {
+	bool isOfContext;
+
+	if (!pContext->isWildcard) {
+		return true;
+	}
+	lockShadowRecords();
+	isOfContext = findThing(pContext, pThingName, strlen(pThingName)) != NULL;
+	unlockShadowRecords();
+	return isOfContext;
+}
@@ -19,24 +19,37 @@
 #include <stdbool.h>
 
 #include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_context.h"
+#include "aws_iot_shadow_schema.h"
 #include "aws_iot_config.h"
 
 
-extern uint32_t shadowJsonVersionNum;
+extern ShadowContext_t defaultShadowContext;
 extern bool shadowDiscardOldDeltaFlag;
 
 void initializeRecords(MQTTClient_t *pClient);
-bool isSubscriptionPresent(const char *pThingName, ShadowActions_t action);
-IoT_Error_t subscribeToShadowActionAcks(const char *pThingName, ShadowActions_t action, bool isSticky);
-void incrementSubscriptionCnt(const char *pThingName, ShadowActions_t action, bool isSticky);
-
-IoT_Error_t publishToShadowAction(const char * pThingName, ShadowActions_t action, const char *pJsonDocumentToBeSent);
-void addToAckWaitList(uint8_t indexAckWaitList, const char *pThingName, ShadowActions_t action,
-		const char *pExtractedClientToken, fpActionCallback_t callback, void *pCallbackContext,
-		uint32_t timeout_seconds);
-bool getNextFreeIndexOfAckWaitList(uint8_t *pIndex);
-void HandleExpiredResponseCallbacks(void);
+bool isThingOfContext(ShadowContext_t *pContext, const char *pThingName);
+// counts one more action waiting on the responses, subscribing their topics if they are not yet
+IoT_Error_t subscribeToShadowActionAcks(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		bool isSticky);
+void unsubscribeFromShadowActionAcks(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action);
+
+IoT_Error_t publishToShadowAction(ShadowContext_t *pContext, const char * pThingName, ShadowActions_t action,
+		const char *pJsonDocumentToBeSent);
+IoT_Error_t publishStreamToShadowAction(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		fpShadowJsonWriter_t writer, void *pWriterContext, uint32_t clientTokenNum);
+// false if the list is full, it may have filled up since isAckWaitListFull()
+bool addToAckWaitList(ShadowContext_t *pContext, const char *pThingName, ShadowActions_t action,
+		uint32_t clientTokenKey, fpActionCallback_t callback, void *pCallbackContext, uint32_t timeout_seconds);
+bool isAckWaitListFull(ShadowContext_t *pContext);
+// the records and the tokens of parseShadowJson are shared by the threads, recursive
+void lockShadowRecords(void);
+void unlockShadowRecords(void);
+void cancelAckWaitListEntry(ShadowContext_t *pContext, uint32_t clientTokenKey);
+void HandleExpiredResponseCallbacks(ShadowContext_t *pContext);
 void initDeltaTokens(void);
 IoT_Error_t registerJsonTokenOnDelta(jsonStruct_t *pStruct);
+IoT_Error_t registerSchemaOnDelta(const ShadowSchema_t *pSchema, void *pState,
+		fpShadowSchemaDeltaCallback_t callback, void *pContextData);
 
 #endif /* SRC_SHADOW_AWS_IOT_SHADOW_RECORDS_H_ */
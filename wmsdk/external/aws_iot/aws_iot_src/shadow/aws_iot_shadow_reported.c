@@ -0,0 +1,401 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "aws_iot_shadow_reported.h"
+
+#include <string.h>
+#include "aws_iot_log.h"
+#include "aws_iot_json_utils.h"
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_key.h"
+#include "aws_iot_config.h"
+
+#define HASH_TEXT_SEED 2166136261u
+#define SHADOW_VERSION_CONFLICT_CODE 409
+
+// the value an ISR may be changing is read once, what is compared is what gets sent
+typedef union {
+	int32_t int32;
+	int16_t int16;
+	int8_t int8;
+	uint32_t uint32;
+	uint16_t uint16;
+	uint8_t uint8;
+	float float32;
+	double float64;
+	bool boolean;
+} ReportedSnapshot_t;
+
+static uint32_t hashText(const char *pText, size_t length) {
+	uint32_t hash = HASH_TEXT_SEED;
+
+	for (; 0 < length; pText++, length--) {
+		hash = (hash ^ (uint8_t)*pText) * 16777619u;
+	}
+	return hash;
+}
+
+static void setNumber(ShadowReportedValue_t *pValue, double number) {
+	pValue->number = number;
+	pValue->textLength = 0;
+}
+
+// text too long for the copy is left to its length and hash
+static void setText(ShadowReportedValue_t *pValue, const char *pText, size_t length) {
+	pValue->number = hashText(pText, length);
+	pValue->textLength = length;
+	if (length <= sizeof(pValue->text)) {
+		memcpy(pValue->text, pText, length);
+	}
+}
+
+static bool isSameValue(const ShadowReportedValue_t *pValue, const ShadowReportedValue_t *pOther) {
+	if (pValue->number != pOther->number || pValue->textLength != pOther->textLength) {
+		return false;
+	}
+	return pValue->textLength > sizeof(pValue->text) || 0 == memcmp(pValue->text, pOther->text, pValue->textLength);
+}
+
+// copies the value of the field and returns it as a value to compare
+static void readField(const ShadowReportedField_t *pField, ReportedSnapshot_t *pSnapshot,
+		ShadowReportedValue_t *pValue) {
+	switch (pField->type) {
+	case SHADOW_JSON_INT32:
+		pSnapshot->int32 = *(volatile int32_t *)pField->pData;
+		setNumber(pValue, pSnapshot->int32);
+		break;
+	case SHADOW_JSON_INT16:
+		pSnapshot->int16 = *(volatile int16_t *)pField->pData;
+		setNumber(pValue, pSnapshot->int16);
+		break;
+	case SHADOW_JSON_INT8:
+		pSnapshot->int8 = *(volatile int8_t *)pField->pData;
+		setNumber(pValue, pSnapshot->int8);
+		break;
+	case SHADOW_JSON_UINT32:
+		pSnapshot->uint32 = *(volatile uint32_t *)pField->pData;
+		setNumber(pValue, pSnapshot->uint32);
+		break;
+	case SHADOW_JSON_UINT16:
+		pSnapshot->uint16 = *(volatile uint16_t *)pField->pData;
+		setNumber(pValue, pSnapshot->uint16);
+		break;
+	case SHADOW_JSON_UINT8:
+		pSnapshot->uint8 = *(volatile uint8_t *)pField->pData;
+		setNumber(pValue, pSnapshot->uint8);
+		break;
+	case SHADOW_JSON_FLOAT:
+		pSnapshot->float32 = *(volatile float *)pField->pData;
+		setNumber(pValue, pSnapshot->float32);
+		break;
+	case SHADOW_JSON_DOUBLE:
+		pSnapshot->float64 = *(volatile double *)pField->pData;
+		setNumber(pValue, pSnapshot->float64);
+		break;
+	case SHADOW_JSON_BOOL:
+		pSnapshot->boolean = *(volatile bool *)pField->pData;
+		setNumber(pValue, pSnapshot->boolean);
+		break;
+	case SHADOW_JSON_STRING:
+	case SHADOW_JSON_OBJECT:
+		setText(pValue, (const char *)pField->pData, strlen((const char *)pField->pData));
+		break;
+	}
+}
+
+// the value of the field held by a received document, as readField() would return it
+static bool readFieldToken(const ShadowReportedField_t *pField, const ShadowJsonView_t *pView, int32_t valueToken,
+		ShadowReportedValue_t *pValue) {
+	jsmntok_t *pToken = &pView->pTokens[valueToken];
+	double number;
+	bool boolean;
+
+	switch (pField->type) {
+	case SHADOW_JSON_BOOL:
+		if (NONE_ERROR != parseBooleanValue(&boolean, pView->pJsonDocument, pToken)) {
+			return false;
+		}
+		setNumber(pValue, boolean);
+		return true;
+	case SHADOW_JSON_STRING:
+		setText(pValue, pView->pJsonDocument + pToken->start, pToken->end - pToken->start);
+		return true;
+	case SHADOW_JSON_OBJECT:
+		// the field holds JSON text, which has the quotes of a string
+		if (JSMN_STRING == pToken->type) {
+			setText(pValue, pView->pJsonDocument + pToken->start - 1, pToken->end - pToken->start + 2);
+		} else {
+			setText(pValue, pView->pJsonDocument + pToken->start, pToken->end - pToken->start);
+		}
+		return true;
+	default:
+		if (NONE_ERROR != parseDoubleValue(&number, pView->pJsonDocument, pToken)) {
+			return false;
+		}
+		setNumber(pValue, number);
+		return true;
+	}
+}
+
+static bool isFieldChanged(const ShadowReportedField_t *pField, const ShadowReportedValue_t *pValue) {
+	double accepted = pField->acceptedValue.number;
+	double difference;
+
+	if (!pField->isAccepted) {
+		return true;
+	}
+	if (isSameValue(pValue, &pField->acceptedValue)) {
+		return false;
+	}
+	if (SHADOW_JSON_STRING == pField->type || SHADOW_JSON_OBJECT == pField->type || SHADOW_JSON_BOOL == pField->type) {
+		return true;
+	}
+	difference = (pValue->number > accepted) ? pValue->number - accepted : accepted - pValue->number;
+	return difference >= pField->deadband;
+}
+
+void aws_iot_shadow_reported_enable_versioning(ShadowReportedCache_t *pCache) {
+	if (NULL != pCache) {
+		pCache->isVersioned = true;
+	}
+}
+
+IoT_Error_t aws_iot_shadow_reported_init(ShadowReportedCache_t *pCache, ShadowReportedField_t *pFields, uint8_t count) {
+	uint8_t i;
+
+	if (NULL == pCache || (NULL == pFields && 0 != count)) {
+		return NULL_VALUE_ERROR;
+	}
+	for (i = 0; i < count; i++) {
+		if (NULL == pFields[i].pKey || NULL == pFields[i].pData) {
+			return NULL_VALUE_ERROR;
+		}
+		setNumber(&pFields[i].acceptedValue, 0);
+		setNumber(&pFields[i].pendingValue, 0);
+		pFields[i].isAccepted = false;
+		pFields[i].isPending = false;
+		countdown_ms(&pFields[i].intervalTimer, 0);
+	}
+	pCache->pFields = pFields;
+	pCache->count = count;
+	pCache->state = SHADOW_REPORTED_IDLE;
+	pCache->isVersioned = false;
+	pCache->isVersionKnown = false;
+	pCache->version = 0;
+	pCache->conflictRetries = 0;
+	pCache->callback = NULL;
+	pCache->pCallbackContext = NULL;
+	return NONE_ERROR;
+}
+
+uint8_t aws_iot_shadow_reported_add_changes(ShadowReportedCache_t *pCache, ShadowJsonBuilder_t *pBuilder) {
+	ShadowReportedField_t *pField;
+	ReportedSnapshot_t snapshot;
+	ShadowReportedValue_t value;
+	const void *pValue;
+	uint8_t added = 0;
+	uint8_t i;
+
+	if (NULL == pCache || NULL == pBuilder) {
+		return 0;
+	}
+	for (i = 0; i < pCache->count; i++) {
+		pField = &pCache->pFields[i];
+		if (pField->isPending) {
+			continue;
+		}
+		if (0 != pField->minIntervalMs && pField->isAccepted && !expired(&pField->intervalTimer)) {
+			continue;
+		}
+		readField(pField, &snapshot, &value);
+		if (!isFieldChanged(pField, &value)) {
+			continue;
+		}
+
+		pValue = (SHADOW_JSON_STRING == pField->type || SHADOW_JSON_OBJECT == pField->type) ? pField->pData : &snapshot;
+		if (NONE_ERROR != aws_iot_shadow_builder_add_value(pBuilder, pField->pKey, pField->type, pValue)) {
+			break;
+		}
+		pField->pendingValue = value;
+		pField->isPending = true;
+		if (0 != pField->minIntervalMs) {
+			countdown_ms(&pField->intervalTimer, pField->minIntervalMs);
+		}
+		added++;
+	}
+	return added;
+}
+
+void aws_iot_shadow_reported_complete(ShadowReportedCache_t *pCache, Shadow_Ack_Status_t status) {
+	ShadowReportedField_t *pField;
+	uint8_t i;
+
+	if (NULL == pCache) {
+		return;
+	}
+	for (i = 0; i < pCache->count; i++) {
+		pField = &pCache->pFields[i];
+		if (!pField->isPending) {
+			continue;
+		}
+		pField->isPending = false;
+		if (SHADOW_ACK_ACCEPTED == status) {
+			pField->acceptedValue = pField->pendingValue;
+			pField->isAccepted = true;
+		} else {
+			// reported again as soon as the next update is made
+			countdown_ms(&pField->intervalTimer, 0);
+		}
+	}
+}
+
+static void takeVersion(ShadowReportedCache_t *pCache, const ShadowJsonView_t *pView) {
+	uint32_t version;
+
+	if (getShadowJsonVersion(pView, &version) && (!pCache->isVersionKnown || version > pCache->version)) {
+		pCache->version = version;
+		pCache->isVersionKnown = true;
+	}
+}
+
+// the fields the shadow already holds are accepted, the others are reported again by the next update,
+// returns the number of those
+static uint8_t mergeFetchedState(ShadowReportedCache_t *pCache, const ShadowJsonView_t *pView) {
+	ShadowReportedField_t *pField;
+	int32_t reported = findShadowJsonMember(pView, pView->state, SHADOW_REPORTED_STRING);
+	ShadowReportedValue_t value;
+	int32_t valueToken;
+	uint8_t unmerged = 0;
+	uint8_t i;
+
+	for (i = 0; i < pCache->count; i++) {
+		pField = &pCache->pFields[i];
+		if (!pField->isPending) {
+			continue;
+		}
+		pField->isPending = false;
+		valueToken = findShadowJsonMember(pView, reported, pField->pKey);
+		if (valueToken >= 0 && readFieldToken(pField, pView, valueToken, &value)
+				&& isSameValue(&value, &pField->pendingValue)) {
+			pField->acceptedValue = value;
+			pField->isAccepted = true;
+		} else {
+			pField->isAccepted = false;
+			unmerged++;
+		}
+	}
+	return unmerged;
+}
+
+static void finishUpdate(ShadowReportedCache_t *pCache, const char *pThingName, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument) {
+	fpActionCallback_t callback = pCache->callback;
+	void *pCallbackContext = pCache->pCallbackContext;
+
+	aws_iot_shadow_reported_complete(pCache, status);
+	pCache->conflictRetries = 0;
+	pCache->state = SHADOW_REPORTED_IDLE;
+	if (NULL != callback) {
+		callback(pThingName, SHADOW_UPDATE, status, pReceivedJsonDocument, pCallbackContext);
+	}
+}
+
+// called from the MQTT yield, the get after a conflict is left to the next update not to re-enter the client
+static void reportedUpdateCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	ShadowReportedCache_t *pCache = (ShadowReportedCache_t *)pContextData;
+	ShadowJsonView_t view;
+	uint32_t code;
+
+	if (SHADOW_ACK_TIMEOUT != status && parseShadowJson(pReceivedJsonDocument, &view)) {
+		if (SHADOW_ACK_ACCEPTED == status) {
+			takeVersion(pCache, &view);
+		} else if (pCache->isVersioned && getShadowJsonErrorCode(&view, &code) && SHADOW_VERSION_CONFLICT_CODE == code
+				&& pCache->conflictRetries < SHADOW_MAX_VERSION_CONFLICT_RETRIES) {
+			pCache->conflictRetries++;
+			pCache->state = SHADOW_REPORTED_CONFLICT;
+			return;
+		}
+	}
+	finishUpdate(pCache, pThingName, status, pReceivedJsonDocument);
+}
+
+static void reportedFetchCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	ShadowReportedCache_t *pCache = (ShadowReportedCache_t *)pContextData;
+	ShadowJsonView_t view;
+
+	if (SHADOW_ACK_ACCEPTED != status || !parseShadowJson(pReceivedJsonDocument, &view)) {
+		finishUpdate(pCache, pThingName, SHADOW_ACK_ACCEPTED == status ? SHADOW_ACK_REJECTED : status,
+				pReceivedJsonDocument);
+		return;
+	}
+	takeVersion(pCache, &view);
+	if (0 == mergeFetchedState(pCache, &view)) {
+		// the shadow holds every field of the update, nothing is left to send
+		finishUpdate(pCache, pThingName, SHADOW_ACK_ACCEPTED, pReceivedJsonDocument);
+		return;
+	}
+	pCache->state = SHADOW_REPORTED_IDLE;
+}
+
+IoT_Error_t aws_iot_shadow_reported_update(MQTTClient_t *pClient, const char *pThingName,
+		ShadowReportedCache_t *pCache, char *pBuffer, size_t size, fpActionCallback_t callback, void *pContextData,
+		uint8_t timeout_seconds) {
+	ShadowJsonBuilder_t builder;
+	IoT_Error_t ret_val;
+
+	if (NULL == pClient || NULL == pThingName || NULL == pCache || NULL == pBuffer) {
+		return NULL_VALUE_ERROR;
+	}
+	if (SHADOW_REPORTED_UPDATING == pCache->state || SHADOW_REPORTED_FETCHING == pCache->state) {
+		return WAIT_FOR_PUBLISH;
+	}
+	pCache->callback = callback;
+	pCache->pCallbackContext = pContextData;
+
+	if (SHADOW_REPORTED_CONFLICT == pCache->state) {
+		pCache->state = SHADOW_REPORTED_FETCHING;
+		ret_val = aws_iot_shadow_get(pClient, pThingName, reportedFetchCallback, pCache, timeout_seconds, false);
+		if (NONE_ERROR != ret_val) {
+			pCache->state = SHADOW_REPORTED_CONFLICT;	// tried again by the next call
+		}
+		return ret_val;
+	}
+
+	aws_iot_shadow_builder_init(&builder, pBuffer, size);
+	aws_iot_shadow_builder_begin_object(&builder, SHADOW_STATE_STRING);
+	aws_iot_shadow_builder_begin_object(&builder, SHADOW_REPORTED_STRING);
+	if (0 == aws_iot_shadow_reported_add_changes(pCache, &builder)) {
+		return builder.error;
+	}
+	aws_iot_shadow_builder_end(&builder);
+	aws_iot_shadow_builder_end(&builder);
+	if (pCache->isVersioned && pCache->isVersionKnown) {
+		aws_iot_shadow_builder_add_value(&builder, SHADOW_VERSION_STRING, SHADOW_JSON_UINT32, &pCache->version);
+	}
+	ret_val = aws_iot_shadow_builder_finalize(&builder);
+	if (NONE_ERROR == ret_val) {
+		pCache->state = SHADOW_REPORTED_UPDATING;
+		ret_val = aws_iot_shadow_update(pClient, pThingName, pBuffer, reportedUpdateCallback, pCache,
+				timeout_seconds, true);
+	}
+	if (NONE_ERROR != ret_val) {
+		DEBUG("Reported state update not sent %d", ret_val);
+		pCache->state = SHADOW_REPORTED_IDLE;
+		aws_iot_shadow_reported_complete(pCache, SHADOW_ACK_REJECTED);
+	}
+	return ret_val;
+}
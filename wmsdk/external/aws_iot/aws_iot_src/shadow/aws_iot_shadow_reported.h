@@ -0,0 +1,167 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_shadow_reported.h
+ * @brief Reports only the part of the state that changed.
+ *
+ * A reported state cache keeps, for every field of the reported state, the last value
+ * the shadow accepted. An update then carries only the fields whose value moved away
+ * from it by more than their deadband, and no more often than their minimum interval.
+ * Values are compared as numbers, strings and JSON text by their text. Text longer than
+ * #SHADOW_REPORTED_TEXT_LEN is compared by its length and a hash of it instead.
+ * A field sent in an update that is rejected or times out is sent again by the next one.
+ *
+ * With versioning enabled, updates carry the version of the shadow last seen by the
+ * cache so that an update based on a stale state is rejected with a 409 conflict rather
+ * than overwriting what another writer reported. On a conflict the next update gets the
+ * shadow, keeps the fields it had sent that the shadow already holds and sends the
+ * others again with the current version.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_REPORTED_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_REPORTED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "timer_interface.h"
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+
+/**
+ * @brief Value of a field as the cache compares it
+ */
+typedef struct {
+	double number;							///< The number, for strings and JSON text the hash of the text
+	uint32_t textLength;					///< Length of the text, 0 for a number
+	char text[SHADOW_REPORTED_TEXT_LEN];	///< The text, not NUL terminated, when it is no longer than the buffer
+} ShadowReportedValue_t;
+
+/**
+ * @brief Field of the reported state
+ *
+ * pKey, pData, type, deadband and minIntervalMs are set by the application, the other
+ * members are internal.
+ */
+typedef struct {
+	const char *pKey;			///< Key in the reported state
+	void *pData;				///< Current value, read by every update
+	JsonPrimitiveType type;		///< Type of the value pointed to by pData
+	double deadband;			///< Numbers closer than this to the value accepted are not reported, 0 reports any change
+	uint32_t minIntervalMs;		///< Time between two reports of the field, 0 for no limit
+	ShadowReportedValue_t acceptedValue;	///< Value accepted last
+	ShadowReportedValue_t pendingValue;		///< Value sent in the update waiting for a response
+	bool isAccepted;			///< False until a value was accepted
+	bool isPending;				///< Sent in the update waiting for a response
+	Timer intervalTimer;		///< Runs from the last report for minIntervalMs
+} ShadowReportedField_t;
+
+/**
+ * @brief Progress of the update of a reported state cache
+ */
+typedef enum {
+	SHADOW_REPORTED_IDLE,		///< No update waits for a response
+	SHADOW_REPORTED_UPDATING,	///< An update waits for its response
+	SHADOW_REPORTED_CONFLICT,	///< An update was rejected as a version conflict, the shadow is to be fetched
+	SHADOW_REPORTED_FETCHING	///< The get after a conflict waits for its response
+} ShadowReportedState_t;
+
+/**
+ * @brief Reported State Cache Type
+ *
+ * Set up by aws_iot_shadow_reported_init(), its members are internal.
+ */
+typedef struct {
+	ShadowReportedField_t *pFields;			///< Fields of the reported state, set aside by the application
+	uint8_t count;							///< Number of entries in pFields
+	volatile ShadowReportedState_t state;	///< Progress of the update
+	bool isVersioned;						///< Updates carry the version of the shadow
+	bool isVersionKnown;					///< False until a response carried the version
+	uint32_t version;						///< Version of the shadow in the last accepted update or get
+	uint8_t conflictRetries;				///< Version conflicts in a row
+	fpActionCallback_t callback;			///< Callback of the update in flight
+	void *pCallbackContext;					///< Passed back to callback
+} ShadowReportedCache_t;
+
+/**
+ * @brief Set up a reported state cache
+ *
+ * Nothing is taken as accepted yet, so the first update reports every field.
+ *
+ * @param pCache	Cache to set up
+ * @param pFields	Fields of the reported state, must stay valid while in use
+ * @param count		Number of entries in pFields
+ * @return An IoT Error Type, NULL_VALUE_ERROR if a field has no key or value
+ */
+IoT_Error_t aws_iot_shadow_reported_init(ShadowReportedCache_t *pCache, ShadowReportedField_t *pFields, uint8_t count);
+
+/**
+ * @brief Have the updates of a cache carry the version of the shadow
+ *
+ * Only aws_iot_shadow_reported_update() handles the version conflicts. An update is
+ * retried up to #SHADOW_MAX_VERSION_CONFLICT_RETRIES times before its fields are given
+ * up as rejected.
+ *
+ * @param pCache	Reported state cache
+ */
+void aws_iot_shadow_reported_enable_versioning(ShadowReportedCache_t *pCache);
+
+/**
+ * @brief Add the fields to report to a document
+ *
+ * Adds the fields that changed to the object opened last in pBuilder, usually
+ * "state":{"reported":{, and marks them as waiting for a response.
+ * aws_iot_shadow_reported_complete() has to be called with the response.
+ *
+ * @param pCache	Reported state cache
+ * @param pBuilder	Builder of the document
+ * @return Number of fields added
+ */
+uint8_t aws_iot_shadow_reported_add_changes(ShadowReportedCache_t *pCache, ShadowJsonBuilder_t *pBuilder);
+
+/**
+ * @brief Take the response to the fields added by aws_iot_shadow_reported_add_changes()
+ *
+ * @param pCache	Reported state cache
+ * @param status	SHADOW_ACK_ACCEPTED keeps the values sent as accepted, else they are sent again
+ */
+void aws_iot_shadow_reported_complete(ShadowReportedCache_t *pCache, Shadow_Ack_Status_t status);
+
+/**
+ * @brief Report the fields that changed
+ *
+ * Builds {"state":{"reported":{...}},"clientToken":...} in pBuffer out of the fields
+ * that changed and sends it with aws_iot_shadow_update(). Nothing is sent when no field
+ * changed, the callback is not called then. After a version conflict the call gets the
+ * shadow instead. The fields the shadow does not hold yet are sent again by the call after
+ * it, if it holds them all the update is accepted. The callback is called once the update
+ * is accepted, or given up.
+ *
+ * @param pClient			MQTT Client used as the protocol layer
+ * @param pThingName		Thing Name of the shadow to update
+ * @param pCache			Reported state cache
+ * @param pBuffer			Buffer for the document, must stay valid until the callback
+ * @param size				Size of pBuffer
+ * @param callback			Called with the response, or on timeout. Could be NULL
+ * @param pContextData		Passed back to the callback, could be NULL
+ * @param timeout_seconds	Time to wait for the response
+ * @return An IoT Error Type, WAIT_FOR_PUBLISH while the previous update or get waits for its response
+ */
+IoT_Error_t aws_iot_shadow_reported_update(MQTTClient_t *pClient, const char *pThingName,
+		ShadowReportedCache_t *pCache, char *pBuffer, size_t size, fpActionCallback_t callback, void *pContextData,
+		uint8_t timeout_seconds);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_REPORTED_H_ */
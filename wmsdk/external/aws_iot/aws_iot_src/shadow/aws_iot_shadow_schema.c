@@ -0,0 +1,119 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <string.h>
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_schema.h"
+
+#define SHADOW_SCHEMA_PARSER(kind, parse) \
+	IoT_Error_t shadowSchemaParse##kind(void *pValue, const char *pJsonString, jsmntok_t *pToken) { \
+		return parse((SHADOW_SCHEMA_CTYPE_##kind *)pValue, pJsonString, pToken); \
+	}
+
+SHADOW_SCHEMA_PARSER(BOOL, parseBooleanValue)
+SHADOW_SCHEMA_PARSER(INT32, parseInteger32Value)
+SHADOW_SCHEMA_PARSER(INT16, parseInteger16Value)
+SHADOW_SCHEMA_PARSER(INT8, parseInteger8Value)
+SHADOW_SCHEMA_PARSER(UINT32, parseUnsignedInteger32Value)
+SHADOW_SCHEMA_PARSER(UINT16, parseUnsignedInteger16Value)
+SHADOW_SCHEMA_PARSER(UINT8, parseUnsignedInteger8Value)
+SHADOW_SCHEMA_PARSER(FLOAT, parseFloatValue)
+SHADOW_SCHEMA_PARSER(DOUBLE, parseDoubleValue)
+
+#define SHADOW_SCHEMA_WRITER(kind, add) \
+	IoT_Error_t shadowSchemaWrite##kind(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue) { \
+		return add(pBuilder, pKey, *(const SHADOW_SCHEMA_CTYPE_##kind *)pValue); \
+	}
+
+SHADOW_SCHEMA_WRITER(BOOL, aws_iot_shadow_builder_add_bool)
+SHADOW_SCHEMA_WRITER(INT32, aws_iot_shadow_builder_add_int32)
+SHADOW_SCHEMA_WRITER(INT16, aws_iot_shadow_builder_add_int32)
+SHADOW_SCHEMA_WRITER(INT8, aws_iot_shadow_builder_add_int32)
+SHADOW_SCHEMA_WRITER(UINT32, aws_iot_shadow_builder_add_uint32)
+SHADOW_SCHEMA_WRITER(UINT16, aws_iot_shadow_builder_add_uint32)
+SHADOW_SCHEMA_WRITER(UINT8, aws_iot_shadow_builder_add_uint32)
+SHADOW_SCHEMA_WRITER(FLOAT, aws_iot_shadow_builder_add_double)
+SHADOW_SCHEMA_WRITER(DOUBLE, aws_iot_shadow_builder_add_double)
+
+// strcmp() of a key of the schema with a key of the document, which is not NULL terminated
+static int compareKey(const char *pSchemaKey, const char *pKey, size_t length) {
+	int order = strncmp(pSchemaKey, pKey, length);
+
+	if (order != 0) {
+		return order;
+	}
+	return (unsigned char)pSchemaKey[length];
+}
+
+int32_t findShadowSchemaField(const ShadowSchema_t *pSchema, const char *pKey, size_t length) {
+	int32_t low = 0;
+	int32_t high = (int32_t)pSchema->count - 1;
+	int32_t middle;
+	int order;
+
+	while (low <= high) {
+		middle = (low + high) / 2;
+		order = compareKey(pSchema->pFields[middle].pKey, pKey, length);
+		if (order == 0) {
+			return middle;
+		}
+		if (order < 0) {
+			low = middle + 1;
+		} else {
+			high = middle - 1;
+		}
+	}
+	return -1;
+}
+
+IoT_Error_t aws_iot_shadow_schema_check(const ShadowSchema_t *pSchema) {
+	uint8_t i;
+
+	if (NULL == pSchema || NULL == pSchema->pFields) {
+		return NULL_VALUE_ERROR;
+	}
+	if (pSchema->count > SHADOW_SCHEMA_MAX_FIELDS) {
+		return GENERIC_ERROR;
+	}
+	for (i = 1; i < pSchema->count; i++) {
+		if (strcmp(pSchema->pFields[i - 1].pKey, pSchema->pFields[i].pKey) >= 0) {
+			return GENERIC_ERROR;
+		}
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_schema_add(ShadowJsonBuilder_t *pBuilder, const ShadowSchema_t *pSchema,
+		const void *pState, uint32_t fields) {
+	const ShadowSchemaField_t *pField;
+	uint8_t i;
+
+	if (NULL == pBuilder) {
+		return NULL_VALUE_ERROR;
+	}
+	if (NULL == pSchema || NULL == pState) {
+		if (NONE_ERROR == pBuilder->error) {
+			pBuilder->error = NULL_VALUE_ERROR;
+		}
+		return pBuilder->error;
+	}
+	for (i = 0; i < pSchema->count; i++) {
+		if (fields & ((uint32_t)1 << i)) {
+			pField = &pSchema->pFields[i];
+			pField->write(pBuilder, pField->pKey, (const uint8_t *)pState + pField->offset);
+		}
+	}
+	return pBuilder->error;
+}
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_shadow_schema.h
+ * @brief Shadow state described once, bound to a C struct at build time.
+ *
+ * A schema lists the keys of the state with their type and the struct member they
+ * go to, as an X-macro:
+ *
+ * @code
+ * #define LIGHT_SCHEMA(X, type) \
+ *     X(type, UINT8, brightness, "brightness") \
+ *     X(type, BOOL, on, "on")
+ *
+ * SHADOW_SCHEMA_STRUCT(LightState_t, LIGHT_SCHEMA);	// in a header
+ * SHADOW_SCHEMA_DEFINE(lightSchema, LightState_t, LIGHT_SCHEMA);	// in one source file
+ * @endcode
+ *
+ * The struct, the key table and the parser and writer of every key are produced by the
+ * compiler and the table lives in flash. A delta is matched against the table by a binary
+ * search and every value goes straight to the parser of its type, with no jsonStruct_t
+ * registered per key. The keys have to be listed in strcmp() order, which
+ * aws_iot_shadow_register_delta_schema() checks. Keys are those of the top level of
+ * the state, of any type but SHADOW_JSON_STRING and SHADOW_JSON_OBJECT, at most 32
+ * of them.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_SCHEMA_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_SCHEMA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "aws_iot_json_utils.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_json_data.h"
+
+/**
+ * @brief Parser of the value of a key, into its struct member
+ */
+typedef IoT_Error_t (*fpShadowSchemaParse_t)(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+
+/**
+ * @brief Writer of a struct member, as the value of a key, into a document
+ */
+typedef IoT_Error_t (*fpShadowSchemaWrite_t)(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+
+/**
+ * @brief Key of a schema
+ */
+typedef struct {
+	const char *pKey;				///< Key in the state
+	uint16_t offset;				///< Offset of the member in the struct
+	JsonPrimitiveType type;			///< Type of the member
+	fpShadowSchemaParse_t parse;	///< Parser of the type
+	fpShadowSchemaWrite_t write;	///< Writer of the type
+} ShadowSchemaField_t;
+
+/**
+ * @brief Shadow Schema Type
+ *
+ * Defined by SHADOW_SCHEMA_DEFINE().
+ */
+typedef struct {
+	const ShadowSchemaField_t *pFields;	///< Keys, in strcmp() order
+	uint8_t count;						///< Number of entries in pFields
+} ShadowSchema_t;
+
+/**
+ * @brief Callback Type of a schema registered on the delta
+ *
+ * Called from the context of the MQTT yield once the values of a delta are in the struct.
+ *
+ * @param pState		The struct of the schema
+ * @param changedFields	Bit n is set if the key n of the schema was in the delta
+ * @param pContextData	The data given when the schema was registered
+ */
+typedef void (*fpShadowSchemaDeltaCallback_t)(void *pState, uint32_t changedFields, void *pContextData);
+
+#define SHADOW_SCHEMA_ALL_FIELDS 0xFFFFFFFFu	///< Every key of a schema, see aws_iot_shadow_schema_add()
+#define SHADOW_SCHEMA_MAX_FIELDS 32			///< Keys a schema can hold
+
+#define SHADOW_SCHEMA_CTYPE_BOOL bool
+#define SHADOW_SCHEMA_CTYPE_INT32 int32_t
+#define SHADOW_SCHEMA_CTYPE_INT16 int16_t
+#define SHADOW_SCHEMA_CTYPE_INT8 int8_t
+#define SHADOW_SCHEMA_CTYPE_UINT32 uint32_t
+#define SHADOW_SCHEMA_CTYPE_UINT16 uint16_t
+#define SHADOW_SCHEMA_CTYPE_UINT8 uint8_t
+#define SHADOW_SCHEMA_CTYPE_FLOAT float
+#define SHADOW_SCHEMA_CTYPE_DOUBLE double
+
+IoT_Error_t shadowSchemaParseBOOL(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseINT32(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseINT16(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseINT8(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseUINT32(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseUINT16(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseUINT8(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseFLOAT(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+IoT_Error_t shadowSchemaParseDOUBLE(void *pValue, const char *pJsonString, jsmntok_t *pToken);
+
+IoT_Error_t shadowSchemaWriteBOOL(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteINT32(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteINT16(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteINT8(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteUINT32(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteUINT16(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteUINT8(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteFLOAT(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+IoT_Error_t shadowSchemaWriteDOUBLE(ShadowJsonBuilder_t *pBuilder, const char *pKey, const void *pValue);
+
+#define SHADOW_SCHEMA_MEMBER(type, kind, member, key) SHADOW_SCHEMA_CTYPE_##kind member;
+#define SHADOW_SCHEMA_FIELD(type, kind, member, key) \
+	{ key, offsetof(type, member), SHADOW_JSON_##kind, shadowSchemaParse##kind, shadowSchemaWrite##kind },
+
+/**
+ * @brief Declare the struct of a schema
+ *
+ * @param type	Name of the struct type
+ * @param LIST	X-macro listing the keys, as X(type, kind, member, key)
+ */
+#define SHADOW_SCHEMA_STRUCT(type, LIST) typedef struct { LIST(SHADOW_SCHEMA_MEMBER, type) } type
+
+/**
+ * @brief Define a schema, in one source file
+ *
+ * @param name	Name of the ShadowSchema_t
+ * @param type	Struct of the schema, declared by SHADOW_SCHEMA_STRUCT()
+ * @param LIST	X-macro listing the keys, as X(type, kind, member, key)
+ */
+#define SHADOW_SCHEMA_DEFINE(name, type, LIST) \
+	static const ShadowSchemaField_t name##Fields[] = { LIST(SHADOW_SCHEMA_FIELD, type) }; \
+	typedef char name##FieldCountCheck[sizeof(name##Fields) / sizeof(name##Fields[0]) <= SHADOW_SCHEMA_MAX_FIELDS ? 1 : -1]; \
+	const ShadowSchema_t name = { name##Fields, sizeof(name##Fields) / sizeof(name##Fields[0]) }
+
+/**
+ * @brief Check the keys of a schema are in strcmp() order and unique
+ *
+ * @param pSchema	Schema to check
+ * @return NONE_ERROR if the schema can be used, GENERIC_ERROR otherwise
+ */
+IoT_Error_t aws_iot_shadow_schema_check(const ShadowSchema_t *pSchema);
+
+/**
+ * @brief Add the values of a schema to a document
+ *
+ * @param pBuilder	Builder of the document, see aws_iot_shadow_builder_init()
+ * @param pSchema	Schema of the struct
+ * @param pState	The struct of the schema
+ * @param fields	Bit n set adds the key n, #SHADOW_SCHEMA_ALL_FIELDS adds them all
+ * @return The error of the builder
+ */
+IoT_Error_t aws_iot_shadow_schema_add(ShadowJsonBuilder_t *pBuilder, const ShadowSchema_t *pSchema,
+		const void *pState, uint32_t fields);
+
+/**
+ * @brief Have the deltas of the shadow update the struct of a schema
+ *
+ * Works along with aws_iot_shadow_register_delta(), a key could be registered both
+ * ways. One schema can be registered at a time, registering another one replaces it.
+ *
+ * @param pClient		MQTT Client used as the protocol layer
+ * @param pSchema		Schema of the state, must stay valid while in use
+ * @param pState		The struct of the schema the deltas go to, must stay valid while in use
+ * @param callback		Called once the values of a delta are in pState, could be NULL
+ * @param pContextData	Passed back to the callback, could be NULL
+ * @return An IoT Error Type, GENERIC_ERROR if the keys of the schema are not in order
+ */
+IoT_Error_t aws_iot_shadow_register_delta_schema(MQTTClient_t *pClient, const ShadowSchema_t *pSchema,
+		void *pState, fpShadowSchemaDeltaCallback_t callback, void *pContextData);
+
+// used by the shadow records
+int32_t findShadowSchemaField(const ShadowSchema_t *pSchema, const char *pKey, size_t length);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_SCHEMA_H_ */
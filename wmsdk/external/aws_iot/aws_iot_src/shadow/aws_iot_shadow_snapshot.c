@@ -0,0 +1,194 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <string.h>
+#include "aws_iot_log.h"
+#include "aws_iot_shadow_json.h"
+#include "aws_iot_shadow_records.h"
+#include "aws_iot_shadow_snapshot.h"
+#include "timer_interface.h"
+
+static const ShadowSnapshotStore_t *pSnapshotStore = NULL;
+static ShadowSnapshot_t snapshot;
+static bool isSnapshotChanged = false;
+static Timer saveTimer;
+
+void aws_iot_shadow_set_snapshot_store(const ShadowSnapshotStore_t *pStore) {
+	pSnapshotStore = pStore;
+	snapshot.version = 0;
+	snapshot.length = 0;
+	isSnapshotChanged = false;
+	countdown_ms(&saveTimer, 0);
+}
+
+// a record is the key, the type byte and the value, the key and the value NULL terminated
+static uint16_t recordValueOffset(uint16_t offset) {
+	return offset + strlen(snapshot.values + offset) + 2;
+}
+
+static uint16_t nextRecordOffset(uint16_t offset) {
+	uint16_t value = recordValueOffset(offset);
+
+	return value + strlen(snapshot.values + value) + 1;
+}
+
+static int32_t findRecord(const char *pKey) {
+	uint16_t offset = 0;
+
+	while (offset < snapshot.length) {
+		if (strcmp(snapshot.values + offset, pKey) == 0) {
+			return offset;
+		}
+		offset = nextRecordOffset(offset);
+	}
+	return -1;
+}
+
+// a snapshot written by a build with other sizes, or torn, is not used
+static bool isSnapshotValid(void) {
+	uint16_t offset = 0;
+
+	if (snapshot.length > AWS_IOT_SHADOW_SNAPSHOT_LEN) {
+		return false;
+	}
+	while (offset < snapshot.length) {
+		offset += strnlen(snapshot.values + offset, snapshot.length - offset) + 2;	// key and type byte
+		if (offset >= snapshot.length) {
+			return false;
+		}
+		offset += strnlen(snapshot.values + offset, snapshot.length - offset);
+		if (offset >= snapshot.length) {
+			return false;
+		}
+		offset++;
+	}
+	return true;
+}
+
+bool isShadowSnapshotSet(void) {
+	return pSnapshotStore != NULL;
+}
+
+bool loadShadowSnapshot(uint32_t *pVersion) {
+	if (pSnapshotStore == NULL) {
+		return false;
+	}
+	snapshot.length = 0;
+	isSnapshotChanged = false;
+	if (pSnapshotStore->load == NULL || pSnapshotStore->load(pSnapshotStore, &snapshot) != NONE_ERROR
+			|| snapshot.length == 0 || !isSnapshotValid()) {
+		snapshot.version = 0;
+		snapshot.length = 0;
+		return false;
+	}
+	*pVersion = snapshot.version;
+	return true;
+}
+
+void rememberShadowSnapshotValue(const char *pKey, uint8_t type, const char *pValue, uint16_t length) {
+	int32_t offset;
+	uint16_t next;
+	uint16_t value;
+	size_t keyLength;
+
+	if (pSnapshotStore == NULL) {
+		return;
+	}
+
+	offset = findRecord(pKey);
+	if (offset >= 0) {
+		value = recordValueOffset(offset);
+		if ((uint8_t)snapshot.values[value - 1] == type && strlen(snapshot.values + value) == length
+				&& memcmp(snapshot.values + value, pValue, length) == 0) {
+			return;
+		}
+		// the record goes to the end, with its new value
+		next = nextRecordOffset(offset);
+		memmove(snapshot.values + offset, snapshot.values + next, snapshot.length - next);
+		snapshot.length -= next - offset;
+	}
+	isSnapshotChanged = true;
+
+	keyLength = strlen(pKey);
+	if (snapshot.length + keyLength + length + 3 > AWS_IOT_SHADOW_SNAPSHOT_LEN) {
+		WARN("No room to keep %s in the shadow snapshot", pKey);
+		return;
+	}
+	memcpy(snapshot.values + snapshot.length, pKey, keyLength + 1);
+	snapshot.length += keyLength + 1;
+	snapshot.values[snapshot.length++] = (char)type;
+	memcpy(snapshot.values + snapshot.length, pValue, length);
+	snapshot.length += length;
+	snapshot.values[snapshot.length++] = '\0';
+}
+
+void setShadowSnapshotVersion(uint32_t version) {
+	if (pSnapshotStore != NULL) {
+		snapshot.version = version;
+	}
+}
+
+void saveShadowSnapshot(void) {
+	ShadowSnapshot_t copy;
+
+	if (pSnapshotStore == NULL || pSnapshotStore->save == NULL || !isSnapshotChanged || !expired(&saveTimer)) {
+		return;
+	}
+	// the handlers keep changing the snapshot while the copy is written
+	lockShadowRecords();
+	copy = snapshot;
+	isSnapshotChanged = false;
+	unlockShadowRecords();
+
+	countdown_ms(&saveTimer, AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS);
+	if (pSnapshotStore->save(pSnapshotStore, &copy) != NONE_ERROR) {
+		// tried again once the interval is over
+		WARN("Shadow snapshot not saved");
+		lockShadowRecords();
+		isSnapshotChanged = true;
+		unlockShadowRecords();
+	}
+}
+
+IoT_Error_t aws_iot_shadow_snapshot_apply(jsonStruct_t *pStruct) {
+	ShadowJsonView_t view;
+	jsmntok_t token;
+	int32_t offset;
+	uint16_t value;
+
+	if (pStruct == NULL || pStruct->pKey == NULL) {
+		return NULL_VALUE_ERROR;
+	}
+	offset = findRecord(pStruct->pKey);
+	if (offset < 0) {
+		return GENERIC_ERROR;
+	}
+
+	value = recordValueOffset(offset);
+	memset(&token, 0, sizeof(token));
+	token.type = (jsmntype_t)(uint8_t)snapshot.values[value - 1];
+	token.start = value;
+	token.end = value + strlen(snapshot.values + value);
+	token.parent = -1;
+	view.pJsonDocument = snapshot.values;
+	view.pTokens = &token;
+	view.tokenCount = 1;
+
+	updateJsonStructFromToken(&view, 0, pStruct);
+	if (pStruct->cb != NULL) {
+		pStruct->cb(snapshot.values + token.start, token.end - token.start, pStruct);
+	}
+	return NONE_ERROR;
+}
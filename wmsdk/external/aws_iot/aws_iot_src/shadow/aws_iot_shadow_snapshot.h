@@ -0,0 +1,114 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_shadow_snapshot.h
+ * @brief Keeps the last shadow state received across a restart.
+ *
+ * Once a snapshot store is set, the value of every key registered with
+ * aws_iot_shadow_register_delta() that a delta brings is copied into a snapshot,
+ * along with the version of the shadow. A snapshot whose values changed is saved by
+ * aws_iot_shadow_yield() or aws_iot_shadow_context_yield(), outside of the message
+ * handlers, and at most once every #AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS.
+ * aws_iot_shadow_init() reads it back: the version is taken as the last one
+ * received, and aws_iot_shadow_snapshot_apply() hands the saved values to their keys
+ * before the device is even connected. Once connected, a get of the shadow reconciles
+ * the device with the desired state: the values of the desired state of a get/accepted
+ * are passed to the registered keys as a delta would be.
+ * Values are kept as the JSON text received, at most #AWS_IOT_SHADOW_SNAPSHOT_LEN bytes
+ * of keys and values in all.
+ */
+
+#ifndef SRC_SHADOW_AWS_IOT_SHADOW_SNAPSHOT_H_
+#define SRC_SHADOW_AWS_IOT_SHADOW_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <mdev.h>
+
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_config.h"
+
+/**
+ * @brief Shadow Snapshot Type
+ *
+ * The values are NULL terminated records of a key, a JSON type byte and the JSON text
+ * of the value, one after the other.
+ */
+typedef struct {
+	uint32_t version;							///< Version of the shadow when the snapshot was taken
+	uint16_t length;							///< Number of bytes used in values
+	char values[AWS_IOT_SHADOW_SNAPSHOT_LEN];	///< Records of the values
+} ShadowSnapshot_t;
+
+typedef struct ShadowSnapshotStore ShadowSnapshotStore_t;
+
+/**
+ * @brief Shadow Snapshot Store Backend Type
+ *
+ * Keeps the snapshot outside of RAM, such as in flash or, for a host build, in a file.
+ */
+struct ShadowSnapshotStore {
+	IoT_Error_t (*load)(const ShadowSnapshotStore_t *pStore, ShadowSnapshot_t *pSnapshot);	///< Read the snapshot back, an empty store is reported with length 0
+	IoT_Error_t (*save)(const ShadowSnapshotStore_t *pStore, const ShadowSnapshot_t *pSnapshot);	///< Write the snapshot
+	void *pContext;		///< Backend specific
+};
+
+/**
+ * @brief Set the snapshot store of the shadow
+ *
+ * Call it before aws_iot_shadow_init(), which reads the snapshot back. The store must
+ * stay valid while in use.
+ *
+ * @param pStore	Snapshot store to use, NULL stops keeping a snapshot
+ */
+void aws_iot_shadow_set_snapshot_store(const ShadowSnapshotStore_t *pStore);
+
+/**
+ * @brief Apply the value the snapshot holds for a key
+ *
+ * Updates the data of pStruct from the value saved for its key and calls its callback,
+ * as a delta would. Needs no connection.
+ *
+ * @param pStruct	The key and the data to update, as given to aws_iot_shadow_register_delta()
+ * @return NONE_ERROR if a value was applied, GENERIC_ERROR if the snapshot has none for the key
+ */
+IoT_Error_t aws_iot_shadow_snapshot_apply(jsonStruct_t *pStruct);
+
+/**
+ * @brief Set up a snapshot store backed by flash
+ *
+ * The snapshot takes one sector, reserved for it. It is written to the freshly erased
+ * sector, only when a value changed and no more often than
+ * #AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS.
+ *
+ * @param pStore		Snapshot store to set up
+ * @param pDev			Flash device, as returned by flash_drv_open()
+ * @param start			Flash address of the sector, sector aligned
+ * @param sectorSize	Erase size of the flash, at least sizeof(ShadowSnapshot_t) plus a small header
+ * @return An IoT Error Type defining successful/failed setup of the store
+ */
+IoT_Error_t aws_iot_shadow_snapshot_flash_init(ShadowSnapshotStore_t *pStore, mdev_t *pDev, uint32_t start,
+		uint32_t sectorSize);
+
+// used by the shadow records
+bool isShadowSnapshotSet(void);
+bool loadShadowSnapshot(uint32_t *pVersion);
+void rememberShadowSnapshotValue(const char *pKey, uint8_t type, const char *pValue, uint16_t length);
+void setShadowSnapshotVersion(uint32_t version);
+// saves the values changed once the interval since the last save is over, not to be called from a message handler
+void saveShadowSnapshot(void);
+
+#endif /* SRC_SHADOW_AWS_IOT_SHADOW_SNAPSHOT_H_ */
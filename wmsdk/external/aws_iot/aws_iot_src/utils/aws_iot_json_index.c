@@ -0,0 +1,127 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "aws_iot_json_index.h"
+
+#define KEY_INDEX_FREE (-1)
+
+// FNV-1a
+static uint32_t hashKey(const char *pKey, size_t length) {
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)pKey[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static bool isKeyEqual(const char *pJson, const jsmntok_t *pToken, const char *pKey, size_t length) {
+	return (size_t)(pToken->end - pToken->start) == length && memcmp(pJson + pToken->start, pKey, length) == 0;
+}
+
+/*
+ * Walked from the last token back, the next sibling of every token after i is known
+ * when i is reached. The children of a container are then found by jumping from one
+ * to the next, each token is stepped on once by its parent.
+ */
+void aws_iot_json_index_siblings(const jsmntok_t *pTokens, int32_t tokenCount, int16_t *pNext) {
+	int32_t i;
+	int32_t j;
+
+	for (i = tokenCount - 1; i >= 0; i--) {
+		if (pTokens[i].type == JSMN_OBJECT || pTokens[i].type == JSMN_ARRAY) {
+			j = i + 1;
+			while (j < tokenCount && pTokens[j].start < pTokens[i].end) {
+				j = pNext[j];
+			}
+			pNext[i] = j;
+		} else if (pTokens[i].type == JSMN_STRING && pTokens[i].size > 0 && i + 1 < tokenCount) {
+			// a key, its value is nested in it
+			pNext[i] = pNext[i + 1];
+		} else {
+			pNext[i] = i + 1;
+		}
+	}
+}
+
+int32_t aws_iot_json_find_key(const char *pJson, const jsmntok_t *pTokens, const int16_t *pNext, int32_t object,
+		const char *pKey) {
+	size_t length = strlen(pKey);
+	int32_t i;
+
+	if (object < 0 || pTokens[object].type != JSMN_OBJECT) {
+		return -1;
+	}
+	for (i = object + 1; i < pNext[object]; i = pNext[i]) {
+		if (isKeyEqual(pJson, &pTokens[i], pKey, length)) {
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+IoT_Error_t aws_iot_json_index_keys(JsonKeyIndex_t *pIndex, const char *pJson, const jsmntok_t *pTokens,
+		const int16_t *pNext, int32_t object, int16_t *pSlots, uint16_t slotCount) {
+	uint32_t keyCount = 0;
+	uint32_t slot;
+	int32_t i;
+
+	if (NULL == pIndex || NULL == pJson || NULL == pTokens || NULL == pNext || NULL == pSlots) {
+		return NULL_VALUE_ERROR;
+	}
+	if (object < 0 || pTokens[object].type != JSMN_OBJECT || slotCount == 0 || (slotCount & (slotCount - 1)) != 0) {
+		return GENERIC_ERROR;
+	}
+	// the size of a token stops at 255, the keys are counted instead
+	for (i = object + 1; i < pNext[object]; i = pNext[i]) {
+		keyCount++;
+	}
+	if (keyCount * 2 > slotCount) {
+		return GENERIC_ERROR;
+	}
+
+	pIndex->pJson = pJson;
+	pIndex->pTokens = pTokens;
+	pIndex->pSlots = pSlots;
+	pIndex->slotMask = slotCount - 1;
+	memset(pSlots, 0xFF, slotCount * sizeof(pSlots[0]));
+
+	// a repeated key probes past the first one, which is the one found
+	for (i = object + 1; i < pNext[object]; i = pNext[i]) {
+		slot = hashKey(pJson + pTokens[i].start, pTokens[i].end - pTokens[i].start) & pIndex->slotMask;
+		while (pSlots[slot] != KEY_INDEX_FREE) {
+			slot = (slot + 1) & pIndex->slotMask;
+		}
+		pSlots[slot] = i;
+	}
+	return NONE_ERROR;
+}
+
+int32_t aws_iot_json_index_find(const JsonKeyIndex_t *pIndex, const char *pKey) {
+	size_t length = strlen(pKey);
+	uint32_t slot = hashKey(pKey, length) & pIndex->slotMask;
+	int16_t key;
+
+	while ((key = pIndex->pSlots[slot]) != KEY_INDEX_FREE) {
+		if (isKeyEqual(pIndex->pJson, &pIndex->pTokens[key], pKey, length)) {
+			return key + 1;
+		}
+		slot = (slot + 1) & pIndex->slotMask;
+	}
+	return -1;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_json_index.h
+ * @brief Constant time sibling skips and key lookups over parsed JSON tokens.
+ *
+ * The tokens of jsmn_parse(), aws_iot_json_tokenize() or json_init() (the jsontok_t
+ * of jsonv2.h is the same type) only say where a value starts and ends. Finding a key
+ * walks every token of the object, nested ones included, and looking up K keys walks
+ * it K times. The tokens of the prebuilt parsers cannot hold more, so the index lives
+ * in arrays given by the caller:
+ *
+ * - the next sibling of every token, filled in one pass after the parse, turns
+ *   skipping a value of any size into a single step;
+ * - the key index of an object, built when it is first needed, hashes its keys so
+ *   that each lookup is a probe or two.
+ *
+ * @code
+ * int16_t next[NUM_TOKENS];
+ * int16_t slots[64];	// a power of two, at least twice the keys of the object
+ * JsonKeyIndex_t keys;
+ *
+ * aws_iot_json_index_siblings(tokens, count, next);
+ * aws_iot_json_index_keys(&keys, json, tokens, next, 0, slots, 64);
+ * value = aws_iot_json_index_find(&keys, "interval");
+ * parseInteger32Value(&interval, json, &tokens[value]);
+ * @endcode
+ */
+
+#ifndef AWS_IOT_SDK_SRC_JSON_INDEX_H_
+#define AWS_IOT_SDK_SRC_JSON_INDEX_H_
+
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+#include "jsmn.h"
+
+/**
+ * @brief Key index of an object
+ *
+ * Filled by aws_iot_json_index_keys(), the members are private to the index.
+ */
+typedef struct {
+	const char *pJson;			///< Document the tokens point into
+	const jsmntok_t *pTokens;	///< Tokens of the document
+	int16_t *pSlots;			///< Key tokens placed by the hash of the key, -1 if free
+	uint16_t slotMask;			///< Number of slots minus one
+} JsonKeyIndex_t;
+
+/**
+ * @brief Find the next sibling of every token
+ *
+ * pNext[i] is the index of the first token after token i and everything nested in it.
+ * The value of a key is nested in the key, so the next sibling of a key is the next key.
+ *
+ * @param pTokens		Tokens of a parsed document
+ * @param tokenCount	Number of tokens returned by the parser
+ * @param pNext			Filled with tokenCount entries
+ */
+void aws_iot_json_index_siblings(const jsmntok_t *pTokens, int32_t tokenCount, int16_t *pNext);
+
+/**
+ * @brief Find a key of an object without a key index
+ *
+ * Steps from key to key with the next siblings, for objects looked up once or twice.
+ *
+ * @param pJson		Document the tokens point into
+ * @param pTokens	Tokens of the document
+ * @param pNext		Next siblings from aws_iot_json_index_siblings()
+ * @param object	Token of the object
+ * @param pKey		Key to find
+ * @return The token of the value of the first pKey in the object, -1 if there is none
+ */
+int32_t aws_iot_json_find_key(const char *pJson, const jsmntok_t *pTokens, const int16_t *pNext, int32_t object,
+		const char *pKey);
+
+/**
+ * @brief Build the key index of an object
+ *
+ * @param pIndex	Index to build
+ * @param pJson		Document the tokens point into
+ * @param pTokens	Tokens of the document
+ * @param pNext		Next siblings from aws_iot_json_index_siblings()
+ * @param object	Token of the object
+ * @param pSlots	Slots of the index, must stay valid while the index is in use
+ * @param slotCount	Entries in pSlots, a power of two at least twice the number of keys
+ * @return NONE_ERROR, GENERIC_ERROR if the token is not an object or there are not enough slots
+ */
+IoT_Error_t aws_iot_json_index_keys(JsonKeyIndex_t *pIndex, const char *pJson, const jsmntok_t *pTokens,
+		const int16_t *pNext, int32_t object, int16_t *pSlots, uint16_t slotCount);
+
+/**
+ * @brief Find a key in a key index
+ *
+ * @param pIndex	Index built by aws_iot_json_index_keys()
+ * @param pKey		Key to find
+ * @return The token of the value of the first pKey in the object, -1 if there is none
+ */
+int32_t aws_iot_json_index_find(const JsonKeyIndex_t *pIndex, const char *pKey);
+
+#endif /* AWS_IOT_SDK_SRC_JSON_INDEX_H_ */
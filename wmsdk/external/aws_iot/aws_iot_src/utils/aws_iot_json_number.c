@@ -0,0 +1,519 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aws_iot_json_number.h"
+
+#define SIGNIFICANT_DIGITS_MAX 19			// any 19 digits fit in 64 bits
+#define EXPONENT_MAX 100000					// past any double, the exponent stops growing there
+#define EXACT_INTEGER_MAX (1ull << 53)		// every integer up to here is a double
+#define EXACT_POWER_OF_10_MAX 22			// every power of 10 up to here is a double
+#define FALLBACK_TEXT_MAX 128				// the copy given to strtod() or strtof(), NULL included
+#define FALLBACK_DIGITS_MAX 100				// significant digits kept of a number longer than that
+
+static const char digitPairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+static const uint32_t powersOf10[AWS_IOT_JSON_MAX_DECIMALS + 1] = {
+	1u, 10u, 100u, 1000u, 10000u, 100000u, 1000000u, 10000000u, 100000000u, 1000000000u
+};
+
+// the digits are written backwards, ending at pEnd. Each returns where they start
+
+static char *writeDigits(char *pEnd, uint32_t value) {
+	while (value >= 100) {
+		pEnd -= 2;
+		memcpy(pEnd, &digitPairs[(value % 100) * 2], 2);
+		value /= 100;
+	}
+	if (value >= 10) {
+		pEnd -= 2;
+		memcpy(pEnd, &digitPairs[value * 2], 2);
+	} else {
+		*--pEnd = (char)('0' + value);
+	}
+	return pEnd;
+}
+
+// exactly count digits, with leading zeros
+static char *writeFixedDigits(char *pEnd, uint32_t value, uint8_t count) {
+	for (; count >= 2; count -= 2) {
+		pEnd -= 2;
+		memcpy(pEnd, &digitPairs[(value % 100) * 2], 2);
+		value /= 100;
+	}
+	if (count > 0) {
+		*--pEnd = (char)('0' + value);
+	}
+	return pEnd;
+}
+
+static char *writeDigits64(char *pEnd, uint64_t value) {
+	// a 64 bit division is a library call on a 32 bit core, take nine digits at a time
+	while (value > UINT32_MAX) {
+		pEnd = writeFixedDigits(pEnd, (uint32_t)(value % 1000000000u), 9);
+		value /= 1000000000u;
+	}
+	return writeDigits(pEnd, (uint32_t)value);
+}
+
+static size_t copyOut(char *pBuffer, const char *pStart, const char *pEnd) {
+	size_t length = pEnd - pStart;
+
+	memcpy(pBuffer, pStart, length);
+	pBuffer[length] = '\0';
+	return length;
+}
+
+size_t aws_iot_json_format_int32(char *pBuffer, int32_t value) {
+	char text[AWS_IOT_JSON_NUMBER_MAX_LEN];
+	char *pEnd = text + sizeof(text);
+	char *pStart;
+
+	if (value < 0) {
+		pStart = writeDigits(pEnd, 0u - (uint32_t)value);
+		*--pStart = '-';
+	} else {
+		pStart = writeDigits(pEnd, (uint32_t)value);
+	}
+	return copyOut(pBuffer, pStart, pEnd);
+}
+
+size_t aws_iot_json_format_uint32(char *pBuffer, uint32_t value) {
+	char text[AWS_IOT_JSON_NUMBER_MAX_LEN];
+	char *pEnd = text + sizeof(text);
+
+	return copyOut(pBuffer, writeDigits(pEnd, value), pEnd);
+}
+
+/*
+ * fraction * 10^decimals rounded to the nearest integer, to even on a tie. The fraction
+ * of a double is mantissa / 2^shift exactly, so the product is taken on integers: the
+ * mantissa has 53 bits and 10^9 has 30, which fits in two 64 bit halves. The result is
+ * 10^decimals when it rounds up to the next integer.
+ */
+static uint32_t scaleFraction(double fraction, uint8_t decimals, bool isIntegerOdd) {
+	uint32_t scale = powersOf10[decimals];
+	uint64_t mantissa;
+	uint64_t high;
+	uint64_t low;
+	uint64_t part;
+	uint64_t remainderHigh;
+	uint64_t remainderLow;
+	uint64_t halfHigh;
+	uint64_t halfLow;
+	uint32_t scaled;
+	int exponent;
+	int shift;
+	bool isOdd;
+
+	if (fraction == 0.0) {
+		return 0;
+	}
+	mantissa = (uint64_t)ldexp(frexp(fraction, &exponent), 53);
+	shift = 53 - exponent;	// at least 53, the fraction is below 1
+
+	part = (mantissa >> 32) * scale;
+	low = (mantissa & 0xFFFFFFFFu) * scale;
+	high = part >> 32;
+	part <<= 32;
+	low += part;
+	if (low < part) {
+		high++;
+	}
+
+	// the product is below 2^83, under half of 2^shift from here on
+	if (shift > 83) {
+		return 0;
+	}
+	if (shift < 64) {
+		scaled = (uint32_t)((high << (64 - shift)) | (low >> shift));
+		remainderHigh = 0;
+		remainderLow = low & (((uint64_t)1 << shift) - 1);
+		halfHigh = 0;
+		halfLow = (uint64_t)1 << (shift - 1);
+	} else if (shift == 64) {
+		scaled = (uint32_t)high;
+		remainderHigh = 0;
+		remainderLow = low;
+		halfHigh = 0;
+		halfLow = (uint64_t)1 << 63;
+	} else {
+		scaled = (uint32_t)(high >> (shift - 64));
+		remainderHigh = high & (((uint64_t)1 << (shift - 64)) - 1);
+		remainderLow = low;
+		halfHigh = (uint64_t)1 << (shift - 65);
+		halfLow = 0;
+	}
+
+	// with no decimals the digit that rounds is the last one of the integer part
+	isOdd = (decimals > 0) ? (scaled & 1) : isIntegerOdd;
+	if (remainderHigh > halfHigh || (remainderHigh == halfHigh && (remainderLow > halfLow
+			|| (remainderLow == halfLow && isOdd)))) {
+		scaled++;
+	}
+	return scaled;
+}
+
+size_t aws_iot_json_format_double(char *pBuffer, double value, uint8_t decimals) {
+	char text[AWS_IOT_JSON_NUMBER_MAX_LEN];
+	char *pEnd = text + sizeof(text);
+	char *pStart = pEnd;
+	double magnitude;
+	uint64_t integer;
+	uint32_t fraction;
+
+	if (isnan(value) || isinf(value)) {
+		memcpy(pBuffer, "null", 5);
+		return 4;
+	}
+	magnitude = fabs(value);
+	if (magnitude >= 18446744073709551616.0 || decimals > AWS_IOT_JSON_MAX_DECIMALS) {
+		return (size_t)snprintf(pBuffer, AWS_IOT_JSON_NUMBER_MAX_LEN, "%.17g", value);
+	}
+
+	// both parts are exact, the fraction has the bits of the value below the point
+	integer = (uint64_t)magnitude;
+	fraction = scaleFraction(magnitude - (double)integer, decimals, (integer & 1) != 0);
+	if (fraction == powersOf10[decimals]) {
+		fraction = 0;
+		integer++;
+	}
+
+	if (decimals > 0) {
+		pStart = writeFixedDigits(pStart, fraction, decimals);
+		*--pStart = '.';
+	}
+	pStart = writeDigits64(pStart, integer);
+	if (signbit(value)) {
+		*--pStart = '-';
+	}
+	return copyOut(pBuffer, pStart, pEnd);
+}
+
+static const double exactPowersOf10[EXACT_POWER_OF_10_MAX + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * The value of a number is mantissa * 10^exponent, plus less than one unit of its last
+ * digit when isTruncated.
+ */
+typedef struct {
+	uint64_t mantissa;		///< First significant digits
+	int32_t exponent;		///< Power of 10 of the last digit kept
+	bool isNegative;		///< A '-' leads
+	bool isTruncated;		///< Non zero digits were dropped past the mantissa
+	bool isInteger;			///< Neither a fraction nor an exponent
+} JsonNumber_t;
+
+static bool isDigit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+// follows the JSON grammar over the whole text
+static bool scanNumber(const char *pText, size_t length, JsonNumber_t *pNumber) {
+	const char *pEnd = pText + length;
+	uint8_t digits = 0;
+	int32_t exponent = 0;
+	bool isExponentNegative;
+
+	pNumber->mantissa = 0;
+	pNumber->exponent = 0;
+	pNumber->isTruncated = false;
+	pNumber->isInteger = true;
+	pNumber->isNegative = (pText < pEnd && *pText == '-');
+	if (pNumber->isNegative) {
+		pText++;
+	}
+	if (pText == pEnd || !isDigit(*pText)) {
+		return false;
+	}
+
+	if (*pText == '0') {
+		pText++;
+	} else {
+		for (; pText < pEnd && isDigit(*pText); pText++) {
+			if (digits < SIGNIFICANT_DIGITS_MAX) {
+				pNumber->mantissa = pNumber->mantissa * 10 + (*pText - '0');
+				digits++;
+			} else {
+				pNumber->exponent++;
+				pNumber->isTruncated |= (*pText != '0');
+			}
+		}
+	}
+
+	if (pText < pEnd && *pText == '.') {
+		pNumber->isInteger = false;
+		if (++pText == pEnd || !isDigit(*pText)) {
+			return false;
+		}
+		for (; pText < pEnd && isDigit(*pText); pText++) {
+			if (digits < SIGNIFICANT_DIGITS_MAX) {
+				// zeros ahead of the first significant digit only move the exponent
+				pNumber->mantissa = pNumber->mantissa * 10 + (*pText - '0');
+				pNumber->exponent--;
+				if (0 != pNumber->mantissa) {
+					digits++;
+				}
+			} else {
+				pNumber->isTruncated |= (*pText != '0');
+			}
+		}
+	}
+
+	if (pText < pEnd && (*pText == 'e' || *pText == 'E')) {
+		pNumber->isInteger = false;
+		pText++;
+		isExponentNegative = (pText < pEnd && *pText == '-');
+		if (pText < pEnd && (*pText == '-' || *pText == '+')) {
+			pText++;
+		}
+		if (pText == pEnd || !isDigit(*pText)) {
+			return false;
+		}
+		for (; pText < pEnd && isDigit(*pText); pText++) {
+			if (exponent < EXPONENT_MAX) {
+				exponent = exponent * 10 + (*pText - '0');
+			}
+		}
+		pNumber->exponent += isExponentNegative ? -exponent : exponent;
+	}
+
+	return pText == pEnd;
+}
+
+// the magnitude of an integer, false if it has no fraction but does not fit either
+static bool integerMagnitude(const char *pText, size_t length, bool *pIsNegative, uint32_t *pMagnitude) {
+	JsonNumber_t number;
+
+	if (!scanNumber(pText, length, &number) || !number.isInteger) {
+		return false;
+	}
+	if (number.exponent > 0 || number.mantissa > UINT32_MAX) {
+		return false;
+	}
+	*pIsNegative = number.isNegative;
+	*pMagnitude = (uint32_t)number.mantissa;
+	return true;
+}
+
+IoT_Error_t aws_iot_json_parse_int32(const char *pText, size_t length, int32_t min, int32_t max, int32_t *pValue) {
+	bool isNegative;
+	uint32_t magnitude;
+	int64_t value;
+
+	if (!integerMagnitude(pText, length, &isNegative, &magnitude)) {
+		return JSON_PARSE_ERROR;
+	}
+	value = isNegative ? -(int64_t)magnitude : (int64_t)magnitude;
+	if (value < min || value > max) {
+		return JSON_PARSE_ERROR;
+	}
+	*pValue = (int32_t)value;
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_json_parse_uint32(const char *pText, size_t length, uint32_t max, uint32_t *pValue) {
+	bool isNegative;
+	uint32_t magnitude;
+
+	if (!integerMagnitude(pText, length, &isNegative, &magnitude)) {
+		return JSON_PARSE_ERROR;
+	}
+	if ((isNegative && 0 != magnitude) || magnitude > max) {
+		return JSON_PARSE_ERROR;
+	}
+	*pValue = magnitude;
+	return NONE_ERROR;
+}
+
+/*
+ * Clinger's fast path: when the mantissa and the power of 10 are both exact doubles,
+ * IEEE 754 rounds their product or quotient exactly. A bigger exponent still works
+ * when the mantissa can take a few of its zeros without going past 2^53.
+ */
+static bool fastDouble(const JsonNumber_t *pNumber, double *pValue) {
+	uint64_t mantissa = pNumber->mantissa;
+	int32_t exponent = pNumber->exponent;
+
+	if (pNumber->isTruncated || mantissa > EXACT_INTEGER_MAX) {
+		return false;
+	}
+	if (exponent < -EXACT_POWER_OF_10_MAX) {
+		return false;
+	}
+	if (exponent < 0) {
+		*pValue = (double)mantissa / exactPowersOf10[-exponent];
+		return true;
+	}
+	while (exponent > EXACT_POWER_OF_10_MAX) {
+		mantissa *= 10;
+		exponent--;
+		if (mantissa > EXACT_INTEGER_MAX) {
+			return false;
+		}
+	}
+	*pValue = (double)mantissa * exactPowersOf10[exponent];
+	return true;
+}
+
+/*
+ * Every float and every midpoint between two floats is a double. A double rounded
+ * from the text lands on the same side of each midpoint as the text, so rounding it
+ * again to a float gives the nearest float, unless it landed on the midpoint itself.
+ */
+static bool isFloatMidpoint(double value) {
+	uint64_t bits;
+
+	value = fabs(value);
+	if (value < FLT_MIN) {
+		// a denormal float drops more bits than a normal one, leave it to strtof()
+		return true;
+	}
+	memcpy(&bits, &value, sizeof(bits));
+	return (bits & 0x1FFFFFFFu) == 0x10000000u;
+}
+
+/*
+ * strtod() and strtof() read up to a NULL, which the text of a token does not have, so
+ * they are given a copy. A number too long for it keeps its first significant digits,
+ * a 1 after them if any of the others is not zero, and the exponent that goes with them.
+ */
+static void fallbackText(const char *pText, size_t length, char *pCopy) {
+	const char *pEnd = pText + length;
+	char *pOut = pCopy;
+	int32_t exponent = 0;
+	int32_t textExponent = 0;
+	uint8_t digits = 0;
+	bool isFraction = false;
+	bool isTruncated = false;
+	bool isExponentNegative;
+
+	if (length < FALLBACK_TEXT_MAX) {
+		memcpy(pCopy, pText, length);
+		pCopy[length] = '\0';
+		return;
+	}
+
+	// the sign is left out, the callers only take the magnitude
+	if (*pText == '-') {
+		pText++;
+	}
+	for (; pText < pEnd && *pText != 'e' && *pText != 'E'; pText++) {
+		if (*pText == '.') {
+			isFraction = true;
+		} else if (0 == digits && *pText == '0') {
+			exponent -= isFraction ? 1 : 0;
+		} else if (digits < FALLBACK_DIGITS_MAX) {
+			*pOut++ = *pText;
+			digits++;
+			exponent -= isFraction ? 1 : 0;
+		} else {
+			isTruncated |= (*pText != '0');
+			exponent += isFraction ? 0 : 1;
+		}
+	}
+	if (isTruncated) {
+		*pOut++ = '1';
+		exponent--;
+	}
+
+	if (pText < pEnd) {
+		pText++;
+		isExponentNegative = (*pText == '-');
+		if (*pText == '-' || *pText == '+') {
+			pText++;
+		}
+		for (; pText < pEnd; pText++) {
+			if (textExponent < EXPONENT_MAX) {
+				textExponent = textExponent * 10 + (*pText - '0');
+			}
+		}
+		exponent += isExponentNegative ? -textExponent : textExponent;
+	}
+	snprintf(pOut, FALLBACK_TEXT_MAX - (pOut - pCopy), "e%ld", (long)exponent);
+}
+
+IoT_Error_t aws_iot_json_parse_double(const char *pText, size_t length, double *pValue) {
+	JsonNumber_t number;
+	char copy[FALLBACK_TEXT_MAX];
+	char *pEnd;
+	double value;
+
+	if (!scanNumber(pText, length, &number)) {
+		return JSON_PARSE_ERROR;
+	}
+	if (0 == number.mantissa && !number.isTruncated) {
+		value = 0.0;
+	} else if (!fastDouble(&number, &value)) {
+		fallbackText(pText, length, copy);
+		value = strtod(copy, &pEnd);
+		if (*pEnd != '\0') {
+			return JSON_PARSE_ERROR;
+		}
+		value = fabs(value);
+	}
+	if (isinf(value)) {
+		return JSON_PARSE_ERROR;
+	}
+	*pValue = number.isNegative ? -value : value;
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_json_parse_float(const char *pText, size_t length, float *pValue) {
+	JsonNumber_t number;
+	char copy[FALLBACK_TEXT_MAX];
+	char *pEnd;
+	double exact;
+	float value;
+
+	if (!scanNumber(pText, length, &number)) {
+		return JSON_PARSE_ERROR;
+	}
+	if (0 == number.mantissa && !number.isTruncated) {
+		value = 0.0f;
+	} else if (fastDouble(&number, &exact) && !isFloatMidpoint(exact)) {
+		value = (float)exact;
+	} else {
+		fallbackText(pText, length, copy);
+		value = strtof(copy, &pEnd);
+		if (*pEnd != '\0') {
+			return JSON_PARSE_ERROR;
+		}
+		value = fabsf(value);
+	}
+	if (isinf(value)) {
+		return JSON_PARSE_ERROR;
+	}
+	*pValue = number.isNegative ? -value : value;
+	return NONE_ERROR;
+}
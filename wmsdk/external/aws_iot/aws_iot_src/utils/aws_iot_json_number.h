@@ -0,0 +1,142 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_json_number.h
+ * @brief Numbers written as JSON text and read back without the printf and scanf families.
+ *
+ * snprintf() parses its format string on every call and, for a double, pulls in the
+ * floating point support of the C library. The values of a shadow document only ever
+ * need a decimal integer or a fixed number of decimals, which these write straight
+ * into the caller's buffer, two digits per step.
+ *
+ * sscanf() is as slow the other way, takes whatever prefix of the text looks like a
+ * number and leaves an integer that does not fit undefined. The parsers here take the
+ * whole text of a value, follow the JSON grammar, with no locale, no leading '+', no
+ * leading zeros, no hexadecimal and no "inf" or "nan", and reject an integer outside
+ * of the range asked for or a floating point number too big for its type. A number of
+ * up to 15 significant digits and an exponent of up to 22, which is about every value
+ * a device reports, is converted with a single exactly rounded multiplication or
+ * division. The others go to strtod() or strtof(), so the result is the nearest one.
+ * Those are given a NULL terminated copy of up to 127 characters; a longer number
+ * keeps its first 100 significant digits and whether any of the others is not zero,
+ * which still gives the nearest value unless the number is closer than one part in
+ * 10^100 to halfway between two of them.
+ */
+
+#ifndef AWS_IOT_SDK_SRC_JSON_NUMBER_H_
+#define AWS_IOT_SDK_SRC_JSON_NUMBER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "aws_iot_error.h"
+
+/**
+ * @brief Size of a buffer that holds any number written by this module, the NULL included
+ */
+#define AWS_IOT_JSON_NUMBER_MAX_LEN 32
+
+/**
+ * @brief Most decimals aws_iot_json_format_double() writes itself
+ */
+#define AWS_IOT_JSON_MAX_DECIMALS 9
+
+/**
+ * @brief Write a signed integer
+ *
+ * @param pBuffer	At least #AWS_IOT_JSON_NUMBER_MAX_LEN bytes, NULL terminated on return
+ * @param value		Value to write
+ * @return Length of the text
+ */
+size_t aws_iot_json_format_int32(char *pBuffer, int32_t value);
+
+/**
+ * @brief Write an unsigned integer
+ *
+ * @param pBuffer	At least #AWS_IOT_JSON_NUMBER_MAX_LEN bytes, NULL terminated on return
+ * @param value		Value to write
+ * @return Length of the text
+ */
+size_t aws_iot_json_format_uint32(char *pBuffer, uint32_t value);
+
+/**
+ * @brief Write a floating point number with a fixed number of decimals
+ *
+ * Gives the same text as "%.*f" does: the value is rounded exactly, to the nearest
+ * and to even on a tie, whatever its magnitude. A value of 2^64 or more, or more than
+ * #AWS_IOT_JSON_MAX_DECIMALS decimals, is written with 17 significant digits
+ * instead, in exponent notation if needed, so that it still fits. JSON has no NaN or
+ * infinity, both are written as null.
+ *
+ * @param pBuffer	At least #AWS_IOT_JSON_NUMBER_MAX_LEN bytes, NULL terminated on return
+ * @param value		Value to write
+ * @param decimals	Digits after the decimal point, none and no point for 0
+ * @return Length of the text
+ */
+size_t aws_iot_json_format_double(char *pBuffer, double value, uint8_t decimals);
+
+/**
+ * @brief Read a signed integer
+ *
+ * pText need not be NULL terminated, nothing past its length is read. The same holds
+ * for all the parsers below.
+ *
+ * @param pText		Text of the value, without any white space
+ * @param length	Length of pText
+ * @param min		Smallest value accepted
+ * @param max		Biggest value accepted
+ * @param pValue	Set on success only
+ * @return NONE_ERROR, JSON_PARSE_ERROR if the text is not an integer or is out of range
+ */
+IoT_Error_t aws_iot_json_parse_int32(const char *pText, size_t length, int32_t min, int32_t max, int32_t *pValue);
+
+/**
+ * @brief Read an unsigned integer
+ *
+ * @param pText		Text of the value, without any white space
+ * @param length	Length of pText
+ * @param max		Biggest value accepted
+ * @param pValue	Set on success only
+ * @return NONE_ERROR, JSON_PARSE_ERROR if the text is not an integer or is out of range,
+ * -0 is 0
+ */
+IoT_Error_t aws_iot_json_parse_uint32(const char *pText, size_t length, uint32_t max, uint32_t *pValue);
+
+/**
+ * @brief Read a double
+ *
+ * @param pText		Text of the value, without any white space
+ * @param length	Length of pText
+ * @param pValue	Set to the nearest double on success only
+ * @return NONE_ERROR, JSON_PARSE_ERROR if the text is not a number or is too big for a
+ * double. A number too small for one is 0 or a denormal.
+ */
+IoT_Error_t aws_iot_json_parse_double(const char *pText, size_t length, double *pValue);
+
+/**
+ * @brief Read a float
+ *
+ * Rounded once, to the nearest float, not to a double and then to a float.
+ *
+ * @param pText		Text of the value, without any white space
+ * @param length	Length of pText
+ * @param pValue	Set to the nearest float on success only
+ * @return NONE_ERROR, JSON_PARSE_ERROR if the text is not a number or is too big for a
+ * float. A number too small for one is 0 or a denormal.
+ */
+IoT_Error_t aws_iot_json_parse_float(const char *pText, size_t length, float *pValue);
+
+#endif /* AWS_IOT_SDK_SRC_JSON_NUMBER_H_ */
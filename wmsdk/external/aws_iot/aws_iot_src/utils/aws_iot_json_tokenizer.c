@@ -0,0 +1,604 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "aws_iot_json_tokenizer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// a register of the CPU, 4 bytes on a Cortex-M
+typedef uintptr_t ScanWord_t;
+
+#define SCAN_WORD_ONES ((ScanWord_t)-1 / 0xFF)
+#define SCAN_WORD_HIGHS (SCAN_WORD_ONES * 0x80)
+// non zero if a byte of the word is zero, or is c
+#define SCAN_WORD_HAS_ZERO(w) (((w) - SCAN_WORD_ONES) & ~(w) & SCAN_WORD_HIGHS)
+#define SCAN_WORD_HAS_BYTE(w, c) SCAN_WORD_HAS_ZERO((w) ^ (SCAN_WORD_ONES * (uint8_t)(c)))
+
+// position of the first quote, backslash or NULL from pos on, len if there is none
+static size_t findStringEnd(const char *js, size_t pos, size_t len) {
+	ScanWord_t word;
+
+#if defined(__SSE2__)
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i zero = _mm_setzero_si128();
+	__m128i block;
+	int mask;
+
+	while (pos + sizeof(block) <= len) {
+		block = _mm_loadu_si128((const __m128i *)(js + pos));
+		mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote),
+				_mm_cmpeq_epi8(block, backslash)), _mm_cmpeq_epi8(block, zero)));
+		if (mask != 0) {
+			return pos + __builtin_ctz(mask);
+		}
+		pos += sizeof(block);
+	}
+#endif
+	while (pos + sizeof(word) <= len) {
+		memcpy(&word, js + pos, sizeof(word));	// a single load where unaligned loads are allowed
+		if (SCAN_WORD_HAS_ZERO(word) | SCAN_WORD_HAS_BYTE(word, '"') | SCAN_WORD_HAS_BYTE(word, '\\')) {
+			break;
+		}
+		pos += sizeof(word);
+	}
+	while (pos < len && js[pos] != '"' && js[pos] != '\\' && js[pos] != '\0') {
+		pos++;
+	}
+	return pos;
+}
+
+static jsmntok_t *allocToken(jsmn_parser *parser, jsmntok_t *tokens, unsigned int num_tokens) {
+	jsmntok_t *token;
+
+	if (parser->toknext >= (int)num_tokens) {
+		return NULL;
+	}
+	token = &tokens[parser->toknext++];
+	token->start = token->end = -1;
+	token->size = 0;
+	token->parent = -1;
+	return token;
+}
+
+static void fillToken(jsmntok_t *token, jsmntype_t type, size_t start, size_t end) {
+	token->type = type;
+	token->start = start;
+	token->end = end;
+	token->size = 0;
+}
+
+static bool isHexDigit(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+// pos is on the opening quote, left on the closing one
+static int tokenizeString(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		unsigned int num_tokens, size_t *pPos) {
+	size_t start = *pPos;
+	size_t pos = start + 1;
+	jsmntok_t *token;
+	uint8_t i;
+
+	for (;;) {
+		pos = findStringEnd(js, pos, len);
+		if (pos >= len || js[pos] == '\0') {
+			return JSMN_ERROR_PART;
+		}
+		if (js[pos] == '"') {
+			break;
+		}
+		// a backslash, the last byte of the document is left for the next call
+		if (pos + 1 >= len) {
+			pos++;
+			continue;
+		}
+		pos++;
+		switch (js[pos]) {
+		case '"':
+		case '/':
+		case '\\':
+		case 'b':
+		case 'f':
+		case 'r':
+		case 'n':
+		case 't':
+			break;
+		case 'u':
+			pos++;
+			for (i = 0; i < 4 && pos < len && js[pos] != '\0'; i++) {
+				if (!isHexDigit(js[pos])) {
+					return JSMN_ERROR_INVAL;
+				}
+				pos++;
+			}
+			pos--;
+			break;
+		default:
+			return JSMN_ERROR_INVAL;
+		}
+		pos++;
+	}
+
+	*pPos = pos;
+	if (tokens == NULL) {
+		return 0;
+	}
+	token = allocToken(parser, tokens, num_tokens);
+	if (token == NULL) {
+		*pPos = start;
+		return JSMN_ERROR_NOMEM;
+	}
+	fillToken(token, JSMN_STRING, start + 1, pos);
+	token->parent = parser->toksuper;
+	return 0;
+}
+
+// pos is on the first character, left on the last one
+static int tokenizePrimitive(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		unsigned int num_tokens, size_t *pPos) {
+	size_t start = *pPos;
+	size_t pos = start;
+	jsmntok_t *token;
+
+	for (; pos < len && js[pos] != '\0'; pos++) {
+		switch (js[pos]) {
+		case '\t':
+		case '\r':
+		case '\n':
+		case ' ':
+		case ',':
+		case ']':
+		case '}':
+			goto found;
+		}
+		if (js[pos] < 32 || js[pos] >= 127) {
+			return JSMN_ERROR_INVAL;
+		}
+	}
+	// a primitive has to be followed by a delimiter
+	return JSMN_ERROR_PART;
+
+found:
+	*pPos = pos - 1;
+	if (tokens == NULL) {
+		return 0;
+	}
+	token = allocToken(parser, tokens, num_tokens);
+	if (token == NULL) {
+		*pPos = start;
+		return JSMN_ERROR_NOMEM;
+	}
+	fillToken(token, JSMN_PRIMITIVE, start, pos);
+	token->parent = parser->toksuper;
+	return 0;
+}
+
+int aws_iot_json_tokenize(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		unsigned int num_tokens) {
+	size_t pos = parser->pos;
+	int count = parser->toknext;
+	jsmntok_t *token;
+	jsmntype_t type;
+	int r;
+	int i;
+	char c;
+
+	for (; pos < len && js[pos] != '\0'; pos++) {
+		c = js[pos];
+		switch (c) {
+		case '{':
+		case '[':
+			count++;
+			if (tokens == NULL) {
+				break;
+			}
+			token = allocToken(parser, tokens, num_tokens);
+			if (token == NULL) {
+				parser->pos = pos;
+				return JSMN_ERROR_NOMEM;
+			}
+			if (parser->toksuper != -1) {
+				tokens[parser->toksuper].size++;
+				token->parent = parser->toksuper;
+			}
+			token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
+			token->start = pos;
+			parser->toksuper = parser->toknext - 1;
+			break;
+		case '}':
+		case ']':
+			if (tokens == NULL) {
+				break;
+			}
+			type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
+			if (parser->toknext < 1) {
+				parser->pos = pos;
+				return JSMN_ERROR_INVAL;
+			}
+			token = &tokens[parser->toknext - 1];
+			for (;;) {
+				if (token->start != -1 && token->end == -1) {
+					if (token->type != type) {
+						parser->pos = pos;
+						return JSMN_ERROR_INVAL;
+					}
+					token->end = pos + 1;
+					parser->toksuper = token->parent;
+					break;
+				}
+				if (token->parent == -1) {
+					break;
+				}
+				token = &tokens[token->parent];
+			}
+			break;
+		case '"':
+			r = tokenizeString(parser, js, len, tokens, num_tokens, &pos);
+			if (r < 0) {
+				parser->pos = pos;
+				return r;
+			}
+			count++;
+			if (parser->toksuper != -1 && tokens != NULL) {
+				tokens[parser->toksuper].size++;
+			}
+			break;
+		case '\t':
+		case '\r':
+		case '\n':
+		case ' ':
+			break;
+		case ':':
+			parser->toksuper = parser->toknext - 1;
+			break;
+		case ',':
+			if (tokens != NULL && parser->toksuper != -1 && tokens[parser->toksuper].type != JSMN_ARRAY
+					&& tokens[parser->toksuper].type != JSMN_OBJECT) {
+				parser->toksuper = tokens[parser->toksuper].parent;
+			}
+			break;
+		case '-':
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+		case 't':
+		case 'f':
+		case 'n':
+			// a primitive is not a key
+			if (tokens != NULL && parser->toksuper != -1) {
+				token = &tokens[parser->toksuper];
+				if (token->type == JSMN_OBJECT || (token->type == JSMN_STRING && token->size != 0)) {
+					parser->pos = pos;
+					return JSMN_ERROR_INVAL;
+				}
+			}
+			r = tokenizePrimitive(parser, js, len, tokens, num_tokens, &pos);
+			if (r < 0) {
+				parser->pos = pos;
+				return r;
+			}
+			count++;
+			if (parser->toksuper != -1 && tokens != NULL) {
+				tokens[parser->toksuper].size++;
+			}
+			break;
+		default:
+			parser->pos = pos;
+			return JSMN_ERROR_INVAL;
+		}
+	}
+	parser->pos = pos;
+
+	if (tokens != NULL) {
+		for (i = parser->toknext - 1; i >= 0; i--) {
+			if (tokens[i].start != -1 && tokens[i].end == -1) {
+				return JSMN_ERROR_PART;
+			}
+		}
+	}
+	return count;
+}
+
+#define STREAM_NO_TOKEN 0xFF
+#define STREAM_MAX_DEPTH 32
+
+// what the grammar allows next
+enum {
+	STREAM_EXPECT_VALUE,
+	STREAM_EXPECT_VALUE_OR_END,
+	STREAM_EXPECT_KEY,
+	STREAM_EXPECT_KEY_OR_END,
+	STREAM_EXPECT_COLON,
+	STREAM_EXPECT_COMMA_OR_END,
+	STREAM_EXPECT_NOTHING
+};
+
+static bool isStreamValueExpected(const JsonStreamParser_t *pParser) {
+	return pParser->expect == STREAM_EXPECT_VALUE || pParser->expect == STREAM_EXPECT_VALUE_OR_END;
+}
+
+static bool isStreamInArray(const JsonStreamParser_t *pParser) {
+	return (pParser->isArray & ((uint32_t)1 << (pParser->depth - 1))) != 0;
+}
+
+static void endStreamValue(JsonStreamParser_t *pParser) {
+	pParser->expect = (pParser->depth == 0) ? STREAM_EXPECT_NOTHING : STREAM_EXPECT_COMMA_OR_END;
+}
+
+static void appendStreamToken(JsonStreamParser_t *pParser, const char *pText, size_t length) {
+	if (pParser->tokenLength + length > AWS_IOT_JSON_STREAM_TOKEN_LEN) {
+		pParser->error = JSMN_ERROR_NOMEM;
+		return;
+	}
+	memcpy(pParser->tokenText + pParser->tokenLength, pText, length);
+	pParser->tokenLength += length;
+}
+
+// the key or value ends in this chunk, the start of it could be in the previous ones
+static void emitStreamToken(JsonStreamParser_t *pParser, const char *pText, size_t length) {
+	JsonStreamEvent_t event = (JsonStreamEvent_t)pParser->token;
+
+	if (pParser->tokenLength > 0) {
+		appendStreamToken(pParser, pText, length);
+		if (pParser->error != 0) {
+			return;
+		}
+		pParser->tokenText[pParser->tokenLength] = '\0';
+		pText = pParser->tokenText;
+		length = pParser->tokenLength;
+	}
+	pParser->token = STREAM_NO_TOKEN;
+	pParser->tokenLength = 0;
+	if (event == JSON_STREAM_KEY) {
+		pParser->expect = STREAM_EXPECT_COLON;
+	} else {
+		endStreamValue(pParser);
+	}
+	pParser->callback(event, pText, length, pParser->depth, pParser->pContextData);
+}
+
+// pos is after the opening quote or at the start of the chunk, returns the position after the closing quote
+static size_t readStreamString(JsonStreamParser_t *pParser, const char *pChunk, size_t pos, size_t length) {
+	size_t start = pos;
+
+	while (pos < length) {
+		if (pParser->hexLeft > 0) {
+			if (!isHexDigit(pChunk[pos])) {
+				pParser->error = JSMN_ERROR_INVAL;
+				return length;
+			}
+			pParser->hexLeft--;
+			pos++;
+			continue;
+		}
+		if (pParser->isEscaped) {
+			switch (pChunk[pos]) {
+			case '"':
+			case '/':
+			case '\\':
+			case 'b':
+			case 'f':
+			case 'r':
+			case 'n':
+			case 't':
+				break;
+			case 'u':
+				pParser->hexLeft = 4;
+				break;
+			default:
+				pParser->error = JSMN_ERROR_INVAL;
+				return length;
+			}
+			pParser->isEscaped = false;
+			pos++;
+			continue;
+		}
+		pos = findStringEnd(pChunk, pos, length);
+		if (pos >= length) {
+			break;
+		}
+		if (pChunk[pos] == '"') {
+			emitStreamToken(pParser, pChunk + start, pos - start);
+			return pos + 1;
+		}
+		if (pChunk[pos] == '\0') {
+			pParser->error = JSMN_ERROR_INVAL;
+			return length;
+		}
+		pParser->isEscaped = true;
+		pos++;
+	}
+	appendStreamToken(pParser, pChunk + start, length - start);
+	return length;
+}
+
+// returns the position of the delimiter after the primitive, which is left to the caller
+static size_t readStreamPrimitive(JsonStreamParser_t *pParser, const char *pChunk, size_t pos, size_t length) {
+	size_t start = pos;
+	uint8_t c;
+
+	for (; pos < length; pos++) {
+		c = (uint8_t)pChunk[pos];
+		if (c == '\t' || c == '\r' || c == '\n' || c == ' ' || c == ',' || c == ']' || c == '}') {
+			emitStreamToken(pParser, pChunk + start, pos - start);
+			return pos;
+		}
+		if (c < 32 || c >= 127) {
+			pParser->error = JSMN_ERROR_INVAL;
+			return length;
+		}
+	}
+	appendStreamToken(pParser, pChunk + start, length - start);
+	return length;
+}
+
+static void openStreamContainer(JsonStreamParser_t *pParser, bool isArray) {
+	uint32_t depthBit = (uint32_t)1 << pParser->depth;
+
+	if (!isStreamValueExpected(pParser)) {
+		pParser->error = JSMN_ERROR_INVAL;
+		return;
+	}
+	if (pParser->depth >= STREAM_MAX_DEPTH) {
+		pParser->error = JSMN_ERROR_NOMEM;
+		return;
+	}
+	pParser->callback(isArray ? JSON_STREAM_ARRAY_BEGIN : JSON_STREAM_OBJECT_BEGIN, NULL, 0, pParser->depth,
+			pParser->pContextData);
+	if (isArray) {
+		pParser->isArray |= depthBit;
+		pParser->expect = STREAM_EXPECT_VALUE_OR_END;
+	} else {
+		pParser->isArray &= ~depthBit;
+		pParser->expect = STREAM_EXPECT_KEY_OR_END;
+	}
+	pParser->depth++;
+}
+
+static void closeStreamContainer(JsonStreamParser_t *pParser, bool isArray) {
+	if (pParser->depth == 0 || isStreamInArray(pParser) != isArray) {
+		pParser->error = JSMN_ERROR_INVAL;
+		return;
+	}
+	// a trailing comma is not allowed
+	if (pParser->expect != STREAM_EXPECT_COMMA_OR_END
+			&& pParser->expect != (isArray ? STREAM_EXPECT_VALUE_OR_END : STREAM_EXPECT_KEY_OR_END)) {
+		pParser->error = JSMN_ERROR_INVAL;
+		return;
+	}
+	pParser->depth--;
+	endStreamValue(pParser);
+	pParser->callback(isArray ? JSON_STREAM_ARRAY_END : JSON_STREAM_OBJECT_END, NULL, 0, pParser->depth,
+			pParser->pContextData);
+}
+
+void aws_iot_json_stream_init(JsonStreamParser_t *pParser, fpJsonStreamCallback_t callback, void *pContextData) {
+	memset(pParser, 0, sizeof(JsonStreamParser_t));
+	pParser->callback = callback;
+	pParser->pContextData = pContextData;
+	pParser->expect = STREAM_EXPECT_VALUE;
+	pParser->token = STREAM_NO_TOKEN;
+}
+
+int aws_iot_json_stream_feed(JsonStreamParser_t *pParser, const char *pChunk, size_t length) {
+	size_t pos = 0;
+
+	if (pParser->error != 0) {
+		return pParser->error;
+	}
+
+	// a key or a value split by the end of the previous chunk
+	if (pParser->token == JSON_STREAM_PRIMITIVE) {
+		pos = readStreamPrimitive(pParser, pChunk, 0, length);
+	} else if (pParser->token != STREAM_NO_TOKEN) {
+		pos = readStreamString(pParser, pChunk, 0, length);
+	}
+
+	while (pParser->error == 0 && pos < length) {
+		switch (pChunk[pos]) {
+		case '{':
+		case '[':
+			openStreamContainer(pParser, pChunk[pos] == '[');
+			break;
+		case '}':
+		case ']':
+			closeStreamContainer(pParser, pChunk[pos] == ']');
+			break;
+		case '"':
+			if (pParser->expect == STREAM_EXPECT_KEY || pParser->expect == STREAM_EXPECT_KEY_OR_END) {
+				pParser->token = JSON_STREAM_KEY;
+			} else if (isStreamValueExpected(pParser)) {
+				pParser->token = JSON_STREAM_STRING;
+			} else {
+				pParser->error = JSMN_ERROR_INVAL;
+				break;
+			}
+			pos = readStreamString(pParser, pChunk, pos + 1, length);
+			continue;
+		case ':':
+			if (pParser->expect != STREAM_EXPECT_COLON) {
+				pParser->error = JSMN_ERROR_INVAL;
+				break;
+			}
+			pParser->expect = STREAM_EXPECT_VALUE;
+			break;
+		case ',':
+			if (pParser->expect != STREAM_EXPECT_COMMA_OR_END) {
+				pParser->error = JSMN_ERROR_INVAL;
+				break;
+			}
+			pParser->expect = isStreamInArray(pParser) ? STREAM_EXPECT_VALUE : STREAM_EXPECT_KEY;
+			break;
+		case '\t':
+		case '\r':
+		case '\n':
+		case ' ':
+			break;
+		case '-':
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+		case 't':
+		case 'f':
+		case 'n':
+			if (!isStreamValueExpected(pParser)) {
+				pParser->error = JSMN_ERROR_INVAL;
+				break;
+			}
+			pParser->token = JSON_STREAM_PRIMITIVE;
+			pos = readStreamPrimitive(pParser, pChunk, pos, length);
+			continue;
+		default:
+			pParser->error = JSMN_ERROR_INVAL;
+			break;
+		}
+		pos++;
+	}
+	return pParser->error;
+}
+
+int aws_iot_json_stream_finish(JsonStreamParser_t *pParser) {
+	if (pParser->error != 0) {
+		return pParser->error;
+	}
+	// nothing follows a number at the top level to end it
+	if (pParser->token == JSON_STREAM_PRIMITIVE && pParser->depth == 0) {
+		emitStreamToken(pParser, "", 0);
+	}
+	if (pParser->error == 0 && pParser->expect != STREAM_EXPECT_NOTHING) {
+		return JSMN_ERROR_PART;
+	}
+	return pParser->error;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_json_tokenizer.h
+ * @brief Tokenizer giving the same tokens as jsmn_parse(), scanning strings a word at a time.
+ *
+ * Most of the bytes of a shadow document are inside strings: keys, the client token
+ * and the metadata. Instead of going through them a byte at a time, this tokenizer
+ * looks for the closing quote, a backslash or a NULL in a whole machine word at once,
+ * with the SSE2 instructions on a host that has them. Everything else follows
+ * jsmn_parse() in strict mode with parent links, so the tokens, the return values and
+ * the state of the parser are the same. #AWS_IOT_JSON_FAST_TOKENIZER selects it for
+ * the shadow documents.
+ *
+ * A document received in chunks can also be parsed as it arrives by the streaming
+ * parser, which calls back with every key and value instead of filling tokens.
+ */
+
+#ifndef AWS_IOT_SDK_SRC_JSON_TOKENIZER_H_
+#define AWS_IOT_SDK_SRC_JSON_TOKENIZER_H_
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "jsmn.h"
+#include "aws_iot_config.h"
+
+/**
+ * @brief Tokenize a JSON document, as jsmn_parse() does
+ *
+ * On JSMN_ERROR_PART the parser is left where the complete tokens end. Calling again
+ * with the same parser once more bytes are appended to js carries on from there.
+ *
+ * @param parser		Parser set up by jsmn_init()
+ * @param js			The JSON document
+ * @param len			Length of js, a NULL ends the document earlier
+ * @param tokens		Tokens to fill, NULL only counts them
+ * @param num_tokens	Number of entries in tokens
+ * @return The number of tokens, or a jsmnerr_t
+ */
+int aws_iot_json_tokenize(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		unsigned int num_tokens);
+
+/**
+ * @brief Event of the streaming parser
+ */
+typedef enum {
+	JSON_STREAM_OBJECT_BEGIN,	///< An object opens
+	JSON_STREAM_OBJECT_END,		///< The object closes
+	JSON_STREAM_ARRAY_BEGIN,	///< An array opens
+	JSON_STREAM_ARRAY_END,		///< The array closes
+	JSON_STREAM_KEY,			///< A key of an object, without its quotes
+	JSON_STREAM_STRING,			///< A string value, without its quotes and escapes left as they are
+	JSON_STREAM_PRIMITIVE		///< A number, true, false or null
+} JsonStreamEvent_t;
+
+/**
+ * @brief Callback Type of the streaming parser
+ *
+ * The text of a key or a value is only valid during the call. It is followed by its
+ * closing quote or the delimiter after it, or by a NULL when it was gathered from
+ * several chunks, so the aws_iot_json_utils.h parsers can read it with a token of
+ * start 0 and end length.
+ *
+ * @param event			What was found
+ * @param pText			Text of a key or a value, NULL for the others
+ * @param length		Length of pText
+ * @param depth			Containers around the event, 0 for the top level value
+ * @param pContextData	The data given to aws_iot_json_stream_init()
+ */
+typedef void (*fpJsonStreamCallback_t)(JsonStreamEvent_t event, const char *pText, size_t length, uint8_t depth,
+		void *pContextData);
+
+/**
+ * @brief Streaming parser, fed a document in chunks
+ *
+ * Keeps no token array and no copy of the document, only the text of a key or a
+ * value split across two chunks. The members are private to the parser.
+ */
+typedef struct {
+	fpJsonStreamCallback_t callback;		///< Called for every event
+	void *pContextData;						///< Passed back to the callback
+	uint32_t isArray;						///< Bit n set if the container at depth n is an array
+	int error;								///< First error found, a jsmnerr_t, 0 if none
+	uint16_t tokenLength;					///< Bytes of the split key or value gathered so far
+	uint8_t depth;							///< Containers open
+	uint8_t expect;							///< What may come next
+	uint8_t token;							///< Event of the key or value being read, 0xFF if none
+	uint8_t hexLeft;						///< Hex digits left of a \u escape
+	bool isEscaped;							///< A backslash ended the last chunk in a string
+	char tokenText[AWS_IOT_JSON_STREAM_TOKEN_LEN + 1];	///< The split key or value
+} JsonStreamParser_t;
+
+/**
+ * @brief Start a streaming parse
+ *
+ * Unlike aws_iot_json_tokenize(), which can resume after JSMN_ERROR_PART only on the
+ * same, longer, buffer, the streaming parser needs each byte once and forgets it. The
+ * document can be far bigger than the RAM. The grammar is checked at least as
+ * strictly as jsmn_parse() does: commas and colons have to be where JSON puts them
+ * and there is a single top level value.
+ *
+ * @param pParser		Parser to start
+ * @param callback		Called for every event
+ * @param pContextData	Passed back to the callback, could be NULL
+ */
+void aws_iot_json_stream_init(JsonStreamParser_t *pParser, fpJsonStreamCallback_t callback, void *pContextData);
+
+/**
+ * @brief Parse the next chunk of the document
+ *
+ * @param pParser	Parser started by aws_iot_json_stream_init()
+ * @param pChunk	Bytes following the previous chunk
+ * @param length	Length of pChunk
+ * @return 0, or the jsmnerr_t of the first error. JSMN_ERROR_NOMEM when a key or a
+ * value split across chunks is longer than #AWS_IOT_JSON_STREAM_TOKEN_LEN or the
+ * nesting is deeper than 32.
+ */
+int aws_iot_json_stream_feed(JsonStreamParser_t *pParser, const char *pChunk, size_t length);
+
+/**
+ * @brief End the document
+ *
+ * A number at the top level is only known to be complete here.
+ *
+ * @param pParser	Parser fed the whole document
+ * @return 0 if the document is complete, JSMN_ERROR_PART if it is not, or the first error
+ */
+int aws_iot_json_stream_finish(JsonStreamParser_t *pParser);
+
+#endif /* AWS_IOT_SDK_SRC_JSON_TOKENIZER_H_ */
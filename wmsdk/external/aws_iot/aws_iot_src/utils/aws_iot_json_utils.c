@@ -24,10 +24,9 @@
 
 #include "aws_iot_json_utils.h"
 
-#include <stdio.h>
 #include <stdint.h>
-#include <inttypes.h>
 #include <string.h>
+#include "aws_iot_json_number.h"
 #include "aws_iot_log.h"
 
 int8_t jsoneq(const char *json, jsmntok_t *tok, const char *s) {
@@ -47,7 +46,8 @@ IoT_Error_t parseUnsignedInteger32Value(uint32_t *i, const char *jsonString, jsm
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%"PRIu32, i)) {
+	if (NONE_ERROR != aws_iot_json_parse_uint32(jsonString + token->start, token->end - token->start,
+			UINT32_MAX, i)) {
 		WARN("Token was not an integer.");
 		return JSON_PARSE_ERROR;
 	}
@@ -56,30 +56,38 @@ IoT_Error_t parseUnsignedInteger32Value(uint32_t *i, const char *jsonString, jsm
 }
 
 IoT_Error_t parseUnsignedInteger16Value(uint16_t *i, const char *jsonString, jsmntok_t *token) {
+	uint32_t value;
+
 	if (token->type != JSMN_PRIMITIVE) {
 		WARN("Token was not an integer");
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%"PRIu16, i)) {
+	if (NONE_ERROR != aws_iot_json_parse_uint32(jsonString + token->start, token->end - token->start,
+			UINT16_MAX, &value)) {
 		WARN("Token was not an integer.");
 		return JSON_PARSE_ERROR;
 	}
 
+	*i = value;
 	return NONE_ERROR;
 }
 
 IoT_Error_t parseUnsignedInteger8Value(uint8_t *i, const char *jsonString, jsmntok_t *token) {
+	uint32_t value;
+
 	if (token->type != JSMN_PRIMITIVE) {
 		WARN("Token was not an integer");
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%"PRIu8, i)) {
+	if (NONE_ERROR != aws_iot_json_parse_uint32(jsonString + token->start, token->end - token->start,
+			UINT8_MAX, &value)) {
 		WARN("Token was not an integer.");
 		return JSON_PARSE_ERROR;
 	}
 
+	*i = value;
 	return NONE_ERROR;
 }
 
@@ -89,7 +97,8 @@ IoT_Error_t parseInteger32Value(int32_t *i, const char *jsonString, jsmntok_t *t
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%"PRIi32, i)) {
+	if (NONE_ERROR != aws_iot_json_parse_int32(jsonString + token->start, token->end - token->start,
+			INT32_MIN, INT32_MAX, i)) {
 		WARN("Token was not an integer.");
 		return JSON_PARSE_ERROR;
 	}
@@ -98,30 +107,38 @@ IoT_Error_t parseInteger32Value(int32_t *i, const char *jsonString, jsmntok_t *t
 }
 
 IoT_Error_t parseInteger16Value(int16_t *i, const char *jsonString, jsmntok_t *token) {
+	int32_t value;
+
 	if (token->type != JSMN_PRIMITIVE) {
 		WARN("Token was not an integer");
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%"PRIi16, i)) {
+	if (NONE_ERROR != aws_iot_json_parse_int32(jsonString + token->start, token->end - token->start,
+			INT16_MIN, INT16_MAX, &value)) {
 		WARN("Token was not an integer.");
 		return JSON_PARSE_ERROR;
 	}
 
+	*i = value;
 	return NONE_ERROR;
 }
 
 IoT_Error_t parseInteger8Value(int8_t *i, const char *jsonString, jsmntok_t *token) {
+	int32_t value;
+
 	if (token->type != JSMN_PRIMITIVE) {
 		WARN("Token was not an integer");
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%"PRIi8, i)) {
+	if (NONE_ERROR != aws_iot_json_parse_int32(jsonString + token->start, token->end - token->start,
+			INT8_MIN, INT8_MAX, &value)) {
 		WARN("Token was not an integer.");
 		return JSON_PARSE_ERROR;
 	}
 
+	*i = value;
 	return NONE_ERROR;
 }
 
@@ -131,7 +148,8 @@ IoT_Error_t parseFloatValue(float *f, const char *jsonString, jsmntok_t *token)
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%f", f)) {
+	if (NONE_ERROR != aws_iot_json_parse_float(jsonString + token->start, token->end - token->start,
+			f)) {
 		WARN("Token was not a float.");
 		return JSON_PARSE_ERROR;
 	}
@@ -145,7 +163,8 @@ IoT_Error_t parseDoubleValue(double *d, const char *jsonString, jsmntok_t *token
 		return JSON_PARSE_ERROR;
 	}
 
-	if (1 != sscanf(jsonString + token->start, "%lf", d)) {
+	if (NONE_ERROR != aws_iot_json_parse_double(jsonString + token->start, token->end - token->start,
+			d)) {
 		WARN("Token was not a double.");
 		return JSON_PARSE_ERROR;
 	}
@@ -18,7 +18,8 @@
  * @brief Utilities for manipulating JSON
  *
  * json_utils provides JSON parsing utilities for use with the IoT SDK.
- * Underlying JSON parsing relies on the Jasmine JSON parser.
+ * Underlying JSON parsing relies on the Jasmine JSON parser, numbers are read by
+ * aws_iot_json_number.h.
  *
  */
 
@@ -56,7 +57,7 @@ int8_t jsoneq(const char *json, jsmntok_t *tok, const char *s);
  * @param i				address of int32_t to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseInteger32Value(int32_t *i, const char *jsonString, jsmntok_t *token);
 
@@ -70,7 +71,7 @@ IoT_Error_t parseInteger32Value(int32_t *i, const char *jsonString, jsmntok_t *t
  * @param i				address of int16_t to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseInteger16Value(int16_t *i, const char *jsonString, jsmntok_t *token);
 
@@ -84,7 +85,7 @@ IoT_Error_t parseInteger16Value(int16_t *i, const char *jsonString, jsmntok_t *t
  * @param i				address of int8_t to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseInteger8Value(int8_t *i, const char *jsonString, jsmntok_t *token);
 
@@ -98,7 +99,7 @@ IoT_Error_t parseInteger8Value(int8_t *i, const char *jsonString, jsmntok_t *tok
  * @param i				address of uint32_t to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseUnsignedInteger32Value(uint32_t *i, const char *jsonString, jsmntok_t *token);
 
@@ -112,7 +113,7 @@ IoT_Error_t parseUnsignedInteger32Value(uint32_t *i, const char *jsonString, jsm
  * @param i				address of uint16_t to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseUnsignedInteger16Value(uint16_t *i, const char *jsonString, jsmntok_t *token);
 
@@ -126,7 +127,7 @@ IoT_Error_t parseUnsignedInteger16Value(uint16_t *i, const char *jsonString, jsm
  * @param i				address of uint8_t to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseUnsignedInteger8Value(uint8_t *i, const char *jsonString, jsmntok_t *token);
 
@@ -140,7 +141,7 @@ IoT_Error_t parseUnsignedInteger8Value(uint8_t *i, const char *jsonString, jsmnt
  * @param f				address of float to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseFloatValue(float *f, const char *jsonString, jsmntok_t *token);
 
@@ -154,7 +155,7 @@ IoT_Error_t parseFloatValue(float *f, const char *jsonString, jsmntok_t *token);
  * @param d				address of double to be updated
  *
  * @return         		NONE_ERROR - success
- * @return				JSON_PARSE_ERROR - error parsing value
+ * @return				JSON_PARSE_ERROR - error parsing value, or out of range for the type
  */
 IoT_Error_t parseDoubleValue(double *d, const char *jsonString, jsmntok_t *token);
 
@@ -17,6 +17,14 @@
 #include "MQTTClient.h"
 #include <string.h>
 
+#define INFLIGHT_FREE 0
+#define INFLIGHT_AWAIT_PUBACK 1     // QoS1, PUBLISH sent
+#define INFLIGHT_AWAIT_PUBREC 2     // QoS2, PUBLISH sent
+#define INFLIGHT_AWAIT_PUBCOMP 3    // QoS2, PUBREL sent
+
+#define MQTT_PUBLISH_PENDING 1      // positive so it can never be mistaken for a return code
+#define MQTT_MAX_REMAINING_LENGTH 268435455  // largest value the four bytes of the remaining length field encode
+
 void NewMessageData(MessageData* md, MQTTString* aTopicName, MQTTMessage* aMessgage, pApplicationHandler_t applicationHandler) {
     md->topicName = aTopicName;
     md->message = aMessgage;
@@ -24,23 +32,36 @@ void NewMessageData(MessageData* md, MQTTString* aTopicName, MQTTMessage* aMessg
 }
 
 
+int findInflight(Client* c, unsigned short packetId)
+{
+    int i;
+
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+    {
+        if (c->inflight[i].state != INFLIGHT_FREE && c->inflight[i].message.id == packetId)
+            return i;
+    }
+    return -1;
+}
+
+
 int getNextPacketId(Client *c) {
-    return c->next_packetid = (c->next_packetid == MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
+    // never hand out an id that is still waiting for its acknowledgement
+    do
+        c->next_packetid = (c->next_packetid == MAX_PACKET_ID) ? 1 : c->next_packetid + 1;
+    while (c->inflightCount > 0 && findInflight(c, c->next_packetid) >= 0);
+    return c->next_packetid;
 }
 
 
-int sendPacket(Client* c, int length, Timer* timer)
+int writeBytes(Client* c, unsigned char* buf, int length, Timer* timer)
 {
     int rc = MQTT_FAILURE, 
         sent = 0;
 
-    if(length >= c->buf_size){
-    	return MQTT_FAILURE;
-    }
-
     while (sent < length && !expired(timer))
     {
-        rc = c->ipstack->mqttwrite(c->ipstack, &c->buf[sent], length, left_ms(timer));
+        rc = c->ipstack->mqttwrite(c->ipstack, &buf[sent], length - sent, left_ms(timer));
         if (rc < 0)  // there was an error writing the data
             break;
         sent += rc;
@@ -56,6 +77,46 @@ int sendPacket(Client* c, int length, Timer* timer)
 }
 
 
+// write out the packets gathered by sendPacket
+int flushPending(Client* c, Timer* timer)
+{
+    int rc = MQTT_SUCCESS;
+
+    if (c->txLen > 0)
+    {
+        rc = writeBytes(c, c->txbuf, c->txLen, timer);
+        c->txLen = 0;
+    }
+    return rc;
+}
+
+
+// with write coalescing on, the packet is only appended to txbuf and goes out with the packets
+// that follow it within the latency budget, as a single TLS record
+int sendPacket(Client* c, int length, Timer* timer)
+{
+    int rc = MQTT_SUCCESS;
+
+    if(length >= c->buf_size){
+    	return MQTT_FAILURE;
+    }
+    if (c->txbuf == NULL)
+        return writeBytes(c, c->buf, length, timer);
+
+    if (c->txLen + length > c->txbuf_size && (rc = flushPending(c, timer)) != MQTT_SUCCESS)
+        return rc;
+    if (length > c->txbuf_size)
+        return writeBytes(c, c->buf, length, timer);
+    if (c->txLen == 0)
+        countdown_ms(&c->txFlushTimer, c->txLatency_ms);
+    memcpy(c->txbuf + c->txLen, c->buf, length);
+    c->txLen += length;
+    if (c->txLatency_ms == 0)
+        rc = flushPending(c, timer);
+    return rc;
+}
+
+
 void MQTTClient(Client* c, Network* network, unsigned int command_timeout_ms, unsigned char* buf, size_t buf_size, unsigned char* readbuf, size_t readbuf_size)
 {
     int i;
@@ -63,6 +124,7 @@ void MQTTClient(Client* c, Network* network, unsigned int command_timeout_ms, un
     
     for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
         c->messageHandlers[i].topicFilter = 0;
+    TopicTrie_init(&c->topicIndex);
     c->command_timeout_ms = command_timeout_ms;
     c->buf = buf;
     c->buf_size = buf_size;
@@ -71,11 +133,203 @@ void MQTTClient(Client* c, Network* network, unsigned int command_timeout_ms, un
     c->isconnected = 0;
     c->ping_outstanding = 0;
     c->defaultMessageHandler = NULL;
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+        c->inflight[i].state = INFLIGHT_FREE;
+    c->inflightCount = 0;
+    c->inflightWindow = MAX_INFLIGHT_PUBLISHES;
+    c->streamChunkSize = 0;
+    c->streamRemaining = 0;
+    c->rxAheadPos = c->rxAheadLen = 0;
+    c->txbuf = NULL;
+    c->txbuf_size = c->txLen = 0;
+    c->txLatency_ms = 0;
+    c->txStream = NULL;
+    c->txStreamRemaining = 0;
+    c->txStreamRc = MQTT_SUCCESS;
     InitTimer(&c->ping_timer);
+    InitTimer(&c->txFlushTimer);
+}
+
+
+void setWriteCoalescing(Client* c, unsigned char* txbuf, size_t txbuf_size, unsigned int latency_ms)
+{
+    c->txbuf = txbuf;
+    c->txbuf_size = (txbuf == NULL) ? 0 : txbuf_size;
+    c->txLen = 0;
+    c->txLatency_ms = latency_ms;
+}
+
+
+int MQTTFlush(Client* c)
+{
+    Timer timer;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, c->command_timeout_ms);
+    return flushPending(c, &timer);
+}
+
+
+void setStreamChunkSize(Client* c, size_t chunkSize)
+{
+    c->streamChunkSize = chunkSize;
+}
+
+
+void setInflightWindow(Client* c, unsigned int window)
+{
+    if (window == 0)
+        window = 1;
+    else if (window > MAX_INFLIGHT_PUBLISHES)
+        window = MAX_INFLIGHT_PUBLISHES;
+    c->inflightWindow = window;
+}
+
+
+void completeInflight(Client* c, int index, int rc)
+{
+    publishCompleteHandler fp = c->inflight[index].fp;
+    void* context = c->inflight[index].context;
+    unsigned short packetId = c->inflight[index].message.id;
+
+    // free the slot first so the handler is able to publish again
+    c->inflight[index].state = INFLIGHT_FREE;
+    c->inflightCount--;
+    if (fp != NULL)
+        fp(packetId, rc, context);
+}
+
+
+void MQTTAbortInflight(Client* c)
+{
+    int i;
+
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+    {
+        if (c->inflight[i].state != INFLIGHT_FREE)
+            completeInflight(c, i, MQTT_FAILURE);
+    }
+}
+
+
+int sendPublish(Client* c, const char* topicName, MQTTMessage* message, Timer* timer)
+{
+    MQTTString topic = MQTTString_initializer;
+    topic.cstring = (char *)topicName;
+    int len = 0;
+
+    len = MQTTSerialize_publish(c->buf, c->buf_size, message->dup, message->qos, message->retained, message->id,
+              topic, (unsigned char*)message->payload, message->payloadlen);
+    if (len <= 0)
+        return MQTT_FAILURE;
+    return sendPacket(c, len, timer);
+}
+
+
+// returns the in-flight slot the message went into, or a negative return code
+int addInflight(Client* c, const char* topicName, MQTTMessage* message, publishCompleteHandler fp, void* context, Timer* timer)
+{
+    int rc = MQTT_INFLIGHT_WINDOW_FULL;
+    int i;
+
+    if (c->inflightCount >= c->inflightWindow)
+        goto exit;
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+    {
+        if (c->inflight[i].state == INFLIGHT_FREE)
+            break;
+    }
+    if (i == MAX_INFLIGHT_PUBLISHES)
+        goto exit;
+
+    message->id = getNextPacketId(c);
+    message->dup = 0;
+    if ((rc = sendPublish(c, topicName, message, timer)) != MQTT_SUCCESS)
+        goto exit;
+
+    c->inflight[i].state = (message->qos == QOS1) ? INFLIGHT_AWAIT_PUBACK : INFLIGHT_AWAIT_PUBREC;
+    c->inflight[i].topicName = topicName;
+    c->inflight[i].message = *message;
+    c->inflight[i].fp = fp;
+    c->inflight[i].context = context;
+    c->inflightCount++;
+    rc = i;
+exit:
+    return rc;
+}
+
+
+// on a resumed session everything not yet acknowledged is sent again, publishes with the DUP flag set
+int resendInflight(Client* c)
+{
+    int rc = MQTT_SUCCESS;
+    Timer timer;
+    int len = 0;
+    int i;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, c->command_timeout_ms);
+
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES && rc == MQTT_SUCCESS; ++i)
+    {
+        if (c->inflight[i].state == INFLIGHT_AWAIT_PUBCOMP)
+        {
+            if ((len = MQTTSerialize_ack(c->buf, c->buf_size, PUBREL, 0, c->inflight[i].message.id)) <= 0)
+                rc = MQTT_FAILURE;
+            else
+                rc = sendPacket(c, len, &timer);
+        }
+        else if (c->inflight[i].state != INFLIGHT_FREE)
+        {
+            c->inflight[i].message.dup = 1;
+            rc = sendPublish(c, c->inflight[i].topicName, &c->inflight[i].message, &timer);
+        }
+    }
+    return rc;
+}
+
+
+// read len bytes, taking them from rxAhead first. An empty rxAhead is refilled with whatever the
+// network has ready, so the header, remaining length and body of a packet, and often the next
+// packets too, cost a single network read instead of one per field
+int bufferedRead(Client* c, unsigned char* buf, int len, Timer* timer)
+{
+    int done = 0;
+    int rc = 0;
+
+    if (c->ipstack->mqttreadsome == NULL)
+        return c->ipstack->mqttread(c->ipstack, buf, len, left_ms(timer));
+
+    while (done < len)
+    {
+        int n = len - done;
+
+        if (c->rxAheadLen == 0)
+        {
+            if (n >= MQTT_RX_AHEAD_SIZE)
+            {   // nothing to gain from copying a big read through rxAhead
+                if ((rc = c->ipstack->mqttreadsome(c->ipstack, buf + done, n, left_ms(timer))) <= 0)
+                    break;
+                done += rc;
+                continue;
+            }
+            if ((rc = c->ipstack->mqttreadsome(c->ipstack, c->rxAhead, MQTT_RX_AHEAD_SIZE, left_ms(timer))) <= 0)
+                break;
+            c->rxAheadPos = 0;
+            c->rxAheadLen = rc;
+        }
+        if (n > (int)c->rxAheadLen)
+            n = c->rxAheadLen;
+        memcpy(buf + done, c->rxAhead + c->rxAheadPos, n);
+        c->rxAheadPos += n;
+        c->rxAheadLen -= n;
+        done += n;
+    }
+    return (done > 0) ? done : rc;
 }
 
 
-int decodePacket(Client* c, int* value, int timeout)
+int decodePacket(Client* c, int* value, Timer* timer)
 {
     unsigned char i;
     int multiplier = 1;
@@ -92,7 +346,7 @@ int decodePacket(Client* c, int* value, int timeout)
             rc = MQTTPACKET_READ_ERROR; /* bad data */
             goto exit;
         }
-        rc = c->ipstack->mqttread(c->ipstack, &i, 1, timeout);
+        rc = bufferedRead(c, &i, 1, timer);
         if (rc != 1)
             goto exit;
         *value += (i & 127) * multiplier;
@@ -103,6 +357,68 @@ exit:
 }
 
 
+// read and throw away the rest of a packet that cannot be handled, so the next packet is framed correctly
+int drainPacket(Client* c, int remaining, Timer* timer)
+{
+    int rc = MQTT_SUCCESS;
+
+    while (remaining > 0)
+    {
+        int chunk = (remaining < c->readbuf_size) ? remaining : c->readbuf_size;
+        if (bufferedRead(c, c->readbuf, chunk, timer) != chunk)
+        {
+            rc = MQTT_FAILURE;
+            break;
+        }
+        remaining -= chunk;
+    }
+    return rc;
+}
+
+
+// read only the variable header of a PUBLISH too big for readbuf, the payload is left in the network to be streamed
+int readPublishHeader(Client* c, int len, int rem_len, Timer* timer)
+{
+    int rc = MQTT_FAILURE;
+    MQTTHeader header = {0};
+    int topic_len = 0;
+    int header_len = 2;
+    int length_bytes = len - 1;
+    int i;
+
+    header.byte = c->readbuf[0];
+    if (len + header_len > c->readbuf_size ||
+            bufferedRead(c, c->readbuf + len, header_len, timer) != header_len)
+        goto exit;
+    topic_len = 256 * c->readbuf[len] + c->readbuf[len + 1];
+    len += header_len;
+    rem_len -= header_len;
+
+    header_len = topic_len + ((header.bits.qos > 0) ? 2 : 0);    /* topic name and packet id */
+    // the payload is streamed through what is left of readbuf after the header, at least a byte of it
+    if (header_len > rem_len || len + header_len >= c->readbuf_size)
+        goto exit;
+    if (bufferedRead(c, c->readbuf + len, header_len, timer) != header_len)
+        goto exit;
+    rem_len -= header_len;
+    c->streamRemaining = rem_len;
+
+    // the payload stays in the network, so the buffered packet has to end where its header does
+    // for the deserializer to take it. The remaining length keeps its size, padded with continuation bits
+    header_len += 2;
+    for (i = 1; i <= length_bytes; ++i)
+    {
+        c->readbuf[i] = (header_len % 128) | ((i < length_bytes) ? 128 : 0);
+        header_len /= 128;
+    }
+    rc = MQTT_SUCCESS;
+exit:
+    if (rc != MQTT_SUCCESS)
+        drainPacket(c, rem_len, timer);
+    return rc;
+}
+
+
 int readPacket(Client* c, Timer* timer) 
 {
     int rc = MQTT_FAILURE;
@@ -111,23 +427,29 @@ int readPacket(Client* c, Timer* timer)
     int rem_len = 0;
 
     /* 1. read the header byte.  This has the packet type in it */
-    if (c->ipstack->mqttread(c->ipstack, c->readbuf, 1, left_ms(timer)) != 1)
+    if (bufferedRead(c, c->readbuf, 1, timer) != 1)
         goto exit;
     len = 1;
     /* 2. read the remaining length.  This is variable in itself */
-    decodePacket(c, &rem_len, left_ms(timer));
+    decodePacket(c, &rem_len, timer);
+    len += MQTTPacket_encode(c->readbuf + 1, rem_len); /* put the original remaining length back into the buffer */
+    header.byte = c->readbuf[0];
 
-    // if the buffer is too big then the message will be dropped silently
-    if(rem_len >= c->readbuf_size){
-    	goto exit;
+    if (len + rem_len > c->readbuf_size)
+    {
+        // a PUBLISH can still be handed to the message handler in chunks, anything else is dropped
+        if (header.bits.type == PUBLISH && c->streamChunkSize > 0 &&
+                readPublishHeader(c, len, rem_len, timer) == MQTT_SUCCESS)
+            rc = PUBLISH;
+        else
+            drainPacket(c, rem_len, timer);
+        goto exit;
     }
-    len += MQTTPacket_encode(c->readbuf + 1, rem_len); /* put the original remaining length back into the buffer */
 
     /* 3. read the rest of the buffer using a callback to supply the rest of the data */
-    if (rem_len > 0 && (c->ipstack->mqttread(c->ipstack, c->readbuf + len, rem_len, left_ms(timer)) != rem_len))
+    if (rem_len > 0 && (bufferedRead(c, c->readbuf + len, rem_len, timer) != rem_len))
         goto exit;
 
-    header.byte = c->readbuf[0];
     rc = header.bits.type;
 exit:
     return rc;
@@ -165,35 +487,94 @@ char isTopicMatched(char* topicFilter, MQTTString* topicName)
 }
 
 
-int deliverMessage(Client* c, MQTTString* topicName, MQTTMessage* message)
+struct HandlerMatch
 {
-    int i;
-    int rc = MQTT_FAILURE;
+    Client* c;
+    MQTTString* topicName;
+    MQTTMessage* message;
+    int rc;
+};
 
-    // we have to find the right message handler - indexed by topic
-    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+
+// topicIndex visitor, the trie only compares level hashes so the filter itself is checked here
+void deliverToHandler(int i, void* context)
+{
+    struct HandlerMatch* match = (struct HandlerMatch*)context;
+    Client* c = match->c;
+
+    if (c->messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(match->topicName, (char*)c->messageHandlers[i].topicFilter) ||
+            isTopicMatched((char*)c->messageHandlers[i].topicFilter, match->topicName)))
     {
-        if (c->messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(topicName, (char*)c->messageHandlers[i].topicFilter) ||
-                isTopicMatched((char*)c->messageHandlers[i].topicFilter, topicName)))
+        if (c->messageHandlers[i].fp != NULL)
         {
-            if (c->messageHandlers[i].fp != NULL)
-            {
-                MessageData md;
-                NewMessageData(&md, topicName, message, c->messageHandlers[i].applicationHandler);
-                c->messageHandlers[i].fp(&md);
-                rc = MQTT_SUCCESS;
-            }
+            MessageData md;
+            NewMessageData(&md, match->topicName, match->message, c->messageHandlers[i].applicationHandler);
+            c->messageHandlers[i].fp(&md);
+            match->rc = MQTT_SUCCESS;
         }
     }
+}
+
+
+int deliverMessage(Client* c, MQTTString* topicName, MQTTMessage* message)
+{
+    struct HandlerMatch match = {c, topicName, message, MQTT_FAILURE};
+
+    // we have to find the right message handler - indexed by topic
+    TopicTrie_match(&c->topicIndex, topicName, deliverToHandler, &match);
     
-    if (rc == MQTT_FAILURE && c->defaultMessageHandler != NULL) 
+    if (match.rc == MQTT_FAILURE && c->defaultMessageHandler != NULL) 
     {
         MessageData md;
         NewMessageData(&md, topicName, message, NULL);
         c->defaultMessageHandler(&md);
-        rc = MQTT_SUCCESS;
+        match.rc = MQTT_SUCCESS;
     }   
     
+    return match.rc;
+}
+
+
+// deliver the payload left in the network by readPublishHeader, one chunk at a time through the tail of readbuf
+int deliverStreamedMessage(Client* c, MQTTString* topicName, MQTTMessage* message)
+{
+    int rc = MQTT_SUCCESS;
+    unsigned char* chunk = (unsigned char*)message->payload;
+    size_t room = c->readbuf + c->readbuf_size - chunk;
+    Timer timer;
+
+    if (room > c->streamChunkSize)
+        room = c->streamChunkSize;
+
+    message->totallen = c->streamRemaining;
+    if (room == 0)
+    {   // no room for a chunk, the payload is dropped so the next packet is framed correctly
+        InitTimer(&timer);
+        countdown_ms(&timer, c->command_timeout_ms);
+        drainPacket(c, c->streamRemaining, &timer);
+        c->streamRemaining = 0;
+        return MQTT_FAILURE;
+    }
+    message->offset = 0;
+    while (message->offset < message->totallen)
+    {
+        size_t n = message->totallen - message->offset;
+        if (n > room)
+            n = room;
+
+        // every chunk gets a full command timeout, a big payload may take far longer than the yield timer
+        InitTimer(&timer);
+        countdown_ms(&timer, c->command_timeout_ms);
+        if (bufferedRead(c, chunk, n, &timer) != n)
+        {
+            rc = MQTT_FAILURE;
+            break;
+        }
+        message->payloadlen = n;
+        deliverMessage(c, topicName, message);
+        message->offset += n;
+    }
+    c->streamRemaining = 0;
     return rc;
 }
 
@@ -257,9 +638,20 @@ int cycle(Client* c, Timer* timer)
     switch (packet_type)
     {
         case CONNACK:
-        case PUBACK:
         case SUBACK:
             break;
+        case PUBACK:
+        case PUBCOMP:
+        {
+            unsigned short mypacketid;
+            unsigned char dup, type;
+            int i;
+            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) == 1 &&
+                    (i = findInflight(c, mypacketid)) >= 0 &&
+                    c->inflight[i].state == ((packet_type == PUBACK) ? INFLIGHT_AWAIT_PUBACK : INFLIGHT_AWAIT_PUBCOMP))
+                completeInflight(c, i, MQTT_SUCCESS);
+            break;
+        }
         case PUBLISH:
         {
             MQTTString topicName;
@@ -267,7 +659,17 @@ int cycle(Client* c, Timer* timer)
             if (MQTTDeserialize_publish((unsigned char*)&msg.dup, (int*)&msg.qos, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
                (unsigned char**)&msg.payload, (int*)&msg.payloadlen, c->readbuf, c->readbuf_size) != 1)
                 goto exit;
-            deliverMessage(c, &topicName, &msg);
+            if (c->streamRemaining > 0)
+            {
+                if ((rc = deliverStreamedMessage(c, &topicName, &msg)) != MQTT_SUCCESS)
+                    goto exit;
+            }
+            else
+            {
+                msg.offset = 0;
+                msg.totallen = msg.payloadlen;
+                deliverMessage(c, &topicName, &msg);
+            }
             if (msg.qos != QOS0)
             {
                 if (msg.qos == QOS1)
@@ -295,15 +697,24 @@ int cycle(Client* c, Timer* timer)
                 rc = MQTT_FAILURE; // there was a problem
             if (rc == MQTT_FAILURE)
                 goto exit; // there was a problem
+            else
+            {
+                int i = findInflight(c, mypacketid);
+                if (i >= 0 && c->inflight[i].state == INFLIGHT_AWAIT_PUBREC)
+                    c->inflight[i].state = INFLIGHT_AWAIT_PUBCOMP;
+            }
             break;
         }
-        case PUBCOMP:
-            break;
         case PINGRESP:
 			c->ping_outstanding = 0;
 			countdown(&c->ping_timer, c->keepAliveInterval);
             break;
     }
+    if (c->txLen > 0 && expired(&c->txFlushTimer) && flushPending(c, timer) != MQTT_SUCCESS)
+    {
+        rc = MQTT_FAILURE;
+        goto exit;
+    }
     rc = keepalive(c);
 exit:
     if (rc == MQTT_SUCCESS)
@@ -312,6 +723,49 @@ exit:
 }
 
 
+// sleep in the network until a packet arrives or the keepalive is due, whichever comes first, instead
+// of waking up on every read timeout. Returns once the packets that woke it up are handled
+int yieldOnEvents(Client* c, Timer* timer)
+{
+    int rc = MQTT_SUCCESS;
+
+    while (!expired(timer) && c->isconnected)
+    {
+        int wait_ms = left_ms(timer);
+        int ready = 0;
+
+        if (c->rxAheadLen == 0 && c->streamRemaining == 0)
+        {
+            if (c->keepAliveInterval > 0 && left_ms(&c->ping_timer) < wait_ms)
+                wait_ms = left_ms(&c->ping_timer);
+            if (c->txLen > 0 && left_ms(&c->txFlushTimer) < wait_ms)
+                wait_ms = left_ms(&c->txFlushTimer);
+            if ((ready = c->ipstack->mqttwait(c->ipstack, (wait_ms > 0) ? wait_ms : 0)) < 0)
+            {
+                rc = MQTT_FAILURE;
+                break;
+            }
+            if (ready == 0)
+            {   // nothing arrived, the keepalive or the coalesced writes may be due though
+                if (c->txLen > 0 && expired(&c->txFlushTimer) && (rc = flushPending(c, timer)) != MQTT_SUCCESS)
+                    break;
+                if ((rc = keepalive(c)) != MQTT_SUCCESS)
+                    break;
+                continue;
+            }
+        }
+        if (cycle(c, timer) == MQTT_FAILURE)
+        {
+            rc = MQTT_FAILURE;
+            break;
+        }
+        if (c->rxAheadLen == 0 && c->streamRemaining == 0 && c->ipstack->mqttwait(c->ipstack, 0) == 0)
+            break;      // all caught up
+    }
+    return rc;
+}
+
+
 int MQTTYield(Client* c, int timeout_ms)
 {
     int rc = MQTT_SUCCESS;
@@ -323,6 +777,11 @@ int MQTTYield(Client* c, int timeout_ms)
 
     InitTimer(&timer);    
     countdown_ms(&timer, timeout_ms);
+    if (c->ipstack->mqttwait != NULL)
+        return yieldOnEvents(c, &timer);
+    // the reads below block for the whole timeout, anything gathered so far cannot wait for them
+    if (flushPending(c, &timer) != MQTT_SUCCESS)
+        return MQTT_FAILURE;
     while (!expired(&timer))
     {
         if (cycle(c, &timer) == MQTT_FAILURE)
@@ -340,6 +799,8 @@ int waitfor(Client* c, int packet_type, Timer* timer)
 {
     int rc = MQTT_FAILURE;
     
+    if (flushPending(c, timer) != MQTT_SUCCESS)
+        return rc;      // the request never made it out
     do
     {
         if (expired(timer))
@@ -350,12 +811,54 @@ int waitfor(Client* c, int packet_type, Timer* timer)
 }
 
 
+// subscribe again to the filters of every registered handler, a few per SUBSCRIBE packet
+int resubscribeAll(Client* c, Timer* timer)
+{
+    int rc = MQTT_SUCCESS;
+    int i = 0;
+
+    while (i < MAX_MESSAGE_HANDLERS && rc == MQTT_SUCCESS)
+    {
+        MQTTString topics[MAX_SUBSCRIBE_FILTERS];
+        int qoss[MAX_SUBSCRIBE_FILTERS];
+        int granted[MAX_SUBSCRIBE_FILTERS];
+        int count = 0, grantedCount = 0, len = 0;
+        unsigned short packetId, mypacketid;
+
+        for (; i < MAX_MESSAGE_HANDLERS && count < MAX_SUBSCRIBE_FILTERS; ++i)
+        {
+            if (c->messageHandlers[i].topicFilter == 0)
+                continue;
+            topics[count].cstring = (char *)c->messageHandlers[i].topicFilter;
+            topics[count].lenstring.len = 0;
+            topics[count].lenstring.data = NULL;
+            qoss[count++] = c->messageHandlers[i].qos;
+        }
+        if (count == 0)
+            break;
+
+        packetId = getNextPacketId(c);
+        if ((len = MQTTSerialize_subscribe(c->buf, c->buf_size, 0, packetId, count, topics, qoss)) <= 0)
+            rc = MQTT_FAILURE;
+        else if ((rc = sendPacket(c, len, timer)) != MQTT_SUCCESS)
+            break;
+        else if (waitfor(c, SUBACK, timer) != SUBACK ||
+                MQTTDeserialize_suback(&mypacketid, count, &grantedCount, granted, c->readbuf, c->readbuf_size) != 1 ||
+                mypacketid != packetId)
+            rc = MQTT_FAILURE;
+        // a filter refused now keeps its handler, it was granted when it was first subscribed
+    }
+    return rc;
+}
+
+
 int MQTTConnect(Client* c, MQTTPacket_connectData* options)
 {
     Timer connect_timer;
     int rc = MQTT_FAILURE;
     MQTTPacket_connectData default_options = MQTTPacket_connectData_initializer;
     int len = 0;
+    unsigned char sessionPresent = 0;
 
     InitTimer(&connect_timer);
     countdown_ms(&connect_timer, c->command_timeout_ms);
@@ -370,6 +873,9 @@ int MQTTConnect(Client* c, MQTTPacket_connectData* options)
     
     c->keepAliveInterval = options->keepAliveInterval;
     countdown(&c->ping_timer, c->keepAliveInterval);
+    c->rxAheadPos = c->rxAheadLen = 0;     // anything left over belongs to the previous connection
+    c->streamRemaining = 0;
+    c->txLen = 0;
     if ((len = MQTTSerialize_connect(c->buf, c->buf_size, options)) <= 0) {
         goto exit;
     }
@@ -380,8 +886,7 @@ int MQTTConnect(Client* c, MQTTPacket_connectData* options)
     if (waitfor(c, CONNACK, &connect_timer) == CONNACK)
     {
         unsigned char connack_rc = 255;
-        char sessionPresent = 0;
-        if (MQTTDeserialize_connack((unsigned char*)&sessionPresent, &connack_rc, c->readbuf, c->readbuf_size) == 1) {
+        if (MQTTDeserialize_connack(&sessionPresent, &connack_rc, c->readbuf, c->readbuf_size) == 1) {
             rc = connack_rc;
         } else {
             rc = MQTT_FAILURE;
@@ -390,6 +895,19 @@ int MQTTConnect(Client* c, MQTTPacket_connectData* options)
     else {
         rc = MQTT_FAILURE;
     }
+
+    if (rc == MQTT_SUCCESS) {
+        if (options->cleansession) {
+            // the broker dropped the session, nothing outstanding can be completed any more
+            MQTTAbortInflight(c);
+        } else {
+            // the broker may have lost the session all the same, the handlers are still registered here
+            if (!sessionPresent)
+                rc = resubscribeAll(c, &connect_timer);
+            if (rc == MQTT_SUCCESS)
+                resendInflight(c);
+        }
+    }
 exit:
     if (rc == MQTT_SUCCESS) {
         c->isconnected = 1;
@@ -398,59 +916,115 @@ exit:
 }
 
 
-int MQTTSubscribe(Client* c, const char* topicFilter, enum QoS qos, messageHandler messageHandler, pApplicationHandler_t applicationHandler)
+int findMessageHandler(Client* c, const char* topicFilter, messageHandler fp, pApplicationHandler_t applicationHandler)
+{
+    int i;
+
+    for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
+    {
+        if (c->messageHandlers[i].topicFilter != 0 && strcmp(c->messageHandlers[i].topicFilter, topicFilter) == 0 &&
+                c->messageHandlers[i].fp == fp && c->messageHandlers[i].applicationHandler == applicationHandler)
+            return i;
+    }
+    return -1;
+}
+
+
+int MQTTSubscribeMany(Client* c, int count, const char* topicFilters[], enum QoS qoss[], messageHandler fps[],
+        pApplicationHandler_t applicationHandlers[], int grantedQoSs[])
 { 
     int rc = MQTT_FAILURE;  
     Timer timer;
     int len = 0;
-    int indexOfFreemessageHandler;
-
-    MQTTString topic = MQTTString_initializer;
-    topic.cstring = (char *)topicFilter;
-    unsigned char isMessageHandlerFree = 0;
+    int i, handler = 0, claimed = 0;
+    int handlerIndexes[MAX_SUBSCRIBE_FILTERS];
+    char isNew[MAX_SUBSCRIBE_FILTERS];
+    MQTTString topics[MAX_SUBSCRIBE_FILTERS];
+    unsigned short packetId;
     
     InitTimer(&timer);
     countdown_ms(&timer, c->command_timeout_ms);
 
-    if (!c->isconnected)
-        goto exit;
-    
-    len = MQTTSerialize_subscribe(c->buf, c->buf_size, 0, getNextPacketId(c), 1, &topic, (int*)&qos);
-    if (len <= 0)
+    if (!c->isconnected || count <= 0 || count > MAX_SUBSCRIBE_FILTERS)
         goto exit;
 
-    for (indexOfFreemessageHandler = 0; indexOfFreemessageHandler < MAX_MESSAGE_HANDLERS; ++indexOfFreemessageHandler){
-    	if (c->messageHandlers[indexOfFreemessageHandler].topicFilter == 0){
-    		isMessageHandlerFree = 1;
-    		break;
-    	}
-    }
-    if(isMessageHandlerFree == 0){
-    	goto exit;
+    // claim a handler slot and index every filter up front, nothing is registered unless all of them fit.
+    // Subscribing again with the same filter and handlers, as after a reconnect, reuses the slot it has
+    for (claimed = 0; claimed < count; ++claimed)
+    {
+        int existing = findMessageHandler(c, topicFilters[claimed], fps[claimed], applicationHandlers[claimed]);
+
+        isNew[claimed] = (existing < 0);
+        if (!isNew[claimed])
+            handlerIndexes[claimed] = existing;
+        else
+        {
+            while (handler < MAX_MESSAGE_HANDLERS && (c->messageHandlers[handler].topicFilter != 0 ||
+                    c->topicIndex.entryNode[handler] != TOPIC_TRIE_NONE))
+                ++handler;
+            if (handler == MAX_MESSAGE_HANDLERS ||
+                    TopicTrie_add(&c->topicIndex, topicFilters[claimed], handler) != 0)
+                goto exit;         // out of handler slots or trie nodes
+            handlerIndexes[claimed] = handler;
+        }
+        topics[claimed].cstring = (char *)topicFilters[claimed];
+        topics[claimed].lenstring.len = 0;
+        topics[claimed].lenstring.data = NULL;
+        grantedQoSs[claimed] = 0x80;
     }
+
+    packetId = getNextPacketId(c);
+    len = MQTTSerialize_subscribe(c->buf, c->buf_size, 0, packetId, count, topics, (int*)qoss);
+    if (len <= 0)
+        goto exit;
     if ((rc = sendPacket(c, len, &timer)) != MQTT_SUCCESS) // send the subscribe packet
         goto exit;             // there was a problem
     
+    rc = MQTT_FAILURE;
     if (waitfor(c, SUBACK, &timer) == SUBACK)      // wait for suback 
     {
-        int count = 0, grantedQoS = -1;
+        int grantedCount = 0;
         unsigned short mypacketid;
-        if (MQTTDeserialize_suback(&mypacketid, 1, &count, &grantedQoS, c->readbuf, c->readbuf_size) == 1)
-            rc = grantedQoS; // 0, 1, 2 or 0x80 
-        if (rc != 0x80)
+        if (MQTTDeserialize_suback(&mypacketid, count, &grantedCount, grantedQoSs, c->readbuf, c->readbuf_size) == 1 &&
+                mypacketid == packetId && grantedCount == count)
+            rc = MQTT_SUCCESS;
+    }
+    if (rc != MQTT_SUCCESS)
+        goto exit;
+
+    for (i = 0; i < count; ++i)
+    {
+        grantedQoSs[i] = (unsigned char)grantedQoSs[i];    // the deserializer sign extends the 0x80 failure code
+        if (grantedQoSs[i] == 0x80)     // refused by the server, give the slot back
         {
-			c->messageHandlers[indexOfFreemessageHandler].topicFilter =
-					topicFilter;
-			c->messageHandlers[indexOfFreemessageHandler].fp = messageHandler;
-			c->messageHandlers[indexOfFreemessageHandler].applicationHandler =
-					applicationHandler;
-			rc = 0;
+            c->messageHandlers[handlerIndexes[i]].topicFilter = 0;
+            TopicTrie_remove(&c->topicIndex, handlerIndexes[i]);
+            continue;
         }
+        c->messageHandlers[handlerIndexes[i]].topicFilter = topicFilters[i];
+        c->messageHandlers[handlerIndexes[i]].qos = qoss[i];
+        c->messageHandlers[handlerIndexes[i]].fp = fps[i];
+        c->messageHandlers[handlerIndexes[i]].applicationHandler = applicationHandlers[i];
     }
-    else 
-        rc = MQTT_FAILURE;
+    claimed = 0;
         
 exit:
+    while (claimed > 0)
+    {
+        if (isNew[--claimed])
+            TopicTrie_remove(&c->topicIndex, handlerIndexes[claimed]);
+    }
+    return rc;
+}
+
+
+int MQTTSubscribe(Client* c, const char* topicFilter, enum QoS qos, messageHandler messageHandler, pApplicationHandler_t applicationHandler)
+{
+    int grantedQoS = 0x80;
+    int rc = MQTTSubscribeMany(c, 1, &topicFilter, &qos, &messageHandler, &applicationHandler, &grantedQoS);
+
+    if (rc == MQTT_SUCCESS && grantedQoS == 0x80)
+        rc = grantedQoS;
     return rc;
 }
 
@@ -481,6 +1055,7 @@ int MQTTUnsubscribe(Client* c, const char* topicFilter)
         	 for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i){
         	        if (c->messageHandlers[i].topicFilter != 0 && (strcmp(c->messageHandlers[i].topicFilter, topicFilter)==0)){
         	        	c->messageHandlers[i].topicFilter = 0;
+        	        	TopicTrie_remove(&c->topicIndex, i);
         	        	// We dont want to break here, if the same topic is registered with 2 callbacks. Unlikeley scenario.
         	        }
         	 }
@@ -495,60 +1070,121 @@ exit:
 }
 
 
-int MQTTPublish(Client* c, const char* topicName, MQTTMessage* message)
+int MQTTPublishAsync(Client* c, const char* topicName, MQTTMessage* message, publishCompleteHandler fp, void* context)
 {
     int rc = MQTT_FAILURE;
-    Timer timer;   
-    MQTTString topic = MQTTString_initializer;
-    topic.cstring = (char *)topicName;
-    int len = 0;
+    Timer timer;
 
     InitTimer(&timer);
     countdown_ms(&timer, c->command_timeout_ms);
-    
+
     if (!c->isconnected)
         goto exit;
 
-    if (message->qos == QOS1 || message->qos == QOS2)
-        message->id = getNextPacketId(c);
-
-    len = MQTTSerialize_publish(c->buf, c->buf_size, 0, message->qos, message->retained, message->id, 
-              topic, (unsigned char*)message->payload, message->payloadlen);
-    if (len <= 0) {
+    if (message->qos == QOS0)
+    {
+        // nothing to wait for, complete right away
+        if ((rc = sendPublish(c, topicName, message, &timer)) == MQTT_SUCCESS && fp != NULL)
+            fp(message->id, MQTT_SUCCESS, context);
         goto exit;
     }
-    if ((rc = sendPacket(c, len, &timer)) != MQTT_SUCCESS) { // send the subscribe packet
-        goto exit; // there was a problem
+
+    if ((rc = addInflight(c, topicName, message, fp, context, &timer)) >= 0)
+        rc = MQTT_SUCCESS;
+
+exit:
+    return rc;
+}
+
+
+// put back in flight a publish kept across a restart, with the packet id it was first sent with.
+// It goes out with the DUP flag set right away if connected, otherwise by MQTTConnect on a resumed session
+int MQTTResumePublish(Client* c, const char* topicName, MQTTMessage* message, publishCompleteHandler fp, void* context)
+{
+    int rc = MQTT_FAILURE;
+    Timer timer;
+    int i;
+
+    if (message->qos == QOS0 || message->id == 0 || findInflight(c, message->id) >= 0)
+        goto exit;
+    rc = MQTT_INFLIGHT_WINDOW_FULL;
+    for (i = 0; i < MAX_INFLIGHT_PUBLISHES; ++i)
+    {
+        if (c->inflight[i].state == INFLIGHT_FREE)
+            break;
     }
+    if (i == MAX_INFLIGHT_PUBLISHES)
+        goto exit;
 
+    message->dup = 1;
+    c->inflight[i].state = (message->qos == QOS1) ? INFLIGHT_AWAIT_PUBACK : INFLIGHT_AWAIT_PUBREC;
+    c->inflight[i].topicName = topicName;
+    c->inflight[i].message = *message;
+    c->inflight[i].fp = fp;
+    c->inflight[i].context = context;
+    c->inflightCount++;
     rc = MQTT_SUCCESS;
-    if (message->qos == QOS1)
+
+    if (c->isconnected)
     {
-        if (waitfor(c, PUBACK, &timer) == PUBACK)
-        {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1) {
-                rc = MQTT_FAILURE;
-    	    }
-        }
-        else {
-            rc = MQTT_FAILURE;
-    	}
+        InitTimer(&timer);
+        countdown_ms(&timer, c->command_timeout_ms);
+        sendPublish(c, topicName, message, &timer);     // still in flight if this fails, resent on reconnect
+    }
+exit:
+    return rc;
+}
+
+
+void syncPublishComplete(unsigned short packetId, int rc, void* context)
+{
+    *(int*)context = rc;
+}
+
+
+int MQTTPublish(Client* c, const char* topicName, MQTTMessage* message)
+{
+    int rc = MQTT_FAILURE;
+    Timer timer;
+    int i;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, c->command_timeout_ms);
+    
+    if (!c->isconnected)
+        goto exit;
+
+    if (message->qos == QOS0)
+    {
+        rc = sendPublish(c, topicName, message, &timer);
+        goto exit;
+    }
+
+    // a blocking publish is an in-flight entry whose completion handler we wait for
+    if ((i = addInflight(c, topicName, message, syncPublishComplete, &rc, &timer)) < 0)
+    {
+        rc = i;
+        goto exit;
     }
-    else if (message->qos == QOS2)
+
+    // the PUBACK is waited for, the packet cannot wait in txbuf for others to join it
+    rc = MQTT_PUBLISH_PENDING;
+    while (rc == MQTT_PUBLISH_PENDING)
     {
-        if (waitfor(c, PUBCOMP, &timer) == PUBCOMP)
+        if (expired(&timer) || flushPending(c, &timer) != MQTT_SUCCESS || cycle(c, &timer) == MQTT_FAILURE ||
+                !c->isconnected)
         {
-            unsigned short mypacketid;
-            unsigned char dup, type;
-            if (MQTTDeserialize_ack(&type, &dup, &mypacketid, c->readbuf, c->readbuf_size) != 1) {
-                rc = MQTT_FAILURE;
-    	    }
-        }
-        else {
+            if (rc != MQTT_PUBLISH_PENDING)
+                break;      // acknowledged by the cycle that failed afterwards
+            // drop the entry, a late acknowledgement has nobody to report to
+            if (c->inflight[i].state != INFLIGHT_FREE && c->inflight[i].context == &rc)
+            {
+                c->inflight[i].state = INFLIGHT_FREE;
+                c->inflightCount--;
+            }
             rc = MQTT_FAILURE;
-    	}
+            break;
+        }
     }
     
 exit:
@@ -556,6 +1192,111 @@ exit:
 }
 
 
+// a packet cut short leaves the broker reading the next packets as its payload, the connection is
+// closed rather than carrying on out of step, with no DISCONNECT the broker would take as payload too
+void dropConnection(Client* c)
+{
+    c->txLen = 0;
+    c->isconnected = 0;
+    c->ipstack->disconnect(c->ipstack);
+    if (c->disconnectHandler != NULL)
+        c->disconnectHandler();
+}
+
+
+// QoS 0 only, a QoS 1 or 2 message would have to be sent again and there is no copy of the payload
+int MQTTPublishStream(Client* c, const char* topicName, MQTTMessage* message, publishPayloadWriter fp, void* context)
+{
+    int rc = MQTT_FAILURE;
+    Timer timer;
+    MQTTHeader header = {0};
+    MQTTString topic = MQTTString_initializer;
+    unsigned char* ptr = c->buf;
+    size_t rem_len;
+
+    InitTimer(&timer);
+    countdown_ms(&timer, c->command_timeout_ms);
+
+    if (!c->isconnected || message->qos != QOS0 || fp == NULL || c->txStream != NULL)
+        goto exit;
+
+    topic.cstring = (char*)topicName;
+    rem_len = 2 + MQTTstrlen(topic);
+    if (message->payloadlen > MQTT_MAX_REMAINING_LENGTH - rem_len)
+        goto exit;
+    rem_len += message->payloadlen;
+    // only the header goes through buf, the payload follows it from the writer's buffers
+    if (MQTTPacket_len((int)rem_len) - message->payloadlen >= c->buf_size)
+        goto exit;
+
+    header.bits.type = PUBLISH;
+    header.bits.retain = message->retained;
+    writeChar(&ptr, header.byte);
+    ptr += MQTTPacket_encode(ptr, (int)rem_len);
+    writeMQTTString(&ptr, topic);
+    if ((rc = sendPacket(c, ptr - c->buf, &timer)) != MQTT_SUCCESS)
+        goto exit;
+
+    c->txStream = &timer;
+    c->txStreamRemaining = message->payloadlen;
+    c->txStreamRc = MQTT_SUCCESS;
+    rc = fp(c, context);
+
+    if (c->txStreamRc == MQTT_SUCCESS && c->txStreamRemaining == 0)
+    {
+        countdown_ms(&timer, c->command_timeout_ms);
+        c->txStreamRc = flushPending(c, &timer);
+    }
+    else if (c->txStreamRc == MQTT_SUCCESS)
+        c->txStreamRc = MQTT_FAILURE;  // the writer stopped short of the length in the header
+    if (c->txStreamRc != MQTT_SUCCESS)
+    {
+        rc = c->txStreamRc;
+        dropConnection(c);
+    }
+    c->txStream = NULL;
+
+exit:
+    return rc;
+}
+
+
+int MQTTPublishStreamWrite(Client* c, const void* data, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t part;
+
+    if (c->txStream == NULL || length > c->txStreamRemaining)
+        return MQTT_FAILURE;
+    if (c->txStreamRc != MQTT_SUCCESS)
+        return c->txStreamRc;
+    c->txStreamRemaining -= length;
+    // each window of the payload has the command timeout, a long payload is not bound by one
+    countdown_ms(c->txStream, c->command_timeout_ms);
+
+    if (c->txbuf == NULL || length >= c->txbuf_size)
+    {
+        if ((c->txStreamRc = flushPending(c, c->txStream)) == MQTT_SUCCESS)
+            c->txStreamRc = writeBytes(c, (unsigned char*)bytes, (int)length, c->txStream);
+        return c->txStreamRc;
+    }
+    // small pieces are gathered in the coalescing buffer and written out a full buffer at a time
+    while (length > 0)
+    {
+        if (c->txLen == c->txbuf_size && (c->txStreamRc = flushPending(c, c->txStream)) != MQTT_SUCCESS)
+            return c->txStreamRc;
+        part = c->txbuf_size - c->txLen;
+        if (part > length)
+            part = length;
+        memcpy(c->txbuf + c->txLen, bytes, part);
+        c->txLen += part;
+        bytes += part;
+        length -= part;
+    }
+    return MQTT_SUCCESS;
+}
+
+
 int MQTTDisconnect(Client* c)
 {  
     int rc = MQTT_FAILURE;
@@ -567,6 +1308,8 @@ int MQTTDisconnect(Client* c)
 
     if (len > 0)
         rc = sendPacket(c, len, &timer);            // send the disconnect packet
+    if (rc == MQTT_SUCCESS)
+        rc = flushPending(c, &timer);
         
     c->isconnected = 0;
     return rc;
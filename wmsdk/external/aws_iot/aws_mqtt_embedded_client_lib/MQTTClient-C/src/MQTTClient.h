@@ -25,11 +25,24 @@
 #include <timer_interface.h>
 
 #define MAX_PACKET_ID 65535
-#define MAX_MESSAGE_HANDLERS 5
+#ifndef MAX_MESSAGE_HANDLERS
+#define MAX_MESSAGE_HANDLERS 5      // subscriptions held at once, topic filters are looked up through topicIndex
+#endif
+#define TOPIC_TRIE_MAX_ENTRIES MAX_MESSAGE_HANDLERS
+#include "MQTTTopicTrie.h"
+#ifndef MQTT_RX_AHEAD_SIZE
+#define MQTT_RX_AHEAD_SIZE 256      // bytes read ahead of the parser when the network provides mqttreadsome
+#endif
+#ifndef MAX_SUBSCRIBE_FILTERS
+#define MAX_SUBSCRIBE_FILTERS 8     // topic filters a single MQTTSubscribeMany call can carry
+#endif
+#ifndef MAX_INFLIGHT_PUBLISHES
+#define MAX_INFLIGHT_PUBLISHES 10   // upper bound of QoS1/QoS2 publishes awaiting acknowledgement
+#endif
 
 enum QoS { QOS0, QOS1, QOS2 };
 
-enum returnCode { MQTT_BUFFER_OVERFLOW = -2, MQTT_FAILURE = -1, MQTT_SUCCESS = 0};
+enum returnCode { MQTT_INFLIGHT_WINDOW_FULL = -3, MQTT_BUFFER_OVERFLOW = -2, MQTT_FAILURE = -1, MQTT_SUCCESS = 0};
 // all failure return codes must be negative
 
 void NewTimer(Timer*);
@@ -37,9 +50,13 @@ typedef struct MQTTMessage MQTTMessage;
 
 typedef struct MessageData MessageData;
 
+typedef struct Client Client;
+
 typedef void (*messageHandler)(MessageData*);
 typedef void (*pApplicationHandler_t)(void);
 typedef void (*disconnectHander_t)(void);
+typedef void (*publishCompleteHandler)(unsigned short packetId, int rc, void* context);
+typedef int (*publishPayloadWriter)(Client* c, void* context);     // writes the payload with MQTTPublishStreamWrite
 
 struct MQTTMessage
 {
@@ -49,6 +66,8 @@ struct MQTTMessage
     unsigned short id;
     void *payload;
     size_t payloadlen;
+    size_t offset;      // position of this payload chunk in the whole message, 0 unless streamed
+    size_t totallen;    // length of the whole message, equals payloadlen unless streamed
 };
 
 struct MessageData
@@ -58,17 +77,26 @@ struct MessageData
     pApplicationHandler_t applicationHandler;
 };
 
-typedef struct Client Client;
-
 int MQTTConnect (Client*, MQTTPacket_connectData*);
 int MQTTPublish (Client*, const char*, MQTTMessage*);
+int MQTTPublishAsync (Client*, const char*, MQTTMessage*, publishCompleteHandler, void*);
+int MQTTResumePublish (Client*, const char*, MQTTMessage*, publishCompleteHandler, void*);
+int MQTTPublishStream (Client*, const char*, MQTTMessage*, publishPayloadWriter, void*);
+int MQTTPublishStreamWrite (Client*, const void*, size_t);
 int MQTTSubscribe(Client* c, const char* topicFilter, enum QoS qos, messageHandler messageHandler, pApplicationHandler_t applicationHandler);
+int MQTTSubscribeMany(Client* c, int count, const char* topicFilters[], enum QoS qoss[], messageHandler fps[],
+        pApplicationHandler_t applicationHandlers[], int grantedQoSs[]);
 int MQTTUnsubscribe (Client*, const char*);
 int MQTTDisconnect (Client*);
 int MQTTYield (Client*, int);
 
 void setDefaultMessageHandler(Client*, messageHandler);
 void setDisconnectHandler(Client*, disconnectHander_t disconnectHandler);
+void setInflightWindow(Client*, unsigned int);
+void setStreamChunkSize(Client*, size_t);
+void setWriteCoalescing(Client*, unsigned char*, size_t, unsigned int);
+int MQTTFlush(Client*);
+void MQTTAbortInflight(Client*);
 
 void MQTTClient(Client*, Network*, unsigned int, unsigned char*, size_t, unsigned char*, size_t);
 
@@ -85,9 +113,38 @@ struct Client {
     struct MessageHandlers
     {
         const char* topicFilter;
+        enum QoS qos;                   // as requested, used to subscribe again when the broker lost the session
         void (*fp) (MessageData*);
         pApplicationHandler_t applicationHandler;
     } messageHandlers[MAX_MESSAGE_HANDLERS];      // Message handlers are indexed by subscription topic
+    TopicTrie topicIndex;                         // topic filter levels of messageHandlers, entries are handler indexes
+
+    struct InflightPublish
+    {
+        char state;                     // one of the INFLIGHT_* states in MQTTClient.c, 0 when the slot is free
+        const char* topicName;          // caller owned, must stay valid until the completion handler runs
+        MQTTMessage message;            // payload is caller owned as well
+        publishCompleteHandler fp;
+        void* context;
+    } inflight[MAX_INFLIGHT_PUBLISHES];           // QoS1/QoS2 publishes awaiting PUBACK/PUBREC/PUBCOMP, keyed by packet id
+    unsigned int inflightWindow;
+    unsigned int inflightCount;
+
+    size_t streamChunkSize;     // 0 drops PUBLISH packets bigger than readbuf, otherwise their payload is delivered in chunks
+    size_t streamRemaining;     // payload bytes of the current PUBLISH still unread in the network
+
+    unsigned char rxAhead[MQTT_RX_AHEAD_SIZE];  // bytes received but not parsed yet, packets are framed from here
+    size_t rxAheadPos;
+    size_t rxAheadLen;
+
+    unsigned char *txbuf;       // packets gathered for a single write when write coalescing is on, NULL when off
+    size_t txbuf_size;
+    size_t txLen;
+    unsigned int txLatency_ms;  // longest time a packet waits in txbuf, it is written out by a yield or MQTTFlush
+    Timer txFlushTimer;
+    Timer* txStream;            // deadline of the window of the streamed PUBLISH being written, NULL when none
+    size_t txStreamRemaining;   // payload bytes of it the writer has yet to write
+    int txStreamRc;             // first write error of it, the packet is cut short and the connection dropped
     
     void (*defaultMessageHandler) (MessageData*);
     disconnectHander_t disconnectHandler;
@@ -0,0 +1,222 @@
+/*******************************************************************************
+ * Copyright (c) 2014 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Allan Stockdill-Mander/Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#include "MQTTClient.h"   // sizes the trie from MAX_MESSAGE_HANDLERS
+#include <string.h>
+
+#define NODE_PLAIN 0
+#define NODE_FREE 1
+
+
+unsigned long hashLevel(const char* level, int len)
+{
+    unsigned long hash = 2166136261UL;
+    int i;
+
+    for (i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)level[i]) * 16777619UL;
+    return hash;
+}
+
+
+char levelType(const char* level, int len)
+{
+    if (len == 1 && (*level == '+' || *level == '#'))
+        return *level;
+    return NODE_PLAIN;
+}
+
+
+void TopicTrie_init(TopicTrie* t)
+{
+    int i;
+
+    t->root = TOPIC_TRIE_NONE;
+    t->freeNodes = TOPIC_TRIE_NONE;
+    for (i = TOPIC_TRIE_MAX_NODES - 1; i >= 0; --i)
+    {
+        t->nodes[i].type = NODE_FREE;
+        t->nodes[i].sibling = t->freeNodes;
+        t->freeNodes = i;
+    }
+    for (i = 0; i < TOPIC_TRIE_MAX_ENTRIES; ++i)
+    {
+        t->entryNode[i] = TOPIC_TRIE_NONE;
+        t->entryNext[i] = TOPIC_TRIE_NONE;
+    }
+}
+
+
+short findChild(TopicTrie* t, short first, char type, unsigned long hash, int len)
+{
+    short node;
+
+    for (node = first; node != TOPIC_TRIE_NONE; node = t->nodes[node].sibling)
+    {
+        if (t->nodes[node].type == type && (type != NODE_PLAIN ||
+                (t->nodes[node].hash == hash && t->nodes[node].len == len)))
+            break;
+    }
+    return node;
+}
+
+
+// give back node and its ancestors for as long as nothing ends at or below them
+void pruneNodes(TopicTrie* t, short node)
+{
+    while (node != TOPIC_TRIE_NONE && t->nodes[node].child == TOPIC_TRIE_NONE && t->nodes[node].entries == TOPIC_TRIE_NONE)
+    {
+        short parent = t->nodes[node].parent;
+        short* link = (parent == TOPIC_TRIE_NONE) ? &t->root : &t->nodes[parent].child;
+
+        while (*link != node)
+            link = &t->nodes[*link].sibling;
+        *link = t->nodes[node].sibling;
+
+        t->nodes[node].type = NODE_FREE;
+        t->nodes[node].sibling = t->freeNodes;
+        t->freeNodes = node;
+        node = parent;
+    }
+}
+
+
+int TopicTrie_add(TopicTrie* t, const char* topicFilter, int entry)
+{
+    int rc = -1;
+    short parent = TOPIC_TRIE_NONE;
+    short node = TOPIC_TRIE_NONE;
+    short* first = &t->root;
+    const char* level = topicFilter;
+
+    if (entry < 0 || entry >= TOPIC_TRIE_MAX_ENTRIES || t->entryNode[entry] != TOPIC_TRIE_NONE)
+        goto exit;
+
+    while (1)
+    {
+        const char* end = strchr(level, '/');
+        int len = (end == NULL) ? strlen(level) : end - level;
+        char type = levelType(level, len);
+        unsigned long hash = hashLevel(level, len);
+
+        if ((node = findChild(t, *first, type, hash, len)) == TOPIC_TRIE_NONE)
+        {
+            if ((node = t->freeNodes) == TOPIC_TRIE_NONE)
+            {
+                pruneNodes(t, parent);  // drop the levels this filter added so far
+                goto exit;
+            }
+            t->freeNodes = t->nodes[node].sibling;
+            t->nodes[node].hash = hash;
+            t->nodes[node].len = len;
+            t->nodes[node].type = type;
+            t->nodes[node].parent = parent;
+            t->nodes[node].child = TOPIC_TRIE_NONE;
+            t->nodes[node].entries = TOPIC_TRIE_NONE;
+            t->nodes[node].sibling = *first;
+            *first = node;
+        }
+        if (end == NULL)
+            break;
+        parent = node;
+        first = &t->nodes[node].child;
+        level = end + 1;
+    }
+
+    t->entryNode[entry] = node;
+    t->entryNext[entry] = t->nodes[node].entries;
+    t->nodes[node].entries = entry;
+    rc = 0;
+exit:
+    return rc;
+}
+
+
+void TopicTrie_remove(TopicTrie* t, int entry)
+{
+    short node;
+    short* link;
+
+    if (entry < 0 || entry >= TOPIC_TRIE_MAX_ENTRIES || (node = t->entryNode[entry]) == TOPIC_TRIE_NONE)
+        return;
+
+    for (link = &t->nodes[node].entries; *link != entry; link = &t->entryNext[*link])
+        ;
+    *link = t->entryNext[entry];
+    t->entryNode[entry] = TOPIC_TRIE_NONE;
+    t->entryNext[entry] = TOPIC_TRIE_NONE;
+    pruneNodes(t, node);
+}
+
+
+int visitEntries(TopicTrie* t, short node, topicTrieVisitor visitor, void* context)
+{
+    int count = 0;
+    short entry;
+
+    for (entry = t->nodes[node].entries; entry != TOPIC_TRIE_NONE; entry = t->entryNext[entry])
+    {
+        visitor(entry, context);
+        ++count;
+    }
+    return count;
+}
+
+
+// match the topic name from level up to end against the nodes starting at first
+int matchLevel(TopicTrie* t, short first, const char* level, const char* end, topicTrieVisitor visitor, void* context)
+{
+    int count = 0;
+    const char* next = level;
+    unsigned long hash;
+    short node;
+
+    while (next < end && *next != '/')
+        ++next;
+    hash = hashLevel(level, next - level);
+
+    for (node = first; node != TOPIC_TRIE_NONE; node = t->nodes[node].sibling)
+    {
+        TopicTrieNode* n = &t->nodes[node];
+
+        if (n->type == '#')
+            count += visitEntries(t, node, visitor, context);
+        else if (n->type == '+' || (n->hash == hash && n->len == next - level))
+        {
+            if (next == end)
+                count += visitEntries(t, node, visitor, context);
+            else if (n->child != TOPIC_TRIE_NONE)
+                count += matchLevel(t, n->child, next + 1, end, visitor, context);
+        }
+    }
+    return count;
+}
+
+
+int TopicTrie_match(TopicTrie* t, MQTTString* topicName, topicTrieVisitor visitor, void* context)
+{
+    const char* name = topicName->lenstring.data;
+    int len = topicName->lenstring.len;
+
+    if (name == NULL)
+    {
+        name = topicName->cstring;
+        len = (name == NULL) ? 0 : strlen(name);
+    }
+    if (name == NULL || t->root == TOPIC_TRIE_NONE)
+        return 0;
+    return matchLevel(t, t->root, name, name + len, visitor, context);
+}
@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * Copyright (c) 2014 IBM Corp.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * and Eclipse Distribution License v1.0 which accompany this distribution.
+ *
+ * The Eclipse Public License is available at
+ *    http://www.eclipse.org/legal/epl-v10.html
+ * and the Eclipse Distribution License is available at
+ *   http://www.eclipse.org/org/documents/edl-v10.php.
+ *
+ * Contributors:
+ *    Allan Stockdill-Mander/Ian Craggs - initial API and implementation and/or initial documentation
+ *******************************************************************************/
+
+#ifndef __MQTT_TOPIC_TRIE_H_
+#define __MQTT_TOPIC_TRIE_H_
+
+#include <MQTTPacket.h>
+
+// Index of subscription topic filters, one trie node per topic level. A filter
+// is stored as the path of its levels, "+" and "#" levels being wildcard nodes,
+// so matching a topic name only walks the levels it can actually match instead
+// of comparing it against every registered filter.
+//
+// Nodes come from a fixed pool. They do not copy the filter text, a level is
+// identified by its hash and length, so the caller owned filter strings may go
+// away once unsubscribed. Entries visited by TopicTrie_match are therefore only
+// candidates, the caller confirms them against the full filter.
+
+#ifndef TOPIC_TRIE_MAX_ENTRIES
+#define TOPIC_TRIE_MAX_ENTRIES 5
+#endif
+#ifndef TOPIC_TRIE_MAX_NODES
+#define TOPIC_TRIE_MAX_NODES (TOPIC_TRIE_MAX_ENTRIES * 6)   // enough for filters of 6 levels sharing nothing
+#endif
+
+#define TOPIC_TRIE_NONE (-1)
+
+typedef void (*topicTrieVisitor)(int entry, void* context);
+
+typedef struct TopicTrieNode
+{
+    unsigned long hash;         // FNV-1a of the level text
+    unsigned short len;         // length of the level text
+    char type;                  // 0 for a plain level, '+' or '#' for a wildcard, 1 while on the free list
+    short parent;
+    short child;                // first child, its siblings are linked through sibling
+    short sibling;
+    short entries;              // first entry ending at this node, the others are linked through entryNext
+} TopicTrieNode;
+
+typedef struct TopicTrie
+{
+    short root;                 // first top level node
+    short freeNodes;            // free nodes are linked through sibling
+    TopicTrieNode nodes[TOPIC_TRIE_MAX_NODES];
+    short entryNode[TOPIC_TRIE_MAX_ENTRIES];
+    short entryNext[TOPIC_TRIE_MAX_ENTRIES];
+} TopicTrie;
+
+void TopicTrie_init(TopicTrie*);
+int TopicTrie_add(TopicTrie*, const char* topicFilter, int entry);
+void TopicTrie_remove(TopicTrie*, int entry);
+int TopicTrie_match(TopicTrie*, MQTTString* topicName, topicTrieVisitor visitor, void* context);
+
+#endif
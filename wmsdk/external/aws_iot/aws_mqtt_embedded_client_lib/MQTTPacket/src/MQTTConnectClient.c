@@ -139,12 +139,17 @@ int MQTTDeserialize_connack(unsigned char* sessionPresent, unsigned char* connac
 	MQTTConnackFlags flags = {0};
 
 	FUNC_ENTRY;
+	if (buflen < 2)
+		goto exit;
 	header.byte = readChar(&curdata);
 	if (header.bits.type != CONNACK)
 		goto exit;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if ((rc = MQTTPacket_decodeBufLen(curdata, buflen - 1, &mylen)) == 0) /* read remaining length */
+		goto exit;
+	curdata += rc;
 	enddata = curdata + mylen;
+	rc = 0;
 	if (enddata - curdata < 2)
 		goto exit;
 
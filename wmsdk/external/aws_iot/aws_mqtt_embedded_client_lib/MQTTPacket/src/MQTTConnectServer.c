@@ -53,21 +53,27 @@ int MQTTDeserialize_connect(MQTTPacket_connectData* data, unsigned char* buf, in
 	MQTTHeader header = {0};
 	MQTTConnectFlags flags = {0};
 	unsigned char* curdata = buf;
-	unsigned char* enddata = &buf[len];
+	unsigned char* enddata = NULL;
 	int rc = 0;
 	MQTTString Protocol;
 	int version;
 	int mylen = 0;
 
 	FUNC_ENTRY;
+	if (len < 2)
+		goto exit;
 	header.byte = readChar(&curdata);
 	if (header.bits.type != CONNECT)
 		goto exit;
 
-	curdata += MQTTPacket_decodeBuf(curdata, &mylen); /* read remaining length */
+	if ((rc = MQTTPacket_decodeBufLen(curdata, len - 1, &mylen)) == 0) /* read remaining length */
+		goto exit;
+	curdata += rc;
+	enddata = curdata + mylen;
+	rc = 0;
 
 	if (!readMQTTLenString(&Protocol, &curdata, enddata) ||
-		enddata - curdata < 0) /* do we have enough data to read the protocol version byte? */
+		enddata - curdata < 4) /* do we have enough data to read the protocol version, flags and keepalive? */
 		goto exit;
 
 	version = (int)readChar(&curdata); /* Protocol version */
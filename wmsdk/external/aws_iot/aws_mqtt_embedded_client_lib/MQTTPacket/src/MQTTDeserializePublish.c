@@ -43,6 +43,8 @@ int MQTTDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retaine
 	int mylen = 0;
 
 	FUNC_ENTRY;
+	if (buflen < 2)
+		goto exit;
 	header.byte = readChar(&curdata);
 	if (header.bits.type != PUBLISH)
 		goto exit;
@@ -50,15 +52,22 @@ int MQTTDeserialize_publish(unsigned char* dup, int* qos, unsigned char* retaine
 	*qos = header.bits.qos;
 	*retained = header.bits.retain;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if ((rc = MQTTPacket_decodeBufLen(curdata, buflen - 1, &mylen)) == 0) /* read remaining length */
+		goto exit;
+	curdata += rc;
 	enddata = curdata + mylen;
+	rc = 0;
 
 	if (!readMQTTLenString(topicName, &curdata, enddata) ||
 		enddata - curdata < 0) /* do we have enough data to read the protocol version byte? */
 		goto exit;
 
 	if (*qos > 0)
+	{
+		if (enddata - curdata < 2)
+			goto exit;
 		*packetid = readInt(&curdata);
+	}
 
 	*payloadlen = enddata - curdata;
 	*payload = curdata;
@@ -88,12 +97,17 @@ int MQTTDeserialize_ack(unsigned char* packettype, unsigned char* dup, unsigned
 	int mylen;
 
 	FUNC_ENTRY;
+	if (buflen < 2)
+		goto exit;
 	header.byte = readChar(&curdata);
 	*dup = header.bits.dup;
 	*packettype = header.bits.type;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if ((rc = MQTTPacket_decodeBufLen(curdata, buflen - 1, &mylen)) == 0) /* read remaining length */
+		goto exit;
+	curdata += rc;
 	enddata = curdata + mylen;
+	rc = 0;
 
 	if (enddata - curdata < 2)
 		goto exit;
@@ -117,6 +117,33 @@ int MQTTPacket_decodeBuf(unsigned char* buf, int* value)
 }
 
 
+/**
+ * Decodes the remaining length of a packet, without reading past the end of the buffer
+ * @param buf the buffer, positioned just after the fixed header byte
+ * @param buflen the number of bytes left in the buffer from buf onward
+ * @param value the decoded length returned
+ * @return the number of bytes the remaining length takes, 0 if it is malformed
+ * or the packet it announces runs past the end of the buffer
+ */
+int MQTTPacket_decodeBufLen(unsigned char* buf, int buflen, int* value)
+{
+	unsigned char c;
+	int multiplier = 1;
+	int len = 0;
+
+	*value = 0;
+	do
+	{
+		if (len >= buflen || len >= MAX_NO_OF_REMAINING_LENGTH_BYTES)
+			return 0;
+		c = buf[len++];
+		*value += (c & 127) * multiplier;
+		multiplier *= 128;
+	} while ((c & 128) != 0);
+	return (*value <= buflen - len) ? len : 0;
+}
+
+
 /**
  * Calculates an integer from two bytes read from the input buffer
  * @param pptr pointer to the input buffer - incremented by the number of bytes used & returned
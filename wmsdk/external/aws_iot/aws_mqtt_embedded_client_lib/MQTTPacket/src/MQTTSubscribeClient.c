@@ -106,12 +106,17 @@ int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, i
 	int mylen;
 
 	FUNC_ENTRY;
+	if (buflen < 2)
+		goto exit;
 	header.byte = readChar(&curdata);
 	if (header.bits.type != SUBACK)
 		goto exit;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if ((rc = MQTTPacket_decodeBufLen(curdata, buflen - 1, &mylen)) == 0) /* read remaining length */
+		goto exit;
+	curdata += rc;
 	enddata = curdata + mylen;
+	rc = 0;
 	if (enddata - curdata < 2)
 		goto exit;
 
@@ -120,7 +125,7 @@ int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, i
 	*count = 0;
 	while (curdata < enddata)
 	{
-		if (*count > maxcount)
+		if (*count >= maxcount)
 		{
 			rc = -1;
 			goto exit;
@@ -42,19 +42,28 @@ int MQTTDeserialize_subscribe(unsigned char* dup, unsigned short* packetid, int
 	int mylen = 0;
 
 	FUNC_ENTRY;
+	if (buflen < 2)
+		goto exit;
 	header.byte = readChar(&curdata);
 	if (header.bits.type != SUBSCRIBE)
 		goto exit;
 	*dup = header.bits.dup;
 
-	curdata += (rc = MQTTPacket_decodeBuf(curdata, &mylen)); /* read remaining length */
+	if ((rc = MQTTPacket_decodeBufLen(curdata, buflen - 1, &mylen)) == 0) /* read remaining length */
+		goto exit;
+	curdata += rc;
 	enddata = curdata + mylen;
+	rc = -1;
+	if (enddata - curdata < 2)
+		goto exit;
 
 	*packetid = readInt(&curdata);
 
 	*count = 0;
 	while (curdata < enddata)
 	{
+		if (*count >= maxcount)
+			goto exit;
 		if (!readMQTTLenString(&topicFilters[*count], &curdata, enddata))
 			goto exit;
 		if (curdata >= enddata) /* do we have enough data to read the req_qos version byte? */
@@ -97,8 +97,8 @@ int MQTTDeserialize_unsuback(unsigned short* packetid, unsigned char* buf, int b
 
 	FUNC_ENTRY;
 	rc = MQTTDeserialize_ack(&type, &dup, packetid, buf, buflen);
-	if (type == UNSUBACK)
-		rc = 1;
+	if (type != UNSUBACK)
+		rc = 0;
 	FUNC_EXIT_RC(rc);
 	return rc;
 }
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file bench.h
+ * @brief Timing shared by the host benchmarks.
+ */
+
+#ifndef __BENCH_H_
+#define __BENCH_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/** @brief Nanoseconds of the monotonic clock */
+static inline uint64_t bench_now_ns(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+/** @brief Keeps the compiler from dropping the computation of a result nobody reads */
+static inline void bench_keep(uintptr_t value) {
+	__asm__ __volatile__("" : : "r"(value) : "memory");
+}
+
+#endif /* __BENCH_H_ */
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Looking up 1, 10, 50 and 200 keys of a configuration document of 200 keys: the
+ * search of every token the jsonv2 getters do for each key, against the sibling skips
+ * and the key index of aws_iot_json_index.h, built for every document.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "aws_iot_json_index.h"
+#include "aws_iot_json_tokenizer.h"
+#include "bench.h"
+
+#define MAX_TOKENS 1200
+#define CONFIG_KEYS 200
+#define LOOKUPS 400000
+
+static jsmntok_t tokens[MAX_TOKENS];
+static int16_t next[MAX_TOKENS];
+static int16_t slots[512];
+static char config[16384];
+static char keys[CONFIG_KEYS][8];
+static int32_t tokenCount;
+
+static int32_t findLinear(int32_t object, const char *pKey) {
+	size_t length = strlen(pKey);
+	int32_t i;
+
+	for (i = object + 1; i < tokenCount && tokens[i].start < tokens[object].end; i++) {
+		if (tokens[i].parent == object && tokens[i].type == JSMN_STRING
+				&& (size_t)(tokens[i].end - tokens[i].start) == length
+				&& memcmp(config + tokens[i].start, pKey, length) == 0) {
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+static void run(int keyCount) {
+	JsonKeyIndex_t index;
+	int rounds = LOOKUPS / keyCount;
+	uint64_t start;
+	uint64_t linearNs;
+	uint64_t skipNs;
+	uint64_t indexNs;
+	int round;
+	int k;
+
+	start = bench_now_ns();
+	for (round = 0; round < rounds; round++) {
+		for (k = 0; k < keyCount; k++) {
+			bench_keep(findLinear(0, keys[(k * 37 + round) % CONFIG_KEYS]));
+		}
+	}
+	linearNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (round = 0; round < rounds; round++) {
+		aws_iot_json_index_siblings(tokens, tokenCount, next);
+		for (k = 0; k < keyCount; k++) {
+			bench_keep(aws_iot_json_find_key(config, tokens, next, 0, keys[(k * 37 + round) % CONFIG_KEYS]));
+		}
+	}
+	skipNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (round = 0; round < rounds; round++) {
+		aws_iot_json_index_siblings(tokens, tokenCount, next);
+		aws_iot_json_index_keys(&index, config, tokens, next, 0, slots, 512);
+		for (k = 0; k < keyCount; k++) {
+			bench_keep(aws_iot_json_index_find(&index, keys[(k * 37 + round) % CONFIG_KEYS]));
+		}
+	}
+	indexNs = bench_now_ns() - start;
+
+	printf("%3d keys: token search %7.2f us, sibling skips %7.2f us, key index %6.2f us per document\n", keyCount,
+			(double)linearNs / rounds / 1000, (double)skipNs / rounds / 1000, (double)indexNs / rounds / 1000);
+}
+
+int main(void) {
+	jsmn_parser parser;
+	size_t n = 0;
+	int i;
+
+	// one key in ten holds a nested object, which the token search walks through
+	n += snprintf(config + n, sizeof(config) - n, "{");
+	for (i = 0; i < CONFIG_KEYS; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "key%03d", i);
+		if (i % 10 == 3) {
+			n += snprintf(config + n, sizeof(config) - n, "%s\"%s\":{\"a\":[1,2,{\"b\":3}],\"c\":\"d\"}",
+					(i == 0) ? "" : ",", keys[i]);
+		} else {
+			n += snprintf(config + n, sizeof(config) - n, "%s\"%s\":%d", (i == 0) ? "" : ",", keys[i], i * 7);
+		}
+	}
+	snprintf(config + n, sizeof(config) - n, "}");
+	jsmn_init(&parser);
+	tokenCount = aws_iot_json_tokenize(&parser, config, strlen(config), tokens, MAX_TOKENS);
+	printf("%zu bytes, %d tokens\n", strlen(config), (int)tokenCount);
+
+	run(1);
+	run(10);
+	run(50);
+	run(200);
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Reading and writing the numbers of a shadow document, aws_iot_json_number.h against
+ * the sscanf() and snprintf() it stands in for, in ns per number.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "aws_iot_json_number.h"
+#include "bench.h"
+
+#define ROUNDS 1000000
+
+static const char *floatingTexts[] = {
+	"23.5", "-12.345678", "1013.25", "0.001", "37.774929", "98.6", "1e-3", "6.02214076e23", "0.30000000000000004",
+};
+static const char *integerTexts[] = {
+	"42", "-7", "1013", "123456", "65535", "-32768", "2147483647",
+};
+
+static void runFloating(const char *pText) {
+	size_t length = strlen(pText);
+	uint64_t start;
+	uint64_t parseNs;
+	uint64_t sscanfNs;
+	double value;
+	int round;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(aws_iot_json_parse_double(pText, length, &value));
+		bench_keep((uintptr_t)(value * 1000));
+	}
+	parseNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(sscanf(pText, "%lf", &value));
+		bench_keep((uintptr_t)(value * 1000));
+	}
+	sscanfNs = bench_now_ns() - start;
+
+	printf("%-20s sscanf %6.1f ns, aws_iot_json_parse_double %5.1f ns\n", pText, (double)sscanfNs / ROUNDS,
+			(double)parseNs / ROUNDS);
+}
+
+static void runInteger(const char *pText) {
+	size_t length = strlen(pText);
+	uint64_t start;
+	uint64_t parseNs;
+	uint64_t sscanfNs;
+	int32_t value;
+	int round;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(aws_iot_json_parse_int32(pText, length, INT32_MIN, INT32_MAX, &value));
+		bench_keep((uintptr_t)value);
+	}
+	parseNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(sscanf(pText, "%" SCNi32, &value));
+		bench_keep((uintptr_t)value);
+	}
+	sscanfNs = bench_now_ns() - start;
+
+	printf("%-20s sscanf %6.1f ns, aws_iot_json_parse_int32  %5.1f ns\n", pText, (double)sscanfNs / ROUNDS,
+			(double)parseNs / ROUNDS);
+}
+
+static void runFormat(double value, uint8_t decimals) {
+	char text[AWS_IOT_JSON_NUMBER_MAX_LEN];
+	uint64_t start;
+	uint64_t formatNs;
+	uint64_t snprintfNs;
+	int round;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(aws_iot_json_format_double(text, value, decimals));
+		bench_keep((uintptr_t)text);
+	}
+	formatNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(snprintf(text, sizeof(text), "%.*f", decimals, value));
+		bench_keep((uintptr_t)text);
+	}
+	snprintfNs = bench_now_ns() - start;
+
+	printf("%-20s snprintf %6.1f ns, aws_iot_json_format_double %5.1f ns\n", text, (double)snprintfNs / ROUNDS,
+			(double)formatNs / ROUNDS);
+}
+
+int main(void) {
+	unsigned int i;
+
+	for (i = 0; i < sizeof(floatingTexts) / sizeof(floatingTexts[0]); i++) {
+		runFloating(floatingTexts[i]);
+	}
+	for (i = 0; i < sizeof(integerTexts) / sizeof(integerTexts[0]); i++) {
+		runInteger(integerTexts[i]);
+	}
+	runFormat(23.5, 1);
+	runFormat(-12.345678, 6);
+	runFormat(1013.25, 2);
+	runFormat(1443657600.0, 0);
+	return 0;
+}
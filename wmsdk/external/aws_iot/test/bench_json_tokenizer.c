@@ -0,0 +1,65 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Tokenizing shadow documents, aws_iot_json_tokenize() against the jsmn_parse() it
+ * stands in for, in MB/s of document.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "aws_iot_json_tokenizer.h"
+#include "bench.h"
+
+#define MAX_TOKENS 200
+#define ROUNDS 200000
+
+typedef int (*fpTokenize_t)(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		unsigned int num_tokens);
+
+static const char getAccepted[] =
+	"{\"state\":{\"desired\":{\"led\":1,\"color\":\"red\"},\"reported\":{\"led\":0,\"pb\":12,\"temperature\":21.500000,"
+	"\"light\":{\"lux\":340,\"ok\":true}}},\"metadata\":{\"desired\":{\"led\":{\"timestamp\":1443657600},"
+	"\"color\":{\"timestamp\":1443657600}},\"reported\":{\"led\":{\"timestamp\":1443657601},"
+	"\"pb\":{\"timestamp\":1443657602}}},\"version\":1234,\"timestamp\":1443657700,"
+	"\"clientToken\":\"c-sdk-client-id-42\"}";
+static const char rejected[] = "{\"code\":409,\"message\":\"Version conflict\",\"clientToken\":\"c-sdk-client-id-7\"}";
+
+static double megabytesPerSecond(fpTokenize_t tokenizer, const char *pJson) {
+	jsmntok_t tokens[MAX_TOKENS];
+	jsmn_parser parser;
+	size_t length = strlen(pJson);
+	uint64_t start;
+	int round;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		jsmn_init(&parser);
+		bench_keep(tokenizer(&parser, pJson, length, tokens, MAX_TOKENS));
+		bench_keep((uintptr_t)tokens);
+	}
+	return (double)length * ROUNDS * 1000 / (bench_now_ns() - start);
+}
+
+static void run(const char *pName, const char *pJson) {
+	printf("%-12s %4zu bytes: jsmn_parse %6.1f MB/s, aws_iot_json_tokenize %6.1f MB/s\n", pName, strlen(pJson),
+			megabytesPerSecond(jsmn_parse, pJson), megabytesPerSecond(aws_iot_json_tokenize, pJson));
+}
+
+int main(void) {
+	run("get/accepted", getAccepted);
+	run("rejected", rejected);
+	return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Encode and decode rates of the MQTTPacket serializers over the packets a device
+ * exchanges most: small telemetry publishes, shadow updates with their acks, the
+ * control packets of a session, and the remaining length of packets of every size.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "MQTTPacket.h"
+#include "bench.h"
+#include "unit_test.h"
+
+#define ROUNDS 2000000
+
+typedef struct {
+	const char *pName;
+	int (*encode)(unsigned char *pBuffer, int bufferLen);	// one of each packet of the mix, returns the bytes
+	int (*decode)(unsigned char *pBuffer, int length);		// all the packets encode wrote, returns a checksum
+	int packets;
+} Mix_t;
+
+static unsigned char telemetryPayload[20];
+static unsigned char shadowPayload[300];
+static char thingTopic[] = "$aws/things/device-0001/shadow/update";
+
+static MQTTString topicOf(char *pTopic) {
+	MQTTString topic = MQTTString_initializer;
+
+	topic.cstring = pTopic;
+	return topic;
+}
+
+static int skipPacket(unsigned char *pBuffer) {
+	int value;
+	int length = MQTTPacket_decodeBuf(pBuffer + 1, &value);
+
+	return 1 + length + value;
+}
+
+static int encodeTelemetry(unsigned char *pBuffer, int bufferLen) {
+	return MQTTSerialize_publish(pBuffer, bufferLen, 0, 0, 0, 0, topicOf("dt/device-0001/temperature"),
+			telemetryPayload, sizeof(telemetryPayload));
+}
+
+static int decodeTelemetry(unsigned char *pBuffer, int length) {
+	unsigned char dup, retained;
+	unsigned short packetId;
+	unsigned char *pPayload;
+	MQTTString topic;
+	int qos, payloadLen;
+
+	MQTTDeserialize_publish(&dup, &qos, &retained, &packetId, &topic, &pPayload, &payloadLen, pBuffer, length);
+	return payloadLen + topic.lenstring.len;
+}
+
+static int encodeShadow(unsigned char *pBuffer, int bufferLen) {
+	int length = MQTTSerialize_publish(pBuffer, bufferLen, 0, 1, 0, 42, topicOf(thingTopic), shadowPayload,
+			sizeof(shadowPayload));
+
+	return length + MQTTSerialize_puback(pBuffer + length, bufferLen - length, 42);
+}
+
+static int decodeShadow(unsigned char *pBuffer, int length) {
+	unsigned char dup, retained, type;
+	unsigned short packetId, ackId;
+	unsigned char *pPayload;
+	MQTTString topic;
+	int qos, payloadLen;
+	int publishLen = skipPacket(pBuffer);
+
+	MQTTDeserialize_publish(&dup, &qos, &retained, &packetId, &topic, &pPayload, &payloadLen, pBuffer, publishLen);
+	MQTTDeserialize_ack(&type, &dup, &ackId, pBuffer + publishLen, length - publishLen);
+	return payloadLen + packetId + ackId;
+}
+
+// subscribe, suback, unsubscribe, unsuback, pingreq and connack
+static int encodeControl(unsigned char *pBuffer, int bufferLen) {
+	MQTTString filters[2] = {MQTTString_initializer, MQTTString_initializer};
+	int qoss[2] = {1, 0};
+	int length = 0;
+
+	filters[0].cstring = "$aws/things/device-0001/shadow/update/delta";
+	filters[1].cstring = "cmd/device-0001/#";
+	length += MQTTSerialize_subscribe(pBuffer + length, bufferLen - length, 0, 7, 2, filters, qoss);
+	length += MQTTSerialize_suback(pBuffer + length, bufferLen - length, 7, 2, qoss);
+	length += MQTTSerialize_unsubscribe(pBuffer + length, bufferLen - length, 0, 8, 2, filters);
+	length += MQTTSerialize_unsuback(pBuffer + length, bufferLen - length, 8);
+	length += MQTTSerialize_pingreq(pBuffer + length, bufferLen - length);
+	length += MQTTSerialize_connack(pBuffer + length, bufferLen - length, 0, 1);
+	return length;
+}
+
+static int decodeControl(unsigned char *pBuffer, int length) {
+	MQTTString filters[2];
+	unsigned char dup, sessionPresent, returnCode;
+	unsigned short packetId, total = 0;
+	int qoss[2];
+	int count;
+	int n;
+
+	n = skipPacket(pBuffer);
+	MQTTDeserialize_subscribe(&dup, &packetId, 2, &count, filters, qoss, pBuffer, n);
+	total += packetId + count;
+	pBuffer += n;
+	n = skipPacket(pBuffer);
+	MQTTDeserialize_suback(&packetId, 2, &count, qoss, pBuffer, n);
+	total += packetId + count;
+	pBuffer += n;
+	n = skipPacket(pBuffer);
+	MQTTDeserialize_unsubscribe(&dup, &packetId, 2, &count, filters, pBuffer, n);
+	total += packetId + count;
+	pBuffer += n;
+	n = skipPacket(pBuffer);
+	MQTTDeserialize_unsuback(&packetId, pBuffer, n);
+	total += packetId;
+	pBuffer += n + skipPacket(pBuffer + n);		// the pingreq has nothing to decode
+	MQTTDeserialize_connack(&sessionPresent, &returnCode, pBuffer, 4);
+	return total + sessionPresent;
+}
+
+static const Mix_t mixes[] = {
+	{"telemetry publish QoS 0", encodeTelemetry, decodeTelemetry, 1},
+	{"shadow publish QoS 1+ack", encodeShadow, decodeShadow, 2},
+	{"session control packets", encodeControl, decodeControl, 6},
+};
+
+static void runMix(const Mix_t *pMix) {
+	static unsigned char buffer[1024];
+	uint64_t start;
+	uint64_t encodeNs;
+	uint64_t decodeNs;
+	uintptr_t sum = 0;
+	int length = 0;
+	int i;
+
+	start = bench_now_ns();
+	for (i = 0; i < ROUNDS; i++) {
+		length = pMix->encode(buffer, sizeof(buffer));
+		bench_keep((uintptr_t)buffer);
+	}
+	encodeNs = bench_now_ns() - start;
+	TEST_ASSERT(length > 0);
+
+	start = bench_now_ns();
+	for (i = 0; i < ROUNDS; i++) {
+		sum += pMix->decode(buffer, length);
+		bench_keep(sum);
+	}
+	decodeNs = bench_now_ns() - start;
+
+	printf("%-26s %4d bytes  encode %6.2f Mpkt/s %7.1f MB/s  decode %6.2f Mpkt/s %7.1f MB/s\n", pMix->pName, length,
+			(double)ROUNDS * pMix->packets * 1e3 / encodeNs, (double)ROUNDS * length * 1e3 / encodeNs,
+			(double)ROUNDS * pMix->packets * 1e3 / decodeNs, (double)ROUNDS * length * 1e3 / decodeNs);
+}
+
+// remaining lengths spread over the 1 to 4 byte encodings
+static void runRemainingLength(void) {
+	static int values[1024];
+	unsigned char buffer[4];
+	uint64_t start;
+	uint64_t encodeNs;
+	uint64_t decodeNs;
+	uintptr_t sum = 0;
+	int value;
+	int i;
+
+	for (i = 0; i < 1024; i++) {
+		values[i] = (i * 2654435761u) % (1 << (7 * (1 + i % 4)));
+	}
+	start = bench_now_ns();
+	for (i = 0; i < ROUNDS * 4; i++) {
+		sum += MQTTPacket_encode(buffer, values[i & 1023]);
+		bench_keep((uintptr_t)buffer);
+	}
+	encodeNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (i = 0; i < ROUNDS * 4; i++) {
+		MQTTPacket_encode(buffer, values[i & 1023]);
+		sum += MQTTPacket_decodeBufLen(buffer, sizeof(buffer), &value) + value;
+		bench_keep(sum);
+	}
+	decodeNs = bench_now_ns() - start - encodeNs;
+
+	printf("%-26s %15s  encode %6.1f Mops/s %17s decode %6.1f Mops/s\n", "remaining length", "", ROUNDS * 4e3 / encodeNs,
+			"", ROUNDS * 4e3 / decodeNs);
+}
+
+int main(void) {
+	size_t i;
+
+	memset(telemetryPayload, '7', sizeof(telemetryPayload));
+	memset(shadowPayload, 'x', sizeof(shadowPayload));
+	for (i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++) {
+		runMix(&mixes[i]);
+	}
+	runRemainingLength();
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Small QoS 0 publishes received back to back, read field by field through mqttread
+ * against framed from the read-ahead buffer of the client, filled through mqttreadsome.
+ * Each call to a read function of the network is a read of the TLS layer, so the calls
+ * per message are what the read-ahead saves. The fake hands mqttreadsome pieces of
+ * random size, as the segments of a TCP stream arrive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MQTTClient.h"
+#include "bench.h"
+#include "fake_network.h"
+#include "unit_test.h"
+
+#define MESSAGES 100000
+#define TOPIC "dt/device1/temperature"
+
+int cycle(Client* c, Timer* timer);
+
+static FakeNetwork_t fake;
+static unsigned char writeBuf[256];
+static unsigned char readBuf[512];
+static int received;
+
+static void countMessage(MessageData *pData) {
+	(void)pData;
+	received++;
+}
+
+static void run(const char *pName, bool readSome, size_t payloadLen) {
+	static const unsigned char connack[] = {0x20, 2, 0, 0};
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	MQTTString topic = MQTTString_initializer;
+	unsigned char *pPackets;
+	unsigned char *pPayload;
+	size_t packetLen;
+	Client client;
+	Timer timer;
+	uint64_t start;
+	uint64_t ns;
+	int reads;
+	int i;
+
+	srand(1);
+	fake_network_init(&fake, readSome);
+	MQTTClient(&client, &fake.network, 1000, writeBuf, sizeof(writeBuf), readBuf, sizeof(readBuf));
+	client.defaultMessageHandler = countMessage;
+	fake_network_push(&fake, connack, sizeof(connack));
+	data.clientID.cstring = "bench";
+	data.keepAliveInterval = 0;
+	TEST_ASSERT(MQTTConnect(&client, &data) == MQTT_SUCCESS);
+
+	// all the messages queued as one stretch of input, as a burst from the broker
+	pPayload = calloc(1, payloadLen);
+	packetLen = MQTTPacket_len(2 + strlen(TOPIC) + payloadLen);
+	pPackets = malloc(packetLen * MESSAGES);
+	TEST_ASSERT(pPayload != NULL && pPackets != NULL);
+	topic.cstring = TOPIC;
+	for (i = 0; i < MESSAGES; i++) {
+		TEST_ASSERT(MQTTSerialize_publish(pPackets + i * packetLen, packetLen, 0, 0, 0, 0, topic, pPayload,
+				payloadLen) == (int)packetLen);
+	}
+	fake_network_push(&fake, pPackets, packetLen * MESSAGES);
+	free(pPackets);
+	free(pPayload);
+
+	received = 0;
+	reads = fake.reads;
+	InitTimer(&timer);
+	countdown_ms(&timer, 60000);
+	start = bench_now_ns();
+	while (received < MESSAGES) {
+		TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+	}
+	ns = bench_now_ns() - start;
+	reads = fake.reads - reads;
+	TEST_ASSERT(fake_network_input_left(&fake) == 0);
+
+	printf("%-32s %8d reads %5.2f reads/msg %6.1f ns/msg\n", pName, reads, (double)reads / MESSAGES,
+			(double)ns / MESSAGES);
+	fake_network_free(&fake);
+}
+
+int main(void) {
+	printf("%d QoS 0 publishes to %s\n", MESSAGES, TOPIC);
+	run("20 bytes, mqttread", false, 20);
+	run("20 bytes, read-ahead", true, 20);
+	run("200 bytes, mqttread", false, 200);
+	run("200 bytes, read-ahead", true, 200);
+	run("400 bytes, mqttread", false, 400);
+	run("400 bytes, read-ahead", true, 400);
+	return 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Dispatch of a delta to 100 registered keys, the lookup of the delta callback against
+ * the scan of every token for every key it replaced, at 5, 25 and 50 keys set, as many
+ * as fit the receive buffer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "aws_iot_config.h"
+#include "aws_iot_json_utils.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_json.h"
+#include "bench.h"
+#include "fake_mqtt_client.h"
+
+#define DELTA_TOPIC "$aws/things/" AWS_IOT_MY_THING_NAME "/shadow/update/delta"
+#define KEYS 100
+#define ROUNDS 20000
+
+static MQTTClient_t mqttClient;
+static char names[KEYS][8];
+static int32_t values[KEYS];
+static jsonStruct_t keys[KEYS];
+static int calls;
+
+static void valueCallback(const char *pJsonValueBuffer, uint32_t valueLength, jsonStruct_t *pJsonStruct_t) {
+	calls++;
+}
+
+static void run(int setCount) {
+	char delta[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	char document[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	ShadowJsonView_t view;
+	uint64_t start;
+	uint64_t linearNs;
+	uint64_t dispatchNs;
+	int linearCalls = 0;
+	int round;
+	int n;
+	int i;
+	int k;
+
+	// the keys set are spread over the registered ones, in the reverse order
+	n = snprintf(delta, sizeof(delta), "{\"version\":1,\"timestamp\":1,\"state\":{");
+	for (i = 0; i < setCount; i++) {
+		n += snprintf(delta + n, sizeof(delta) - n, "%s\"k%d\":%d", (i == 0) ? "" : ",",
+				KEYS - 1 - i * KEYS / setCount, i);
+	}
+	snprintf(delta + n, sizeof(delta) - n, "}}");
+
+	calls = 0;
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		fake_mqtt_client_deliver(DELTA_TOPIC, delta, strlen(delta), 0);
+	}
+	dispatchNs = bench_now_ns() - start;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		// the receive buffer is parsed in place, as the delta callback does
+		memcpy(document, delta, strlen(delta) + 1);
+		parseShadowJson(document, &view);
+		for (k = 0; k < KEYS; k++) {
+			for (i = 1; i < view.tokenCount; i++) {
+				if (jsoneq(document, &view.pTokens[i], names[k]) == 0) {
+					updateJsonStructFromToken(&view, i + 1, &keys[k]);
+					linearCalls++;
+					break;
+				}
+			}
+		}
+	}
+	linearNs = bench_now_ns() - start;
+
+	printf("%3d of %d keys set: linear %7.2f us, dispatch %6.2f us per delta, %s\n", setCount, KEYS,
+			(double)linearNs / ROUNDS / 1000, (double)dispatchNs / ROUNDS / 1000,
+			(calls == linearCalls) ? "same keys" : "MISMATCH");
+}
+
+int main(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+	int i;
+
+	fake_mqtt_client_init(&mqttClient);
+	aws_iot_shadow_init(&mqttClient);
+	aws_iot_shadow_connect(&mqttClient, &parameters);
+	// the same delta every round
+	aws_iot_shadow_disable_discard_old_delta_msgs();
+	for (i = 0; i < KEYS; i++) {
+		snprintf(names[i], sizeof(names[i]), "k%d", i);
+		keys[i].pKey = names[i];
+		keys[i].pData = &values[i];
+		keys[i].type = SHADOW_JSON_INT32;
+		keys[i].cb = valueCallback;
+		aws_iot_shadow_register_delta(&mqttClient, &keys[i]);
+	}
+
+	run(5);
+	run(25);
+	run(50);
+	return 0;
+}
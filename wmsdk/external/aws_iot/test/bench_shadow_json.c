@@ -0,0 +1,179 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * A reported section of N fields written with aws_iot_shadow_add_reported() and
+ * aws_iot_finalize_json_document(), against ShadowJsonBuilder_t, in ns per document
+ * and in stack. The stack is what a document takes on a thread of its own, whose
+ * stack is painted before and scanned after, over the same thread doing nothing.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include "aws_iot_shadow_interface.h"
+#include "bench.h"
+#include "unit_test.h"
+
+#define ROUNDS 200000
+#define MAX_FIELDS 20
+#define STACK_SIZE (64 * 1024)
+#define STACK_PAINT 0xA5
+
+static char keys[MAX_FIELDS][16];
+static double doubles[MAX_FIELDS];
+static int32_t integers[MAX_FIELDS];
+static bool bools[MAX_FIELDS];
+static char strings[MAX_FIELDS][16];
+static jsonStruct_t fields[MAX_FIELDS];
+static char document[2048];
+static unsigned char stack[STACK_SIZE] __attribute__((aligned(4096)));
+
+// a mix of the types a device reports
+static void setFields(void) {
+	int i;
+
+	for (i = 0; i < MAX_FIELDS; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "field%d", i);
+		fields[i].pKey = keys[i];
+		fields[i].cb = NULL;
+		switch (i % 4) {
+		case 0:
+			doubles[i] = 21.5 + i;
+			fields[i].pData = &doubles[i];
+			fields[i].type = SHADOW_JSON_DOUBLE;
+			break;
+		case 1:
+			integers[i] = 1000 * i;
+			fields[i].pData = &integers[i];
+			fields[i].type = SHADOW_JSON_INT32;
+			break;
+		case 2:
+			bools[i] = (i & 1) != 0;
+			fields[i].pData = &bools[i];
+			fields[i].type = SHADOW_JSON_BOOL;
+			break;
+		default:
+			snprintf(strings[i], sizeof(strings[i]), "state-%d", i);
+			fields[i].pData = strings[i];
+			fields[i].type = SHADOW_JSON_STRING;
+			break;
+		}
+	}
+}
+
+static IoT_Error_t writeVarargs5(void) {
+	IoT_Error_t rc = aws_iot_shadow_init_json_document(document, sizeof(document));
+
+	if (rc == NONE_ERROR) {
+		rc = aws_iot_shadow_add_reported(document, sizeof(document), 5, &fields[0], &fields[1], &fields[2],
+				&fields[3], &fields[4]);
+	}
+	return (rc == NONE_ERROR) ? aws_iot_finalize_json_document(document, sizeof(document)) : rc;
+}
+
+static IoT_Error_t writeVarargs20(void) {
+	IoT_Error_t rc = aws_iot_shadow_init_json_document(document, sizeof(document));
+
+	if (rc == NONE_ERROR) {
+		rc = aws_iot_shadow_add_reported(document, sizeof(document), 20, &fields[0], &fields[1], &fields[2],
+				&fields[3], &fields[4], &fields[5], &fields[6], &fields[7], &fields[8], &fields[9], &fields[10],
+				&fields[11], &fields[12], &fields[13], &fields[14], &fields[15], &fields[16], &fields[17],
+				&fields[18], &fields[19]);
+	}
+	return (rc == NONE_ERROR) ? aws_iot_finalize_json_document(document, sizeof(document)) : rc;
+}
+
+static IoT_Error_t writeBuilder(int count) {
+	ShadowJsonBuilder_t builder;
+	int i;
+
+	aws_iot_shadow_builder_init(&builder, document, sizeof(document));
+	aws_iot_shadow_builder_begin_object(&builder, "state");
+	aws_iot_shadow_builder_begin_object(&builder, "reported");
+	for (i = 0; i < count; i++) {
+		aws_iot_shadow_builder_add(&builder, &fields[i]);
+	}
+	return aws_iot_shadow_builder_finalize(&builder);
+}
+
+static IoT_Error_t writeBuilder5(void) {
+	return writeBuilder(5);
+}
+
+static IoT_Error_t writeBuilder20(void) {
+	return writeBuilder(20);
+}
+
+static IoT_Error_t writeNothing(void) {
+	return NONE_ERROR;
+}
+
+static void *runWriter(void *pArg) {
+	IoT_Error_t (*write)(void) = (IoT_Error_t (*)(void))pArg;
+
+	TEST_ASSERT(write() == NONE_ERROR);
+	return NULL;
+}
+
+// bytes of the painted stack the writer touched, on a thread of its own
+static size_t stackUsed(IoT_Error_t (*write)(void)) {
+	pthread_attr_t attr;
+	pthread_t thread;
+	size_t i;
+
+	memset(stack, STACK_PAINT, sizeof(stack));
+	TEST_ASSERT(pthread_attr_init(&attr) == 0);
+	TEST_ASSERT(pthread_attr_setstack(&attr, stack, sizeof(stack)) == 0);
+	TEST_ASSERT(pthread_create(&thread, &attr, runWriter, (void *)write) == 0);
+	pthread_join(thread, NULL);
+	pthread_attr_destroy(&attr);
+	for (i = 0; i < sizeof(stack) && stack[i] == STACK_PAINT; i++) {
+	}
+	return sizeof(stack) - i;
+}
+
+static void run(const char *pName, IoT_Error_t (*write)(void), size_t baseStack) {
+	uint64_t start;
+	uint64_t ns;
+	int round;
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		bench_keep(write());
+		bench_keep((uintptr_t)document);
+	}
+	ns = bench_now_ns() - start;
+	printf("%-28s %7.1f ns/document %5zu bytes of stack\n", pName, (double)ns / ROUNDS, stackUsed(write) - baseStack);
+}
+
+int main(void) {
+	size_t baseStack;
+	char varargs[sizeof(document)];
+
+	setFields();
+	// both write the same state, the client token and the space before it differ
+	TEST_ASSERT(writeVarargs20() == NONE_ERROR);
+	strcpy(varargs, document);
+	TEST_ASSERT(writeBuilder20() == NONE_ERROR);
+	TEST_ASSERT(strncmp(varargs, document, strstr(document, "}}") + 2 - document) == 0);
+
+	baseStack = stackUsed(writeNothing);
+	run("5 fields, add_reported", writeVarargs5, baseStack);
+	run("5 fields, builder", writeBuilder5, baseStack);
+	run("20 fields, add_reported", writeVarargs20, baseStack);
+	run("20 fields, builder", writeBuilder20, baseStack);
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Dispatch of a received topic name to its subscriptions, the topic trie of the
+ * client against the loop over every filter it replaced, at 5, 50 and 500 filters.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "MQTTClient.h"
+#include "MQTTTopicTrie.h"
+#include "bench.h"
+
+#define MAX_FILTERS 500
+#define ROUNDS 200000
+
+#if TOPIC_TRIE_MAX_ENTRIES < MAX_FILTERS
+#error "build with MAX_MESSAGE_HANDLERS of MAX_FILTERS at least"
+#endif
+
+char isTopicMatched(char* topicFilter, MQTTString* topicName);
+
+static TopicTrie trie;
+static char filters[MAX_FILTERS][64];
+static int matches;
+
+static void confirm(int entry, void *context) {
+	MQTTString *pName = (MQTTString *)context;
+
+	if (MQTTPacket_equals(pName, filters[entry]) || isTopicMatched(filters[entry], pName)) {
+		matches++;
+	}
+}
+
+static void run(int filterCount) {
+	char names[16][64];
+	MQTTString name = MQTTString_initializer;
+	uint64_t start;
+	uint64_t linearNs;
+	uint64_t trieNs;
+	int linearMatches = 0;
+	int round;
+	int i;
+
+	// the filters of a shadow client serving many Things, a few of them wildcards
+	TopicTrie_init(&trie);
+	for (i = 0; i < filterCount; i++) {
+		switch (i % 5) {
+		case 0:
+			snprintf(filters[i], sizeof(filters[i]), "$aws/things/thing%d/shadow/+/accepted", i);
+			break;
+		case 1:
+			snprintf(filters[i], sizeof(filters[i]), "$aws/things/thing%d/shadow/update/delta", i);
+			break;
+		case 2:
+			snprintf(filters[i], sizeof(filters[i]), "devices/%d/#", i);
+			break;
+		default:
+			snprintf(filters[i], sizeof(filters[i]), "$aws/things/thing%d/shadow/get/rejected", i);
+			break;
+		}
+		TopicTrie_add(&trie, filters[i], i);
+	}
+	for (i = 0; i < 16; i++) {
+		snprintf(names[i], sizeof(names[i]), "$aws/things/thing%d/shadow/update/accepted", (i * 37) % filterCount);
+	}
+
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		name.lenstring.data = names[round % 16];
+		name.lenstring.len = strlen(names[round % 16]);
+		for (i = 0; i < filterCount; i++) {
+			if (MQTTPacket_equals(&name, filters[i]) || isTopicMatched(filters[i], &name)) {
+				linearMatches++;
+			}
+		}
+	}
+	linearNs = bench_now_ns() - start;
+
+	matches = 0;
+	start = bench_now_ns();
+	for (round = 0; round < ROUNDS; round++) {
+		name.lenstring.data = names[round % 16];
+		name.lenstring.len = strlen(names[round % 16]);
+		TopicTrie_match(&trie, &name, confirm, &name);
+	}
+	trieNs = bench_now_ns() - start;
+
+	printf("%3d filters: linear %8.1f ns, trie %6.1f ns per message, %s\n", filterCount,
+			(double)linearNs / ROUNDS, (double)trieNs / ROUNDS, (matches == linearMatches) ? "same matches" : "MISMATCH");
+}
+
+int main(void) {
+	run(5);
+	run(50);
+	run(500);
+	return 0;
+}
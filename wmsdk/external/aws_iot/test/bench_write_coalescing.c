@@ -0,0 +1,262 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Small QoS 0 publishes written one TLS record each against gathered by the write
+ * coalescing of the client, to a stand-in broker on a loopback TCP connection. Every
+ * write of the client goes out as a record framed as TLS frames AES-GCM records, so
+ * the bytes on the wire carry the TLS overhead of each write.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "MQTTClient.h"
+#include "bench.h"
+#include "unit_test.h"
+
+#define MESSAGES 200000
+#define PAYLOAD_LEN 20
+#define TLS_HEADER_LEN 5		// content type, version and length
+#define TLS_TRAILER_LEN 24		// explicit nonce and tag of AES-GCM, sent after the data here
+#define TLS_MAX_RECORD 16384
+
+typedef enum {
+	PACKET_HEADER, PACKET_LENGTH, PACKET_BODY
+} PacketState_t;
+
+typedef struct {
+	int socket;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	int publishes;			// PUBLISH packets read
+	int records;
+	size_t mqttBytes;		// bytes of the packets, without the TLS framing
+	size_t wireBytes;		// bytes read from the socket
+	PacketState_t state;	// packets may span records
+	unsigned char packetType;
+	size_t remaining;
+	int shift;
+} Broker_t;
+
+static Broker_t broker = {.lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER};
+static unsigned char writeBuf[256];
+static unsigned char readBuf[256];
+static unsigned char coalesceBuf[4096];
+static unsigned char frame[TLS_HEADER_LEN + TLS_MAX_RECORD + TLS_TRAILER_LEN];
+
+static bool readAll(int socket, unsigned char *pBuffer, size_t length) {
+	size_t done = 0;
+	ssize_t n;
+
+	while (done < length) {
+		if ((n = read(socket, pBuffer + done, length - done)) <= 0) {
+			return false;
+		}
+		done += n;
+	}
+	return true;
+}
+
+// returns the PUBLISH packets that end in the bytes
+static int countPackets(const unsigned char *pBytes, size_t length) {
+	int publishes = 0;
+	size_t i = 0;
+	size_t n;
+
+	while (i < length) {
+		switch (broker.state) {
+		case PACKET_HEADER:
+			broker.packetType = pBytes[i++] >> 4;
+			broker.remaining = 0;
+			broker.shift = 0;
+			broker.state = PACKET_LENGTH;
+			break;
+		case PACKET_LENGTH:
+			broker.remaining |= (size_t)(pBytes[i] & 0x7F) << broker.shift;
+			broker.shift += 7;
+			broker.state = (pBytes[i++] & 0x80) ? PACKET_LENGTH : PACKET_BODY;
+			break;
+		case PACKET_BODY:
+			n = (length - i < broker.remaining) ? length - i : broker.remaining;
+			i += n;
+			broker.remaining -= n;
+			break;
+		}
+		if (broker.state == PACKET_BODY && broker.remaining == 0) {
+			publishes += (broker.packetType == PUBLISH);
+			broker.state = PACKET_HEADER;
+		}
+	}
+	return publishes;
+}
+
+static void *brokerThread(void *pArg) {
+	static unsigned char record[TLS_MAX_RECORD + TLS_TRAILER_LEN];
+	static const unsigned char connack[] = {0x20, 2, 0, 0};
+	unsigned char header[TLS_HEADER_LEN];
+	size_t length;
+	int publishes;
+
+	if (write(broker.socket, connack, sizeof(connack)) != sizeof(connack)) {
+		return NULL;
+	}
+	while (readAll(broker.socket, header, sizeof(header))) {
+		length = (header[3] << 8) | header[4];
+		if (!readAll(broker.socket, record, length + TLS_TRAILER_LEN)) {
+			break;
+		}
+		publishes = countPackets(record, length);
+		pthread_mutex_lock(&broker.lock);
+		broker.records++;
+		broker.wireBytes += sizeof(header) + length + TLS_TRAILER_LEN;
+		broker.mqttBytes += length;
+		broker.publishes += publishes;
+		pthread_cond_broadcast(&broker.changed);
+		pthread_mutex_unlock(&broker.lock);
+	}
+	return NULL;
+}
+
+// a write is a record, sent with a single call as a TLS layer sends it
+static int recordWrite(Network *pNetwork, unsigned char *pBuffer, int length, int timeout_ms) {
+	(void)timeout_ms;
+	if (length > TLS_MAX_RECORD) {
+		length = TLS_MAX_RECORD;
+	}
+	frame[0] = 0x17;
+	frame[1] = 3;
+	frame[2] = 3;
+	frame[3] = length >> 8;
+	frame[4] = length & 0xFF;
+	memcpy(frame + TLS_HEADER_LEN, pBuffer, length);
+	memset(frame + TLS_HEADER_LEN + length, 0, TLS_TRAILER_LEN);
+	if (!(write(pNetwork->my_socket, frame, TLS_HEADER_LEN + length + TLS_TRAILER_LEN)
+			== TLS_HEADER_LEN + length + TLS_TRAILER_LEN)) {
+		return -1;
+	}
+	return length;
+}
+
+static int plainRead(Network *pNetwork, unsigned char *pBuffer, int length, int timeout_ms) {
+	(void)timeout_ms;
+	return readAll(pNetwork->my_socket, pBuffer, length) ? length : -1;
+}
+
+// a loopback connection, the client end without Nagle as a TLS layer flushing each record has it
+static void connectLoopback(int *pClientSocket, int *pBrokerSocket) {
+	struct sockaddr_in address;
+	socklen_t addressLen = sizeof(address);
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	int one = 1;
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	TEST_ASSERT(listener >= 0 && bind(listener, (struct sockaddr *)&address, sizeof(address)) == 0);
+	TEST_ASSERT(listen(listener, 1) == 0);
+	TEST_ASSERT(getsockname(listener, (struct sockaddr *)&address, &addressLen) == 0);
+	*pClientSocket = socket(AF_INET, SOCK_STREAM, 0);
+	TEST_ASSERT(connect(*pClientSocket, (struct sockaddr *)&address, sizeof(address)) == 0);
+	TEST_ASSERT(setsockopt(*pClientSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) == 0);
+	*pBrokerSocket = accept(listener, NULL, NULL);
+	TEST_ASSERT(*pBrokerSocket >= 0);
+	close(listener);
+}
+
+static void run(const char *pName, size_t coalesceLen, unsigned int latency_ms) {
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	char payload[PAYLOAD_LEN];
+	MQTTMessage message;
+	Network network;
+	Client client;
+	pthread_t thread;
+	uint64_t start;
+	uint64_t ns;
+	int records;
+	size_t mqttBytes;
+	size_t wireBytes;
+	int i;
+
+	memset(&network, 0, sizeof(network));
+	network.mqttread = plainRead;
+	network.mqttwrite = recordWrite;
+	connectLoopback(&network.my_socket, &broker.socket);
+	broker.state = PACKET_HEADER;
+	broker.publishes = broker.records = 0;
+	broker.mqttBytes = broker.wireBytes = 0;
+	TEST_ASSERT(pthread_create(&thread, NULL, brokerThread, NULL) == 0);
+
+	MQTTClient(&client, &network, 1000, writeBuf, sizeof(writeBuf), readBuf, sizeof(readBuf));
+	setWriteCoalescing(&client, coalesceLen > 0 ? coalesceBuf : NULL, coalesceLen, latency_ms);
+	data.clientID.cstring = "bench";
+	data.keepAliveInterval = 0;
+	TEST_ASSERT(MQTTConnect(&client, &data) == MQTT_SUCCESS);
+	TEST_ASSERT(MQTTFlush(&client) == MQTT_SUCCESS);
+
+	// the connect is left out of the counts
+	pthread_mutex_lock(&broker.lock);
+	while (broker.records == 0) {
+		pthread_cond_wait(&broker.changed, &broker.lock);
+	}
+	records = broker.records;
+	mqttBytes = broker.mqttBytes;
+	wireBytes = broker.wireBytes;
+	pthread_mutex_unlock(&broker.lock);
+
+	memset(payload, 'x', sizeof(payload));
+	memset(&message, 0, sizeof(message));
+	message.qos = QOS0;
+	message.payload = payload;
+	message.payloadlen = sizeof(payload);
+	start = bench_now_ns();
+	for (i = 0; i < MESSAGES; i++) {
+		TEST_ASSERT(MQTTPublish(&client, "dt/device1/temperature", &message) == MQTT_SUCCESS);
+	}
+	TEST_ASSERT(MQTTFlush(&client) == MQTT_SUCCESS);
+	pthread_mutex_lock(&broker.lock);
+	while (broker.publishes < MESSAGES) {
+		pthread_cond_wait(&broker.changed, &broker.lock);
+	}
+	ns = bench_now_ns() - start;
+	records = broker.records - records;
+	mqttBytes = broker.mqttBytes - mqttBytes;
+	wireBytes = broker.wireBytes - wireBytes;
+	pthread_mutex_unlock(&broker.lock);
+	TEST_ASSERT(broker.publishes == MESSAGES);
+
+	printf("%-26s %7d records %6.1f wire bytes/msg %5.1f%% TLS overhead %9.0f msgs/s\n", pName, records,
+			(double)wireBytes / MESSAGES, 100.0 * (wireBytes - mqttBytes) / wireBytes, MESSAGES * 1e9 / ns);
+
+	shutdown(network.my_socket, SHUT_RDWR);
+	pthread_join(thread, NULL);
+	close(network.my_socket);
+	close(broker.socket);
+}
+
+int main(void) {
+	printf("%d QoS 0 publishes of %d bytes\n", MESSAGES, PAYLOAD_LEN);
+	run("one record per packet", 0, 0);
+	run("coalesced in 512 bytes", 512, 20);
+	run("coalesced in 1460 bytes", 1460, 20);
+	run("coalesced in 4096 bytes", 4096, 20);
+	return 0;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+#include "fake_mqtt_client.h"
+
+FakeMqttSubscription_t fakeMqttSubscriptions[FAKE_MQTT_MAX_SUBSCRIPTIONS];
+int fakeMqttSubscriptionCount;
+FakeMqttPublish_t fakeMqttLastPublish;
+int fakeMqttPublishCount;
+void (*fakeMqttPublishHook)(const char *pTopic, const char *pPayload, size_t length);
+
+// calls may come from several threads at once, each is made in one go as the I/O task makes them
+static pthread_mutex_t fakeMqttLock = PTHREAD_MUTEX_INITIALIZER;
+
+static IoT_Error_t fakeConnect(MQTTConnectParams *pParams) {
+	(void)pParams;
+	return NONE_ERROR;
+}
+
+static IoT_Error_t fakePublish(MQTTPublishParams *pParams) {
+	size_t length = pParams->MessageParams.PayloadLen;
+
+	if (length >= sizeof(fakeMqttLastPublish.payload)) {
+		length = sizeof(fakeMqttLastPublish.payload) - 1;
+	}
+	pthread_mutex_lock(&fakeMqttLock);
+	snprintf(fakeMqttLastPublish.topic, FAKE_MQTT_MAX_TOPIC_LEN, "%s", pParams->pTopic);
+	memcpy(fakeMqttLastPublish.payload, pParams->MessageParams.pPayload, length);
+	fakeMqttLastPublish.payload[length] = '\0';
+	fakeMqttLastPublish.payloadLen = pParams->MessageParams.PayloadLen;
+	fakeMqttPublishCount++;
+	pthread_mutex_unlock(&fakeMqttLock);
+	if (fakeMqttPublishHook != NULL) {
+		fakeMqttPublishHook(pParams->pTopic, pParams->MessageParams.pPayload, pParams->MessageParams.PayloadLen);
+	}
+	return NONE_ERROR;
+}
+
+static int findSubscription(const char *pTopic, iot_message_handler handler) {
+	int i;
+
+	for (i = 0; i < fakeMqttSubscriptionCount; i++) {
+		if (strcmp(fakeMqttSubscriptions[i].topic, pTopic) == 0 && fakeMqttSubscriptions[i].handler == handler) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static IoT_Error_t fakeSubscribeBatch(MQTTSubscribeParams *pParams, uint8_t count) {
+	IoT_Error_t rc = NONE_ERROR;
+	uint8_t i;
+
+	pthread_mutex_lock(&fakeMqttLock);
+	for (i = 0; i < count; i++) {
+		// as in the MQTT client, the same filter and handler subscribed again keep the slot they have
+		if (findSubscription(pParams[i].pTopic, pParams[i].mHandler) >= 0) {
+			pParams[i].grantedQos = pParams[i].qos;
+			continue;
+		}
+		if (fakeMqttSubscriptionCount == FAKE_MQTT_MAX_SUBSCRIPTIONS) {
+			rc = GENERIC_ERROR;
+			break;
+		}
+		snprintf(fakeMqttSubscriptions[fakeMqttSubscriptionCount].topic, FAKE_MQTT_MAX_TOPIC_LEN, "%s", pParams[i].pTopic);
+		fakeMqttSubscriptions[fakeMqttSubscriptionCount].handler = pParams[i].mHandler;
+		fakeMqttSubscriptionCount++;
+		pParams[i].grantedQos = pParams[i].qos;
+	}
+	pthread_mutex_unlock(&fakeMqttLock);
+	return rc;
+}
+
+static IoT_Error_t fakeSubscribe(MQTTSubscribeParams *pParams) {
+	return fakeSubscribeBatch(pParams, 1);
+}
+
+static IoT_Error_t fakeUnsubscribe(char *pTopic) {
+	IoT_Error_t rc = GENERIC_ERROR;
+	int i;
+
+	pthread_mutex_lock(&fakeMqttLock);
+	for (i = 0; i < fakeMqttSubscriptionCount; i++) {
+		if (strcmp(fakeMqttSubscriptions[i].topic, pTopic) == 0) {
+			fakeMqttSubscriptions[i] = fakeMqttSubscriptions[--fakeMqttSubscriptionCount];
+			rc = NONE_ERROR;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&fakeMqttLock);
+	return rc;
+}
+
+static IoT_Error_t fakeDisconnect(void) {
+	return NONE_ERROR;
+}
+
+static IoT_Error_t fakeYield(int timeout) {
+	(void)timeout;
+	return NONE_ERROR;
+}
+
+static bool fakeIsConnected(void) {
+	return true;
+}
+
+void fake_mqtt_client_init(MQTTClient_t *pClient) {
+	memset(pClient, 0, sizeof(*pClient));
+	pClient->connect = fakeConnect;
+	pClient->publish = fakePublish;
+	pClient->subscribe = fakeSubscribe;
+	pClient->subscribeBatch = fakeSubscribeBatch;
+	pClient->unsubscribe = fakeUnsubscribe;
+	pClient->disconnect = fakeDisconnect;
+	pClient->yield = fakeYield;
+	pClient->isConnected = fakeIsConnected;
+	fakeMqttSubscriptionCount = 0;
+	fakeMqttPublishCount = 0;
+	fakeMqttPublishHook = NULL;
+}
+
+// MQTT topic filter matching, + for one level and # for the levels left
+static bool isFilterMatching(const char *pFilter, const char *pTopic) {
+	while (*pFilter != '\0') {
+		if (*pFilter == '#') {
+			return true;
+		}
+		if (*pFilter == '+') {
+			while (*pTopic != '\0' && *pTopic != '/') {
+				pTopic++;
+			}
+			pFilter++;
+		} else if (*pFilter++ != *pTopic++) {
+			return false;
+		}
+	}
+	return *pTopic == '\0';
+}
+
+int fake_mqtt_client_deliver(const char *pTopic, const char *pPayload, size_t length, size_t chunkSize) {
+	char chunk[FAKE_MQTT_MAX_PAYLOAD_LEN + 8];
+	iot_message_handler handlers[FAKE_MQTT_MAX_SUBSCRIPTIONS];
+	MQTTCallbackParams params;
+	int handlerCount = 0;
+	size_t offset = 0;
+	int rc = -1;
+	int i;
+
+	if (chunkSize == 0 || chunkSize > FAKE_MQTT_MAX_PAYLOAD_LEN) {
+		chunkSize = FAKE_MQTT_MAX_PAYLOAD_LEN;
+	}
+	// the handlers may subscribe and unsubscribe, the ones matching are picked first
+	pthread_mutex_lock(&fakeMqttLock);
+	for (i = 0; i < fakeMqttSubscriptionCount; i++) {
+		if (isFilterMatching(fakeMqttSubscriptions[i].topic, pTopic)) {
+			handlers[handlerCount++] = fakeMqttSubscriptions[i].handler;
+		}
+	}
+	pthread_mutex_unlock(&fakeMqttLock);
+
+	// as the MQTT client does, every chunk is handed to all the handlers before the next one is read
+	do {
+		size_t n = (length - offset < chunkSize) ? length - offset : chunkSize;
+
+		for (i = 0; i < handlerCount; i++) {
+			// what follows a chunk in the RX buffer is anything but a string terminator
+			memcpy(chunk, pPayload + offset, n);
+			memset(chunk + n, '#', 8);
+			memset(&params, 0, sizeof(params));
+			params.pTopicName = (char *)pTopic;
+			params.TopicNameLen = strlen(pTopic);
+			params.MessageParams.pPayload = chunk;
+			params.MessageParams.PayloadLen = n;
+			params.MessageParams.PayloadOffset = offset;
+			params.MessageParams.TotalPayloadLen = length;
+			rc = handlers[i](params);
+		}
+		offset += n;
+	} while (offset < length);
+	return rc;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file fake_mqtt_client.h
+ * @brief An MQTTClient_t for the host tests of the shadow, without a broker.
+ *
+ * Subscriptions are granted at once and kept, so messages can be handed to their
+ * handlers as the MQTT client would deliver them. Publishes are kept for the test
+ * to look at. Its functions may be called from several threads, the messages are
+ * to be delivered from one of them as the MQTT I/O task does.
+ */
+
+#ifndef __FAKE_MQTT_CLIENT_H_
+#define __FAKE_MQTT_CLIENT_H_
+
+#include <stddef.h>
+#include "aws_iot_mqtt_interface.h"
+
+#define FAKE_MQTT_MAX_SUBSCRIPTIONS 32
+#define FAKE_MQTT_MAX_TOPIC_LEN 128
+#define FAKE_MQTT_MAX_PAYLOAD_LEN 2048
+
+typedef struct {
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+	iot_message_handler handler;
+} FakeMqttSubscription_t;
+
+typedef struct {
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+	char payload[FAKE_MQTT_MAX_PAYLOAD_LEN];	///< The payload as a string, cut to the size of the buffer
+	size_t payloadLen;
+} FakeMqttPublish_t;
+
+extern FakeMqttSubscription_t fakeMqttSubscriptions[FAKE_MQTT_MAX_SUBSCRIPTIONS];
+extern int fakeMqttSubscriptionCount;
+extern FakeMqttPublish_t fakeMqttLastPublish;	///< The latest message published
+extern int fakeMqttPublishCount;
+/** Called with every message published, from the thread publishing it. Could be NULL */
+extern void (*fakeMqttPublishHook)(const char *pTopic, const char *pPayload, size_t length);
+
+/** @brief Set the functions of pClient to the fake, connected with no subscription */
+void fake_mqtt_client_init(MQTTClient_t *pClient);
+
+/**
+ * @brief Hand a message to the handler of every subscription matching pTopic, in chunks of
+ * at most chunkSize bytes as the MQTT client streams a message bigger than its RX buffer.
+ * A chunkSize of 0 delivers the message in one piece. Chunks are not NUL terminated.
+ *
+ * @return the value returned by the handler for the last chunk, -1 if no subscription matches
+ */
+int fake_mqtt_client_deliver(const char *pTopic, const char *pPayload, size_t length, size_t chunkSize);
+
+#endif /* __FAKE_MQTT_CLIENT_H_ */
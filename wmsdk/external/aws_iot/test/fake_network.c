@@ -0,0 +1,272 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fake_network.h"
+
+FakeNetwork_t *pFakeTlsNetwork = NULL;
+static Network *pTlsNetwork = NULL;		// the Network set up by iot_tls_init()
+
+// the fake of a Network, either the Network of the fake or the one bound to the TLS functions
+static FakeNetwork_t *fakeOf(Network *pNetwork) {
+	return (pNetwork == pTlsNetwork && pFakeTlsNetwork != NULL) ? pFakeTlsNetwork : (FakeNetwork_t *)pNetwork;
+}
+
+// copy at most length bytes of the queued input, returns the bytes copied
+static size_t readInput(FakeNetwork_t *pFake, unsigned char *pBuffer, size_t length) {
+	size_t done = 0;
+
+	while (done < length && pFake->segmentRead < pFake->segmentCount) {
+		FakeNetworkSegment_t *pSegment = &pFake->segments[pFake->segmentRead];
+		size_t n = pSegment->length - pSegment->position;
+		size_t i;
+
+		if (n > length - done) {
+			n = length - done;
+		}
+		if (pSegment->pData != NULL) {
+			memcpy(pBuffer + done, pSegment->pData + pSegment->position, n);
+		} else {
+			for (i = 0; i < n; i++) {
+				pBuffer[done + i] = (unsigned char)(pSegment->position + i);
+			}
+		}
+		pSegment->position += n;
+		done += n;
+		if (pSegment->position == pSegment->length) {
+			pFake->segmentRead++;
+		}
+	}
+	return done;
+}
+
+static size_t inputLeft(const FakeNetwork_t *pFake) {
+	size_t left = 0;
+	int i;
+
+	for (i = pFake->segmentRead; i < pFake->segmentCount; i++) {
+		left += pFake->segments[i].length - pFake->segments[i].position;
+	}
+	return left;
+}
+
+static int fakeRead(Network *pNetwork, unsigned char *pBuffer, int length, int timeout_ms) {
+	FakeNetwork_t *pFake = fakeOf(pNetwork);
+	int rc = -1;
+
+	(void)timeout_ms;
+	pthread_mutex_lock(&pFake->lock);
+	pFake->reads++;
+	if ((size_t)length > pFake->largestRead) {
+		pFake->largestRead = length;
+	}
+	// a read of the whole length or nothing, as the TLS layer does after its timeout
+	if (!pFake->isClosed) {
+		rc = (inputLeft(pFake) < (size_t)length) ? 0 : (int)readInput(pFake, pBuffer, length);
+	}
+	pthread_mutex_unlock(&pFake->lock);
+	return rc;
+}
+
+static int fakeReadSome(Network *pNetwork, unsigned char *pBuffer, int length, int timeout_ms) {
+	FakeNetwork_t *pFake = fakeOf(pNetwork);
+	int rc = -1;
+
+	(void)timeout_ms;
+	pthread_mutex_lock(&pFake->lock);
+	pFake->reads++;
+	if ((size_t)length > pFake->largestRead) {
+		pFake->largestRead = length;
+	}
+	if (!pFake->isClosed) {
+		if (length > 3 && (rand() & 1)) {
+			length = 1 + rand() % length;
+		}
+		rc = (int)readInput(pFake, pBuffer, length);
+	}
+	pthread_mutex_unlock(&pFake->lock);
+	return rc;
+}
+
+// sleeps until input is queued or the connection closes, as select() on the socket does
+static int fakeWait(Network *pNetwork, int timeout_ms) {
+	FakeNetwork_t *pFake = fakeOf(pNetwork);
+	struct timespec deadline;
+	int rc = 0;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	pthread_mutex_lock(&pFake->lock);
+	while (!pFake->isClosed && inputLeft(pFake) == 0 && rc != ETIMEDOUT) {
+		rc = pthread_cond_timedwait(&pFake->changed, &pFake->lock, &deadline);
+	}
+	rc = pFake->isClosed ? -1 : (inputLeft(pFake) > 0);
+	pthread_mutex_unlock(&pFake->lock);
+	return rc;
+}
+
+static int fakeWrite(Network *pNetwork, unsigned char *pBuffer, int length, int timeout_ms) {
+	FakeNetwork_t *pFake = fakeOf(pNetwork);
+	size_t n = 0;
+
+	(void)timeout_ms;
+	pthread_mutex_lock(&pFake->lock);
+	if (pFake->isClosed) {
+		pthread_mutex_unlock(&pFake->lock);
+		return -1;
+	}
+	if (pFake->outputLen < sizeof(pFake->output)) {
+		n = sizeof(pFake->output) - pFake->outputLen;
+		if (n > (size_t)length) {
+			n = length;
+		}
+		memcpy(pFake->output + pFake->outputLen, pBuffer, n);
+	}
+	pFake->outputLen += length;
+	pthread_mutex_unlock(&pFake->lock);
+	if (pFake->onWrite != NULL) {
+		pFake->onWrite(pFake, pBuffer, length);
+	}
+	return length;
+}
+
+static void fakeDisconnect(Network *pNetwork) {
+	FakeNetwork_t *pFake = fakeOf(pNetwork);
+
+	pthread_mutex_lock(&pFake->lock);
+	pFake->isClosed = true;
+	pthread_cond_broadcast(&pFake->changed);
+	pthread_mutex_unlock(&pFake->lock);
+}
+
+void fake_network_init(FakeNetwork_t *pFake, bool readSome) {
+	memset(pFake, 0, sizeof(*pFake));
+	pthread_mutex_init(&pFake->lock, NULL);
+	pthread_cond_init(&pFake->changed, NULL);
+	pFake->network.mqttread = fakeRead;
+	pFake->network.mqttreadsome = readSome ? fakeReadSome : NULL;
+	pFake->network.mqttwait = fakeWait;
+	pFake->network.mqttwrite = fakeWrite;
+	pFake->network.disconnect = fakeDisconnect;
+}
+
+static void pushSegment(FakeNetwork_t *pFake, unsigned char *pData, size_t length) {
+	int i;
+
+	pthread_mutex_lock(&pFake->lock);
+	if (pFake->segmentCount == FAKE_NETWORK_MAX_SEGMENTS) {
+		// make room with the segments read already, as a long running fake broker needs
+		for (i = 0; i < pFake->segmentRead; i++) {
+			free(pFake->segments[i].pData);
+		}
+		memmove(pFake->segments, pFake->segments + pFake->segmentRead,
+				(pFake->segmentCount - pFake->segmentRead) * sizeof(pFake->segments[0]));
+		pFake->segmentCount -= pFake->segmentRead;
+		pFake->segmentRead = 0;
+	}
+	if (pFake->segmentCount == FAKE_NETWORK_MAX_SEGMENTS) {
+		abort();
+	}
+	pFake->segments[pFake->segmentCount].pData = pData;
+	pFake->segments[pFake->segmentCount].length = length;
+	pFake->segments[pFake->segmentCount].position = 0;
+	pFake->segmentCount++;
+	pthread_cond_broadcast(&pFake->changed);
+	pthread_mutex_unlock(&pFake->lock);
+}
+
+void fake_network_push(FakeNetwork_t *pFake, const void *pData, size_t length) {
+	unsigned char *pCopy = malloc(length);
+
+	if (pCopy == NULL) {
+		abort();
+	}
+	memcpy(pCopy, pData, length);
+	pushSegment(pFake, pCopy, length);
+}
+
+void fake_network_push_pattern(FakeNetwork_t *pFake, size_t length) {
+	pushSegment(pFake, NULL, length);
+}
+
+size_t fake_network_input_left(FakeNetwork_t *pFake) {
+	size_t left;
+
+	pthread_mutex_lock(&pFake->lock);
+	left = inputLeft(pFake);
+	pthread_mutex_unlock(&pFake->lock);
+	return left;
+}
+
+void fake_network_free(FakeNetwork_t *pFake) {
+	int i;
+
+	pthread_mutex_lock(&pFake->lock);
+	for (i = 0; i < pFake->segmentCount; i++) {
+		free(pFake->segments[i].pData);
+	}
+	pFake->segmentCount = pFake->segmentRead = 0;
+	pthread_mutex_unlock(&pFake->lock);
+}
+
+int iot_tls_init(Network *pNetwork) {
+	pTlsNetwork = pNetwork;
+	pNetwork->mqttread = fakeRead;
+	pNetwork->mqttreadsome = (pFakeTlsNetwork != NULL) ? pFakeTlsNetwork->network.mqttreadsome : NULL;
+	pNetwork->mqttwait = fakeWait;
+	pNetwork->mqttwrite = fakeWrite;
+	pNetwork->disconnect = fakeDisconnect;
+	return 0;
+}
+
+int iot_tls_connect(Network *pNetwork, TLSConnectParams params) {
+	(void)params;
+	if (pNetwork != pTlsNetwork || pFakeTlsNetwork == NULL) {
+		return -1;
+	}
+	pthread_mutex_lock(&pFakeTlsNetwork->lock);
+	pFakeTlsNetwork->isClosed = false;
+	pthread_mutex_unlock(&pFakeTlsNetwork->lock);
+	return 0;
+}
+
+int iot_tls_write(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) {
+	return fakeWrite(pNetwork, pMsg, len, timeout_ms);
+}
+
+int iot_tls_read(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) {
+	return fakeRead(pNetwork, pMsg, len, timeout_ms);
+}
+
+int iot_tls_read_some(Network *pNetwork, unsigned char *pMsg, int len, int timeout_ms) {
+	return fakeReadSome(pNetwork, pMsg, len, timeout_ms);
+}
+
+void iot_tls_disconnect(Network *pNetwork) {
+	fakeDisconnect(pNetwork);
+}
+
+int iot_tls_destroy(Network *pNetwork) {
+	(void)pNetwork;
+	return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file fake_network.h
+ * @brief A Network for the host tests, reading scripted bytes and keeping what is written.
+ *
+ * The input is a queue of segments read one after the other. A pattern segment is
+ * generated as it is read, so a payload of any size costs no memory in the test.
+ * Input may be pushed from another thread while the client waits in mqttwait.
+ */
+
+#ifndef __FAKE_NETWORK_H_
+#define __FAKE_NETWORK_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "network_interface.h"
+
+#define FAKE_NETWORK_MAX_SEGMENTS 16
+#define FAKE_NETWORK_OUTPUT_SIZE 65536
+
+typedef struct {
+	unsigned char *pData;	///< Copy of the bytes, NULL for a pattern segment
+	size_t length;
+	size_t position;		///< Bytes of the segment already read
+} FakeNetworkSegment_t;
+
+typedef struct FakeNetwork FakeNetwork_t;
+
+/** Called with the bytes of each write, without the lock so it may push an answer */
+typedef void (*FakeNetworkWriteHook_t)(FakeNetwork_t *pFake, const unsigned char *pBytes, size_t length);
+
+struct FakeNetwork {
+	Network network;		///< Handed to the client, first so the callbacks find the fake from it
+	FakeNetworkSegment_t segments[FAKE_NETWORK_MAX_SEGMENTS];
+	int segmentCount;
+	int segmentRead;		///< Segment the next read starts in
+	unsigned char output[FAKE_NETWORK_OUTPUT_SIZE];	///< The first bytes written
+	size_t outputLen;		///< Bytes written, some of them may not be in output
+	bool isClosed;			///< Reads and writes fail, as on a dropped connection
+	int reads;				///< Calls to the read functions
+	size_t largestRead;		///< Largest length a read asked for
+	pthread_mutex_t lock;	///< Guards the fields above, taken by each call
+	pthread_cond_t changed;	///< Signalled when input is pushed or the connection closes
+	FakeNetworkWriteHook_t onWrite;	///< May be NULL, set after fake_network_init()
+};
+
+/** The fake behind the iot_tls_* functions, and so behind the MQTT client of the wrapper */
+extern FakeNetwork_t *pFakeTlsNetwork;
+
+/**
+ * @brief Set up an empty fake. The client reads whole lengths through mqttread, and
+ * also through mqttreadsome when readSome is true, in pieces of random size. Its
+ * mqttwait returns once input is queued.
+ */
+void fake_network_init(FakeNetwork_t *pFake, bool readSome);
+
+/** @brief Queue a copy of length bytes for the client to read */
+void fake_network_push(FakeNetwork_t *pFake, const void *pData, size_t length);
+
+/** @brief Queue length bytes, each the low byte of its offset from the start of the segment */
+void fake_network_push_pattern(FakeNetwork_t *pFake, size_t length);
+
+/** @brief Bytes queued that have not been read yet */
+size_t fake_network_input_left(FakeNetwork_t *pFake);
+
+/** @brief Free the queued segments */
+void fake_network_free(FakeNetwork_t *pFake);
+
+#endif /* __FAKE_NETWORK_H_ */
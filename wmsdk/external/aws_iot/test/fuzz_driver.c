@@ -0,0 +1,157 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Runs a fuzz target without libFuzzer, which the host compiler may not have. Every
+ * file of the corpus directory given is run as it is, then mutations of them, so that
+ * the sanitizers see inputs the corpus does not hold:
+ *
+ *   fuzz_<target> <corpus directory> [iterations]
+ *
+ * The targets define LLVMFuzzerTestOneInput() as for libFuzzer, so they also build
+ * with clang -fsanitize=fuzzer,address and without this file.
+ */
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unit_test.h"
+
+#define MAX_SEEDS 256
+#define MAX_INPUT_LEN 4096
+#define DEFAULT_ITERATIONS 1000000
+
+int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t size);
+
+typedef struct {
+	uint8_t *pData;
+	size_t size;
+} Seed_t;
+
+static Seed_t seeds[MAX_SEEDS];
+static int seedCount;
+static uint32_t randomState = 1;
+
+// a generator of its own, the runs are the same on every host
+static uint32_t nextRandom(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+	return randomState;
+}
+
+static void loadCorpus(const char *pDirectory) {
+	char path[512];
+	struct dirent *pEntry;
+	DIR *pDir = opendir(pDirectory);
+	FILE *pFile;
+
+	TEST_ASSERT(pDir != NULL);
+	while ((pEntry = readdir(pDir)) != NULL && seedCount < MAX_SEEDS) {
+		if (pEntry->d_name[0] == '.') {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", pDirectory, pEntry->d_name);
+		TEST_ASSERT((pFile = fopen(path, "rb")) != NULL);
+		seeds[seedCount].pData = malloc(MAX_INPUT_LEN);
+		TEST_ASSERT(seeds[seedCount].pData != NULL);
+		seeds[seedCount].size = fread(seeds[seedCount].pData, 1, MAX_INPUT_LEN, pFile);
+		fclose(pFile);
+		seedCount++;
+	}
+	closedir(pDir);
+	TEST_ASSERT(seedCount > 0);
+}
+
+// a few random edits of a seed: byte flips and sets, insertions, deletions, a cut and a splice
+static size_t mutate(uint8_t *pInput, size_t size) {
+	int edits = 1 + nextRandom() % 4;
+	const Seed_t *pOther;
+	size_t at;
+	size_t n;
+
+	while (edits-- > 0) {
+		at = (size > 0) ? nextRandom() % size : 0;
+		switch (nextRandom() % 6) {
+		case 0:
+			if (size > 0) {
+				pInput[at] ^= 1 << (nextRandom() % 8);
+			}
+			break;
+		case 1:
+			if (size > 0) {
+				pInput[at] = (nextRandom() & 1) ? (uint8_t)nextRandom() : 0xFF;
+			}
+			break;
+		case 2:
+			if (size < MAX_INPUT_LEN) {
+				memmove(pInput + at + 1, pInput + at, size - at);
+				pInput[at] = (uint8_t)nextRandom();
+				size++;
+			}
+			break;
+		case 3:
+			if (size > 0) {
+				memmove(pInput + at, pInput + at + 1, size - at - 1);
+				size--;
+			}
+			break;
+		case 4:
+			size = at;
+			break;
+		default:
+			pOther = &seeds[nextRandom() % seedCount];
+			n = pOther->size - ((pOther->size > 0) ? nextRandom() % pOther->size : 0);
+			if (at + n > MAX_INPUT_LEN) {
+				n = MAX_INPUT_LEN - at;
+			}
+			memcpy(pInput + at, pOther->pData + pOther->size - n, n);
+			size = at + n;
+			break;
+		}
+	}
+	return size;
+}
+
+int main(int argc, char *argv[]) {
+	static uint8_t input[MAX_INPUT_LEN];
+	long iterations = DEFAULT_ITERATIONS;
+	long i;
+	size_t size;
+	int s;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <corpus directory> [iterations]\n", argv[0]);
+		return 2;
+	}
+	if (argc > 2) {
+		iterations = atol(argv[2]);
+	}
+	loadCorpus(argv[1]);
+	for (s = 0; s < seedCount; s++) {
+		LLVMFuzzerTestOneInput(seeds[s].pData, seeds[s].size);
+	}
+	for (i = 0; i < iterations; i++) {
+		const Seed_t *pSeed = &seeds[nextRandom() % seedCount];
+
+		memcpy(input, pSeed->pData, pSeed->size);
+		size = mutate(input, pSeed->size);
+		LLVMFuzzerTestOneInput(input, size);
+	}
+	printf("%d inputs of the corpus, %ld mutations\n", seedCount, iterations);
+	return 0;
+}
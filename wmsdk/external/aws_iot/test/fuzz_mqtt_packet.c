@@ -0,0 +1,143 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Every deserializer of MQTTPacket over the same input, in a buffer of exactly its size
+ * so that the address sanitizer reports any read past it. What a deserializer accepts
+ * has to point inside the buffer, and a PUBLISH or ack accepted has to come out the
+ * same once serialized again.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MQTTPacket.h"
+#include "unit_test.h"
+
+#define MAX_FILTERS 8
+
+static bool isInside(const unsigned char *pBuffer, size_t size, const void *pData, int length) {
+	const unsigned char *p = (const unsigned char *)pData;
+
+	return length >= 0 && p >= pBuffer && p + length <= pBuffer + size;
+}
+
+static bool isStringInside(const unsigned char *pBuffer, size_t size, const MQTTString *pString) {
+	return pString->lenstring.len == 0 || isInside(pBuffer, size, pString->lenstring.data, pString->lenstring.len);
+}
+
+static void checkPublish(unsigned char *pBuffer, size_t size) {
+	static unsigned char again[8192];
+	unsigned char dup, retained, dup2, retained2;
+	unsigned short packetId, packetId2;
+	unsigned char *pPayload, *pPayload2;
+	MQTTString topic, topic2;
+	int qos, qos2, payloadLen, payloadLen2;
+	int length;
+
+	if (MQTTDeserialize_publish(&dup, &qos, &retained, &packetId, &topic, &pPayload, &payloadLen, pBuffer, size) != 1) {
+		return;
+	}
+	TEST_ASSERT(isStringInside(pBuffer, size, &topic));
+	TEST_ASSERT(isInside(pBuffer, size, pPayload, payloadLen));
+
+	length = MQTTSerialize_publish(again, sizeof(again), dup, qos, retained, packetId, topic, pPayload, payloadLen);
+	TEST_ASSERT(length > 0 && (size_t)length <= size);
+	TEST_ASSERT(MQTTDeserialize_publish(&dup2, &qos2, &retained2, &packetId2, &topic2, &pPayload2, &payloadLen2,
+			again, length) == 1);
+	TEST_ASSERT(dup2 == dup && qos2 == qos && retained2 == retained && (qos == 0 || packetId2 == packetId));
+	TEST_ASSERT(topic2.lenstring.len == topic.lenstring.len
+			&& memcmp(topic2.lenstring.data, topic.lenstring.data, topic.lenstring.len) == 0);
+	TEST_ASSERT(payloadLen2 == payloadLen && memcmp(pPayload2, pPayload, payloadLen) == 0);
+}
+
+static void checkAck(unsigned char *pBuffer, size_t size) {
+	unsigned char again[4];
+	unsigned char type, dup, type2, dup2;
+	unsigned short packetId, packetId2;
+
+	if (MQTTDeserialize_ack(&type, &dup, &packetId, pBuffer, size) != 1) {
+		return;
+	}
+	TEST_ASSERT(MQTTSerialize_ack(again, sizeof(again), type, dup, packetId) == 4);
+	TEST_ASSERT(MQTTDeserialize_ack(&type2, &dup2, &packetId2, again, sizeof(again)) == 1);
+	TEST_ASSERT(type2 == type && dup2 == dup && packetId2 == packetId);
+}
+
+static void checkSubscriptions(unsigned char *pBuffer, size_t size) {
+	MQTTString filters[MAX_FILTERS];
+	int qoss[MAX_FILTERS];
+	unsigned short packetId;
+	unsigned char dup;
+	int count;
+	int i;
+
+	if (MQTTDeserialize_suback(&packetId, MAX_FILTERS, &count, qoss, pBuffer, size) == 1) {
+		TEST_ASSERT(count >= 0 && count <= MAX_FILTERS);
+	}
+	MQTTDeserialize_unsuback(&packetId, pBuffer, size);
+	if (MQTTDeserialize_subscribe(&dup, &packetId, MAX_FILTERS, &count, filters, qoss, pBuffer, size) == 1) {
+		TEST_ASSERT(count >= 0 && count <= MAX_FILTERS);
+		for (i = 0; i < count; i++) {
+			TEST_ASSERT(isStringInside(pBuffer, size, &filters[i]));
+		}
+	}
+	if (MQTTDeserialize_unsubscribe(&dup, &packetId, MAX_FILTERS, &count, filters, pBuffer, size) == 1) {
+		TEST_ASSERT(count >= 0 && count <= MAX_FILTERS);
+		for (i = 0; i < count; i++) {
+			TEST_ASSERT(isStringInside(pBuffer, size, &filters[i]));
+		}
+	}
+}
+
+static void checkConnect(unsigned char *pBuffer, size_t size) {
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	unsigned char sessionPresent, returnCode;
+
+	MQTTDeserialize_connack(&sessionPresent, &returnCode, pBuffer, size);
+	if (MQTTDeserialize_connect(&data, pBuffer, size) == 1) {
+		TEST_ASSERT(isStringInside(pBuffer, size, &data.clientID));
+		if (data.willFlag) {
+			TEST_ASSERT(isStringInside(pBuffer, size, &data.will.topicName));
+			TEST_ASSERT(isStringInside(pBuffer, size, &data.will.message));
+		}
+		TEST_ASSERT(isStringInside(pBuffer, size, &data.username));
+		TEST_ASSERT(isStringInside(pBuffer, size, &data.password));
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *pData, size_t size) {
+	unsigned char *pBuffer;
+	int value;
+
+	if (size == 0 || size > 4096) {
+		return 0;
+	}
+	pBuffer = malloc(size);
+	TEST_ASSERT(pBuffer != NULL);
+	memcpy(pBuffer, pData, size);
+
+	if (MQTTPacket_decodeBufLen(pBuffer + 1, size - 1, &value) > 0) {
+		TEST_ASSERT(value >= 0 && (size_t)value <= size);
+	}
+	checkPublish(pBuffer, size);
+	checkAck(pBuffer, size);
+	checkSubscriptions(pBuffer, size);
+	checkConnect(pBuffer, size);
+
+	free(pBuffer);
+	return 0;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file aws_iot_file_store.h
+ * @brief File backends of the session store and the shadow snapshot, for host builds.
+ *
+ * They keep what the flash backends of the device keep, in the same layout, so that a
+ * restart of the device is a restart of the host program on the same file.
+ */
+
+#ifndef __AWS_IOT_FILE_STORE_H_
+#define __AWS_IOT_FILE_STORE_H_
+
+#include "aws_iot_session_store.h"
+#include "aws_iot_shadow_snapshot.h"
+
+/**
+ * @brief Set up a session store backed by a file
+ *
+ * Every record has a slot of its own in the file, which is created if it does not exist.
+ * A slot that was never written, or whose header was not, reads back empty.
+ *
+ * @param pStore	Session store to set up
+ * @param pPath		File of the records
+ * @return An IoT Error Type defining successful/failed setup of the store
+ */
+IoT_Error_t aws_iot_session_store_file_init(SessionStore_t *pStore, const char *pPath);
+
+/** @brief Close the file of a session store set up by aws_iot_session_store_file_init() */
+void aws_iot_session_store_file_close(SessionStore_t *pStore);
+
+/**
+ * @brief Set up a shadow snapshot store backed by a file
+ *
+ * The snapshot is kept as in the flash sector of aws_iot_shadow_snapshot_flash_init(),
+ * behind its magic, which is written last. The file is created if it does not exist.
+ *
+ * @param pStore	Snapshot store to set up
+ * @param pPath		File of the snapshot
+ * @return An IoT Error Type defining successful/failed setup of the store
+ */
+IoT_Error_t aws_iot_shadow_snapshot_file_init(ShadowSnapshotStore_t *pStore, const char *pPath);
+
+/** @brief Close the file of a snapshot store set up by aws_iot_shadow_snapshot_file_init() */
+void aws_iot_shadow_snapshot_file_close(ShadowSnapshotStore_t *pStore);
+
+#endif /* __AWS_IOT_FILE_STORE_H_ */
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * File backend of the MQTT session store, for host builds. Records are laid out as the
+ * flash backend lays them out, one slot after the other, each behind its magic.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "aws_iot_file_store.h"
+
+// marks a slot holding a record, a slot never written reads short and an emptied one as zeros
+#define SESSION_RECORD_MAGIC 0x53455331
+#define SESSION_SLOT_SIZE (sizeof(uint32_t) + sizeof(SessionRecord_t))
+
+static int fileOf(const SessionStore_t *pStore) {
+	return (int)(intptr_t)pStore->pContext;
+}
+
+static off_t slotOffset(uint8_t slot) {
+	return (off_t)slot * SESSION_SLOT_SIZE;
+}
+
+static IoT_Error_t fileLoad(const SessionStore_t *pStore, uint8_t slot, SessionRecord_t *pRecord) {
+	uint32_t magic = 0;
+	ssize_t n;
+
+	pRecord->isUsed = false;
+	n = pread(fileOf(pStore), &magic, sizeof(magic), slotOffset(slot));
+	if (n < 0) {
+		return GENERIC_ERROR;
+	}
+	if ((size_t)n < sizeof(magic) || SESSION_RECORD_MAGIC != magic) {
+		return NONE_ERROR;
+	}
+	n = pread(fileOf(pStore), pRecord, sizeof(SessionRecord_t), slotOffset(slot) + sizeof(magic));
+	// the unused tail of the payload may never have been written
+	if (n < (ssize_t)(sizeof(SessionRecord_t) - AWS_IOT_SESSION_STORE_PAYLOAD_LEN)
+			|| pRecord->PayloadLen > AWS_IOT_SESSION_STORE_PAYLOAD_LEN) {
+		pRecord->isUsed = false;
+		return (n < 0) ? GENERIC_ERROR : NONE_ERROR;
+	}
+	pRecord->topic[AWS_IOT_SESSION_STORE_TOPIC_LEN - 1] = '\0';
+	return NONE_ERROR;
+}
+
+static IoT_Error_t fileSave(const SessionStore_t *pStore, uint8_t slot, const SessionRecord_t *pRecord) {
+	uint32_t magic = 0;
+	size_t recordLen = sizeof(SessionRecord_t) - AWS_IOT_SESSION_STORE_PAYLOAD_LEN + pRecord->PayloadLen;
+
+	// the slot is emptied first and the record goes before the magic, a crash in between leaves it empty
+	if (pwrite(fileOf(pStore), &magic, sizeof(magic), slotOffset(slot)) != sizeof(magic)) {
+		return GENERIC_ERROR;
+	}
+	if (pwrite(fileOf(pStore), pRecord, recordLen, slotOffset(slot) + sizeof(magic)) != (ssize_t)recordLen) {
+		return GENERIC_ERROR;
+	}
+	magic = SESSION_RECORD_MAGIC;
+	if (pwrite(fileOf(pStore), &magic, sizeof(magic), slotOffset(slot)) != sizeof(magic)) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static IoT_Error_t fileErase(const SessionStore_t *pStore, uint8_t slot) {
+	uint32_t magic = 0;
+	ssize_t n;
+
+	n = pread(fileOf(pStore), &magic, sizeof(magic), slotOffset(slot));
+	if (n < 0) {
+		return GENERIC_ERROR;
+	}
+	if ((size_t)n < sizeof(magic) || SESSION_RECORD_MAGIC != magic) {
+		return NONE_ERROR;
+	}
+	magic = 0;
+	if (pwrite(fileOf(pStore), &magic, sizeof(magic), slotOffset(slot)) != sizeof(magic)) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_session_store_file_init(SessionStore_t *pStore, const char *pPath) {
+	int fd;
+
+	if (NULL == pStore || NULL == pPath) {
+		return NULL_VALUE_ERROR;
+	}
+	if ((fd = open(pPath, O_RDWR | O_CREAT, 0600)) < 0) {
+		return GENERIC_ERROR;
+	}
+
+	pStore->load = fileLoad;
+	pStore->save = fileSave;
+	pStore->erase = fileErase;
+	pStore->pContext = (void *)(intptr_t)fd;
+	return NONE_ERROR;
+}
+
+void aws_iot_session_store_file_close(SessionStore_t *pStore) {
+	close(fileOf(pStore));
+	pStore->pContext = (void *)(intptr_t)-1;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * File backend of the shadow snapshot, for host builds. The file is laid out as the
+ * flash backend lays out its sector, the magic and then the snapshot.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "aws_iot_file_store.h"
+
+// marks a file holding a snapshot, the same as in flash
+#define SHADOW_SNAPSHOT_MAGIC 0x53484431
+
+static int fileOf(const ShadowSnapshotStore_t *pStore) {
+	return (int)(intptr_t)pStore->pContext;
+}
+
+static IoT_Error_t fileLoad(const ShadowSnapshotStore_t *pStore, ShadowSnapshot_t *pSnapshot) {
+	uint32_t magic = 0;
+	ssize_t n;
+
+	pSnapshot->length = 0;
+	n = pread(fileOf(pStore), &magic, sizeof(magic), 0);
+	if (n < 0) {
+		return GENERIC_ERROR;
+	}
+	if ((size_t)n < sizeof(magic) || SHADOW_SNAPSHOT_MAGIC != magic) {
+		return NONE_ERROR;
+	}
+	n = pread(fileOf(pStore), pSnapshot, sizeof(ShadowSnapshot_t), sizeof(magic));
+	// the unused tail of the values is not written
+	if (n < (ssize_t)(sizeof(ShadowSnapshot_t) - AWS_IOT_SHADOW_SNAPSHOT_LEN)
+			|| (size_t)n < sizeof(ShadowSnapshot_t) - AWS_IOT_SHADOW_SNAPSHOT_LEN + pSnapshot->length) {
+		pSnapshot->length = 0;
+		return (n < 0) ? GENERIC_ERROR : NONE_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+static IoT_Error_t fileSave(const ShadowSnapshotStore_t *pStore, const ShadowSnapshot_t *pSnapshot) {
+	uint32_t magic = 0;
+	size_t snapshotLen = sizeof(ShadowSnapshot_t) - AWS_IOT_SHADOW_SNAPSHOT_LEN + pSnapshot->length;
+
+	// the magic is taken away as the flash sector is erased, and written back last
+	if (pwrite(fileOf(pStore), &magic, sizeof(magic), 0) != sizeof(magic)) {
+		return GENERIC_ERROR;
+	}
+	if (pwrite(fileOf(pStore), pSnapshot, snapshotLen, sizeof(magic)) != (ssize_t)snapshotLen) {
+		return GENERIC_ERROR;
+	}
+	magic = SHADOW_SNAPSHOT_MAGIC;
+	if (pwrite(fileOf(pStore), &magic, sizeof(magic), 0) != sizeof(magic)) {
+		return GENERIC_ERROR;
+	}
+	return NONE_ERROR;
+}
+
+IoT_Error_t aws_iot_shadow_snapshot_file_init(ShadowSnapshotStore_t *pStore, const char *pPath) {
+	int fd;
+
+	if (NULL == pStore || NULL == pPath) {
+		return NULL_VALUE_ERROR;
+	}
+	if ((fd = open(pPath, O_RDWR | O_CREAT, 0600)) < 0) {
+		return GENERIC_ERROR;
+	}
+
+	pStore->load = fileLoad;
+	pStore->save = fileSave;
+	pStore->pContext = (void *)(intptr_t)fd;
+	return NONE_ERROR;
+}
+
+void aws_iot_shadow_snapshot_file_close(ShadowSnapshotStore_t *pStore) {
+	close(fileOf(pStore));
+	pStore->pContext = (void *)(intptr_t)-1;
+}
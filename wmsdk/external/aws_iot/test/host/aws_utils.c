@@ -0,0 +1,29 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Host stand-in for the AWS configuration kept in the PSM of the device. Nothing
+ * is configured, so the SDK falls back to the values of aws_iot_config.h.
+ */
+
+#include <wmerrno.h>
+#include <aws_utils.h>
+
+int read_aws_thing(char *thing, unsigned thing_len)
+{
+	(void)thing;
+	(void)thing_len;
+	return -WM_FAIL;
+}
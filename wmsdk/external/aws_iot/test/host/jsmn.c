@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2010 Serge A. Zaitsev
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Host stand-in for the jsmn built into the WMSDK: upstream jsmn with
+ * JSMN_STRICT and JSMN_PARENT_LINKS, as jsmn.h configures it.
+ */
+
+#include <stddef.h>
+#include <jsmn.h>
+
+static jsmntok_t *jsmn_alloc_token(jsmn_parser *parser, jsmntok_t *tokens, size_t num_tokens)
+{
+	jsmntok_t *tok;
+
+	if (parser->toknext >= (int)num_tokens)
+		return NULL;
+	tok = &tokens[parser->toknext++];
+	tok->start = tok->end = -1;
+	tok->size = 0;
+	tok->parent = -1;
+	return tok;
+}
+
+static void jsmn_fill_token(jsmntok_t *token, jsmntype_t type, int start, int end)
+{
+	token->type = type;
+	token->start = start;
+	token->end = end;
+	token->size = 0;
+}
+
+static int jsmn_parse_primitive(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		size_t num_tokens)
+{
+	jsmntok_t *token;
+	int start = parser->pos;
+
+	for (; parser->pos < (int)len && js[parser->pos] != '\0'; parser->pos++) {
+		switch (js[parser->pos]) {
+		case '\t': case '\r': case '\n': case ' ':
+		case ',': case ']': case '}':
+			goto found;
+		}
+		if (js[parser->pos] < 32 || js[parser->pos] >= 127) {
+			parser->pos = start;
+			return JSMN_ERROR_INVAL;
+		}
+	}
+	/* in strict mode a primitive is followed by a comma, a bracket or a space */
+	parser->pos = start;
+	return JSMN_ERROR_PART;
+
+found:
+	token = jsmn_alloc_token(parser, tokens, num_tokens);
+	if (token == NULL) {
+		parser->pos = start;
+		return JSMN_ERROR_NOMEM;
+	}
+	jsmn_fill_token(token, JSMN_PRIMITIVE, start, parser->pos);
+	token->parent = parser->toksuper;
+	parser->pos--;
+	return 0;
+}
+
+static int jsmn_parse_string(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		size_t num_tokens)
+{
+	jsmntok_t *token;
+	int start = parser->pos;
+	int i;
+
+	parser->pos++;
+	for (; parser->pos < (int)len && js[parser->pos] != '\0'; parser->pos++) {
+		char c = js[parser->pos];
+
+		if (c == '\"') {
+			token = jsmn_alloc_token(parser, tokens, num_tokens);
+			if (token == NULL) {
+				parser->pos = start;
+				return JSMN_ERROR_NOMEM;
+			}
+			jsmn_fill_token(token, JSMN_STRING, start + 1, parser->pos);
+			token->parent = parser->toksuper;
+			return 0;
+		}
+
+		if (c == '\\' && parser->pos + 1 < (int)len) {
+			parser->pos++;
+			switch (js[parser->pos]) {
+			case '\"': case '/': case '\\': case 'b':
+			case 'f': case 'r': case 'n': case 't':
+				break;
+			case 'u':
+				parser->pos++;
+				for (i = 0; i < 4 && parser->pos < (int)len && js[parser->pos] != '\0'; i++) {
+					char h = js[parser->pos];
+					if (!((h >= '0' && h <= '9') || (h >= 'A' && h <= 'F') || (h >= 'a' && h <= 'f'))) {
+						parser->pos = start;
+						return JSMN_ERROR_INVAL;
+					}
+					parser->pos++;
+				}
+				parser->pos--;
+				break;
+			default:
+				parser->pos = start;
+				return JSMN_ERROR_INVAL;
+			}
+		}
+	}
+	parser->pos = start;
+	return JSMN_ERROR_PART;
+}
+
+int jsmn_parse(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens, unsigned int num_tokens)
+{
+	int r;
+	int i;
+	jsmntok_t *token;
+	int count = parser->toknext;
+
+	for (; parser->pos < (int)len && js[parser->pos] != '\0'; parser->pos++) {
+		char c = js[parser->pos];
+		jsmntype_t type;
+
+		switch (c) {
+		case '{': case '[':
+			count++;
+			token = jsmn_alloc_token(parser, tokens, num_tokens);
+			if (token == NULL)
+				return JSMN_ERROR_NOMEM;
+			if (parser->toksuper != -1) {
+				tokens[parser->toksuper].size++;
+				token->parent = parser->toksuper;
+			}
+			token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
+			token->start = parser->pos;
+			parser->toksuper = parser->toknext - 1;
+			break;
+		case '}': case ']':
+			type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
+			if (parser->toknext < 1)
+				return JSMN_ERROR_INVAL;
+			token = &tokens[parser->toknext - 1];
+			for (;;) {
+				if (token->start != -1 && token->end == -1) {
+					if (token->type != type)
+						return JSMN_ERROR_INVAL;
+					token->end = parser->pos + 1;
+					parser->toksuper = token->parent;
+					break;
+				}
+				if (token->parent == -1)
+					break;
+				token = &tokens[token->parent];
+			}
+			break;
+		case '\"':
+			r = jsmn_parse_string(parser, js, len, tokens, num_tokens);
+			if (r < 0)
+				return r;
+			count++;
+			if (parser->toksuper != -1)
+				tokens[parser->toksuper].size++;
+			break;
+		case '\t': case '\r': case '\n': case ' ':
+			break;
+		case ':':
+			parser->toksuper = parser->toknext - 1;
+			break;
+		case ',':
+			if (parser->toksuper != -1 && tokens[parser->toksuper].type != JSMN_ARRAY &&
+					tokens[parser->toksuper].type != JSMN_OBJECT)
+				parser->toksuper = tokens[parser->toksuper].parent;
+			break;
+		case '-': case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9':
+		case 't': case 'f': case 'n':
+			/* a primitive is not a key, and does not follow another value */
+			if (parser->toksuper != -1) {
+				jsmntok_t *t = &tokens[parser->toksuper];
+				if (t->type == JSMN_OBJECT || (t->type == JSMN_STRING && t->size != 0))
+					return JSMN_ERROR_INVAL;
+			}
+			r = jsmn_parse_primitive(parser, js, len, tokens, num_tokens);
+			if (r < 0)
+				return r;
+			count++;
+			if (parser->toksuper != -1)
+				tokens[parser->toksuper].size++;
+			break;
+		default:
+			return JSMN_ERROR_INVAL;
+		}
+	}
+
+	for (i = parser->toknext - 1; i >= 0; i--) {
+		/* unmatched opened object or array */
+		if (tokens[i].start != -1 && tokens[i].end == -1)
+			return JSMN_ERROR_PART;
+	}
+	return count;
+}
+
+void jsmn_init(jsmn_parser *parser)
+{
+	parser->pos = 0;
+	parser->toknext = 0;
+	parser->toksuper = -1;
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Host stand-in for the parts of the WMSDK OS abstraction layer that are not inline.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wm_os.h>
+
+pthread_mutex_t osCriticalSection = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+	void (*mainFunc)(os_thread_arg_t arg);
+	void *arg;
+} ThreadStart_t;
+
+static void *startThread(void *pArg) {
+	ThreadStart_t start = *(ThreadStart_t *)pArg;
+
+	free(pArg);
+	start.mainFunc(start.arg);
+	return NULL;
+}
+
+int os_thread_create(os_thread_t *thandle, const char *name, void (*main_func)(os_thread_arg_t arg), void *arg,
+		os_thread_stack_t *stack, int prio) {
+	ThreadStart_t *pStart = malloc(sizeof(*pStart));
+
+	(void)name;
+	(void)stack;
+	(void)prio;
+	if (pStart == NULL) {
+		return -WM_FAIL;
+	}
+	pStart->mainFunc = main_func;
+	pStart->arg = arg;
+	if (pthread_create(thandle, NULL, startThread, pStart) != 0) {
+		free(pStart);
+		return -WM_FAIL;
+	}
+	pthread_detach(*thandle);
+	return WM_SUCCESS;
+}
+
+// waits on changed until isReady() or wait ticks have passed, with lock held. Returns isReady()
+static int waitFor(pthread_mutex_t *lock, pthread_cond_t *changed, unsigned long wait, int (*isReady)(void *),
+		void *pObject) {
+	struct timespec deadline;
+
+	if (wait == OS_WAIT_FOREVER) {
+		while (!isReady(pObject)) {
+			pthread_cond_wait(changed, lock);
+		}
+		return 1;
+	}
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += wait / 1000;
+	deadline.tv_nsec += (long)(wait % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	while (!isReady(pObject)) {
+		if (pthread_cond_timedwait(changed, lock, &deadline) == ETIMEDOUT) {
+			return isReady(pObject);
+		}
+	}
+	return 1;
+}
+
+static int hasRoom(void *pObject) {
+	os_queue_t *pQueue = pObject;
+
+	return pQueue->count < pQueue->capacity;
+}
+
+static int hasItem(void *pObject) {
+	return ((os_queue_t *)pObject)->count > 0;
+}
+
+static int hasCount(void *pObject) {
+	return ((os_semaphore_t *)pObject)->count > 0;
+}
+
+int os_queue_create(os_queue_t *qhandle, const char *name, int msgsize, os_queue_pool_t *poolname) {
+	(void)name;
+	memset(qhandle, 0, sizeof(*qhandle));
+	qhandle->itemSize = msgsize;
+	qhandle->capacity = poolname->size / msgsize;
+	if (qhandle->capacity == 0 || (qhandle->pItems = malloc(poolname->size)) == NULL) {
+		return -WM_FAIL;
+	}
+	pthread_mutex_init(&qhandle->lock, NULL);
+	pthread_cond_init(&qhandle->changed, NULL);
+	return WM_SUCCESS;
+}
+
+int os_queue_send(os_queue_t *qhandle, const void *msg, unsigned long wait) {
+	int rc = -WM_FAIL;
+
+	pthread_mutex_lock(&qhandle->lock);
+	if (waitFor(&qhandle->lock, &qhandle->changed, wait, hasRoom, qhandle)) {
+		memcpy(qhandle->pItems + ((qhandle->head + qhandle->count) % qhandle->capacity) * qhandle->itemSize, msg,
+				qhandle->itemSize);
+		qhandle->count++;
+		pthread_cond_broadcast(&qhandle->changed);
+		rc = WM_SUCCESS;
+	}
+	pthread_mutex_unlock(&qhandle->lock);
+	return rc;
+}
+
+int os_queue_recv(os_queue_t *qhandle, void *msg, unsigned long wait) {
+	int rc = -WM_FAIL;
+
+	pthread_mutex_lock(&qhandle->lock);
+	if (waitFor(&qhandle->lock, &qhandle->changed, wait, hasItem, qhandle)) {
+		memcpy(msg, qhandle->pItems + qhandle->head * qhandle->itemSize, qhandle->itemSize);
+		qhandle->head = (qhandle->head + 1) % qhandle->capacity;
+		qhandle->count--;
+		pthread_cond_broadcast(&qhandle->changed);
+		rc = WM_SUCCESS;
+	}
+	pthread_mutex_unlock(&qhandle->lock);
+	return rc;
+}
+
+int os_semaphore_create_counting(os_semaphore_t *mhandle, const char *name, unsigned long maxcount,
+		unsigned long initcount) {
+	(void)name;
+	pthread_mutex_init(&mhandle->lock, NULL);
+	pthread_cond_init(&mhandle->changed, NULL);
+	mhandle->count = initcount;
+	mhandle->maxCount = maxcount;
+	return WM_SUCCESS;
+}
+
+int os_semaphore_get(os_semaphore_t *mhandle, unsigned long wait) {
+	int rc = -WM_FAIL;
+
+	pthread_mutex_lock(&mhandle->lock);
+	if (waitFor(&mhandle->lock, &mhandle->changed, wait, hasCount, mhandle)) {
+		mhandle->count--;
+		rc = WM_SUCCESS;
+	}
+	pthread_mutex_unlock(&mhandle->lock);
+	return rc;
+}
+
+int os_semaphore_put(os_semaphore_t *mhandle) {
+	int rc = -WM_FAIL;
+
+	pthread_mutex_lock(&mhandle->lock);
+	if (mhandle->count < mhandle->maxCount) {
+		mhandle->count++;
+		pthread_cond_broadcast(&mhandle->changed);
+		rc = WM_SUCCESS;
+	}
+	pthread_mutex_unlock(&mhandle->lock);
+	return rc;
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file wm_os.h
+ * @brief Host stand-in for the WMSDK OS abstraction layer.
+ *
+ * Only the calls made by the SDK sources built into the tests, on top of
+ * POSIX threads and the monotonic clock.
+ */
+
+#ifndef __WM_OS_H__
+#define __WM_OS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <wmerrno.h>
+
+#define OS_WAIT_FOREVER 0xffffffff
+#define OS_NO_WAIT 0
+#define OS_MUTEX_INHERIT 1
+#define OS_MUTEX_NO_INHERIT 0
+#define OS_PRIO_3 3
+
+typedef int os_timer_t;
+typedef pthread_mutex_t os_mutex_t;
+
+/** A tick is a millisecond */
+#define os_msec_to_ticks(msecs) (msecs)
+
+typedef pthread_t os_thread_t;
+typedef void *os_thread_arg_t;
+
+/** The stack is the one of the host thread, only its size is kept */
+typedef struct {
+	size_t size;
+} os_thread_stack_t;
+#define os_thread_stack_define(stackname, stacksize) os_thread_stack_t stackname = {(stacksize)}
+
+typedef struct {
+	int size;
+} os_queue_pool_t;
+#define os_queue_pool_define(poolname, poolsize) os_queue_pool_t poolname = {(poolsize)}
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	unsigned char *pItems;
+	int itemSize;
+	int capacity;
+	int head;
+	int count;
+} os_queue_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+	unsigned long count;
+	unsigned long maxCount;
+} os_semaphore_t;
+
+extern pthread_mutex_t osCriticalSection;
+
+/** Interrupts of the target are left alone, the threads of the host are kept out instead */
+static inline unsigned long os_enter_critical_section(void)
+{
+	pthread_mutex_lock(&osCriticalSection);
+	return 0;
+}
+
+static inline void os_exit_critical_section(unsigned long state)
+{
+	(void)state;
+	pthread_mutex_unlock(&osCriticalSection);
+}
+
+/** Microseconds of the monotonic clock, wrapping as the one of the target does */
+static inline uint32_t os_get_timestamp(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)(now.tv_sec * 1000000ULL + now.tv_nsec / 1000);
+}
+
+static inline int os_mutex_create(os_mutex_t *mhandle, const char *name, int flags)
+{
+	pthread_mutexattr_t attr;
+	int rc;
+
+	(void)name;
+	(void)flags;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
+	rc = pthread_mutex_init(mhandle, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return rc == 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+static inline int os_mutex_get(os_mutex_t *mhandle, unsigned long wait)
+{
+	(void)wait;
+	return pthread_mutex_lock(mhandle) == 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+static inline int os_mutex_put(os_mutex_t *mhandle)
+{
+	return pthread_mutex_unlock(mhandle) == 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+static inline int os_recursive_mutex_create(os_mutex_t *mhandle, const char *name)
+{
+	pthread_mutexattr_t attr;
+	int rc;
+
+	(void)name;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	rc = pthread_mutex_init(mhandle, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return rc == 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+static inline int os_recursive_mutex_get(os_mutex_t *mhandle, unsigned long wait)
+{
+	return os_mutex_get(mhandle, wait);
+}
+
+static inline int os_recursive_mutex_put(os_mutex_t *mhandle)
+{
+	return os_mutex_put(mhandle);
+}
+
+static inline int os_mutex_delete(os_mutex_t *mhandle)
+{
+	return pthread_mutex_destroy(mhandle) == 0 ? WM_SUCCESS : -WM_FAIL;
+}
+
+int os_thread_create(os_thread_t *thandle, const char *name, void (*main_func)(os_thread_arg_t arg), void *arg,
+		os_thread_stack_t *stack, int prio);
+
+static inline os_thread_t os_get_current_task_handle(void)
+{
+	return pthread_self();
+}
+
+static inline void os_thread_sleep(int ticks)
+{
+	usleep(ticks * 1000);
+}
+
+/** The pool only sets the capacity, the items are allocated on the heap */
+int os_queue_create(os_queue_t *qhandle, const char *name, int msgsize, os_queue_pool_t *poolname);
+int os_queue_send(os_queue_t *qhandle, const void *msg, unsigned long wait);
+int os_queue_recv(os_queue_t *qhandle, void *msg, unsigned long wait);
+
+int os_semaphore_create_counting(os_semaphore_t *mhandle, const char *name, unsigned long maxcount,
+		unsigned long initcount);
+int os_semaphore_get(os_semaphore_t *mhandle, unsigned long wait);
+int os_semaphore_put(os_semaphore_t *mhandle);
+
+#endif /* __WM_OS_H__ */
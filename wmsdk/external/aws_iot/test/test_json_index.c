@@ -0,0 +1,174 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Next siblings and key lookups of aws_iot_json_index.h against walking every token,
+ * on nested documents, a configuration document of 200 keys and objects that
+ * repeat a key.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "aws_iot_json_index.h"
+#include "aws_iot_json_tokenizer.h"
+#include "unit_test.h"
+
+#define MAX_TOKENS 1200
+#define CONFIG_KEYS 200
+
+static jsmntok_t tokens[MAX_TOKENS];
+static int16_t next[MAX_TOKENS];
+static char config[16384];
+
+static int32_t tokenize(const char *pJson) {
+	jsmn_parser parser;
+	int32_t count;
+
+	jsmn_init(&parser);
+	count = aws_iot_json_tokenize(&parser, pJson, strlen(pJson), tokens, MAX_TOKENS);
+	TEST_ASSERT(count > 0);
+	aws_iot_json_index_siblings(tokens, count, next);
+	return count;
+}
+
+// the first token past the value of token i and all it holds
+static int32_t skipLinear(int32_t count, int32_t i) {
+	int32_t end = tokens[i].end;
+	int32_t j;
+
+	if (tokens[i].type == JSMN_STRING && tokens[i].size > 0) {
+		end = tokens[i + 1].end;	// a key, its value is nested in it
+	}
+	for (j = i + 1; j < count && tokens[j].start < end; j++) {
+	}
+	return j;
+}
+
+// the search the jsonv2 getters do, every token of the object is looked at
+static int32_t findLinear(const char *pJson, int32_t count, int32_t object, const char *pKey) {
+	size_t length = strlen(pKey);
+	int32_t i;
+
+	for (i = object + 1; i < count && tokens[i].start < tokens[object].end; i++) {
+		if (tokens[i].parent == object && tokens[i].type == JSMN_STRING
+				&& (size_t)(tokens[i].end - tokens[i].start) == length
+				&& memcmp(pJson + tokens[i].start, pKey, length) == 0) {
+			return i + 1;
+		}
+	}
+	return -1;
+}
+
+static void checkSiblings(int32_t count) {
+	int32_t i;
+
+	for (i = 0; i < count; i++) {
+		TEST_ASSERT(next[i] == skipLinear(count, i));
+	}
+}
+
+// 200 keys, one in ten holding a nested object
+static int32_t tokenizeConfig(void) {
+	size_t n = 0;
+	int i;
+
+	n += snprintf(config + n, sizeof(config) - n, "{");
+	for (i = 0; i < CONFIG_KEYS; i++) {
+		if (i % 10 == 3) {
+			n += snprintf(config + n, sizeof(config) - n, "%s\"key%03d\":{\"a\":[1,2,{\"key%03d\":3}],\"c\":\"d\"}",
+					(i == 0) ? "" : ",", i, i + 1);
+		} else {
+			n += snprintf(config + n, sizeof(config) - n, "%s\"key%03d\":%d", (i == 0) ? "" : ",", i, i * 7);
+		}
+	}
+	snprintf(config + n, sizeof(config) - n, "}");
+	TEST_ASSERT(strlen(config) < sizeof(config) - 1);
+	return tokenize(config);
+}
+
+static void test_siblings(void) {
+	static const char *documents[] = {
+		"{\"a\":[1,{\"b\":[[],{}]},\"x\"],\"c\":{\"d\":{\"e\":null}},\"f\":\"g\"}",
+		"[1,[2,[3,[4]]],{\"k\":\"v\",\"k\":2}]",
+		"{\"dup\":1,\"dup\":{\"dup\":[1,2]},\"dup\":3}",
+		"{}",
+		"\"top\"",
+	};
+	unsigned int d;
+
+	for (d = 0; d < sizeof(documents) / sizeof(documents[0]); d++) {
+		checkSiblings(tokenize(documents[d]));
+	}
+	checkSiblings(tokenizeConfig());
+}
+
+// every key of the configuration found both ways, and only at its own level
+static void test_config_keys(void) {
+	int16_t slots[512];
+	JsonKeyIndex_t index;
+	char key[16];
+	int32_t count = tokenizeConfig();
+	int32_t expected;
+	int i;
+
+	TEST_ASSERT(aws_iot_json_index_keys(&index, config, tokens, next, 0, slots, 256) == GENERIC_ERROR);
+	TEST_ASSERT(aws_iot_json_index_keys(&index, config, tokens, next, 0, slots, 500) == GENERIC_ERROR);
+	TEST_ASSERT(aws_iot_json_index_keys(&index, config, tokens, next, 1, slots, 512) == GENERIC_ERROR);
+	TEST_ASSERT(aws_iot_json_index_keys(&index, config, tokens, next, 0, slots, 512) == NONE_ERROR);
+	for (i = 0; i < CONFIG_KEYS; i++) {
+		snprintf(key, sizeof(key), "key%03d", i);
+		expected = findLinear(config, count, 0, key);
+		TEST_ASSERT(expected > 0);
+		TEST_ASSERT(aws_iot_json_find_key(config, tokens, next, 0, key) == expected);
+		TEST_ASSERT(aws_iot_json_index_find(&index, key) == expected);
+	}
+	TEST_ASSERT(aws_iot_json_find_key(config, tokens, next, 0, "key") == -1);
+	TEST_ASSERT(aws_iot_json_index_find(&index, "key") == -1);
+	TEST_ASSERT(aws_iot_json_index_find(&index, "a") == -1);
+	TEST_ASSERT(aws_iot_json_find_key(config, tokens, next, 1, "key000") == -1);
+}
+
+// a repeated key is found at its first place, its siblings skip the values of the others
+static void test_duplicate_keys(void) {
+	static const char document[] = "{\"dup\":1,\"x\":{\"dup\":9},\"dup\":{\"dup\":[1,2]},\"y\":true,\"dup\":3}";
+	int16_t slots[16];
+	JsonKeyIndex_t index;
+	int32_t count = tokenize(document);
+	int32_t inner;
+
+	checkSiblings(count);
+	// every key of the top level reached from the first
+	TEST_ASSERT(next[1] == 3 && next[3] == 7 && next[7] == 13 && next[13] == 15 && next[15] == 17);
+	TEST_ASSERT(next[0] == count);
+
+	TEST_ASSERT(aws_iot_json_find_key(document, tokens, next, 0, "dup") == 2);
+	TEST_ASSERT(aws_iot_json_index_keys(&index, document, tokens, next, 0, slots, 16) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_json_index_find(&index, "dup") == 2);
+	TEST_ASSERT(aws_iot_json_index_find(&index, "y") == 14);
+
+	// the object of the second "dup" keeps its own key apart
+	inner = aws_iot_json_find_key(document, tokens, next, 0, "x");
+	TEST_ASSERT(inner == 4 && aws_iot_json_find_key(document, tokens, next, inner, "dup") == 6);
+	TEST_ASSERT(aws_iot_json_index_keys(&index, document, tokens, next, 8, slots, 2) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_json_index_find(&index, "dup") == 10);
+	TEST_ASSERT(aws_iot_json_index_find(&index, "y") == -1);
+}
+
+int main(void) {
+	RUN_TEST(test_siblings);
+	RUN_TEST(test_config_keys);
+	RUN_TEST(test_duplicate_keys);
+	return 0;
+}
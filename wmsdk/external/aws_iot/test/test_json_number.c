@@ -0,0 +1,386 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * The parsers and writers of aws_iot_json_number.h against strtod(), strtof(),
+ * strtoll() and snprintf(), bit for bit: on both sides of the fast path, on the
+ * midpoints between floats, on mantissas of 19 digits and more, on the limits of
+ * every integer type and on the rounding of ties to a number of decimals. Every text
+ * is parsed from a heap block of its exact length, so a read past it is caught.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aws_iot_json_number.h"
+#include "unit_test.h"
+
+#define RANDOM_VALUES 200000
+
+static uint64_t randomState = 88172645463325252ull;
+
+static uint64_t random64(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return randomState;
+}
+
+// whether the text is a JSON number, the reference for both grammars
+static bool isJsonNumber(const char *pText) {
+	if (*pText == '-') {
+		pText++;
+	}
+	if (*pText == '0') {
+		pText++;
+	} else if (*pText >= '1' && *pText <= '9') {
+		while (*pText >= '0' && *pText <= '9') {
+			pText++;
+		}
+	} else {
+		return false;
+	}
+	if (*pText == '.') {
+		if (!(*++pText >= '0' && *pText <= '9')) {
+			return false;
+		}
+		while (*pText >= '0' && *pText <= '9') {
+			pText++;
+		}
+	}
+	if (*pText == 'e' || *pText == 'E') {
+		pText++;
+		if (*pText == '+' || *pText == '-') {
+			pText++;
+		}
+		if (!(*pText >= '0' && *pText <= '9')) {
+			return false;
+		}
+		while (*pText >= '0' && *pText <= '9') {
+			pText++;
+		}
+	}
+	return *pText == '\0';
+}
+
+// the text with nothing after it, not even a NULL
+static char *unterminated(const char *pText) {
+	size_t length = strlen(pText);
+	char *pCopy = malloc(length ? length : 1);
+
+	TEST_ASSERT(pCopy != NULL);
+	memcpy(pCopy, pText, length);
+	return pCopy;
+}
+
+static void checkFloating(const char *pText) {
+	char *pCopy = unterminated(pText);
+	size_t length = strlen(pText);
+	bool isNumber = isJsonNumber(pText);
+	double expected = strtod(pText, NULL);
+	float expectedFloat = strtof(pText, NULL);
+	double value = 0.0;
+	float floatValue = 0.0f;
+	IoT_Error_t rc;
+
+	rc = aws_iot_json_parse_double(pCopy, length, &value);
+	TEST_ASSERT((rc == NONE_ERROR) == (isNumber && !isinf(expected)));
+	TEST_ASSERT(rc != NONE_ERROR || memcmp(&value, &expected, sizeof(value)) == 0);
+
+	rc = aws_iot_json_parse_float(pCopy, length, &floatValue);
+	TEST_ASSERT((rc == NONE_ERROR) == (isNumber && !isinf(expectedFloat)));
+	TEST_ASSERT(rc != NONE_ERROR || memcmp(&floatValue, &expectedFloat, sizeof(floatValue)) == 0);
+	free(pCopy);
+}
+
+static void checkInteger(const char *pText, int32_t min, int32_t max) {
+	char *pCopy = unterminated(pText);
+	size_t length = strlen(pText);
+	bool isInteger = isJsonNumber(pText) && strpbrk(pText, ".eE") == NULL && length < 18;
+	long long expected = isInteger ? strtoll(pText, NULL, 10) : 0;
+	int32_t value = 12345;
+	uint32_t unsignedValue = 12345;
+	IoT_Error_t rc;
+
+	rc = aws_iot_json_parse_int32(pCopy, length, min, max, &value);
+	TEST_ASSERT((rc == NONE_ERROR) == (isInteger && expected >= min && expected <= max));
+	TEST_ASSERT(rc == NONE_ERROR ? value == expected : value == 12345);
+
+	if (max >= 0) {
+		rc = aws_iot_json_parse_uint32(pCopy, length, (uint32_t)max, &unsignedValue);
+		TEST_ASSERT((rc == NONE_ERROR) == (isInteger && expected >= 0 && expected <= max));
+		TEST_ASSERT(rc == NONE_ERROR ? unsignedValue == expected : unsignedValue == 12345);
+	}
+	free(pCopy);
+}
+
+// 15 significant digits and an exponent of 22 are on the fast path, one more of either is not
+static void test_fast_path_boundary(void) {
+	static const char *texts[] = {
+		"123456789012345", "1234567890123456", "12345678901234567", "999999999999999", "9999999999999999",
+		"9007199254740992", "9007199254740993", "9007199254740994", "9007199254740995",
+		"1e22", "1e23", "-1e22", "-1e23", "1e-22", "1e-23", "4.5e22", "4.5e-22", "123e20", "123e21",
+		"9007199254740992e15", "9007199254740993e15", "123456789012345e22", "123456789012345e-22",
+		"0.123456789012345", "0.1234567890123456", "8.98846567431158e307", "0.1", "0.2", "0.3",
+		"23.5", "-12.345678", "1013.25", "37.774929", "-122.419418", "6.02214076e23", "0.30000000000000004",
+		"1.7976931348623157e308", "1.7976931348623159e308", "1e309", "2.2250738585072011e-308",
+		"2.2250738585072012e-308", "4.9406564584124654e-324", "2.4703282292062327e-324",
+		"2.4703282292062328e-324", "1e-400", "0e99999999999", "1e99999999999", "1e-99999999999",
+	};
+	char text[64];
+	unsigned int i;
+	int digits;
+	int exponent;
+
+	for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		checkFloating(texts[i]);
+	}
+	for (digits = 1; digits <= 18; digits++) {
+		for (exponent = -25; exponent <= 25; exponent++) {
+			snprintf(text, sizeof(text), "%.*se%d", digits, "987654321987654321", exponent);
+			checkFloating(text);
+		}
+	}
+}
+
+// a float midpoint is a double, the text of one must round to even and not away from it
+static void test_float_midpoints(void) {
+	static const char *texts[] = {
+		"16777217", "16777217.000000001", "16777216.999999999", "33554435", "33554437",
+		"1.00000005960464477539062499", "1.000000059604644775390625", "1.00000005960464477539062501",
+		"1.00000017881393432617187499", "1.000000178813934326171875", "1.00000017881393432617187501",
+		"3.4028235e38", "3.4028236e38", "3.40282357e38", "3.4028235677973366e38", "3.4028235677973367e38",
+		"1e39", "1.1754943508222875e-38", "1.401298464324817e-45", "7.006492321624085e-46",
+		"7.006492321624086e-46",
+	};
+	char text[80];
+	unsigned int i;
+	uint32_t bits;
+	float value;
+	double midpoint;
+
+	for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		checkFloating(texts[i]);
+	}
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		bits = (uint32_t)random64();
+		memcpy(&value, &bits, sizeof(value));
+		if (isnan(value) || isinf(value) || isinf(nextafterf(value, INFINITY))) {
+			continue;
+		}
+		midpoint = ((double)value + (double)nextafterf(value, INFINITY)) / 2;
+		snprintf(text, sizeof(text), "%.*g", (int)(random64() % 12) + 1, value);
+		checkFloating(text);
+		snprintf(text, sizeof(text), "%.17g", midpoint);
+		checkFloating(text);
+		snprintf(text, sizeof(text), "%.60g", midpoint);
+		checkFloating(text);
+	}
+}
+
+// more digits than the mantissa takes, and texts longer than the copy given to strtod()
+static void test_long_mantissas(void) {
+	static const char *texts[] = {
+		"1234567890123456789", "12345678901234567890", "18446744073709551615", "18446744073709551616",
+		"9007199254740993.0000000000000001", "123456789012345678901234567890", "0.000000000000000000000000001",
+		"99999999999999999999999", "1.0000000000000000000000000000000000000000000000000001",
+	};
+	static const char midpoint[] = "1.00000000000000011102230246251565404236316680908203125";	// 1 + 2^-53
+	char text[400];
+	size_t length;
+	unsigned int i;
+	unsigned int k;
+	uint64_t bits;
+	double value;
+
+	for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		checkFloating(texts[i]);
+	}
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		bits = random64();
+		memcpy(&value, &bits, sizeof(value));
+		if (!isnan(value) && !isinf(value)) {
+			snprintf(text, sizeof(text), "%.*e", (int)(random64() % 25), value);
+			checkFloating(text);
+		}
+		// up to 300 random digits, most of them past what the copy keeps
+		length = 0;
+		text[length++] = '1' + random64() % 9;
+		text[length++] = '.';
+		for (k = random64() % 300; k > 0; k--) {
+			text[length++] = '0' + random64() % 10;
+		}
+		snprintf(text + length, sizeof(text) - length, "e%d", (int)(random64() % 700) - 350);
+		checkFloating(text);
+	}
+
+	// just above and just below halfway, told apart only by the digits the copy drops
+	length = snprintf(text, sizeof(text), "%s", midpoint);
+	memset(text + length, '0', 150);
+	strcpy(text + length + 150, "1");
+	checkFloating(text);
+	length = snprintf(text, sizeof(text), "%.*s4", (int)strlen(midpoint) - 1, midpoint);
+	memset(text + length, '9', 150);
+	text[length + 150] = '\0';
+	checkFloating(text);
+	TEST_ASSERT(aws_iot_json_parse_double(text, strlen(text), &value) == NONE_ERROR && value == 1.0);
+}
+
+// the limits of the 8, 16 and 32 bit integers on both sides, through min and max
+static void test_integer_limits(void) {
+	static const char *texts[] = {
+		"0", "1", "-1", "127", "128", "-128", "-129", "255", "256", "32767", "32768", "-32768", "-32769",
+		"65535", "65536", "2147483647", "2147483648", "-2147483648", "-2147483649", "4294967295",
+		"4294967296", "99999999999999999999999", "-99999999999999999999999", "1.0", "1e2", "0e0", "-1.5",
+	};
+	static const int32_t limits[][2] = {
+		{INT8_MIN, INT8_MAX}, {0, UINT8_MAX}, {INT16_MIN, INT16_MAX}, {0, UINT16_MAX},
+		{INT32_MIN, INT32_MAX}, {0, INT32_MAX}, {0, 1000},
+	};
+	char text[32];
+	uint32_t value;
+	unsigned int i;
+	unsigned int j;
+
+	for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		for (j = 0; j < sizeof(limits) / sizeof(limits[0]); j++) {
+			checkInteger(texts[i], limits[j][0], limits[j][1]);
+		}
+	}
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		snprintf(text, sizeof(text), "%d", (int32_t)random64() >> (random64() % 32));
+		checkInteger(text, INT32_MIN, INT32_MAX);
+		j = random64() % (sizeof(limits) / sizeof(limits[0]));
+		checkInteger(text, limits[j][0], limits[j][1]);
+	}
+
+	TEST_ASSERT(aws_iot_json_parse_uint32("4294967295", 10, UINT32_MAX, &value) == NONE_ERROR);
+	TEST_ASSERT(value == UINT32_MAX);
+	TEST_ASSERT(aws_iot_json_parse_uint32("4294967296", 10, UINT32_MAX, &value) == JSON_PARSE_ERROR);
+}
+
+// the grammar of JSON: -0 is a number, a leading zero, a '+' or a lone point are not
+static void test_grammar(void) {
+	static const char *texts[] = {
+		"-0", "-0.0", "0.0", "-0e5", "00", "01", "-01", "00.5", "+1", "1.", ".5", "-.5", "1e", "1e+", "1e-",
+		"1E5", "1e+5", "1e-5", "1.5E-3", "--1", "-", "", "inf", "-inf", "nan", "0x10", "1 ", " 1", "1,",
+		"1.5.5", "1e5e5", "1ee5", "0.e1",
+	};
+	static const char numbers[] = "0123456789.eE+-0011";
+	char text[16];
+	double value = 1.0;
+	float floatValue = 1.0f;
+	int32_t integer = 1;
+	uint32_t unsignedValue = 1;
+	unsigned int i;
+	int length;
+	int k;
+
+	for (i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+		checkFloating(texts[i]);
+		checkInteger(texts[i], INT32_MIN, INT32_MAX);
+	}
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		length = random64() % 8 + 1;
+		for (k = 0; k < length; k++) {
+			text[k] = numbers[random64() % (sizeof(numbers) - 1)];
+		}
+		text[length] = '\0';
+		checkFloating(text);
+		checkInteger(text, INT32_MIN, INT32_MAX);
+	}
+
+	// -0 keeps its sign as a double and is 0 as an integer
+	TEST_ASSERT(aws_iot_json_parse_double("-0", 2, &value) == NONE_ERROR && value == 0.0 && signbit(value));
+	TEST_ASSERT(aws_iot_json_parse_float("-0", 2, &floatValue) == NONE_ERROR && floatValue == 0.0f && signbit(floatValue));
+	TEST_ASSERT(aws_iot_json_parse_int32("-0", 2, INT32_MIN, INT32_MAX, &integer) == NONE_ERROR && integer == 0);
+	TEST_ASSERT(aws_iot_json_parse_uint32("-0", 2, UINT32_MAX, &unsignedValue) == NONE_ERROR && unsignedValue == 0);
+}
+
+static void checkFormat(double value, uint8_t decimals) {
+	char text[AWS_IOT_JSON_NUMBER_MAX_LEN];
+	char expected[64];
+	size_t length;
+
+	length = aws_iot_json_format_double(text, value, decimals);
+	if (isnan(value) || isinf(value)) {
+		snprintf(expected, sizeof(expected), "null");
+	} else if (fabs(value) >= 18446744073709551616.0 || decimals > AWS_IOT_JSON_MAX_DECIMALS) {
+		snprintf(expected, sizeof(expected), "%.17g", value);
+	} else {
+		snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+	}
+	TEST_ASSERT(length == strlen(text));
+	TEST_ASSERT(strcmp(text, expected) == 0);
+}
+
+// a tie rounds to even as printf does, an odd multiple of a power of 2 is one on every digit
+static void test_format_double(void) {
+	static const double values[] = {
+		0.0, -0.0, 0.5, 1.5, 2.5, -0.5, -2.5, 0.125, 0.375, 0.0625, 9.5, 2.675, 0.045, 123.456, 0.9999999995,
+		0.99999999949999, 1e-300, -1e-300, 5e-324, 1e19, 18446744073709549568.0, 18446744073709551616.0,
+		1.7976931348623157e308, NAN, INFINITY, -INFINITY,
+	};
+	char text[AWS_IOT_JSON_NUMBER_MAX_LEN];
+	char expected[16];
+	unsigned int i;
+	uint8_t decimals;
+	uint64_t bits;
+	double value;
+
+	for (i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+		for (decimals = 0; decimals <= AWS_IOT_JSON_MAX_DECIMALS + 3; decimals++) {
+			checkFormat(values[i], decimals);
+		}
+	}
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		// ties: k / 2^j has its last bit where one of the decimals rounds
+		value = (double)(random64() % 100000) / (double)(1u << (random64() % 20));
+		checkFormat((random64() & 1) ? -value : value, random64() % 10);
+		value = ldexp((double)(random64() >> 11), (int)(random64() % 140) - 120);
+		checkFormat(value, random64() % 10);
+		value = (double)(int64_t)(random64() % 2000001 - 1000000) / 1000.0;
+		checkFormat(value, random64() % 10);
+		checkFormat((float)value, 6);
+		bits = random64();
+		memcpy(&value, &bits, sizeof(value));
+		checkFormat(value, random64() % 12);
+	}
+
+	for (i = 0; i < RANDOM_VALUES; i++) {
+		bits = random64() >> (random64() % 32);
+		aws_iot_json_format_int32(text, (int32_t)bits);
+		snprintf(expected, sizeof(expected), "%d", (int32_t)bits);
+		TEST_ASSERT(strcmp(text, expected) == 0);
+		aws_iot_json_format_uint32(text, (uint32_t)bits);
+		snprintf(expected, sizeof(expected), "%u", (uint32_t)bits);
+		TEST_ASSERT(strcmp(text, expected) == 0);
+	}
+	aws_iot_json_format_int32(text, INT32_MIN);
+	TEST_ASSERT(strcmp(text, "-2147483648") == 0);
+}
+
+int main(void) {
+	RUN_TEST(test_fast_path_boundary);
+	RUN_TEST(test_float_midpoints);
+	RUN_TEST(test_long_mantissas);
+	RUN_TEST(test_integer_limits);
+	RUN_TEST(test_grammar);
+	RUN_TEST(test_format_double);
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * aws_iot_json_tokenize() against jsmn_parse(): the same tokens, return value and
+ * parser state for shadow documents cut at every length, with every number of
+ * tokens, mutated or made up at random, and resumed after JSMN_ERROR_PART. The
+ * tokens are only counted when every one was found.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "aws_iot_json_tokenizer.h"
+#include "unit_test.h"
+
+#define MAX_TOKENS 200
+#define MUTATIONS 20000
+#define RANDOM_DOCUMENTS 50000
+
+typedef int (*fpTokenize_t)(jsmn_parser *parser, const char *js, size_t len, jsmntok_t *tokens,
+		unsigned int num_tokens);
+
+static const char *documents[] = {
+	"{\"state\":{\"desired\":{\"led\":1,\"color\":\"red\"},\"reported\":{\"led\":0,\"pb\":12,\"temperature\":21.500000,"
+	"\"light\":{\"lux\":340,\"ok\":true}}},\"metadata\":{\"desired\":{\"led\":{\"timestamp\":1443657600},"
+	"\"color\":{\"timestamp\":1443657600}},\"reported\":{\"led\":{\"timestamp\":1443657601},"
+	"\"pb\":{\"timestamp\":1443657602}}},\"version\":1234,\"timestamp\":1443657700,"
+	"\"clientToken\":\"c-sdk-client-id-42\"}",
+	"{\"code\":409,\"message\":\"Version conflict\",\"clientToken\":\"c-sdk-client-id-7\"}",
+	"{\"version\":9,\"timestamp\":1,\"state\":{\"led\":true,\"arr\":[1,2,[3,\"x\\\"y\\\\z\\u00e9\"],{\"a\":null}]}}",
+	"{ \"a\" : [ 1 , -2.5e3 , false ] ,\n\t\"b\" : \"\\/\\b\\f\\n\\r\\t\" }",
+	// strings longer than a word, ending at every offset of one
+	"{\"k\":\"0123456789abcdef0123456789abcdef\",\"kk\":\"0123456789abcdef0123456789abcde\\\"\","
+	"\"kkk\":\"0123456789abcdef012345678\\\\\",\"kkkk\":\"\"}",
+};
+
+// the bytes most likely to reach the corner cases of the grammar
+static const char alphabet[] = "{}[]\":,\\ -0123456789tfnuabcxyzAF\t\n/.e\x01\xc3";
+
+static int tokenize(fpTokenize_t tokenizer, jsmn_parser *pParser, const char *pJson, size_t length,
+		jsmntok_t *pTokens, unsigned int tokenCount) {
+	jsmn_init(pParser);
+	return tokenizer(pParser, pJson, length, pTokens, tokenCount);
+}
+
+// both parse pJson to the same tokens, return value and parser state
+static void checkSame(const char *pJson, size_t length, unsigned int tokenCount) {
+	jsmntok_t expected[MAX_TOKENS];
+	jsmntok_t tokens[MAX_TOKENS];
+	jsmn_parser expectedParser;
+	jsmn_parser parser;
+	int expectedRc;
+	int rc;
+
+	memset(expected, 0x55, sizeof(expected));
+	memset(tokens, 0x55, sizeof(tokens));
+	expectedRc = tokenize(jsmn_parse, &expectedParser, pJson, length, expected, tokenCount);
+	rc = tokenize(aws_iot_json_tokenize, &parser, pJson, length, tokens, tokenCount);
+	TEST_ASSERT(rc == expectedRc);
+	TEST_ASSERT(parser.pos == expectedParser.pos);
+	TEST_ASSERT(parser.toknext == expectedParser.toknext);
+	TEST_ASSERT(parser.toksuper == expectedParser.toksuper);
+	TEST_ASSERT(memcmp(tokens, expected, sizeof(tokens)) == 0);
+
+	// the jsmn of the WMSDK has no counting mode, the count is that of a complete parse
+	if (rc >= 0) {
+		TEST_ASSERT(tokenize(aws_iot_json_tokenize, &parser, pJson, length, NULL, 0) == rc);
+	}
+}
+
+static void test_documents_cut(void) {
+	unsigned int tokenCount;
+	unsigned int d;
+	size_t length;
+
+	for (d = 0; d < sizeof(documents) / sizeof(documents[0]); d++) {
+		for (length = 0; length <= strlen(documents[d]) + 1; length++) {
+			for (tokenCount = 1; tokenCount <= MAX_TOKENS; tokenCount += (tokenCount < 40) ? 1 : 37) {
+				checkSame(documents[d], length, tokenCount);
+			}
+		}
+	}
+}
+
+static void test_documents_mutated(void) {
+	char json[512];
+	unsigned int d;
+	size_t length;
+	int m;
+	int k;
+
+	srand(1);
+	for (d = 0; d < sizeof(documents) / sizeof(documents[0]); d++) {
+		length = strlen(documents[d]);
+		for (m = 0; m < MUTATIONS; m++) {
+			memcpy(json, documents[d], length + 1);
+			for (k = 1 + rand() % 4; k > 0; k--) {
+				json[rand() % length] = alphabet[rand() % (sizeof(alphabet) - 1)];
+			}
+			checkSame(json, length, MAX_TOKENS);
+		}
+	}
+}
+
+static void test_random_documents(void) {
+	char json[64];
+	int length;
+	int m;
+	int i;
+
+	srand(2);
+	for (m = 0; m < RANDOM_DOCUMENTS; m++) {
+		length = rand() % (sizeof(json) - 4);
+		for (i = 0; i < length; i++) {
+			json[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+		}
+		json[length] = '\0';
+		checkSame(json, length, MAX_TOKENS);
+	}
+}
+
+// a document cut anywhere gives JSMN_ERROR_PART or the same error, and the same parser
+// carries on with the whole of it as jsmn does
+static void test_resume_after_part(void) {
+	jsmntok_t expected[MAX_TOKENS];
+	jsmntok_t tokens[MAX_TOKENS];
+	jsmn_parser expectedParser;
+	jsmn_parser parser;
+	int expectedRc;
+	int rc;
+	unsigned int d;
+	size_t length;
+	size_t cut;
+
+	for (d = 0; d < sizeof(documents) / sizeof(documents[0]); d++) {
+		length = strlen(documents[d]);
+		for (cut = 1; cut < length; cut++) {
+			memset(expected, 0x55, sizeof(expected));
+			memset(tokens, 0x55, sizeof(tokens));
+			expectedRc = tokenize(jsmn_parse, &expectedParser, documents[d], cut, expected, MAX_TOKENS);
+			rc = tokenize(aws_iot_json_tokenize, &parser, documents[d], cut, tokens, MAX_TOKENS);
+			TEST_ASSERT(rc == expectedRc);
+			TEST_ASSERT(parser.pos == expectedParser.pos && parser.toknext == expectedParser.toknext);
+
+			expectedRc = jsmn_parse(&expectedParser, documents[d], length, expected, MAX_TOKENS);
+			rc = aws_iot_json_tokenize(&parser, documents[d], length, tokens, MAX_TOKENS);
+			TEST_ASSERT(rc == expectedRc && rc > 0);
+			TEST_ASSERT(parser.pos == expectedParser.pos && parser.toknext == expectedParser.toknext);
+			TEST_ASSERT(memcmp(tokens, expected, sizeof(tokens)) == 0);
+		}
+	}
+}
+
+int main(void) {
+	RUN_TEST(test_documents_cut);
+	RUN_TEST(test_documents_mutated);
+	RUN_TEST(test_random_documents);
+	RUN_TEST(test_resume_after_part);
+	return 0;
+}
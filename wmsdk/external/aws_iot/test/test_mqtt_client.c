@@ -0,0 +1,491 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "MQTTClient.h"
+#include "fake_network.h"
+#include "unit_test.h"
+
+#define COMMAND_TIMEOUT_MS 2000
+
+int cycle(Client* c, Timer* timer);
+
+static Client client;
+static FakeNetwork_t fake;
+static unsigned char writeBuf[512];
+static unsigned char readBuf[512];
+
+static void connectClient(bool readSome) {
+	static const unsigned char connack[] = {0x20, 2, 0, 0};
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+
+	fake_network_free(&fake);
+	fake_network_init(&fake, readSome);
+	memset(&client, 0, sizeof(client));
+	MQTTClient(&client, &fake.network, COMMAND_TIMEOUT_MS, writeBuf, sizeof(writeBuf), readBuf, sizeof(readBuf));
+	fake_network_push(&fake, connack, sizeof(connack));
+	data.clientID.cstring = "test";
+	TEST_ASSERT(MQTTConnect(&client, &data) == MQTT_SUCCESS);
+}
+
+static void subscribe(const char *pFilter, messageHandler handler) {
+	unsigned char suback[] = {0x90, 3, 0, 0, 0};
+	unsigned short packetId = client.next_packetid + 1;
+
+	suback[2] = packetId >> 8;
+	suback[3] = packetId & 0xFF;
+	fake_network_push(&fake, suback, sizeof(suback));
+	TEST_ASSERT(MQTTSubscribe(&client, pFilter, QOS0, handler, NULL) == MQTT_SUCCESS);
+}
+
+// the fixed header and topic of a QoS 0 PUBLISH with a payload of payloadLen bytes
+static void pushPublishHeader(const char *pTopic, size_t payloadLen) {
+	unsigned char header[8];
+	size_t topicLen = strlen(pTopic);
+	int length = 1;
+
+	header[0] = 0x30;
+	length += MQTTPacket_encode(header + 1, 2 + topicLen + payloadLen);
+	header[length++] = topicLen >> 8;
+	header[length++] = topicLen & 0xFF;
+	fake_network_push(&fake, header, length);
+	fake_network_push(&fake, pTopic, topicLen);
+}
+
+static size_t streamedBytes;
+static int streamedChunks;
+static int smallMessages;
+
+static void checkStreamedChunk(MessageData *pData) {
+	MQTTMessage *pMessage = pData->message;
+	const unsigned char *pPayload = (const unsigned char *)pMessage->payload;
+	size_t i;
+
+	if (pMessage->totallen == pMessage->payloadlen) {
+		smallMessages++;
+		return;
+	}
+	// chunks come in order, each through the read buffer of the client
+	TEST_ASSERT(pMessage->offset == streamedBytes);
+	TEST_ASSERT(pMessage->payloadlen > 0 && pMessage->payloadlen <= 256);
+	TEST_ASSERT(pPayload >= readBuf && pPayload + pMessage->payloadlen <= readBuf + sizeof(readBuf));
+	for (i = 0; i < pMessage->payloadlen; i++) {
+		TEST_ASSERT(pPayload[i] == (unsigned char)(pMessage->offset + i));
+	}
+	streamedBytes += pMessage->payloadlen;
+	streamedChunks++;
+}
+
+static void streamPublish(bool readSome) {
+	const size_t total = 8 * 1024 * 1024 + 17;
+	Timer timer;
+
+	connectClient(readSome);
+	setStreamChunkSize(&client, 256);
+	subscribe("big/#", checkStreamedChunk);
+	streamedBytes = 0;
+	streamedChunks = 0;
+	smallMessages = 0;
+
+	pushPublishHeader("big/x", total);
+	fake_network_push_pattern(&fake, total);
+	pushPublishHeader("big/y", 2);
+	fake_network_push(&fake, "hi", 2);
+	InitTimer(&timer);
+	countdown_ms(&timer, COMMAND_TIMEOUT_MS);
+	TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+	TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+
+	TEST_ASSERT(streamedBytes == total);
+	TEST_ASSERT(streamedChunks == (total + 255) / 256);
+	TEST_ASSERT(smallMessages == 1);
+	// nothing bigger than the read buffer was ever asked for, however big the payload
+	TEST_ASSERT(fake.largestRead <= sizeof(readBuf));
+	TEST_ASSERT(fake_network_input_left(&fake) == 0);
+}
+
+static void test_publish_streamed_in_chunks(void) {
+	streamPublish(false);
+	streamPublish(true);
+}
+
+// a topic that leaves no room in the read buffer for a chunk of the payload
+static void test_publish_header_filling_read_buffer(void) {
+	char topic[sizeof(readBuf)];
+	Timer timer;
+
+	connectClient(false);
+	setStreamChunkSize(&client, 256);
+	subscribe("#", checkStreamedChunk);
+	streamedBytes = 0;
+	streamedChunks = 0;
+	smallMessages = 0;
+
+	// fixed header of 3 bytes and topic length of 2, the topic takes the rest of readBuf
+	memset(topic, 'a', sizeof(topic));
+	topic[sizeof(readBuf) - 5] = '\0';
+	pushPublishHeader(topic, 100);
+	fake_network_push_pattern(&fake, 100);
+	pushPublishHeader("small", 2);
+	fake_network_push(&fake, "hi", 2);
+	InitTimer(&timer);
+	countdown_ms(&timer, COMMAND_TIMEOUT_MS);
+	cycle(&client, &timer);
+	TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+
+	TEST_ASSERT(streamedChunks == 0);
+	TEST_ASSERT(smallMessages == 1);
+	TEST_ASSERT(fake_network_input_left(&fake) == 0);
+}
+
+static void test_publish_acknowledged(void) {
+	static const unsigned char puback[] = {0x40, 2, 0, 1};
+	MQTTMessage message = {QOS1, 0, 0, 0, "hi", 2};
+
+	connectClient(false);
+	fake_network_push(&fake, puback, sizeof(puback));
+	TEST_ASSERT(MQTTPublish(&client, "t/a", &message) == MQTT_SUCCESS);
+	TEST_ASSERT(client.inflightCount == 0);
+}
+
+// the keepalive gives up on its ping while the publish waits for its PUBACK
+static void test_publish_returns_on_disconnect(void) {
+	MQTTMessage message = {QOS1, 0, 0, 0, "hi", 2};
+	Timer elapsed;
+
+	connectClient(false);
+	client.ping_outstanding = 1;
+	countdown_ms(&client.ping_timer, 0);
+	InitTimer(&elapsed);
+	countdown_ms(&elapsed, COMMAND_TIMEOUT_MS / 2);
+	TEST_ASSERT(MQTTPublish(&client, "t/a", &message) == MQTT_FAILURE);
+	TEST_ASSERT(!expired(&elapsed));
+	TEST_ASSERT(!client.isconnected);
+	TEST_ASSERT(client.inflightCount == 0);
+}
+
+#define STREAM_TOPIC "dt/stream"
+#define STREAM_PAYLOAD_LEN 300
+
+static unsigned char streamPayload[STREAM_PAYLOAD_LEN];
+static unsigned char txCoalesceBuf[128];
+static size_t streamWindow;		// bytes the writer hands over at a time
+static size_t streamStopAt;		// the writer returns once it wrote this many bytes
+static size_t streamCloseAt;	// the connection drops once this many bytes were written, 0 for never
+static int streamPauseMs;		// the writer waits this long before each window
+static int disconnects;
+
+static void countDisconnect(void) {
+	disconnects++;
+}
+
+static int writeStreamPayload(Client* c, void* context) {
+	size_t written = 0;
+	size_t part;
+	int rc;
+
+	(void)context;
+	while (written < streamStopAt) {
+		part = (streamStopAt - written < streamWindow) ? streamStopAt - written : streamWindow;
+		if (streamPauseMs > 0) {
+			usleep(streamPauseMs * 1000);
+		}
+		if (streamCloseAt != 0 && written >= streamCloseAt) {
+			fake.isClosed = true;
+		}
+		if ((rc = MQTTPublishStreamWrite(c, streamPayload + written, part)) != MQTT_SUCCESS) {
+			return rc;
+		}
+		written += part;
+	}
+	return MQTT_SUCCESS;
+}
+
+// publishes the whole payload in windows of window bytes, returns where the packet starts in the output
+static size_t publishStream(size_t window, bool isCoalesced, int *pRc) {
+	MQTTMessage message = {QOS0, 0, 0, 0, NULL, STREAM_PAYLOAD_LEN};
+	size_t start;
+
+	connectClient(false);
+	setDisconnectHandler(&client, countDisconnect);
+	if (isCoalesced) {
+		setWriteCoalescing(&client, txCoalesceBuf, sizeof(txCoalesceBuf), 0);
+	}
+	disconnects = 0;
+	start = fake.outputLen;
+	streamWindow = window;
+	*pRc = MQTTPublishStream(&client, STREAM_TOPIC, &message, writeStreamPayload, NULL);
+	return start;
+}
+
+// the bytes of a streamed publish are those MQTTSerialize_publish() makes of the whole payload
+static void test_publish_stream_matches_serialize(void) {
+	MQTTString topic = MQTTString_initializer;
+	unsigned char expected[STREAM_PAYLOAD_LEN + 32];
+	size_t window;
+	size_t start;
+	int length;
+	int rc;
+	int i;
+
+	for (i = 0; i < STREAM_PAYLOAD_LEN; i++) {
+		streamPayload[i] = (unsigned char)(i * 7);
+	}
+	topic.cstring = STREAM_TOPIC;
+	length = MQTTSerialize_publish(expected, sizeof(expected), 0, 0, 0, 0, topic, streamPayload, STREAM_PAYLOAD_LEN);
+	TEST_ASSERT(length > STREAM_PAYLOAD_LEN);
+
+	streamStopAt = STREAM_PAYLOAD_LEN;
+	streamCloseAt = 0;
+	streamPauseMs = 0;
+	for (window = 1; window <= STREAM_PAYLOAD_LEN; window++) {
+		for (i = 0; i < 2; i++) {
+			start = publishStream(window, i == 1, &rc);
+			TEST_ASSERT(rc == MQTT_SUCCESS);
+			TEST_ASSERT(fake.outputLen - start == (size_t)length);
+			TEST_ASSERT(memcmp(fake.output + start, expected, length) == 0);
+			TEST_ASSERT(client.isconnected && disconnects == 0);
+		}
+	}
+}
+
+// a writer stopping short leaves nothing more on the wire, the connection is dropped
+static void test_publish_stream_short_writer_disconnects(void) {
+	size_t start;
+	int rc;
+	int i;
+
+	streamStopAt = 100;
+	streamCloseAt = 0;
+	streamPauseMs = 0;
+	for (i = 0; i < 2; i++) {
+		start = publishStream(16, i == 1, &rc);
+		TEST_ASSERT(rc == MQTT_FAILURE);
+		TEST_ASSERT(!client.isconnected && fake.isClosed);
+		TEST_ASSERT(disconnects == 1);
+		TEST_ASSERT(fake.outputLen - start <= 2 + 2 + strlen(STREAM_TOPIC) + 100 + 1);
+	}
+}
+
+// a write failing in the middle of the payload drops the connection as well
+static void test_publish_stream_write_failure_disconnects(void) {
+	int rc;
+
+	streamStopAt = STREAM_PAYLOAD_LEN;
+	streamCloseAt = 64;
+	streamPauseMs = 0;
+	publishStream(32, false, &rc);
+	TEST_ASSERT(rc == MQTT_FAILURE);
+	TEST_ASSERT(!client.isconnected);
+	TEST_ASSERT(disconnects == 1);
+	streamCloseAt = 0;
+}
+
+// a payload taking longer than the command timeout in all is sent, each window has its own
+static void test_publish_stream_timeout_per_window(void) {
+	MQTTMessage message = {QOS0, 0, 0, 0, NULL, STREAM_PAYLOAD_LEN};
+
+	connectClient(false);
+	client.command_timeout_ms = 100;
+	streamWindow = STREAM_PAYLOAD_LEN / 5;
+	streamStopAt = STREAM_PAYLOAD_LEN;
+	streamCloseAt = 0;
+	streamPauseMs = 60;
+	TEST_ASSERT(MQTTPublishStream(&client, STREAM_TOPIC, &message, writeStreamPayload, NULL) == MQTT_SUCCESS);
+	TEST_ASSERT(client.isconnected);
+	streamPauseMs = 0;
+}
+
+static int handledA;
+static int handledB;
+
+static void handleA(MessageData *pData) {
+	(void)pData;
+	handledA++;
+}
+
+static void handleB(MessageData *pData) {
+	(void)pData;
+	handledB++;
+}
+
+// handler slots in use, and those of them with filters in the topic index
+static int usedSlots(int *pIndexed) {
+	int used = 0;
+	int i;
+
+	*pIndexed = 0;
+	for (i = 0; i < MAX_MESSAGE_HANDLERS; i++) {
+		used += (client.messageHandlers[i].topicFilter != 0);
+		*pIndexed += (client.topicIndex.entryNode[i] != TOPIC_TRIE_NONE);
+	}
+	return used;
+}
+
+static void pushSuback(int count, const int *pGranted) {
+	unsigned char suback[4 + MAX_SUBSCRIBE_FILTERS];
+	int i;
+
+	suback[0] = 0x90;
+	suback[1] = 2 + count;
+	suback[2] = (client.next_packetid + 1) >> 8;
+	suback[3] = (client.next_packetid + 1) & 0xFF;
+	for (i = 0; i < count; i++) {
+		suback[4 + i] = pGranted[i];
+	}
+	fake_network_push(&fake, suback, 4 + count);
+}
+
+static void pushPublish(const char *pTopic) {
+	pushPublishHeader(pTopic, 2);
+	fake_network_push(&fake, "hi", 2);
+}
+
+static const char *manyFilters[] = {"a/+", "b/#", "c"};
+static enum QoS manyQoSs[] = {QOS0, QOS1, QOS0};
+static messageHandler manyHandlers[] = {handleA, handleB, handleA};
+static pApplicationHandler_t manyApplicationHandlers[] = {NULL, NULL, NULL};
+
+// all the filters go out in a single SUBSCRIBE, and are answered by a single SUBACK
+static void test_subscribe_many_in_one_packet(void) {
+	static const int granted[] = {0, 1, 0};
+	MQTTString filters[MAX_SUBSCRIBE_FILTERS];
+	int requested[MAX_SUBSCRIBE_FILTERS];
+	int grantedQoSs[3];
+	unsigned short packetId;
+	unsigned char dup;
+	size_t start;
+	int count;
+	int indexed;
+	int i;
+	Timer timer;
+
+	connectClient(false);
+	start = fake.outputLen;
+	pushSuback(3, granted);
+	TEST_ASSERT(MQTTSubscribeMany(&client, 3, manyFilters, manyQoSs, manyHandlers, manyApplicationHandlers,
+			grantedQoSs) == MQTT_SUCCESS);
+	TEST_ASSERT(grantedQoSs[0] == 0 && grantedQoSs[1] == 1 && grantedQoSs[2] == 0);
+
+	TEST_ASSERT(MQTTDeserialize_subscribe(&dup, &packetId, MAX_SUBSCRIBE_FILTERS, &count, filters, requested,
+			fake.output + start, fake.outputLen - start) == 1);
+	TEST_ASSERT(MQTTPacket_len(fake.output[start + 1]) == (int)(fake.outputLen - start));
+	TEST_ASSERT(count == 3);
+	for (i = 0; i < count; i++) {
+		TEST_ASSERT(filters[i].lenstring.len == (int)strlen(manyFilters[i]));
+		TEST_ASSERT(memcmp(filters[i].lenstring.data, manyFilters[i], filters[i].lenstring.len) == 0);
+		TEST_ASSERT(requested[i] == manyQoSs[i]);
+	}
+	TEST_ASSERT(usedSlots(&indexed) == 3 && indexed == 3);
+
+	handledA = handledB = 0;
+	pushPublish("a/x");
+	pushPublish("b/y/z");
+	pushPublish("c");
+	InitTimer(&timer);
+	countdown_ms(&timer, COMMAND_TIMEOUT_MS);
+	for (i = 0; i < 3; i++) {
+		TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+	}
+	TEST_ASSERT(handledA == 2 && handledB == 1);
+}
+
+// the filters the broker refuses give their handler slots and topic index entries back, the others stay
+static void test_subscribe_many_partly_refused(void) {
+	static const int granted[] = {0, 0x80, 0};
+	int grantedQoSs[3];
+	int indexed;
+	Timer timer;
+
+	connectClient(false);
+	pushSuback(3, granted);
+	TEST_ASSERT(MQTTSubscribeMany(&client, 3, manyFilters, manyQoSs, manyHandlers, manyApplicationHandlers,
+			grantedQoSs) == MQTT_SUCCESS);
+	TEST_ASSERT(grantedQoSs[0] == 0 && grantedQoSs[1] == 0x80 && grantedQoSs[2] == 0);
+	TEST_ASSERT(usedSlots(&indexed) == 2 && indexed == 2);
+
+	handledA = handledB = 0;
+	pushPublish("b/y");
+	pushPublish("c");
+	InitTimer(&timer);
+	countdown_ms(&timer, COMMAND_TIMEOUT_MS);
+	TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+	TEST_ASSERT(cycle(&client, &timer) == PUBLISH);
+	TEST_ASSERT(handledA == 1 && handledB == 0);
+}
+
+// a SUBSCRIBE that cannot be sent leaves no slot claimed, and the filters can be subscribed again
+static void test_subscribe_many_send_failed(void) {
+	static const int granted[] = {0, 1, 0};
+	int grantedQoSs[3];
+	int indexed;
+
+	connectClient(false);
+	subscribe("kept", handleB);
+	fake.isClosed = true;
+	TEST_ASSERT(MQTTSubscribeMany(&client, 3, manyFilters, manyQoSs, manyHandlers, manyApplicationHandlers,
+			grantedQoSs) == MQTT_FAILURE);
+	TEST_ASSERT(usedSlots(&indexed) == 1 && indexed == 1);
+
+	fake.isClosed = false;
+	pushSuback(3, granted);
+	TEST_ASSERT(MQTTSubscribeMany(&client, 3, manyFilters, manyQoSs, manyHandlers, manyApplicationHandlers,
+			grantedQoSs) == MQTT_SUCCESS);
+	TEST_ASSERT(usedSlots(&indexed) == 4 && indexed == 4);
+}
+
+static void *pushLater(void *pArg) {
+	(void)pArg;
+	usleep(50 * 1000);
+	pushPublish("c");
+	return NULL;
+}
+
+// a yield sleeps in mqttwait and returns as soon as the packet that woke it is handled
+static void test_yield_returns_on_packet(void) {
+	pthread_t thread;
+	Timer elapsed;
+
+	connectClient(true);
+	subscribe("c", handleA);
+	handledA = 0;
+	TEST_ASSERT(pthread_create(&thread, NULL, pushLater, NULL) == 0);
+	InitTimer(&elapsed);
+	countdown_ms(&elapsed, COMMAND_TIMEOUT_MS);
+	TEST_ASSERT(MQTTYield(&client, COMMAND_TIMEOUT_MS) == MQTT_SUCCESS);
+	TEST_ASSERT(left_ms(&elapsed) > COMMAND_TIMEOUT_MS / 2);
+	TEST_ASSERT(handledA == 1);
+	pthread_join(thread, NULL);
+}
+
+int main(void) {
+	alarm(60);		// a client stuck in a loop fails the test instead of hanging it
+	RUN_TEST(test_publish_acknowledged);
+	RUN_TEST(test_publish_returns_on_disconnect);
+	RUN_TEST(test_publish_streamed_in_chunks);
+	RUN_TEST(test_publish_header_filling_read_buffer);
+	RUN_TEST(test_publish_stream_matches_serialize);
+	RUN_TEST(test_publish_stream_short_writer_disconnects);
+	RUN_TEST(test_publish_stream_write_failure_disconnects);
+	RUN_TEST(test_publish_stream_timeout_per_window);
+	RUN_TEST(test_subscribe_many_in_one_packet);
+	RUN_TEST(test_subscribe_many_partly_refused);
+	RUN_TEST(test_subscribe_many_send_failed);
+	RUN_TEST(test_yield_returns_on_packet);
+	fake_network_free(&fake);
+	return 0;
+}
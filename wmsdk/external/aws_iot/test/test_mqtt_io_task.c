@@ -0,0 +1,353 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * The MQTT I/O task shared by several threads, over the host threads of host/wm_os.c
+ * and a fake broker behind the TLS functions. The broker answers each packet as the
+ * I/O task writes it, and keeps the publishes in the order they reached it. Write
+ * coalescing is on, with a latency longer than the test, so only a flush writes
+ * out the QoS 0 publishes.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <wm_os.h>
+#include "MQTTPacket.h"
+#include "aws_iot_mqtt_io_task.h"
+#include "fake_network.h"
+#include "unit_test.h"
+
+#define THREADS 4
+#define MESSAGES 10		// per thread
+#define WAIT_MS 10000
+
+typedef struct {
+	int thread;
+	int sequence;
+	int qos;
+} Received_t;
+
+static FakeNetwork_t broker;
+static MQTTClient_t client;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+
+// what the broker got, guarded by lock
+static Received_t received[THREADS * MESSAGES * 2];
+static int receivedCount;
+
+// the packet the broker is reading, the writes of the client may split or join packets
+static unsigned char packet[1024];
+static size_t packetLen;
+
+static void answer(const unsigned char *pAnswer, int length) {
+	TEST_ASSERT(length > 0);
+	fake_network_push(&broker, pAnswer, length);
+}
+
+static void handlePacket(void) {
+	unsigned char reply[4 + THREADS];
+	MQTTString topics[THREADS];
+	int qoss[THREADS];
+	MQTTString topic;
+	unsigned char *pPayload;
+	unsigned short packetId;
+	unsigned char dup;
+	unsigned char retained;
+	int payloadLen;
+	int count;
+	int qos;
+	char text[16];
+
+	switch (packet[0] >> 4) {
+	case CONNECT:
+		answer((const unsigned char *)"\x20\x02\x00\x00", 4);
+		break;
+	case SUBSCRIBE:
+		TEST_ASSERT(MQTTDeserialize_subscribe(&dup, &packetId, THREADS, &count, topics, qoss, packet, packetLen) == 1);
+		answer(reply, MQTTSerialize_suback(reply, sizeof(reply), packetId, count, qoss));
+		break;
+	case PUBLISH:
+		TEST_ASSERT(MQTTDeserialize_publish(&dup, &qos, &retained, &packetId, &topic, &pPayload, &payloadLen, packet,
+				packetLen) == 1);
+		TEST_ASSERT(payloadLen < (int)sizeof(text));
+		memcpy(text, pPayload, payloadLen);
+		text[payloadLen] = '\0';
+		pthread_mutex_lock(&lock);
+		TEST_ASSERT(receivedCount < (int)(sizeof(received) / sizeof(received[0])));
+		TEST_ASSERT(sscanf(text, "%d/%d", &received[receivedCount].thread, &received[receivedCount].sequence) == 2);
+		received[receivedCount++].qos = qos;
+		pthread_cond_broadcast(&changed);
+		pthread_mutex_unlock(&lock);
+		if (qos == 1) {
+			answer(reply, MQTTSerialize_puback(reply, sizeof(reply), packetId));
+		}
+		break;
+	}
+}
+
+// a packet is complete once its remaining length is read and that many bytes followed it
+static bool isPacketComplete(void) {
+	size_t remaining = 0;
+	size_t i;
+
+	for (i = 1; i < packetLen && i <= 4; i++) {
+		remaining |= (size_t)(packet[i] & 0x7F) << (7 * (i - 1));
+		if (!(packet[i] & 0x80)) {
+			return packetLen == 1 + i + remaining;
+		}
+	}
+	return false;
+}
+
+static void onWrite(FakeNetwork_t *pFake, const unsigned char *pBytes, size_t length) {
+	size_t i;
+
+	(void)pFake;
+	for (i = 0; i < length; i++) {
+		TEST_ASSERT(packetLen < sizeof(packet));
+		packet[packetLen++] = pBytes[i];
+		if (isPacketComplete()) {
+			handlePacket();
+			packetLen = 0;
+		}
+	}
+}
+
+// waits until pCount reaches target, false if it takes longer than WAIT_MS
+static bool waitForCount(int *pCount, int target) {
+	struct timespec deadline;
+	bool isReached;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += WAIT_MS / 1000;
+	pthread_mutex_lock(&lock);
+	while (*pCount < target) {
+		if (pthread_cond_timedwait(&changed, &lock, &deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+	isReached = (*pCount >= target);
+	pthread_mutex_unlock(&lock);
+	return isReached;
+}
+
+static char topics[THREADS][8];
+static char payloads[THREADS][MESSAGES][16];
+
+static void setMessage(MQTTPublishParams *pParams, int thread, int sequence, QoSLevel qos) {
+	*pParams = MQTTPublishParamsDefault;
+	snprintf(topics[thread], sizeof(topics[thread]), "t/%d", thread);
+	snprintf(payloads[thread][sequence], sizeof(payloads[thread][sequence]), "%d/%d", thread, sequence);
+	pParams->pTopic = topics[thread];
+	pParams->MessageParams.qos = qos;
+	pParams->MessageParams.pPayload = payloads[thread][sequence];
+	pParams->MessageParams.PayloadLen = strlen(payloads[thread][sequence]);
+}
+
+// the messages of each thread reached the broker once each and in the order they were sent
+static void checkOrder(int expected) {
+	int next[THREADS] = {0};
+	int i;
+
+	pthread_mutex_lock(&lock);
+	TEST_ASSERT(receivedCount == expected);
+	for (i = 0; i < receivedCount; i++) {
+		TEST_ASSERT(received[i].thread >= 0 && received[i].thread < THREADS);
+		TEST_ASSERT(received[i].sequence == next[received[i].thread]++);
+	}
+	receivedCount = 0;
+	pthread_mutex_unlock(&lock);
+	for (i = 0; i < THREADS; i++) {
+		TEST_ASSERT(next[i] == MESSAGES);
+	}
+}
+
+static void *publishBlocking(void *pArg) {
+	int thread = (int)(intptr_t)pArg;
+	MQTTPublishParams params;
+	int i;
+
+	for (i = 0; i < MESSAGES; i++) {
+		setMessage(&params, thread, i, (thread & 1) ? QOS_1 : QOS_0);
+		TEST_ASSERT(client.publish(&params) == NONE_ERROR);
+	}
+	return NULL;
+}
+
+static void runThreads(void *(*pFunction)(void *)) {
+	pthread_t threads[THREADS];
+	int i;
+
+	for (i = 0; i < THREADS; i++) {
+		TEST_ASSERT(pthread_create(&threads[i], NULL, pFunction, (void *)(intptr_t)i) == 0);
+	}
+	for (i = 0; i < THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+// blocking publishes from several threads, QoS 0 and QoS 1, each returns once the I/O task handled it
+static void test_blocking_publishes_in_order(void) {
+	runThreads(publishBlocking);
+	TEST_ASSERT(client.flush() == NONE_ERROR);
+	checkOrder(THREADS * MESSAGES);
+}
+
+// a flush from another thread writes out what the I/O task gathered
+static void test_flush_from_other_thread(void) {
+	MQTTPublishParams params;
+	size_t written = broker.outputLen;
+	int i;
+
+	for (i = 0; i < MESSAGES; i++) {
+		setMessage(&params, 0, i, QOS_0);
+		TEST_ASSERT(client.publish(&params) == NONE_ERROR);
+	}
+	TEST_ASSERT(broker.outputLen == written);
+	TEST_ASSERT(client.flush() == NONE_ERROR);
+	TEST_ASSERT(broker.outputLen > written);
+	pthread_mutex_lock(&lock);
+	TEST_ASSERT(receivedCount == MESSAGES);
+	receivedCount = 0;
+	pthread_mutex_unlock(&lock);
+}
+
+static int completions[THREADS][MESSAGES];
+static int completed;
+
+static void publishComplete(uint16_t id, IoT_Error_t rc, void *pContext) {
+	(void)id;
+	TEST_ASSERT(rc == NONE_ERROR);
+	pthread_mutex_lock(&lock);
+	(*(int *)pContext)++;
+	completed++;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+}
+
+static void *publishQueued(void *pArg) {
+	int thread = (int)(intptr_t)pArg;
+	MQTTPublishParams params;
+	IoT_Error_t rc;
+	int i;
+
+	for (i = 0; i < MESSAGES; i++) {
+		setMessage(&params, thread, i, QOS_1);
+		// the queue is shorter than the messages of all the threads, a full one is tried again
+		while ((rc = client.publishAsync(&params, publishComplete, &completions[thread][i])) == WAIT_FOR_PUBLISH) {
+			os_thread_sleep(os_msec_to_ticks(5));
+		}
+		TEST_ASSERT(rc == NONE_ERROR);
+	}
+	return NULL;
+}
+
+// queued publishes complete once each, from the I/O task once the broker acknowledged them
+static void test_async_publishes_complete(void) {
+	int i;
+	int j;
+
+	runThreads(publishQueued);
+	TEST_ASSERT(client.flush() == NONE_ERROR);
+	TEST_ASSERT(waitForCount(&completed, THREADS * MESSAGES));
+	TEST_ASSERT(waitForCount(&receivedCount, THREADS * MESSAGES));
+	for (i = 0; i < THREADS; i++) {
+		for (j = 0; j < MESSAGES; j++) {
+			TEST_ASSERT(completions[i][j] == 1);
+		}
+	}
+	checkOrder(THREADS * MESSAGES);
+}
+
+static int subscribed;
+static int delivered;
+static os_thread_t deliveryThread;
+
+static void subscribeComplete(IoT_Error_t rc, void *pContext) {
+	(void)pContext;
+	TEST_ASSERT(rc == NONE_ERROR);
+	pthread_mutex_lock(&lock);
+	subscribed++;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+}
+
+static int32_t messageArrived(MQTTCallbackParams params) {
+	(void)params;
+	pthread_mutex_lock(&lock);
+	deliveryThread = os_get_current_task_handle();
+	delivered++;
+	pthread_cond_broadcast(&changed);
+	pthread_mutex_unlock(&lock);
+	return 0;
+}
+
+static MQTTSubscribeParams subscriptions[THREADS];
+
+static void *subscribeQueued(void *pArg) {
+	int thread = (int)(intptr_t)pArg;
+
+	subscriptions[thread] = MQTTSubscribeParamsDefault;
+	subscriptions[thread].pTopic = topics[thread];
+	subscriptions[thread].qos = QOS_0;
+	subscriptions[thread].mHandler = messageArrived;
+	TEST_ASSERT(aws_iot_mqtt_io_subscribe_async(&subscriptions[thread], 1, subscribeComplete, NULL) == NONE_ERROR);
+	return NULL;
+}
+
+// subscribes queued from several threads complete, and their messages are delivered on the I/O task
+static void test_async_subscribes_complete(void) {
+	unsigned char publish[32];
+	MQTTString topic = MQTTString_initializer;
+	int i;
+
+	runThreads(subscribeQueued);
+	TEST_ASSERT(waitForCount(&subscribed, THREADS));
+	for (i = 0; i < THREADS; i++) {
+		topic.cstring = topics[i];
+		answer(publish, MQTTSerialize_publish(publish, sizeof(publish), 0, 0, 0, 0, topic, (unsigned char *)"hi", 2));
+	}
+	TEST_ASSERT(waitForCount(&delivered, THREADS));
+	TEST_ASSERT(!pthread_equal(deliveryThread, pthread_self()));
+}
+
+int main(void) {
+	MQTTConnectParams params = MQTTConnectParamsDefault;
+	int i;
+
+	alarm(60);		// a command that never completes fails the test instead of hanging it
+	for (i = 0; i < THREADS; i++) {
+		snprintf(topics[i], sizeof(topics[i]), "t/%d", i);
+	}
+	fake_network_init(&broker, false);
+	broker.onWrite = onWrite;
+	pFakeTlsNetwork = &broker;
+	TEST_ASSERT(aws_iot_mqtt_io_init(&client) == NONE_ERROR);
+	params.pClientID = "test";
+	params.pHostURL = "broker";
+	TEST_ASSERT(client.connect(&params) == NONE_ERROR);
+	TEST_ASSERT(client.isConnected());
+
+	RUN_TEST(test_blocking_publishes_in_order);
+	RUN_TEST(test_flush_from_other_thread);
+	RUN_TEST(test_async_publishes_complete);
+	RUN_TEST(test_async_subscribes_complete);
+	return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * The session store over restarts and reconnects of the MQTT client of the wrapper,
+ * with the file backend and a fake broker behind the TLS functions. A restart is a
+ * child process that publishes and exits without a word to the broker.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "aws_iot_mqtt_interface.h"
+#include "aws_iot_file_store.h"
+#include "fake_network.h"
+#include "unit_test.h"
+
+#define STORM_ROUNDS 50
+#define STORM_MESSAGES (STORM_ROUNDS * 2)
+
+typedef struct {
+	uint16_t id;
+	bool isOutstanding;
+	int completions;
+} Message_t;
+
+static FakeNetwork_t broker;
+static char storePath[] = "/tmp/test_session_store.XXXXXX";
+static SessionStore_t sessionStore;		// the store of the client, it stays in use
+
+static void connectBroker(bool isSessionPresent) {
+	unsigned char connack[] = {0x20, 2, 0, 0};
+	MQTTConnectParams params = MQTTConnectParamsDefault;
+
+	connack[2] = isSessionPresent ? 1 : 0;
+	fake_network_free(&broker);
+	fake_network_init(&broker, false);
+	pFakeTlsNetwork = &broker;
+	fake_network_push(&broker, connack, sizeof(connack));
+	params.pClientID = "test";
+	params.pHostURL = "broker";
+	params.isCleansession = false;
+	TEST_ASSERT(aws_iot_mqtt_connect(&params) == NONE_ERROR);
+	aws_iot_mqtt_yield(5);	// out with any coalesced writes
+}
+
+// the connection drops, the client only learns of it when it next uses it
+static void dropBroker(void) {
+	broker.isClosed = true;
+	aws_iot_mqtt_disconnect();
+}
+
+static void ack(uint16_t id) {
+	unsigned char puback[] = {0x40, 2, 0, 0};
+
+	puback[2] = id >> 8;
+	puback[3] = id & 0xFF;
+	fake_network_push(&broker, puback, sizeof(puback));
+}
+
+// the QoS 1 PUBLISH packets the client wrote from offset on, their ids in pIds
+static int publishedIds(size_t offset, bool isDuplicate, uint16_t *pIds, int maxIds) {
+	const unsigned char *pOut = broker.output;
+	size_t end = broker.outputLen;
+	int count = 0;
+
+	TEST_ASSERT(end <= sizeof(broker.output));
+	while (offset < end) {
+		unsigned char header = pOut[offset++];
+		size_t length = 0;
+		int shift = 0;
+
+		do {
+			length |= (size_t)(pOut[offset] & 0x7F) << shift;
+			shift += 7;
+		} while (pOut[offset++] & 0x80);
+		if ((header >> 4) == 3 && ((header >> 1) & 3) == 1 && ((header & 0x08) != 0) == isDuplicate) {
+			size_t topicLength = (pOut[offset] << 8) | pOut[offset + 1];
+			TEST_ASSERT(count < maxIds);
+			pIds[count++] = (pOut[offset + 2 + topicLength] << 8) | pOut[offset + 3 + topicLength];
+		}
+		offset += length;
+	}
+	return count;
+}
+
+// the ids of the records the file holds, read with a store of its own
+static int storedIds(uint16_t *pIds) {
+	SessionStore_t store;
+	SessionRecord_t record;
+	int count = 0;
+	uint8_t i;
+
+	TEST_ASSERT(aws_iot_session_store_file_init(&store, storePath) == NONE_ERROR);
+	for (i = 0; i < AWS_IOT_SESSION_STORE_RECORDS; i++) {
+		TEST_ASSERT(store.load(&store, i, &record) == NONE_ERROR);
+		if (record.isUsed) {
+			pIds[count++] = record.id;
+		}
+	}
+	aws_iot_session_store_file_close(&store);
+	return count;
+}
+
+static bool hasId(const uint16_t *pIds, int count, uint16_t id) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (pIds[i] == id) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static IoT_Error_t publish(const char *pTopic, const char *pPayload, iot_publish_complete_handler handler,
+		void *pContext, uint16_t *pId) {
+	MQTTPublishParams params = MQTTPublishParamsDefault;
+	IoT_Error_t rc;
+
+	params.pTopic = (char *)pTopic;
+	params.MessageParams.qos = QOS_1;
+	params.MessageParams.pPayload = (void *)pPayload;
+	params.MessageParams.PayloadLen = strlen(pPayload);
+	rc = aws_iot_mqtt_publish_async(&params, handler, pContext);
+	*pId = params.MessageParams.id;
+	return rc;
+}
+
+static void test_file_store_slots(void) {
+	SessionStore_t store;
+	SessionRecord_t record;
+	SessionRecord_t loaded;
+
+	TEST_ASSERT(aws_iot_session_store_file_init(&store, storePath) == NONE_ERROR);
+	TEST_ASSERT(store.load(&store, 1, &loaded) == NONE_ERROR && !loaded.isUsed);
+
+	memset(&record, 0, sizeof(record));
+	record.isUsed = true;
+	record.id = 7;
+	record.qos = QOS_1;
+	strcpy(record.topic, "a/b");
+	record.PayloadLen = 3;
+	memcpy(record.payload, "xyz", 3);
+	TEST_ASSERT(store.save(&store, 1, &record) == NONE_ERROR);
+	TEST_ASSERT(store.load(&store, 0, &loaded) == NONE_ERROR && !loaded.isUsed);
+	TEST_ASSERT(store.load(&store, 1, &loaded) == NONE_ERROR && loaded.isUsed);
+	TEST_ASSERT(loaded.id == 7 && strcmp(loaded.topic, "a/b") == 0);
+	TEST_ASSERT(loaded.PayloadLen == 3 && memcmp(loaded.payload, "xyz", 3) == 0);
+
+	TEST_ASSERT(store.erase(&store, 1) == NONE_ERROR);
+	TEST_ASSERT(store.load(&store, 1, &loaded) == NONE_ERROR && !loaded.isUsed);
+	aws_iot_session_store_file_close(&store);
+}
+
+static void test_publishes_resent_after_restart(void) {
+	uint16_t ids[8];
+	uint16_t stored[AWS_IOT_SESSION_STORE_RECORDS];
+	int status;
+	pid_t child;
+	int i;
+
+	child = fork();
+	TEST_ASSERT(child >= 0);
+	if (child == 0) {
+		TEST_ASSERT(aws_iot_session_store_file_init(&sessionStore, storePath) == NONE_ERROR);
+		TEST_ASSERT(aws_iot_mqtt_set_session_store(&sessionStore) == NONE_ERROR);
+		connectBroker(false);
+		for (i = 0; i < 3; i++) {
+			TEST_ASSERT(publish("kept", "payload", NULL, NULL, &ids[i]) == NONE_ERROR);
+		}
+		_exit(0);
+	}
+	TEST_ASSERT(waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+	TEST_ASSERT(storedIds(stored) == 3);
+
+	// the first connect after the restart sends them again, with the ids they had
+	TEST_ASSERT(aws_iot_session_store_file_init(&sessionStore, storePath) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_mqtt_set_session_store(&sessionStore) == NONE_ERROR);
+	connectBroker(true);
+	TEST_ASSERT(publishedIds(0, true, ids, 8) == 3);
+	for (i = 0; i < 3; i++) {
+		TEST_ASSERT(hasId(stored, 3, ids[i]));
+		ack(ids[i]);
+	}
+	aws_iot_mqtt_yield(5);
+	TEST_ASSERT(storedIds(stored) == 0);
+	dropBroker();
+}
+
+static Message_t messages[STORM_MESSAGES];
+
+static void messageComplete(uint16_t id, IoT_Error_t rc, void *pContext) {
+	Message_t *pMessage = (Message_t *)pContext;
+
+	TEST_ASSERT(rc == NONE_ERROR && id == pMessage->id);
+	pMessage->isOutstanding = false;
+	pMessage->completions++;
+}
+
+static int outstandingIds(uint16_t *pIds) {
+	int count = 0;
+	int i;
+
+	for (i = 0; i < STORM_MESSAGES; i++) {
+		if (messages[i].isOutstanding) {
+			pIds[count++] = messages[i].id;
+		}
+	}
+	return count;
+}
+
+// the connection keeps dropping while publishes are in flight, none is lost and none completes twice
+static void test_reconnect_storm(void) {
+	uint16_t outstanding[AWS_IOT_SESSION_STORE_RECORDS];
+	uint16_t ids[AWS_IOT_SESSION_STORE_RECORDS * 2];
+	int outstandingCount;
+	int published = 0;
+	int round;
+	int i;
+
+	srand(7);
+	for (round = 0; round < STORM_ROUNDS; round++) {
+		// the broker may have lost the session, the client sends the publishes all the same
+		connectBroker(rand() % 4 != 0);
+		outstandingCount = outstandingIds(outstanding);
+		TEST_ASSERT(publishedIds(0, true, ids, AWS_IOT_SESSION_STORE_RECORDS * 2) == outstandingCount);
+		for (i = 0; i < outstandingCount; i++) {
+			TEST_ASSERT(hasId(outstanding, outstandingCount, ids[i]));
+		}
+
+		// more publishes wait while the store is full
+		for (i = 0; i < 2; i++) {
+			Message_t *pMessage = &messages[published];
+			IoT_Error_t rc = publish("storm", "payload", messageComplete, pMessage, &pMessage->id);
+
+			TEST_ASSERT(rc == NONE_ERROR || (rc == WAIT_FOR_PUBLISH && outstandingIds(ids) == AWS_IOT_SESSION_STORE_RECORDS));
+			if (rc == NONE_ERROR) {
+				pMessage->isOutstanding = true;
+				published++;
+			}
+		}
+
+		for (i = 0; i < published; i++) {
+			if (messages[i].isOutstanding && rand() % 2 == 0) {
+				ack(messages[i].id);
+			}
+		}
+		aws_iot_mqtt_yield(5);
+
+		// the file holds exactly the publishes still owed
+		outstandingCount = outstandingIds(outstanding);
+		TEST_ASSERT(storedIds(ids) == outstandingCount);
+		for (i = 0; i < outstandingCount; i++) {
+			TEST_ASSERT(hasId(outstanding, outstandingCount, ids[i]));
+		}
+		dropBroker();
+	}
+
+	connectBroker(true);
+	outstandingCount = outstandingIds(outstanding);
+	for (i = 0; i < outstandingCount; i++) {
+		ack(outstanding[i]);
+	}
+	aws_iot_mqtt_yield(5);
+	TEST_ASSERT(storedIds(ids) == 0);
+	TEST_ASSERT(published > STORM_ROUNDS);
+	for (i = 0; i < published; i++) {
+		TEST_ASSERT(messages[i].completions == 1);
+	}
+}
+
+int main(void) {
+	int fd = mkstemp(storePath);
+
+	TEST_ASSERT(fd >= 0);
+	close(fd);
+	RUN_TEST(test_file_store_slots);
+	RUN_TEST(test_publishes_resent_after_restart);
+	RUN_TEST(test_reconnect_storm);
+	unlink(storePath);
+	return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Updates pipelined through a shadow context, a thousand waiting at once for the
+ * responses of a stand-in broker, which answers them in any order. Covers the
+ * removal from the ack wait hash of entries whose client tokens collide, and the
+ * order in which the expiry heap times the actions out.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_context.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define UPDATES 1000
+#define THINGS 8
+#define COLLIDING 16
+
+#if MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME < UPDATES
+#error "build with MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME of UPDATES at least"
+#endif
+
+typedef struct {
+	char thingName[MAX_SIZE_OF_THING_NAME];
+	char token[MAX_SIZE_OF_UNIQUE_CLIENT_ID_BYTES + 12];
+	uint8_t timeout;
+	int calls;
+	Shadow_Ack_Status_t status;
+} Update_t;
+
+static MQTTClient_t mqttClient;
+static ShadowContext_t context;
+static ShadowThing_t things[THINGS];
+static Update_t updates[UPDATES];
+static int expiredOrder[UPDATES];
+static int expiredCount;
+
+static void ackCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	Update_t *pUpdate = (Update_t *)pContextData;
+
+	TEST_ASSERT(action == SHADOW_UPDATE);
+	TEST_ASSERT(strcmp(pThingName, pUpdate->thingName) == 0);
+	pUpdate->calls++;
+	pUpdate->status = status;
+	if (status == SHADOW_ACK_TIMEOUT) {
+		expiredOrder[expiredCount++] = pUpdate - updates;
+	}
+}
+
+static void setUpContext(void) {
+	char name[MAX_SIZE_OF_THING_NAME];
+	int i;
+
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_init(&context, &mqttClient, things, THINGS) == NONE_ERROR);
+	for (i = 0; i < THINGS; i++) {
+		snprintf(name, sizeof(name), "child-%d", i);
+		TEST_ASSERT(aws_iot_shadow_context_add_thing(&context, name, NULL, NULL) == NONE_ERROR);
+	}
+	memset(updates, 0, sizeof(updates));
+	expiredCount = 0;
+}
+
+// publishes update number n, the broker takes note of its client token
+static void update(int n, uint8_t timeout) {
+	Update_t *pUpdate = &updates[n];
+	char json[128];
+	const char *pStart;
+	const char *pEnd;
+
+	snprintf(pUpdate->thingName, sizeof(pUpdate->thingName), "child-%d", n % THINGS);
+	pUpdate->timeout = timeout;
+	TEST_ASSERT(aws_iot_shadow_init_json_document(json, sizeof(json)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_finalize_json_document(json, sizeof(json)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_update(&context, pUpdate->thingName, json, ackCallback, pUpdate, timeout)
+			== NONE_ERROR);
+
+	pStart = strstr(fakeMqttLastPublish.payload, "\"clientToken\":\"");
+	TEST_ASSERT(pStart != NULL);
+	pStart += strlen("\"clientToken\":\"");
+	pEnd = strchr(pStart, '"');
+	TEST_ASSERT(pEnd != NULL && (size_t)(pEnd - pStart) < sizeof(pUpdate->token));
+	memcpy(pUpdate->token, pStart, pEnd - pStart);
+	pUpdate->token[pEnd - pStart] = '\0';
+}
+
+// the broker answers update number n, as it did not before
+static void answer(int n, bool isRejected) {
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+	char payload[160];
+
+	snprintf(topic, sizeof(topic), "$aws/things/%s/shadow/update/%s", updates[n].thingName,
+			isRejected ? "rejected" : "accepted");
+	if (isRejected) {
+		snprintf(payload, sizeof(payload), "{\"code\":400,\"message\":\"Bad Request\",\"clientToken\":\"%s\"}",
+				updates[n].token);
+	} else {
+		snprintf(payload, sizeof(payload), "{\"state\":{},\"version\":%d,\"clientToken\":\"%s\"}", n + 1,
+				updates[n].token);
+	}
+	TEST_ASSERT(fake_mqtt_client_deliver(topic, payload, strlen(payload), 0) == NONE_ERROR);
+	TEST_ASSERT(updates[n].calls == 1);
+}
+
+static void shuffle(int *pOrder, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		pOrder[i] = i;
+	}
+	for (i = count - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		int t = pOrder[i];
+		pOrder[i] = pOrder[j];
+		pOrder[j] = t;
+	}
+}
+
+// a thousand updates in flight, each response finds its own action whatever the order
+static void test_thousand_updates(void) {
+	static int order[UPDATES];
+	char payload[160];
+	int i;
+
+	setUpContext();
+	for (i = 0; i < UPDATES; i++) {
+		update(i, 60);
+	}
+	TEST_ASSERT(context.ackWaitCount == UPDATES);
+	TEST_ASSERT(fakeMqttSubscriptionCount == 3);
+
+	// one in five is never answered
+	shuffle(order, UPDATES);
+	for (i = 0; i < UPDATES; i++) {
+		if (order[i] % 5 != 4) {
+			answer(order[i], order[i] % 7 == 0);
+		}
+	}
+	TEST_ASSERT(context.ackWaitCount == UPDATES / 5);
+
+	// a response given twice finds nothing the second time
+	snprintf(payload, sizeof(payload), "{\"state\":{},\"version\":1,\"clientToken\":\"%s\"}", updates[0].token);
+	TEST_ASSERT(fake_mqtt_client_deliver("$aws/things/child-0/shadow/update/accepted", payload, strlen(payload), 0)
+			!= NONE_ERROR);
+
+	for (i = 0; i < UPDATES; i++) {
+		if (i % 5 == 4) {
+			TEST_ASSERT(updates[i].calls == 0);
+		} else {
+			TEST_ASSERT(updates[i].calls == 1);
+			TEST_ASSERT(updates[i].status == ((i % 7 == 0) ? SHADOW_ACK_REJECTED : SHADOW_ACK_ACCEPTED));
+		}
+	}
+}
+
+// client tokens a whole hash table apart take the same slot, answering them in any order
+// moves the ones probed past their slot back so that each is still found
+static void test_colliding_tokens(void) {
+	static int order[COLLIDING * 5];
+	int first;
+	int i;
+
+	setUpContext();
+	for (i = 0; i < COLLIDING; i++) {
+		update(i, 60);
+	}
+	// the sequence of the client tokens goes round the hash table, answered as it goes
+	for (i = 0; i < SHADOW_ACK_WAIT_HASH_SLOTS - COLLIDING; i++) {
+		update(COLLIDING, 60);
+		answer(COLLIDING, false);
+		updates[COLLIDING].calls = 0;
+	}
+	// these land on the slots of the first ones and the ones after, in one cluster
+	first = COLLIDING;
+	for (i = 0; i < COLLIDING * 4; i++) {
+		update(first + i, 60);
+	}
+	TEST_ASSERT(context.ackWaitCount == COLLIDING * 5);
+
+	shuffle(order, COLLIDING * 5);
+	for (i = 0; i < COLLIDING * 5; i++) {
+		answer(order[i], false);
+	}
+	TEST_ASSERT(context.ackWaitCount == 0);
+	for (i = 0; i < COLLIDING * 5; i++) {
+		TEST_ASSERT(updates[i].calls == 1 && updates[i].status == SHADOW_ACK_ACCEPTED);
+	}
+}
+
+// the actions time out soonest first, answering some of them on the way keeps the order
+static void test_expiry_order(void) {
+	static int order[UPDATES];
+	int waitingOneSecond = 0;
+	int i;
+
+	setUpContext();
+	srand(11);
+	for (i = 0; i < UPDATES; i++) {
+		update(i, 1 + rand() % 2);
+	}
+	aws_iot_shadow_context_yield(&context, 0);
+	TEST_ASSERT(expiredCount == 0);
+
+	// a third of them are answered, from anywhere in the heap
+	shuffle(order, UPDATES);
+	for (i = 0; i < UPDATES / 3; i++) {
+		answer(order[i], false);
+	}
+	for (i = 0; i < UPDATES; i++) {
+		if (updates[i].calls == 0 && updates[i].timeout == 1) {
+			waitingOneSecond++;
+		}
+	}
+
+	// past the first second only, every action given one second has timed out, none given two
+	usleep(1500 * 1000);
+	aws_iot_shadow_context_yield(&context, 0);
+	TEST_ASSERT(expiredCount == waitingOneSecond);
+	for (i = 0; i < expiredCount; i++) {
+		TEST_ASSERT(updates[expiredOrder[i]].timeout == 1);
+	}
+	usleep(1000 * 1000);
+	aws_iot_shadow_context_yield(&context, 0);
+	for (i = 1; i < expiredCount; i++) {
+		TEST_ASSERT(updates[expiredOrder[i - 1]].timeout <= updates[expiredOrder[i]].timeout);
+	}
+	for (i = 0; i < UPDATES; i++) {
+		TEST_ASSERT(updates[i].calls == 1);
+	}
+	TEST_ASSERT(expiredCount == UPDATES - UPDATES / 3);
+	TEST_ASSERT(context.ackWaitCount == 0);
+}
+
+int main(void) {
+	srand(7);
+	RUN_TEST(test_thousand_updates);
+	RUN_TEST(test_colliding_tokens);
+	RUN_TEST(test_expiry_order);
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * A shadow context serving 50 Things over its three wildcard subscriptions, as a
+ * gateway does for its child devices: the responses and deltas of each Thing are
+ * told apart by the Thing Name in the topic.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_context.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define THINGS 50
+
+static MQTTClient_t mqttClient;
+static ShadowContext_t context;
+static ShadowThing_t things[THINGS];
+static int acks[THINGS];
+static int deltas[THINGS];
+static int timeouts;
+
+static void ackCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	int thing = (int)(intptr_t)pContextData;
+	char name[MAX_SIZE_OF_THING_NAME];
+
+	if (status == SHADOW_ACK_TIMEOUT) {
+		timeouts++;
+		return;
+	}
+	TEST_ASSERT(status == SHADOW_ACK_ACCEPTED);
+	snprintf(name, sizeof(name), "child-%d", thing);
+	TEST_ASSERT(strcmp(pThingName, name) == 0);
+	acks[thing]++;
+}
+
+static void deltaCallback(const char *pThingName, const char *pState, uint32_t stateLength, void *pContextData) {
+	int thing = (int)(intptr_t)pContextData;
+	char name[MAX_SIZE_OF_THING_NAME];
+
+	snprintf(name, sizeof(name), "child-%d", thing);
+	TEST_ASSERT(strcmp(pThingName, name) == 0);
+	TEST_ASSERT(stateLength > 1 && pState[0] == '{' && pState[stateLength - 1] == '}');
+	deltas[thing]++;
+}
+
+// the client token of the latest message published
+static void lastClientToken(char *pToken, size_t size) {
+	const char *pStart = strstr(fakeMqttLastPublish.payload, "\"clientToken\":\"");
+	const char *pEnd;
+
+	TEST_ASSERT(pStart != NULL);
+	pStart += strlen("\"clientToken\":\"");
+	pEnd = strchr(pStart, '"');
+	TEST_ASSERT(pEnd != NULL && (size_t)(pEnd - pStart) < size);
+	memcpy(pToken, pStart, pEnd - pStart);
+	pToken[pEnd - pStart] = '\0';
+}
+
+static void deliver(const char *pTopic, const char *pPayload, int expected) {
+	TEST_ASSERT(fake_mqtt_client_deliver(pTopic, pPayload, strlen(pPayload), 0) == expected);
+}
+
+static void setUpContext(void) {
+	char name[MAX_SIZE_OF_THING_NAME];
+	int i;
+
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_init(&context, &mqttClient, things, THINGS) == NONE_ERROR);
+	for (i = 0; i < THINGS; i++) {
+		snprintf(name, sizeof(name), "child-%d", i);
+		TEST_ASSERT(aws_iot_shadow_context_add_thing(&context, name, deltaCallback, (void *)(intptr_t)i)
+				== NONE_ERROR);
+	}
+	memset(acks, 0, sizeof(acks));
+	memset(deltas, 0, sizeof(deltas));
+	timeouts = 0;
+}
+
+// every Thing gets its own response, in whatever order they come, with three subscriptions for all
+static void test_fifty_things(void) {
+	char tokens[MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME][64];
+	char name[MAX_SIZE_OF_THING_NAME];
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+	char payload[256];
+	int base;
+	int i;
+
+	setUpContext();
+	TEST_ASSERT(fakeMqttSubscriptionCount == 3);
+	TEST_ASSERT(aws_iot_shadow_context_add_thing(&context, "extra", NULL, NULL) != NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_add_thing(&context, "child-7", NULL, NULL) != NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_get(&context, "unknown", ackCallback, NULL, 5) != NONE_ERROR);
+
+	// as many gets as the wait list holds at a time, answered in the reverse order
+	for (base = 0; base < THINGS; base += MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME) {
+		for (i = base; i < base + MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME; i++) {
+			snprintf(name, sizeof(name), "child-%d", i);
+			TEST_ASSERT(aws_iot_shadow_context_get(&context, name, ackCallback, (void *)(intptr_t)i, 5)
+					== NONE_ERROR);
+			snprintf(topic, sizeof(topic), "$aws/things/%s/shadow/get", name);
+			TEST_ASSERT(strcmp(fakeMqttLastPublish.topic, topic) == 0);
+			lastClientToken(tokens[i - base], sizeof(tokens[i - base]));
+		}
+		for (i = base + MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME - 1; i >= base; i--) {
+			snprintf(topic, sizeof(topic), "$aws/things/child-%d/shadow/get/accepted", i);
+			snprintf(payload, sizeof(payload), "{\"state\":{\"reported\":{\"x\":1}},\"version\":%d,\"clientToken\":\"%s\"}",
+					100 + i, tokens[i - base]);
+			deliver(topic, payload, NONE_ERROR);
+		}
+	}
+	for (i = 0; i < THINGS; i++) {
+		snprintf(name, sizeof(name), "child-%d", i);
+		TEST_ASSERT(acks[i] == 1);
+		TEST_ASSERT(aws_iot_shadow_context_get_version(&context, name) == (uint32_t)(100 + i));
+	}
+	TEST_ASSERT(fakeMqttSubscriptionCount == 3);
+}
+
+// a delta goes to its Thing only, if newer than the last version of that Thing
+static void test_deltas_per_thing(void) {
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+	char payload[128];
+	int i;
+
+	setUpContext();
+	for (i = 0; i < THINGS; i++) {
+		snprintf(topic, sizeof(topic), "$aws/things/child-%d/shadow/update/delta", i);
+		snprintf(payload, sizeof(payload), "{\"version\":%d,\"state\":{\"x\":2}}", 100 + i);
+		deliver(topic, payload, NONE_ERROR);
+		deliver(topic, payload, GENERIC_ERROR);
+		snprintf(payload, sizeof(payload), "{\"version\":%d,\"state\":{\"x\":3}}", 200 + i);
+		deliver(topic, payload, NONE_ERROR);
+		TEST_ASSERT(deltas[i] == 2);
+	}
+	for (i = 0; i < THINGS; i++) {
+		TEST_ASSERT(deltas[i] == 2);
+	}
+	deliver("$aws/things/stranger/shadow/update/delta", "{\"version\":1,\"state\":{}}", GENERIC_ERROR);
+}
+
+// an action of a removed Thing times out, the Thing is not served anymore
+static void test_timeout_and_remove(void) {
+	char document[128];
+	int32_t x = 5;
+	jsonStruct_t xKey = {"x", &x, SHADOW_JSON_INT32, NULL};
+
+	setUpContext();
+	TEST_ASSERT(aws_iot_shadow_init_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 1, &xKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_finalize_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_update(&context, "child-7", document, ackCallback, (void *)(intptr_t)7, 0)
+			== NONE_ERROR);
+	TEST_ASSERT(strcmp(fakeMqttLastPublish.topic, "$aws/things/child-7/shadow/update") == 0);
+
+	TEST_ASSERT(aws_iot_shadow_context_remove_thing(&context, "child-7") == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_remove_thing(&context, "child-7") != NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_get_version(&context, "child-7") == 0);
+	deliver("$aws/things/child-7/shadow/update/delta", "{\"version\":1,\"state\":{}}", GENERIC_ERROR);
+
+	aws_iot_shadow_context_yield(&context, 10);
+	TEST_ASSERT(timeouts == 1 && acks[7] == 0);
+	TEST_ASSERT(context.ackWaitCount == 0);
+
+	// its entry serves another Thing
+	TEST_ASSERT(aws_iot_shadow_context_add_thing(&context, "late", NULL, NULL) == NONE_ERROR);
+	TEST_ASSERT(fakeMqttSubscriptionCount == 3);
+}
+
+int main(void) {
+	RUN_TEST(test_fifty_things);
+	RUN_TEST(test_deltas_per_thing);
+	RUN_TEST(test_timeout_and_remove);
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Deltas of the Thing of the device dispatched to the keys registered on them, by
+ * their path from the state object.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define DELTA_TOPIC "$aws/things/" AWS_IOT_MY_THING_NAME "/shadow/update/delta"
+#define MANY_KEYS 100
+
+static MQTTClient_t mqttClient;
+static uint32_t version;
+static int calls;
+static char lastValue[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+
+static void valueCallback(const char *pJsonValueBuffer, uint32_t valueLength, jsonStruct_t *pJsonStruct_t) {
+	calls++;
+	snprintf(lastValue, sizeof(lastValue), "%.*s", (int)valueLength, pJsonValueBuffer);
+}
+
+static char stateValue[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+
+static void stateCallback(const char *pJsonValueBuffer, uint32_t valueLength, jsonStruct_t *pJsonStruct_t) {
+	snprintf(stateValue, sizeof(stateValue), "%.*s", (int)valueLength, pJsonValueBuffer);
+}
+
+static void connectShadow(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_connect(&mqttClient, &parameters) == NONE_ERROR);
+	calls = 0;
+}
+
+// a delta with the state given, of a version newer than the last
+static void deliverDelta(const char *pState) {
+	char delta[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+
+	// the metadata repeats keys of the state, it is not dispatched
+	snprintf(delta, sizeof(delta), "{\"version\":%u,\"timestamp\":1,\"state\":%s,\"metadata\":{\"rate\":{\"timestamp\":1}}}",
+			++version, pState);
+	TEST_ASSERT(strlen(delta) < sizeof(delta) - 1);
+	TEST_ASSERT(fake_mqtt_client_deliver(DELTA_TOPIC, delta, strlen(delta), 0) == NONE_ERROR);
+}
+
+// a key is its path from the state object, the same name elsewhere is not it
+static void test_nested_paths(void) {
+	int32_t rate = 0;
+	int32_t nestedRate = 0;
+	bool isOn = false;
+	jsonStruct_t rateKey = {"rate", &rate, SHADOW_JSON_INT32, valueCallback};
+	jsonStruct_t nestedRateKey = {"light.timer.rate", &nestedRate, SHADOW_JSON_INT32, valueCallback};
+	jsonStruct_t onKey = {"light.on", &isOn, SHADOW_JSON_BOOL, valueCallback};
+
+	connectShadow();
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &rateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &nestedRateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &onKey) == NONE_ERROR);
+
+	deliverDelta("{\"light\":{\"on\":true,\"timer\":{\"rate\":5}},\"rate\":12}");
+	TEST_ASSERT(calls == 3);
+	TEST_ASSERT(rate == 12 && nestedRate == 5 && isOn);
+
+	// not at the path of a key, whatever the name
+	deliverDelta("{\"other\":{\"rate\":99,\"on\":false},\"timer\":{\"rate\":7}}");
+	TEST_ASSERT(calls == 3);
+	TEST_ASSERT(rate == 12 && nestedRate == 5 && isOn);
+
+	deliverDelta("{\"light\":{\"on\":false}}");
+	TEST_ASSERT(calls == 4 && !isOn && strcmp(lastValue, "false") == 0);
+}
+
+// every key registered on a path gets its value, and "state" the whole state object
+static void test_keys_sharing_a_path(void) {
+	int32_t first = 0;
+	int32_t second = 0;
+	char state[64];
+	jsonStruct_t firstKey = {"level", &first, SHADOW_JSON_INT32, valueCallback};
+	jsonStruct_t secondKey = {"level", &second, SHADOW_JSON_INT32, valueCallback};
+	jsonStruct_t stateKey = {"state", state, SHADOW_JSON_OBJECT, stateCallback};
+
+	connectShadow();
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &firstKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &secondKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &stateKey) == NONE_ERROR);
+
+	deliverDelta("{\"level\":3}");
+	TEST_ASSERT(calls == 2);
+	TEST_ASSERT(first == 3 && second == 3);
+	TEST_ASSERT(strcmp(stateValue, "{\"level\":3}") == 0);
+}
+
+// each of many keys is found, those the delta leaves out are left alone
+static void test_many_keys(void) {
+	static char names[MANY_KEYS][16];
+	static int32_t values[MANY_KEYS];
+	static jsonStruct_t keys[MANY_KEYS];
+	char state[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	int n;
+	int i;
+
+	connectShadow();
+	for (i = 0; i < MANY_KEYS; i++) {
+		// half of them nested one level down
+		snprintf(names[i], sizeof(names[i]), (i % 2 == 0) ? "k%d" : "group.k%d", i);
+		values[i] = -1;
+		keys[i].pKey = names[i];
+		keys[i].pData = &values[i];
+		keys[i].type = SHADOW_JSON_INT32;
+		keys[i].cb = valueCallback;
+		TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &keys[i]) == NONE_ERROR);
+	}
+
+	// every third key, the nested ones in an object of their own
+	n = snprintf(state, sizeof(state), "{\"group\":{");
+	for (i = 1; i < MANY_KEYS; i += 2) {
+		if (i % 3 == 0) {
+			n += snprintf(state + n, sizeof(state) - n, "%s\"k%d\":%d", (state[n - 1] == '{') ? "" : ",", i, i * 10);
+		}
+	}
+	n += snprintf(state + n, sizeof(state) - n, "}");
+	for (i = 0; i < MANY_KEYS; i += 2) {
+		if (i % 3 == 0) {
+			n += snprintf(state + n, sizeof(state) - n, ",\"k%d\":%d", i, i * 10);
+		}
+	}
+	snprintf(state + n, sizeof(state) - n, "}");
+	TEST_ASSERT(strlen(state) < sizeof(state) - 1);
+
+	deliverDelta(state);
+	TEST_ASSERT(calls == (MANY_KEYS + 2) / 3);
+	for (i = 0; i < MANY_KEYS; i++) {
+		TEST_ASSERT(values[i] == ((i % 3 == 0) ? i * 10 : -1));
+	}
+}
+
+// a delta that fits the buffer but comes in chunks, as read ahead by the MQTT client, reaches the keys too
+static void test_chunked_delta(void) {
+	int32_t rate = 0;
+	bool isOn = false;
+	char name[32];
+	char delta[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	jsonStruct_t rateKey = {"rate", &rate, SHADOW_JSON_INT32, valueCallback};
+	jsonStruct_t onKey = {"light.on", &isOn, SHADOW_JSON_BOOL, valueCallback};
+	jsonStruct_t nameKey = {"name", name, SHADOW_JSON_STRING, stateCallback};
+
+	connectShadow();
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &rateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &onKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &nameKey) == NONE_ERROR);
+
+	snprintf(delta, sizeof(delta), "{\"version\":%u,\"timestamp\":1,\"state\":{\"light\":{\"on\":true},"
+			"\"name\":\"a name split across the chunks\",\"rate\":42},\"metadata\":{\"rate\":{\"timestamp\":1}}}",
+			++version);
+	TEST_ASSERT(strlen(delta) > 64 && strlen(delta) < SHADOW_MAX_SIZE_OF_RX_BUFFER / 2);
+	TEST_ASSERT(fake_mqtt_client_deliver(DELTA_TOPIC, delta, strlen(delta), 16) == NONE_ERROR);
+	TEST_ASSERT(calls == 2 && rate == 42 && isOn);
+	// a string is handed to the callback only
+	TEST_ASSERT(strcmp(stateValue, "a name split across the chunks") == 0);
+
+	// and an old one in chunks is dropped
+	TEST_ASSERT(fake_mqtt_client_deliver(DELTA_TOPIC, delta, strlen(delta), 16) != NONE_ERROR);
+	TEST_ASSERT(calls == 2);
+}
+
+int main(void) {
+	RUN_TEST(test_nested_paths);
+	RUN_TEST(test_keys_sharing_a_path);
+	RUN_TEST(test_many_keys);
+	RUN_TEST(test_chunked_delta);
+	return 0;
+}
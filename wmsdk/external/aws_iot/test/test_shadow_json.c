@@ -0,0 +1,84 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Shadow documents written section by section with the varargs API, and what a
+ * section that fails leaves of the document.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aws_iot_shadow_interface.h"
+#include "unit_test.h"
+
+static int32_t rate = 5;
+static bool isOn = true;
+static jsonStruct_t rateKey = {"rate", &rate, SHADOW_JSON_INT32, NULL};
+static jsonStruct_t onKey = {"on", &isOn, SHADOW_JSON_BOOL, NULL};
+
+static void test_sections(void) {
+	char document[200];
+
+	TEST_ASSERT(aws_iot_shadow_init_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 2, &rateKey, &onKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_add_desired(document, sizeof(document), 1, &rateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_finalize_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(strncmp(document, "{\"state\":{\"reported\":{\"rate\":5,\"on\":true},\"desired\":{\"rate\":5}}, "
+			"\"clientToken\":\"", 70) == 0);
+}
+
+// an entry found missing after others would already be written is refused before any is
+static void test_missing_entry_leaves_document(void) {
+	jsonStruct_t noData = {"level", NULL, SHADOW_JSON_INT32, NULL};
+	jsonStruct_t noKey = {NULL, &rate, SHADOW_JSON_INT32, NULL};
+	char document[200];
+	char before[200];
+
+	TEST_ASSERT(aws_iot_shadow_init_json_document(document, sizeof(document)) == NONE_ERROR);
+	strcpy(before, document);
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 3, &rateKey, &onKey, NULL)
+			== NULL_VALUE_ERROR);
+	TEST_ASSERT(strcmp(document, before) == 0);
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 2, &rateKey, &noData) == NULL_VALUE_ERROR);
+	TEST_ASSERT(strcmp(document, before) == 0);
+	TEST_ASSERT(aws_iot_shadow_add_desired(document, sizeof(document), 2, &onKey, &noKey) == NULL_VALUE_ERROR);
+	TEST_ASSERT(strcmp(document, before) == 0);
+
+	// the document is still good for the sections that follow
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 1, &onKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_finalize_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(strncmp(document, "{\"state\":{\"reported\":{\"on\":true}}, ", 35) == 0);
+}
+
+// a section that does not fit is not left cut in the document
+static void test_truncated_section_leaves_document(void) {
+	jsonStruct_t nameKey = {"name", "a name too long for what is left of the buffer", SHADOW_JSON_STRING, NULL};
+	char document[64];
+	char before[64];
+
+	TEST_ASSERT(aws_iot_shadow_init_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 1, &rateKey) == NONE_ERROR);
+	strcpy(before, document);
+	TEST_ASSERT(aws_iot_shadow_add_desired(document, sizeof(document), 2, &onKey, &nameKey)
+			== SHADOW_JSON_BUFFER_TRUNCATED);
+	TEST_ASSERT(strcmp(document, before) == 0);
+}
+
+int main(void) {
+	RUN_TEST(test_sections);
+	RUN_TEST(test_missing_entry_leaves_document);
+	RUN_TEST(test_truncated_section_leaves_document);
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_context.h"
+#include "aws_iot_shadow_json.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define THING_TOPIC(thing, suffix) "$aws/things/" thing "/shadow/" suffix
+
+static MQTTClient_t mqttClient;
+
+static int ackCalls;
+static Shadow_Ack_Status_t ackStatus;
+static char ackDocument[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+
+static void ackCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	ackCalls++;
+	ackStatus = status;
+	snprintf(ackDocument, sizeof(ackDocument), "%s", pReceivedJsonDocument);
+}
+
+static void connectShadow(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_connect(&mqttClient, &parameters) == NONE_ERROR);
+}
+
+// the client token of the document last published
+static void lastClientToken(char *pToken, size_t size) {
+	const char *pStart = strstr(fakeMqttLastPublish.payload, "\"clientToken\":\"");
+	const char *pEnd;
+
+	TEST_ASSERT(pStart != NULL);
+	pStart += strlen("\"clientToken\":\"");
+	pEnd = strchr(pStart, '"');
+	TEST_ASSERT(pEnd != NULL && (size_t)(pEnd - pStart) < size);
+	memcpy(pToken, pStart, pEnd - pStart);
+	pToken[pEnd - pStart] = '\0';
+}
+
+static void startUpdate(char *pToken, size_t size) {
+	char document[256];
+	int32_t value = 5;
+	jsonStruct_t reported = {"x", &value, SHADOW_JSON_INT32, NULL};
+
+	TEST_ASSERT(aws_iot_shadow_init_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_add_reported(document, sizeof(document), 1, &reported) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_finalize_json_document(document, sizeof(document)) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_update(&mqttClient, AWS_IOT_MY_THING_NAME, document, ackCallback, NULL, 10, false)
+			== NONE_ERROR);
+	lastClientToken(pToken, size);
+}
+
+// an accepted update of length bytes, padded with a string in the reported state
+static void makeAck(char *pAck, size_t length, const char *pToken) {
+	int n = snprintf(pAck, length + 1, "{\"state\":{\"reported\":{\"pad\":\"");
+	int tail = snprintf(NULL, 0, "\"}},\"version\":7,\"clientToken\":\"%s\"}", pToken);
+
+	TEST_ASSERT(n + tail < (int)length);
+	memset(pAck + n, 'p', length - n - tail);
+	snprintf(pAck + length - tail, tail + 1, "\"}},\"version\":7,\"clientToken\":\"%s\"}", pToken);
+	TEST_ASSERT(strlen(pAck) == length);
+}
+
+/*
+ * An ack that fits the shadow buffer but not the RX buffer of the MQTT client with its
+ * topic comes in chunks, it is gathered before it is parsed.
+ */
+static void test_ack_gathered_from_chunks(void) {
+	static const size_t chunkSizes[] = {0, 1, 7, 100, AWS_IOT_MQTT_RX_CHUNK_LEN};
+	char ack[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	char token[64];
+	size_t i;
+
+	connectShadow();
+	for (i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+		startUpdate(token, sizeof(token));
+		makeAck(ack, SHADOW_MAX_SIZE_OF_RX_BUFFER - 1, token);
+		ackCalls = 0;
+		TEST_ASSERT(fake_mqtt_client_deliver(THING_TOPIC(AWS_IOT_MY_THING_NAME, "update/accepted"), ack, strlen(ack),
+				chunkSizes[i]) == NONE_ERROR);
+		TEST_ASSERT(ackCalls == 1);
+		TEST_ASSERT(ackStatus == SHADOW_ACK_ACCEPTED);
+		TEST_ASSERT(strcmp(ackDocument, ack) == 0);
+	}
+}
+
+// too big for the shadow buffer, the ack is dropped and the next one is still gathered
+static void test_ack_too_big_dropped(void) {
+	char ack[2 * SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	char token[64];
+
+	connectShadow();
+	startUpdate(token, sizeof(token));
+	makeAck(ack, SHADOW_MAX_SIZE_OF_RX_BUFFER, token);
+	ackCalls = 0;
+	TEST_ASSERT(fake_mqtt_client_deliver(THING_TOPIC(AWS_IOT_MY_THING_NAME, "update/accepted"), ack, strlen(ack),
+			AWS_IOT_MQTT_RX_CHUNK_LEN) != NONE_ERROR);
+	TEST_ASSERT(ackCalls == 0);
+
+	makeAck(ack, 300, token);
+	TEST_ASSERT(fake_mqtt_client_deliver(THING_TOPIC(AWS_IOT_MY_THING_NAME, "update/accepted"), ack, strlen(ack),
+			AWS_IOT_MQTT_RX_CHUNK_LEN) == NONE_ERROR);
+	TEST_ASSERT(ackCalls == 1);
+}
+
+static int deltaCalls;
+static char deltaState[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+
+static void thingDeltaCallback(const char *pThingName, const char *pState, uint32_t stateLength,
+		void *pContextData) {
+	deltaCalls++;
+	snprintf(deltaState, sizeof(deltaState), "%.*s", (int)stateLength, pState);
+}
+
+static void test_wildcard_delta_gathered_from_chunks(void) {
+	static ShadowContext_t context;
+	static ShadowThing_t things[2];
+	char delta[2 * SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	char state[SHADOW_MAX_SIZE_OF_RX_BUFFER];
+	int n;
+
+	connectShadow();
+	TEST_ASSERT(aws_iot_shadow_context_init(&context, &mqttClient, things, 2) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_context_add_thing(&context, "child", thingDeltaCallback, NULL) == NONE_ERROR);
+
+	n = snprintf(state, sizeof(state), "{\"text\":\"%0400d\"}", 0);
+	snprintf(delta, sizeof(delta), "{\"version\":3,\"timestamp\":1,\"state\":%s}", state);
+	TEST_ASSERT(n > 400 && strlen(delta) < SHADOW_MAX_SIZE_OF_RX_BUFFER);
+	deltaCalls = 0;
+	TEST_ASSERT(fake_mqtt_client_deliver(THING_TOPIC("child", "update/delta"), delta, strlen(delta),
+			AWS_IOT_MQTT_RX_CHUNK_LEN) == NONE_ERROR);
+	TEST_ASSERT(deltaCalls == 1);
+	TEST_ASSERT(strcmp(deltaState, state) == 0);
+	TEST_ASSERT(aws_iot_shadow_context_get_version(&context, "child") == 3);
+}
+
+int main(void) {
+	RUN_TEST(test_ack_gathered_from_chunks);
+	RUN_TEST(test_ack_too_big_dropped);
+	RUN_TEST(test_wildcard_delta_gathered_from_chunks);
+	return 0;
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * The reported state cache against the fake MQTT client: which fields an update
+ * carries after the shadow accepted or rejected the previous one, within the deadband
+ * and the minimum interval of each field, and after a version conflict the fields it
+ * sends again once it got the shadow.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_reported.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define THING_TOPIC(thing, suffix) "$aws/things/" thing "/shadow/" suffix
+#define LONG_TEXT "a mode name longer than the copy the cache keeps of it"
+// two texts of the same length and the same 32-bit FNV-1a hash
+#define COLLIDING_TEXT "glbvs"
+#define COLLIDING_TEXT_2 "yacxa"
+
+static MQTTClient_t mqttClient;
+static ShadowReportedCache_t cache;
+static char document[512];
+
+static double temperature;
+static uint32_t counter;
+static char mode[64];
+static ShadowReportedField_t fields[] = {
+	{"temperature", &temperature, SHADOW_JSON_DOUBLE, 0.5, 0},
+	{"counter", &counter, SHADOW_JSON_UINT32, 0, 200},
+	{"mode", mode, SHADOW_JSON_STRING, 0, 0},
+};
+
+static int ackCalls;
+static Shadow_Ack_Status_t ackStatus;
+
+static void ackCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	TEST_ASSERT(action == SHADOW_UPDATE);
+	ackCalls++;
+	ackStatus = status;
+}
+
+static void setUpCache(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_connect(&mqttClient, &parameters) == NONE_ERROR);
+	temperature = 21.0;
+	counter = 1;
+	strcpy(mode, "auto");
+	TEST_ASSERT(aws_iot_shadow_reported_init(&cache, fields, sizeof(fields) / sizeof(fields[0])) == NONE_ERROR);
+	ackCalls = 0;
+}
+
+// true if an update was published, the fields it carries are in fakeMqttLastPublish
+static bool update(void) {
+	int published = fakeMqttPublishCount;
+
+	TEST_ASSERT(aws_iot_shadow_reported_update(&mqttClient, AWS_IOT_MY_THING_NAME, &cache, document, sizeof(document),
+			ackCallback, NULL, 10) == NONE_ERROR);
+	return fakeMqttPublishCount != published;
+}
+
+static bool isSent(const char *pKey) {
+	char quoted[32];
+
+	snprintf(quoted, sizeof(quoted), "\"%s\":", pKey);
+	return strstr(fakeMqttLastPublish.payload, quoted) != NULL;
+}
+
+// the shadow answers the request last published on pTopic with pMembers and its client token
+static void respond(const char *pTopic, const char *pMembers) {
+	const char *pStart = strstr(fakeMqttLastPublish.payload, "\"clientToken\":\"");
+	char payload[256];
+
+	TEST_ASSERT(pStart != NULL);
+	pStart += strlen("\"clientToken\":\"");
+	snprintf(payload, sizeof(payload), "{%s,\"clientToken\":\"%.*s\"}", pMembers,
+			(int)(strchr(pStart, '"') - pStart), pStart);
+	TEST_ASSERT(fake_mqtt_client_deliver(pTopic, payload, strlen(payload), 0) == NONE_ERROR);
+}
+
+// the shadow answers the update last published
+static void answer(bool isAccepted) {
+	int calls = ackCalls;
+
+	if (isAccepted) {
+		respond(THING_TOPIC(AWS_IOT_MY_THING_NAME, "update/accepted"), "\"state\":{},\"version\":3");
+	} else {
+		respond(THING_TOPIC(AWS_IOT_MY_THING_NAME, "update/rejected"), "\"code\":400,\"message\":\"Bad Request\"");
+	}
+	TEST_ASSERT(ackCalls == calls + 1);
+	TEST_ASSERT(ackStatus == (isAccepted ? SHADOW_ACK_ACCEPTED : SHADOW_ACK_REJECTED));
+}
+
+// another writer moved the shadow on, the update last published is rejected as based on a stale version
+static void answerConflict(void) {
+	respond(THING_TOPIC(AWS_IOT_MY_THING_NAME, "update/rejected"), "\"code\":409,\"message\":\"Version conflict\"");
+}
+
+// an update of temperature with versioning, the shadow at version 3
+static void startVersionedUpdate(void) {
+	setUpCache();
+	aws_iot_shadow_reported_enable_versioning(&cache);
+	TEST_ASSERT(update());
+	TEST_ASSERT(!isSent("version"));
+	answer(true);
+	temperature = 30.0;
+	TEST_ASSERT(update());
+	TEST_ASSERT(strstr(fakeMqttLastPublish.payload, "\"version\":3") != NULL);
+}
+
+// the first update carries every field, after that only numbers past their deadband
+static void test_deadband_suppresses_small_changes(void) {
+	setUpCache();
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("temperature") && isSent("counter") && isSent("mode"));
+	answer(true);
+	TEST_ASSERT(!update());
+
+	temperature = 21.4;
+	TEST_ASSERT(!update());
+	temperature = 21.5;
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("temperature") && !isSent("counter") && !isSent("mode"));
+	answer(true);
+
+	// the deadband is measured from the value accepted, not from the one read last
+	temperature = 21.1;
+	TEST_ASSERT(!update());
+	temperature = 20.9;
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("temperature"));
+	answer(true);
+}
+
+// a field reported again within its minimum interval waits for the interval to run out
+static void test_min_interval_suppresses_reports(void) {
+	setUpCache();
+	TEST_ASSERT(update());
+	answer(true);
+
+	counter = 2;
+	TEST_ASSERT(!update());
+	usleep(250 * 1000);
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("counter") && !isSent("temperature"));
+	answer(true);
+	counter = 3;
+	TEST_ASSERT(!update());
+}
+
+// fields of a rejected update are sent again by the next one, even within their interval
+static void test_rejected_fields_resent(void) {
+	setUpCache();
+	TEST_ASSERT(update());
+	answer(true);
+
+	usleep(250 * 1000);
+	counter = 2;
+	temperature = 30.0;
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("counter") && isSent("temperature") && !isSent("mode"));
+	answer(false);
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("counter") && isSent("temperature") && !isSent("mode"));
+	answer(true);
+	TEST_ASSERT(!update());
+}
+
+// strings are compared by their text, or by length and hash past the copy the cache keeps
+static void test_string_changes_detected(void) {
+	setUpCache();
+	TEST_ASSERT(update());
+	answer(true);
+
+	strcpy(mode, "auto");
+	TEST_ASSERT(!update());
+	strcpy(mode, "autp");
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("mode") && strstr(fakeMqttLastPublish.payload, "\"autp\"") != NULL);
+	answer(true);
+
+	strcpy(mode, COLLIDING_TEXT);
+	TEST_ASSERT(update());
+	answer(true);
+	strcpy(mode, COLLIDING_TEXT_2);
+	TEST_ASSERT(update());
+	TEST_ASSERT(strstr(fakeMqttLastPublish.payload, "\"" COLLIDING_TEXT_2 "\"") != NULL);
+	answer(true);
+
+	TEST_ASSERT(strlen(LONG_TEXT) > SHADOW_REPORTED_TEXT_LEN);
+	strcpy(mode, LONG_TEXT);
+	TEST_ASSERT(update());
+	answer(true);
+	TEST_ASSERT(!update());
+	mode[strlen(mode) - 1] = 'T';
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("mode"));
+	answer(true);
+	mode[strlen(mode) - 1] = '\0';
+	TEST_ASSERT(update());
+	answer(true);
+}
+
+// after a conflict the shadow already holds what the update sent, the update is done
+static void test_conflict_merged(void) {
+	startVersionedUpdate();
+	answerConflict();
+	TEST_ASSERT(ackCalls == 1);
+	TEST_ASSERT(cache.state == SHADOW_REPORTED_CONFLICT);
+
+	TEST_ASSERT(update());
+	TEST_ASSERT(strcmp(fakeMqttLastPublish.topic, THING_TOPIC(AWS_IOT_MY_THING_NAME, "get")) == 0);
+	respond(THING_TOPIC(AWS_IOT_MY_THING_NAME, "get/accepted"),
+			"\"state\":{\"reported\":{\"temperature\":30,\"counter\":1,\"mode\":\"auto\"}},\"version\":5");
+	TEST_ASSERT(ackCalls == 2 && ackStatus == SHADOW_ACK_ACCEPTED);
+	TEST_ASSERT(cache.state == SHADOW_REPORTED_IDLE);
+	TEST_ASSERT(cache.conflictRetries == 0);
+	TEST_ASSERT(cache.version == 5);
+	TEST_ASSERT(!update());
+}
+
+// after a conflict the fields the shadow holds another value of are sent again with its version
+static void test_conflict_resent(void) {
+	startVersionedUpdate();
+	answerConflict();
+	TEST_ASSERT(update());
+	respond(THING_TOPIC(AWS_IOT_MY_THING_NAME, "get/accepted"),
+			"\"state\":{\"reported\":{\"temperature\":25,\"counter\":1,\"mode\":\"auto\"}},\"version\":5");
+	TEST_ASSERT(ackCalls == 1);
+	TEST_ASSERT(cache.state == SHADOW_REPORTED_IDLE);
+
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("temperature") && !isSent("counter") && !isSent("mode"));
+	TEST_ASSERT(strstr(fakeMqttLastPublish.payload, "\"version\":5") != NULL);
+	answer(true);
+	TEST_ASSERT(cache.conflictRetries == 0);
+	TEST_ASSERT(!update());
+}
+
+// conflicts past SHADOW_MAX_VERSION_CONFLICT_RETRIES give the update up as rejected
+static void test_conflict_given_up(void) {
+	int i;
+
+	startVersionedUpdate();
+	for (i = 0; i < SHADOW_MAX_VERSION_CONFLICT_RETRIES; i++) {
+		answerConflict();
+		TEST_ASSERT(cache.state == SHADOW_REPORTED_CONFLICT);
+		TEST_ASSERT(update());
+		respond(THING_TOPIC(AWS_IOT_MY_THING_NAME, "get/accepted"),
+				"\"state\":{\"reported\":{\"temperature\":25}},\"version\":5");
+		TEST_ASSERT(update());
+		TEST_ASSERT(isSent("temperature"));
+	}
+	TEST_ASSERT(ackCalls == 1);
+	answerConflict();
+	TEST_ASSERT(ackCalls == 2 && ackStatus == SHADOW_ACK_REJECTED);
+	TEST_ASSERT(cache.state == SHADOW_REPORTED_IDLE);
+	TEST_ASSERT(cache.conflictRetries == 0);
+
+	// given up, the field is sent again by the next update
+	TEST_ASSERT(update());
+	TEST_ASSERT(isSent("temperature"));
+}
+
+int main(void) {
+	RUN_TEST(test_deadband_suppresses_small_changes);
+	RUN_TEST(test_min_interval_suppresses_reports);
+	RUN_TEST(test_rejected_fields_resent);
+	RUN_TEST(test_string_changes_detected);
+	RUN_TEST(test_conflict_merged);
+	RUN_TEST(test_conflict_resent);
+	RUN_TEST(test_conflict_given_up);
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * A shadow state described by a schema: its struct written to a document by the
+ * writer of each key, and updated by the deltas through the parser of each key.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_schema.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+// one key of every kind, in strcmp() order
+#define DEVICE_SCHEMA(X, type) \
+	X(type, UINT8, level, "level") \
+	X(type, INT8, offset, "offset") \
+	X(type, BOOL, isOn, "on") \
+	X(type, DOUBLE, ratio, "ratio") \
+	X(type, UINT16, speed, "speed") \
+	X(type, INT32, target, "target") \
+	X(type, FLOAT, temperature, "temperature") \
+	X(type, INT16, trim, "trim") \
+	X(type, UINT32, uptime, "uptime")
+
+#define UNSORTED_SCHEMA(X, type) \
+	X(type, INT32, speed, "speed") \
+	X(type, INT32, level, "level")
+
+#define DUPLICATE_SCHEMA(X, type) \
+	X(type, INT32, level, "level") \
+	X(type, INT32, speed, "level")
+
+#define DELTA_TOPIC "$aws/things/" AWS_IOT_MY_THING_NAME "/shadow/update/delta"
+
+SHADOW_SCHEMA_STRUCT(DeviceState_t, DEVICE_SCHEMA);
+SHADOW_SCHEMA_DEFINE(deviceSchema, DeviceState_t, DEVICE_SCHEMA);
+SHADOW_SCHEMA_STRUCT(PairState_t, UNSORTED_SCHEMA);
+SHADOW_SCHEMA_DEFINE(unsortedSchema, PairState_t, UNSORTED_SCHEMA);
+SHADOW_SCHEMA_DEFINE(duplicateSchema, PairState_t, DUPLICATE_SCHEMA);
+
+#define SAMPLE_REPORTED "\"level\":200,\"offset\":-8,\"on\":true,\"ratio\":0.250000,\"speed\":1200," \
+	"\"target\":-70000,\"temperature\":21.500000,\"trim\":-300,\"uptime\":4000000000"
+
+static const DeviceState_t sampleState = {200, -8, true, 0.25, 1200, -70000, 21.5f, -300, 4000000000u};
+
+static char document[512];
+static MQTTClient_t mqttClient;
+static DeviceState_t deltaState;
+static int deltaCalls;
+static uint32_t deltaFields;
+
+static void deltaCallback(void *pState, uint32_t changedFields, void *pContextData) {
+	TEST_ASSERT(pState == &deltaState && pContextData == &deltaCalls);
+	deltaCalls++;
+	deltaFields = changedFields;
+}
+
+static bool isSameState(const DeviceState_t *pState, const DeviceState_t *pOther) {
+	return pState->level == pOther->level && pState->offset == pOther->offset && pState->isOn == pOther->isOn
+			&& pState->ratio == pOther->ratio && pState->speed == pOther->speed && pState->target == pOther->target
+			&& pState->temperature == pOther->temperature && pState->trim == pOther->trim
+			&& pState->uptime == pOther->uptime;
+}
+
+static void registerSchema(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_connect(&mqttClient, &parameters) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta_schema(&mqttClient, &deviceSchema, &deltaState, deltaCallback,
+			&deltaCalls) == NONE_ERROR);
+	deltaState = sampleState;
+	deltaCalls = 0;
+	deltaFields = 0;
+}
+
+// the reported state of document, up to the client token
+static bool isReported(const char *pMembers) {
+	char expected[sizeof(document)];
+
+	snprintf(expected, sizeof(expected), "{\"state\":{\"reported\":{%s}},\"clientToken\":", pMembers);
+	return strncmp(document, expected, strlen(expected)) == 0;
+}
+
+static IoT_Error_t writeState(const DeviceState_t *pState, uint32_t fields) {
+	ShadowJsonBuilder_t builder;
+
+	aws_iot_shadow_builder_init(&builder, document, sizeof(document));
+	aws_iot_shadow_builder_begin_object(&builder, "state");
+	aws_iot_shadow_builder_begin_object(&builder, "reported");
+	aws_iot_shadow_schema_add(&builder, &deviceSchema, pState, fields);
+	return aws_iot_shadow_builder_finalize(&builder);
+}
+
+// the writer of each key writes what aws_iot_shadow_builder_add_value() writes for its type
+static void test_add_writes_every_kind(void) {
+	char byType[sizeof(document)];
+	ShadowJsonBuilder_t builder;
+	uint8_t i;
+
+	TEST_ASSERT(writeState(&sampleState, SHADOW_SCHEMA_ALL_FIELDS) == NONE_ERROR);
+	TEST_ASSERT(isReported(SAMPLE_REPORTED));
+
+	aws_iot_shadow_builder_init(&builder, byType, sizeof(byType));
+	aws_iot_shadow_builder_begin_object(&builder, "state");
+	aws_iot_shadow_builder_begin_object(&builder, "reported");
+	for (i = 0; i < deviceSchema.count; i++) {
+		aws_iot_shadow_builder_add_value(&builder, deviceSchema.pFields[i].pKey, deviceSchema.pFields[i].type,
+				(const uint8_t *)&sampleState + deviceSchema.pFields[i].offset);
+	}
+	TEST_ASSERT(aws_iot_shadow_builder_finalize(&builder) == NONE_ERROR);
+	TEST_ASSERT(strncmp(document, byType, strstr(byType, "}}") + 2 - byType) == 0);
+}
+
+// only the keys whose bit is set are written
+static void test_add_writes_fields_selected(void) {
+	TEST_ASSERT(writeState(&sampleState, (1u << 0) | (1u << 5) | (1u << 8)) == NONE_ERROR);
+	TEST_ASSERT(isReported("\"level\":200,\"target\":-70000,\"uptime\":4000000000"));
+	TEST_ASSERT(writeState(&sampleState, 0) == NONE_ERROR);
+	TEST_ASSERT(isReported(""));
+}
+
+// a document too small for the state is reported as truncated
+static void test_add_truncated(void) {
+	ShadowJsonBuilder_t builder;
+
+	aws_iot_shadow_builder_init(&builder, document, 40);
+	aws_iot_shadow_builder_begin_object(&builder, "state");
+	TEST_ASSERT(aws_iot_shadow_schema_add(&builder, &deviceSchema, &sampleState, SHADOW_SCHEMA_ALL_FIELDS)
+			== SHADOW_JSON_BUFFER_TRUNCATED);
+}
+
+// a schema whose keys are not in strcmp() order, or not unique, could not be searched
+static void test_unsorted_schema_refused(void) {
+	PairState_t state;
+
+	TEST_ASSERT(aws_iot_shadow_schema_check(&deviceSchema) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_schema_check(&unsortedSchema) == GENERIC_ERROR);
+	TEST_ASSERT(aws_iot_shadow_schema_check(&duplicateSchema) == GENERIC_ERROR);
+	TEST_ASSERT(aws_iot_shadow_schema_check(NULL) == NULL_VALUE_ERROR);
+
+	registerSchema();
+	TEST_ASSERT(aws_iot_shadow_register_delta_schema(&mqttClient, &unsortedSchema, &state, NULL, NULL)
+			== GENERIC_ERROR);
+	// the schema registered before stays in use
+	fake_mqtt_client_deliver(DELTA_TOPIC, "{\"version\":1,\"state\":{\"speed\":7}}",
+			strlen("{\"version\":1,\"state\":{\"speed\":7}}"), 0);
+	TEST_ASSERT(deltaCalls == 1 && deltaState.speed == 7);
+}
+
+// the values of a delta go to their members, the bits of the callback name the keys that came
+static void test_delta_updates_struct(void) {
+	static const char delta[] = "{\"version\":2,\"timestamp\":1,\"state\":{\"trim\":12,\"on\":false,"
+			"\"other\":{\"speed\":5},\"speed\":900,\"ratio\":0.5,\"uptime\":7}}";
+	static const size_t chunkSizes[] = {0, 1, 7, 64};
+	DeviceState_t expected = sampleState;
+	size_t i;
+
+	expected.trim = 12;
+	expected.isOn = false;
+	expected.speed = 900;
+	expected.ratio = 0.5;
+	expected.uptime = 7;
+	// whole or streamed in chunks, the delta does the same
+	for (i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); i++) {
+		registerSchema();
+		fake_mqtt_client_deliver(DELTA_TOPIC, delta, strlen(delta), chunkSizes[i]);
+		TEST_ASSERT(deltaCalls == 1);
+		TEST_ASSERT(deltaFields == ((1u << 7) | (1u << 2) | (1u << 4) | (1u << 3) | (1u << 8)));
+		TEST_ASSERT(isSameState(&deltaState, &expected));
+	}
+}
+
+// keys out of the schema, nested keys and values of the wrong type change nothing
+static void test_delta_without_schema_keys(void) {
+	static const char delta[] = "{\"version\":3,\"state\":{\"other\":1,\"nested\":{\"level\":5},"
+			"\"level\":\"high\"}}";
+
+	registerSchema();
+	fake_mqtt_client_deliver(DELTA_TOPIC, delta, strlen(delta), 0);
+	TEST_ASSERT(deltaCalls == 0);
+	TEST_ASSERT(isSameState(&deltaState, &sampleState));
+}
+
+int main(void) {
+	RUN_TEST(test_add_writes_every_kind);
+	RUN_TEST(test_add_writes_fields_selected);
+	RUN_TEST(test_add_truncated);
+	RUN_TEST(test_unsorted_schema_refused);
+	RUN_TEST(test_delta_updates_struct);
+	RUN_TEST(test_delta_without_schema_keys);
+	return 0;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * The shadow snapshot kept in a file across restarts of the device: read back by
+ * aws_iot_shadow_init(), applied to the keys before the device is connected, and
+ * brought up to the desired state by a get once it is. The snapshot is saved by the
+ * yield, no more often than AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aws_iot_config.h"
+#include "aws_iot_file_store.h"
+#include "aws_iot_shadow_interface.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define SHADOW_TOPIC "$aws/things/" AWS_IOT_MY_THING_NAME "/shadow/"
+
+static MQTTClient_t mqttClient;
+static char snapshotPath[] = "/tmp/test_shadow_snapshot.XXXXXX";
+static ShadowSnapshotStore_t snapshotStore;	// the store of the shadow, it stays in use
+static int32_t rate;
+static bool isOn;
+static int calls;
+static jsonStruct_t rateKey;
+static jsonStruct_t onKey;
+
+static void valueCallback(const char *pJsonValueBuffer, uint32_t valueLength, jsonStruct_t *pJsonStruct_t) {
+	calls++;
+}
+
+// the device starts over, with nothing but what the file keeps
+static void restart(void) {
+	aws_iot_shadow_set_snapshot_store(NULL);
+	if (snapshotStore.load != NULL) {
+		aws_iot_shadow_snapshot_file_close(&snapshotStore);
+	}
+	TEST_ASSERT(aws_iot_shadow_snapshot_file_init(&snapshotStore, snapshotPath) == NONE_ERROR);
+	aws_iot_shadow_set_snapshot_store(&snapshotStore);
+
+	rate = 0;
+	isOn = false;
+	calls = 0;
+	rateKey = (jsonStruct_t){"rate", &rate, SHADOW_JSON_INT32, valueCallback};
+	onKey = (jsonStruct_t){"light.on", &isOn, SHADOW_JSON_BOOL, valueCallback};
+	fake_mqtt_client_init(&mqttClient);
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+}
+
+static void connectShadow(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+
+	TEST_ASSERT(aws_iot_shadow_connect(&mqttClient, &parameters) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &rateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_register_delta(&mqttClient, &onKey) == NONE_ERROR);
+}
+
+static void deliver(const char *pAction, const char *pDocument) {
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+
+	snprintf(topic, sizeof(topic), SHADOW_TOPIC "%s", pAction);
+	fake_mqtt_client_deliver(topic, pDocument, strlen(pDocument), 0);
+}
+
+// the version of the snapshot in the file, 0 if it holds none
+static uint32_t savedVersion(void) {
+	ShadowSnapshot_t loaded;
+
+	TEST_ASSERT(snapshotStore.load(&snapshotStore, &loaded) == NONE_ERROR);
+	return (loaded.length == 0) ? 0 : loaded.version;
+}
+
+// the file is laid out as the flash sector, a snapshot whose magic was not written is not read
+static void test_file_layout(void) {
+	ShadowSnapshot_t snapshot;
+	ShadowSnapshot_t loaded;
+	uint32_t magic = 0;
+	int fd;
+
+	TEST_ASSERT(aws_iot_shadow_snapshot_file_init(&snapshotStore, snapshotPath) == NONE_ERROR);
+	loaded.length = 1;
+	TEST_ASSERT(snapshotStore.load(&snapshotStore, &loaded) == NONE_ERROR);
+	TEST_ASSERT(loaded.length == 0);
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.version = 3;
+	memcpy(snapshot.values, "rate\0\x01" "5", 8);
+	snapshot.length = 8;
+	TEST_ASSERT(snapshotStore.save(&snapshotStore, &snapshot) == NONE_ERROR);
+	TEST_ASSERT(snapshotStore.load(&snapshotStore, &loaded) == NONE_ERROR);
+	TEST_ASSERT(loaded.version == 3 && loaded.length == 8 && memcmp(loaded.values, snapshot.values, 8) == 0);
+
+	fd = open(snapshotPath, O_RDWR);
+	TEST_ASSERT(fd >= 0);
+	TEST_ASSERT(pread(fd, &magic, sizeof(magic), 0) == sizeof(magic));
+	TEST_ASSERT(magic == 0x53484431);
+	magic = 0;
+	TEST_ASSERT(pwrite(fd, &magic, sizeof(magic), 0) == sizeof(magic));
+	close(fd);
+	TEST_ASSERT(snapshotStore.load(&snapshotStore, &loaded) == NONE_ERROR);
+	TEST_ASSERT(loaded.length == 0);
+	aws_iot_shadow_snapshot_file_close(&snapshotStore);
+	snapshotStore.load = NULL;
+}
+
+// what the deltas brought is back after a restart, before any connection
+static void test_applied_before_connect(void) {
+	int32_t other = 0;
+	jsonStruct_t otherKey = {"other", &other, SHADOW_JSON_INT32, valueCallback};
+
+	restart();
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&rateKey) == GENERIC_ERROR);
+	connectShadow();
+	deliver("update/delta", "{\"version\":7,\"timestamp\":1,\"state\":{\"rate\":12,\"light\":{\"on\":true}}}");
+	TEST_ASSERT(calls == 2 && rate == 12 && isOn);
+	TEST_ASSERT(savedVersion() == 0);
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+	TEST_ASSERT(savedVersion() == 7);
+
+	restart();
+	TEST_ASSERT(aws_iot_shadow_get_last_received_version() == 7);
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&rateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&onKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&otherKey) == GENERIC_ERROR);
+	TEST_ASSERT(calls == 2 && rate == 12 && isOn && other == 0);
+
+	// a delta no newer than the snapshot is old news
+	connectShadow();
+	deliver("update/delta", "{\"version\":7,\"timestamp\":1,\"state\":{\"rate\":30}}");
+	TEST_ASSERT(calls == 2 && rate == 12);
+	deliver("update/delta", "{\"version\":8,\"timestamp\":1,\"state\":{\"rate\":13}}");
+	TEST_ASSERT(calls == 3 && rate == 13);
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+	TEST_ASSERT(savedVersion() == 8);
+}
+
+// deltas in a row within the interval are saved once, by the first yield after it
+static void test_saved_once_per_interval(void) {
+	restart();
+	connectShadow();
+	deliver("update/delta", "{\"version\":9,\"timestamp\":1,\"state\":{\"rate\":14}}");
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+	TEST_ASSERT(savedVersion() == 9);
+
+	deliver("update/delta", "{\"version\":10,\"timestamp\":1,\"state\":{\"rate\":15}}");
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+	deliver("update/delta", "{\"version\":11,\"timestamp\":1,\"state\":{\"rate\":13}}");
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+	TEST_ASSERT(savedVersion() == 9);
+
+	usleep((AWS_IOT_SHADOW_SNAPSHOT_SAVE_INTERVAL_MS + 50) * 1000);
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+	TEST_ASSERT(savedVersion() == 11);
+}
+
+static Shadow_Ack_Status_t getStatus;
+
+static void getCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	getStatus = status;
+}
+
+// a get once connected brings the device to the desired state it missed, and the snapshot with it
+static void test_reconciled_by_get(void) {
+	char document[256];
+	const char *pToken;
+
+	restart();
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&rateKey) == NONE_ERROR);
+	TEST_ASSERT(rate == 13);
+	connectShadow();
+
+	getStatus = SHADOW_ACK_TIMEOUT;
+	TEST_ASSERT(aws_iot_shadow_get(&mqttClient, AWS_IOT_MY_THING_NAME, getCallback, NULL, 5, false) == NONE_ERROR);
+	pToken = strstr(fakeMqttLastPublish.payload, "\"clientToken\":\"");
+	TEST_ASSERT(pToken != NULL);
+	pToken += strlen("\"clientToken\":\"");
+	snprintf(document, sizeof(document), "{\"state\":{\"desired\":{\"rate\":20,\"light\":{\"on\":false}},"
+			"\"reported\":{\"rate\":13}},\"version\":12,\"clientToken\":\"%.*s\"}",
+			(int)(strchr(pToken, '"') - pToken), pToken);
+	deliver("get/accepted", document);
+	TEST_ASSERT(getStatus == SHADOW_ACK_ACCEPTED);
+	TEST_ASSERT(rate == 20 && !isOn);
+	TEST_ASSERT(aws_iot_shadow_get_last_received_version() == 12);
+	TEST_ASSERT(aws_iot_shadow_yield(&mqttClient, 0) == NONE_ERROR);
+
+	restart();
+	TEST_ASSERT(aws_iot_shadow_get_last_received_version() == 12);
+	isOn = true;
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&rateKey) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_snapshot_apply(&onKey) == NONE_ERROR);
+	TEST_ASSERT(rate == 20 && !isOn);
+}
+
+int main(void) {
+	int fd = mkstemp(snapshotPath);
+
+	TEST_ASSERT(fd >= 0);
+	close(fd);
+	RUN_TEST(test_file_layout);
+	RUN_TEST(test_applied_before_connect);
+	RUN_TEST(test_saved_once_per_interval);
+	RUN_TEST(test_reconciled_by_get);
+	aws_iot_shadow_set_snapshot_store(NULL);
+	aws_iot_shadow_snapshot_file_close(&snapshotStore);
+	unlink(snapshotPath);
+	return 0;
+}
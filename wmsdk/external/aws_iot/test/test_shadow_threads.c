@@ -0,0 +1,236 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/*
+ * Shadow actions started from several threads at once, with their responses delivered
+ * by another, as the MQTT I/O task does, and their timeouts handled by a third that
+ * yields, as the demo application does.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "aws_iot_config.h"
+#include "aws_iot_shadow_interface.h"
+#include "aws_iot_shadow_records.h"
+#include "fake_mqtt_client.h"
+#include "unit_test.h"
+
+#define APP_THREADS 4
+#define UPDATES_PER_THREAD 200
+#define WAITING_PER_THREAD 2	// all the threads together stay within MAX_ACKS_TO_COMEIN_AT_ANY_GIVEN_TIME
+#define DROP_EVERY 32			// one response in DROP_EVERY never comes, the action times out
+#define BROKER_QUEUE_LEN 64
+
+typedef struct {
+	char topic[FAKE_MQTT_MAX_TOPIC_LEN];
+	char token[64];
+} PendingResponse_t;
+
+typedef struct {
+	int number;
+	int waiting;
+} AppThread_t;
+
+static MQTTClient_t mqttClient;
+static pthread_mutex_t testLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t testChanged = PTHREAD_COND_INITIALIZER;
+
+static PendingResponse_t brokerQueue[BROKER_QUEUE_LEN];
+static int brokerHead;
+static int brokerCount;
+static int published;
+static int dropped;
+static int lost;
+static int accepted;
+static int timedOut;
+static int otherStatus;
+static bool isStopping;
+
+// the broker answers every update, it is published from the thread of the action
+static void publishHook(const char *pTopic, const char *pPayload, size_t length) {
+	const char *pToken = strstr(pPayload, "\"clientToken\":\"");
+	PendingResponse_t *pResponse;
+	const char *pEnd;
+
+	TEST_ASSERT(pToken != NULL);
+	pToken += strlen("\"clientToken\":\"");
+	pEnd = strchr(pToken, '"');
+	TEST_ASSERT(pEnd != NULL && pEnd - pToken < 64);
+
+	pthread_mutex_lock(&testLock);
+	while (brokerCount == BROKER_QUEUE_LEN) {
+		pthread_cond_wait(&testChanged, &testLock);
+	}
+	pResponse = &brokerQueue[(brokerHead + brokerCount) % BROKER_QUEUE_LEN];
+	snprintf(pResponse->topic, sizeof(pResponse->topic), "%s/accepted", pTopic);
+	memcpy(pResponse->token, pToken, pEnd - pToken);
+	pResponse->token[pEnd - pToken] = '\0';
+	brokerCount++;
+	published++;
+	pthread_cond_broadcast(&testChanged);
+	pthread_mutex_unlock(&testLock);
+}
+
+static void *brokerThread(void *pArg) {
+	PendingResponse_t response;
+	char document[128];
+	int n = 0;
+
+	while (1) {
+		pthread_mutex_lock(&testLock);
+		while (brokerCount == 0 && !isStopping) {
+			pthread_cond_wait(&testChanged, &testLock);
+		}
+		if (brokerCount == 0) {
+			pthread_mutex_unlock(&testLock);
+			return NULL;
+		}
+		response = brokerQueue[brokerHead];
+		brokerHead = (brokerHead + 1) % BROKER_QUEUE_LEN;
+		brokerCount--;
+		pthread_cond_broadcast(&testChanged);
+		pthread_mutex_unlock(&testLock);
+
+		if (++n % DROP_EVERY == 0) {
+			pthread_mutex_lock(&testLock);
+			dropped++;
+			pthread_mutex_unlock(&testLock);
+			continue;
+		}
+		snprintf(document, sizeof(document), "{\"state\":{},\"version\":%d,\"clientToken\":\"%s\"}", n,
+				response.token);
+		// an update on a Thing may be answered just as another thread has given the topic up and not yet
+		// taken it again, the response is lost then and its action times out
+		if (fake_mqtt_client_deliver(response.topic, document, strlen(document), 0) != NONE_ERROR) {
+			pthread_mutex_lock(&testLock);
+			lost++;
+			pthread_mutex_unlock(&testLock);
+		}
+	}
+}
+
+static void *yieldThread(void *pArg) {
+	bool isDone = false;
+
+	while (!isDone) {
+		aws_iot_shadow_yield(&mqttClient, 10);
+		usleep(1000);
+		pthread_mutex_lock(&testLock);
+		isDone = isStopping;
+		pthread_mutex_unlock(&testLock);
+	}
+	return NULL;
+}
+
+static void ackCallback(const char *pThingName, ShadowActions_t action, Shadow_Ack_Status_t status,
+		const char *pReceivedJsonDocument, void *pContextData) {
+	AppThread_t *pApp = (AppThread_t *)pContextData;
+
+	pthread_mutex_lock(&testLock);
+	if (status == SHADOW_ACK_ACCEPTED) {
+		accepted++;
+	} else if (status == SHADOW_ACK_TIMEOUT) {
+		timedOut++;
+	} else {
+		otherStatus++;
+	}
+	pApp->waiting--;
+	pthread_cond_broadcast(&testChanged);
+	pthread_mutex_unlock(&testLock);
+}
+
+// half of the updates are for a Thing of the thread, half for one they all share
+static void *appThread(void *pArg) {
+	AppThread_t *pApp = (AppThread_t *)pArg;
+	char thingName[16];
+	char document[128];
+	int i;
+
+	for (i = 0; i < UPDATES_PER_THREAD; i++) {
+		if (i % 2 == 0) {
+			snprintf(thingName, sizeof(thingName), "thing%d", pApp->number);
+		} else {
+			snprintf(thingName, sizeof(thingName), "shared");
+		}
+		pthread_mutex_lock(&testLock);
+		while (pApp->waiting == WAITING_PER_THREAD) {
+			pthread_cond_wait(&testChanged, &testLock);
+		}
+		pApp->waiting++;
+		pthread_mutex_unlock(&testLock);
+
+		TEST_ASSERT(aws_iot_shadow_init_json_document(document, sizeof(document)) == NONE_ERROR);
+		TEST_ASSERT(aws_iot_finalize_json_document(document, sizeof(document)) == NONE_ERROR);
+		TEST_ASSERT(aws_iot_shadow_update(&mqttClient, thingName, document, ackCallback, pApp, 1, false)
+				== NONE_ERROR);
+	}
+	return NULL;
+}
+
+static void test_actions_from_several_threads(void) {
+	ShadowParameters_t parameters = ShadowParametersDefault;
+	AppThread_t apps[APP_THREADS];
+	pthread_t appThreads[APP_THREADS];
+	pthread_t broker;
+	pthread_t yielder;
+	int i;
+
+	fake_mqtt_client_init(&mqttClient);
+	fakeMqttPublishHook = publishHook;
+	TEST_ASSERT(aws_iot_shadow_init(&mqttClient) == NONE_ERROR);
+	TEST_ASSERT(aws_iot_shadow_connect(&mqttClient, &parameters) == NONE_ERROR);
+
+	TEST_ASSERT(pthread_create(&broker, NULL, brokerThread, NULL) == 0);
+	TEST_ASSERT(pthread_create(&yielder, NULL, yieldThread, NULL) == 0);
+	for (i = 0; i < APP_THREADS; i++) {
+		apps[i].number = i;
+		apps[i].waiting = 0;
+		TEST_ASSERT(pthread_create(&appThreads[i], NULL, appThread, &apps[i]) == 0);
+	}
+	for (i = 0; i < APP_THREADS; i++) {
+		pthread_join(appThreads[i], NULL);
+	}
+
+	// every action is answered or times out, exactly once
+	pthread_mutex_lock(&testLock);
+	while (accepted + timedOut + otherStatus < APP_THREADS * UPDATES_PER_THREAD) {
+		pthread_cond_wait(&testChanged, &testLock);
+	}
+	isStopping = true;
+	pthread_cond_broadcast(&testChanged);
+	pthread_mutex_unlock(&testLock);
+	pthread_join(broker, NULL);
+	pthread_join(yielder, NULL);
+
+	TEST_ASSERT(published == APP_THREADS * UPDATES_PER_THREAD);
+	TEST_ASSERT(otherStatus == 0);
+	TEST_ASSERT(timedOut == dropped + lost);
+	TEST_ASSERT(accepted == published - dropped - lost);
+	for (i = 0; i < APP_THREADS; i++) {
+		TEST_ASSERT(apps[i].waiting == 0);
+	}
+
+	// nothing waits anymore, and the subscriptions of the actions are all gone
+	TEST_ASSERT(defaultShadowContext.ackWaitCount == 0);
+	TEST_ASSERT(fakeMqttSubscriptionCount == 0);
+}
+
+int main(void) {
+	alarm(120);
+	RUN_TEST(test_actions_from_several_threads);
+	return 0;
+}
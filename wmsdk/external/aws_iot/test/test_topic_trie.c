@@ -0,0 +1,163 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "MQTTClient.h"
+#include "MQTTTopicTrie.h"
+#include "unit_test.h"
+
+char isTopicMatched(char* topicFilter, MQTTString* topicName);
+
+static const char *levels[] = {"a", "b", "$aws", "things", ""};
+#define LEVEL_COUNT (sizeof(levels) / sizeof(levels[0]))
+
+static TopicTrie trie;
+static int hits[TOPIC_TRIE_MAX_ENTRIES];
+
+static void countHit(int entry, void *context) {
+	(void)context;
+	hits[entry]++;
+}
+
+static int freeNodeCount(void) {
+	int count = 0;
+	short node;
+
+	for (node = trie.freeNodes; node != TOPIC_TRIE_NONE; node = trie.nodes[node].sibling) {
+		count++;
+	}
+	return count;
+}
+
+// a random topic name, or a filter when wildcards is set, of 1 to 4 levels
+static void randomTopic(char *pTopic, int wildcards) {
+	int count = 1 + rand() % 4;
+	int i;
+
+	pTopic[0] = '\0';
+	for (i = 0; i < count; i++) {
+		const char *pLevel = levels[rand() % LEVEL_COUNT];
+
+		if (wildcards && rand() % 4 == 0) {
+			pLevel = (i == count - 1 && rand() % 2) ? "#" : "+";
+		}
+		if (i > 0) {
+			strcat(pTopic, "/");
+		}
+		strcat(pTopic, pLevel);
+	}
+}
+
+// every filter the linear matcher of the client accepts is visited by the trie
+static void checkMatches(char filters[][64], int filterCount, const char *pName) {
+	MQTTString name = MQTTString_initializer;
+	int i;
+
+	name.lenstring.data = (char *)pName;
+	name.lenstring.len = strlen(pName);
+	memset(hits, 0, sizeof(hits));
+	TopicTrie_match(&trie, &name, countHit, NULL);
+	for (i = 0; i < filterCount; i++) {
+		if (MQTTPacket_equals(&name, filters[i]) || isTopicMatched(filters[i], &name)) {
+			if (hits[i] == 0) {
+				fprintf(stderr, "filter %s missed for %s\n", filters[i], pName);
+			}
+			TEST_ASSERT(hits[i] > 0);
+		}
+	}
+}
+
+static void test_shadow_filters(void) {
+	char filters[][64] = {
+		"$aws/things/x/shadow/update/accepted", "$aws/things/+/shadow/+/accepted", "$aws/things/x/shadow/update/delta",
+		"$aws/things/+/shadow/update/delta", "#"
+	};
+	const char *names[] = {
+		"$aws/things/x/shadow/update/accepted", "$aws/things/y/shadow/get/accepted", "$aws/things/x/shadow/update/delta",
+		"$aws/things/x/shadow/update/rejected", "$aws/things/x", "other"
+	};
+	size_t i;
+
+	TopicTrie_init(&trie);
+	for (i = 0; i < TOPIC_TRIE_MAX_ENTRIES; i++) {
+		TEST_ASSERT(TopicTrie_add(&trie, filters[i], i) == 0);
+	}
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		checkMatches(filters, TOPIC_TRIE_MAX_ENTRIES, names[i]);
+	}
+}
+
+// random filters and names against the linear matcher, filters added and removed in turn
+static void test_random_against_linear_matcher(void) {
+	char filters[TOPIC_TRIE_MAX_ENTRIES][64];
+	char name[64];
+	int round;
+	int i;
+
+	srand(3);
+	TopicTrie_init(&trie);
+	for (i = 0; i < TOPIC_TRIE_MAX_ENTRIES; i++) {
+		randomTopic(filters[i], 1);
+		TEST_ASSERT(TopicTrie_add(&trie, filters[i], i) == 0);
+	}
+	for (round = 0; round < 20000; round++) {
+		i = rand() % TOPIC_TRIE_MAX_ENTRIES;
+		TopicTrie_remove(&trie, i);
+		randomTopic(filters[i], 1);
+		TEST_ASSERT(TopicTrie_add(&trie, filters[i], i) == 0);
+
+		randomTopic(name, 0);
+		checkMatches(filters, TOPIC_TRIE_MAX_ENTRIES, name);
+	}
+
+	for (i = 0; i < TOPIC_TRIE_MAX_ENTRIES; i++) {
+		TopicTrie_remove(&trie, i);
+	}
+	TEST_ASSERT(trie.root == TOPIC_TRIE_NONE);
+	TEST_ASSERT(freeNodeCount() == TOPIC_TRIE_MAX_NODES);
+}
+
+// out of nodes, a filter is refused and takes none of them
+static void test_nodes_exhausted(void) {
+	char filter[64];
+	int added = 0;
+	int freeBefore;
+	int i;
+
+	TopicTrie_init(&trie);
+	for (i = 0; i < TOPIC_TRIE_MAX_ENTRIES; i++) {
+		freeBefore = freeNodeCount();
+		snprintf(filter, sizeof(filter), "p%d/q/r/s/t/u/v/w", i);
+		if (TopicTrie_add(&trie, filter, i) == 0) {
+			added++;
+		} else {
+			TEST_ASSERT(freeNodeCount() == freeBefore);
+			TEST_ASSERT(trie.entryNode[i] == TOPIC_TRIE_NONE);
+		}
+	}
+	TEST_ASSERT(added == TOPIC_TRIE_MAX_NODES / 8);
+	for (i = 0; i < TOPIC_TRIE_MAX_ENTRIES; i++) {
+		TopicTrie_remove(&trie, i);
+	}
+	TEST_ASSERT(freeNodeCount() == TOPIC_TRIE_MAX_NODES);
+}
+
+int main(void) {
+	RUN_TEST(test_shadow_filters);
+	RUN_TEST(test_random_against_linear_matcher);
+	RUN_TEST(test_nodes_exhausted);
+	return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright 2010-2015 Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+/**
+ * @file unit_test.h
+ * @brief Checks shared by the host tests.
+ *
+ * A test is a function, run by RUN_TEST() from the main() of its file. A failed
+ * check prints where it failed and ends the program with a non zero status.
+ */
+
+#ifndef __UNIT_TEST_H_
+#define __UNIT_TEST_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_ASSERT(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		exit(1); \
+	} \
+} while (0)
+
+#define RUN_TEST(test) do { \
+	printf("%s\n", #test); \
+	test(); \
+} while (0)
+
+#endif /* __UNIT_TEST_H_ */
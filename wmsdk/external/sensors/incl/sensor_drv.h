@@ -40,6 +40,8 @@ struct sensor_info {
 int sensor_event_register(struct sensor_info *sevnt);
 int sensor_drv_init(void);
 int sensor_msg_construct(char *src, char*dest, int len);
+/* Walk the registered sensor events, pass NULL to get the first one */
+struct sensor_info *sensor_event_next(struct sensor_info *sevent);
 void sensor_inputs_scan(void);
 
 #endif /* __SENSOR_DRV_H__ */
@@ -50,6 +50,11 @@ int sensor_msg_construct(char *src, char *dest, int len)
 	return ret;
 }
 
+struct sensor_info *sensor_event_next(struct sensor_info *sevent)
+{
+	return sevent ? sevent->next : sensor_ll;
+}
+
 void sensor_inputs_scan(void)
 {
 	struct sensor_info *curevent;
@@ -110,9 +115,9 @@ int sensor_event_register(struct sensor_info *sevnt)
 		}
 	}
 
-	/* Make both strings same */
-	sprintf(sevnt->event_prev_value, " ");
-	sprintf(sevnt->event_curr_value, " ");
+	/* Make both strings same, JSON null until the first read */
+	sprintf(sevnt->event_prev_value, "null");
+	sprintf(sevnt->event_curr_value, "null");
 	/* make sure registered event is last in link list */
 	sevnt->next = NULL;
 	/* Sensor initialization call */ 